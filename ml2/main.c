@@ -45,6 +45,8 @@ int main(int argc, char *argv[]) {
 
         switch (output_type) {
             case OUTPUT_VALUE: {
+                parsed_exp = fold_exp(parsed_exp);
+
                 Value *value = evaluate(parsed_exp);
                 if (value == NULL) {
                     printf("evaluation failed\n");
@@ -5,6 +5,45 @@
 
 #include "ml2_semantics.h"
 
+static Var **var_table = NULL;
+static size_t var_table_size = 0;
+static size_t var_table_count = 0;
+
+static size_t hash_var_name(const char *name, const size_t name_len) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < name_len; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool grow_var_table() {
+    size_t var_table_size_new = var_table_size == 0 ? 64 : var_table_size * 2;
+    Var **var_table_new = calloc(var_table_size_new, sizeof(Var *));
+    if (var_table_new == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < var_table_size; i++) {
+        Var *var = var_table[i];
+        if (var == NULL) {
+            continue;
+        }
+
+        size_t j = hash_var_name(var->name, var->name_len) & (var_table_size_new - 1);
+        while (var_table_new[j] != NULL) {
+            j = (j + 1) & (var_table_size_new - 1);
+        }
+        var_table_new[j] = var;
+    }
+
+    free(var_table);
+    var_table = var_table_new;
+    var_table_size = var_table_size_new;
+    return true;
+}
+
 Var *create_var(const char *src_name) {
     if (src_name == NULL) {
         return NULL;
@@ -15,21 +54,33 @@ Var *create_var(const char *src_name) {
         return NULL;
     }
 
+    if (var_table_size <= var_table_count * 2 && !grow_var_table()) {
+        return NULL;
+    }
+
+    size_t i = hash_var_name(src_name, name_len) & (var_table_size - 1);
+    while (var_table[i] != NULL) {
+        Var *var = var_table[i];
+        if (var->name_len == name_len && strncmp(var->name, src_name, name_len) == 0) {
+            return var;
+        }
+        i = (i + 1) & (var_table_size - 1);
+    }
+
     char *dst_name = malloc(name_len + 1);
-    snprintf(dst_name, VAR_NAME_LEN_MAX, "%s", src_name);
+    snprintf(dst_name, name_len + 1, "%s", src_name);
 
     Var *var = malloc(sizeof(Var));
     var->name = dst_name;
     var->name_len = name_len;
+
+    var_table[i] = var;
+    var_table_count++;
     return var;
 }
 
 Var *copy_var(const Var* var) {
-    if (var == NULL) {
-        return NULL;
-    }
-
-    return create_var(var->name);
+    return (Var *) var;
 }
 
 bool is_same_var(const Var *var_1, const Var *var_2) {
@@ -37,24 +88,12 @@ bool is_same_var(const Var *var_1, const Var *var_2) {
         return false;
     }
 
-    if (var_1->name == NULL || var_2->name == NULL) {
-        return false;
-    }
-
-    if (var_1->name_len != var_2->name_len) {
-        return false;
-    }
-
-    return strncmp(var_1->name, var_2->name, var_1->name_len) == 0;
+    return var_1 == var_2;
 }
 
 void free_var(Var *var) {
-    if (var == NULL) {
-        return;
-    }
-
-    free(var->name);
-    free(var);
+    // Vars are interned in var_table and live until the program exits.
+    (void) var;
 }
 
 Value *create_int_value(const int int_value) {
@@ -373,6 +412,165 @@ void free_exp(Exp *exp) {
     }
 }
 
+static bool is_literal_exp(const Exp *exp) {
+    return exp->type == INT_EXP || exp->type == BOOL_EXP;
+}
+
+static Exp *create_literal_exp(const Exp *exp_literal) {
+    switch (exp_literal->type) {
+        case INT_EXP: {
+            return create_int_exp(exp_literal->int_exp->int_value);
+        }
+        case BOOL_EXP: {
+            return create_bool_exp(exp_literal->bool_exp->bool_value);
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
+
+static Exp *substitute_exp(Exp *exp, const Var *var, const Exp *exp_literal) {
+    if (exp == NULL) {
+        return NULL;
+    }
+
+    switch (exp->type) {
+        case VAR_EXP: {
+            if (!is_same_var(exp->var_exp->var, var)) {
+                return exp;
+            }
+
+            free_exp(exp);
+            return create_literal_exp(exp_literal);
+        }
+        case OP_EXP: {
+            exp->op_exp->exp_left = substitute_exp(exp->op_exp->exp_left, var, exp_literal);
+            exp->op_exp->exp_right = substitute_exp(exp->op_exp->exp_right, var, exp_literal);
+            return exp;
+        }
+        case IF_EXP: {
+            exp->if_exp->exp_cond = substitute_exp(exp->if_exp->exp_cond, var, exp_literal);
+            exp->if_exp->exp_true = substitute_exp(exp->if_exp->exp_true, var, exp_literal);
+            exp->if_exp->exp_false = substitute_exp(exp->if_exp->exp_false, var, exp_literal);
+            return exp;
+        }
+        case LET_EXP: {
+            exp->let_exp->exp_1 = substitute_exp(exp->let_exp->exp_1, var, exp_literal);
+            if (!is_same_var(exp->let_exp->var, var)) {
+                exp->let_exp->exp_2 = substitute_exp(exp->let_exp->exp_2, var, exp_literal);
+            }
+            return exp;
+        }
+        default: {
+            return exp;
+        }
+    }
+}
+
+static Exp *fold_op_exp(Exp *exp) {
+    OpExp *op_exp = exp->op_exp;
+    op_exp->exp_left = fold_exp(op_exp->exp_left);
+    op_exp->exp_right = fold_exp(op_exp->exp_right);
+    if (op_exp->exp_left == NULL
+        || op_exp->exp_right == NULL
+        || op_exp->exp_left->type != INT_EXP
+        || op_exp->exp_right->type != INT_EXP) {
+        return exp;
+    }
+
+    int int_value_left = op_exp->exp_left->int_exp->int_value;
+    int int_value_right = op_exp->exp_right->int_exp->int_value;
+
+    Exp *exp_folded;
+    switch (op_exp->type) {
+        case PLUS_OP_EXP: {
+            exp_folded = create_int_exp(int_value_left + int_value_right);
+            break;
+        }
+        case MINUS_OP_EXP: {
+            exp_folded = create_int_exp(int_value_left - int_value_right);
+            break;
+        }
+        case TIMES_OP_EXP: {
+            exp_folded = create_int_exp(int_value_left * int_value_right);
+            break;
+        }
+        case LT_OP_EXP: {
+            exp_folded = create_bool_exp(int_value_left < int_value_right);
+            break;
+        }
+        default: {
+            return exp;
+        }
+    }
+
+    free_exp(exp);
+    return exp_folded;
+}
+
+Exp *fold_exp(Exp *exp) {
+    if (exp == NULL) {
+        return NULL;
+    }
+
+    switch (exp->type) {
+        case OP_EXP: {
+            if (exp->op_exp == NULL) {
+                return exp;
+            }
+
+            return fold_op_exp(exp);
+        }
+        case IF_EXP: {
+            IfExp *if_exp = exp->if_exp;
+            if (if_exp == NULL) {
+                return exp;
+            }
+
+            if_exp->exp_cond = fold_exp(if_exp->exp_cond);
+            if (if_exp->exp_cond == NULL || if_exp->exp_cond->type != BOOL_EXP) {
+                if_exp->exp_true = fold_exp(if_exp->exp_true);
+                if_exp->exp_false = fold_exp(if_exp->exp_false);
+                return exp;
+            }
+
+            Exp *exp_branch;
+            if (if_exp->exp_cond->bool_exp->bool_value) {
+                exp_branch = if_exp->exp_true;
+                if_exp->exp_true = NULL;
+            } else {
+                exp_branch = if_exp->exp_false;
+                if_exp->exp_false = NULL;
+            }
+
+            free_exp(exp);
+            return fold_exp(exp_branch);
+        }
+        case LET_EXP: {
+            LetExp *let_exp = exp->let_exp;
+            if (let_exp == NULL) {
+                return exp;
+            }
+
+            let_exp->exp_1 = fold_exp(let_exp->exp_1);
+            if (let_exp->exp_1 == NULL || !is_literal_exp(let_exp->exp_1)) {
+                let_exp->exp_2 = fold_exp(let_exp->exp_2);
+                return exp;
+            }
+
+            Exp *exp_body = substitute_exp(let_exp->exp_2, let_exp->var, let_exp->exp_1);
+            let_exp->exp_2 = NULL;
+
+            free_exp(exp);
+            return fold_exp(exp_body);
+        }
+        default: {
+            return exp;
+        }
+    }
+}
+
 Value *evaluate(const Exp *exp) {
     if (exp == NULL) {
         return NULL;
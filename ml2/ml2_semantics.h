@@ -262,6 +262,8 @@ Exp *create_let_exp(Var *var, Exp *exp_1, Exp *exp_2);
 
 void free_exp(Exp *exp);
 
+Exp *fold_exp(Exp *exp);
+
 Value *evaluate(const Exp *exp);
 
 Value *evaluate_impl(const Env *env, const Exp *exp);
@@ -183,12 +183,38 @@ void test5(void) {
     free_exp(exp3);
 }
 
+void test6(void) {
+    Exp *exp1 = create_let_exp(
+        create_var("x"),
+        create_times_op_exp(
+            create_int_exp(3),
+            create_int_exp(3)
+        ),
+        create_if_exp(
+            create_lt_op_exp(
+                create_var_exp(create_var("x")),
+                create_int_exp(10)
+            ),
+            create_plus_op_exp(
+                create_var_exp(create_var("x")),
+                create_var_exp(create_var("y"))
+            ),
+            create_int_exp(0)
+        )
+    );
+    exp1 = fold_exp(exp1);
+    fprint_exp(stdout, exp1);
+    printf("\n");
+    free_exp(exp1);
+}
+
 int main(void) {
     test1();
     test2();
     test3();
     test4();
     test5();
+    test6();
 
     return 0;
 }
@@ -12,28 +12,42 @@ extern Exp *parsed_exp;
 
 typedef enum {
     OUTPUT_VALUE,
-    OUTPUT_DERIVATION
+    OUTPUT_DERIVATION,
+    OUTPUT_COMPILED
 } OutputType;
 
 const char *options[] = {
-    "--derivation"
+    "--derivation",
+    "--compile"
 };
 
+const OutputType option_output_types[] = {
+    OUTPUT_DERIVATION,
+    OUTPUT_COMPILED
+};
+
+const int option_count = sizeof(options) / sizeof(options[0]);
+
 int main(int argc, char *argv[]) {
     if (2 < argc) {
-        printf("usage: ml3 [--derivation]\n");
+        printf("usage: ml3 [--derivation | --compile]\n");
         return 1;
     }
 
     OutputType output_type = OUTPUT_VALUE;
     if (argc == 2) {
-        if (strncmp(options[0], argv[1], strlen(options[0])) != 0) {
+        int option = 0;
+        while (option < option_count && strcmp(options[option], argv[1]) != 0) {
+            option++;
+        }
+
+        if (option == option_count) {
             printf("unknown option: %s\n", argv[1]);
-            printf("usage: ml3 [--derivation]\n");
+            printf("usage: ml3 [--derivation | --compile]\n");
             return 1;
         }
 
-        output_type = OUTPUT_DERIVATION;
+        output_type = option_output_types[option];
     }
 
     printf("# ");
@@ -44,8 +58,13 @@ int main(int argc, char *argv[]) {
         }
 
         switch (output_type) {
-            case OUTPUT_VALUE: {
-                Value *value = evaluate(parsed_exp);
+            case OUTPUT_VALUE:
+            case OUTPUT_COMPILED: {
+                parsed_exp = fold_exp(parsed_exp);
+
+                Value *value = output_type == OUTPUT_COMPILED
+                    ? evaluate_compiled(parsed_exp)
+                    : evaluate(parsed_exp);
                 if (value == NULL) {
                     printf("evaluation failed\n");
                     free_exp(parsed_exp);
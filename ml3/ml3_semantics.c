@@ -5,6 +5,45 @@
 
 #include "ml3_semantics.h"
 
+static Var **var_table = NULL;
+static size_t var_table_size = 0;
+static size_t var_table_count = 0;
+
+static size_t hash_var_name(const char *name, const size_t name_len) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < name_len; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool grow_var_table() {
+    size_t var_table_size_new = var_table_size == 0 ? 64 : var_table_size * 2;
+    Var **var_table_new = calloc(var_table_size_new, sizeof(Var *));
+    if (var_table_new == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < var_table_size; i++) {
+        Var *var = var_table[i];
+        if (var == NULL) {
+            continue;
+        }
+
+        size_t j = hash_var_name(var->name, var->name_len) & (var_table_size_new - 1);
+        while (var_table_new[j] != NULL) {
+            j = (j + 1) & (var_table_size_new - 1);
+        }
+        var_table_new[j] = var;
+    }
+
+    free(var_table);
+    var_table = var_table_new;
+    var_table_size = var_table_size_new;
+    return true;
+}
+
 Var *create_var(const char *src_name) {
     if (src_name == NULL) {
         return NULL;
@@ -15,21 +54,33 @@ Var *create_var(const char *src_name) {
         return NULL;
     }
 
+    if (var_table_size <= var_table_count * 2 && !grow_var_table()) {
+        return NULL;
+    }
+
+    size_t i = hash_var_name(src_name, name_len) & (var_table_size - 1);
+    while (var_table[i] != NULL) {
+        Var *var = var_table[i];
+        if (var->name_len == name_len && strncmp(var->name, src_name, name_len) == 0) {
+            return var;
+        }
+        i = (i + 1) & (var_table_size - 1);
+    }
+
     char *dst_name = malloc(name_len + 1);
-    snprintf(dst_name, VAR_NAME_LEN_MAX, "%s", src_name);
+    snprintf(dst_name, name_len + 1, "%s", src_name);
 
     Var *var = malloc(sizeof(Var));
     var->name = dst_name;
     var->name_len = name_len;
+
+    var_table[i] = var;
+    var_table_count++;
     return var;
 }
 
 Var *create_copied_var(const Var* var) {
-    if (var == NULL) {
-        return NULL;
-    }
-
-    return create_var(var->name);
+    return (Var *) var;
 }
 
 bool is_same_var(const Var *var_1, const Var *var_2) {
@@ -37,24 +88,12 @@ bool is_same_var(const Var *var_1, const Var *var_2) {
         return false;
     }
 
-    if (var_1->name == NULL || var_2->name == NULL) {
-        return false;
-    }
-
-    if (var_1->name_len != var_2->name_len) {
-        return false;
-    }
-
-    return strncmp(var_1->name, var_2->name, var_1->name_len) == 0;
+    return var_1 == var_2;
 }
 
 void free_var(Var *var) {
-    if (var == NULL) {
-        return;
-    }
-
-    free(var->name);
-    free(var);
+    // Vars are interned in var_table and live until the program exits.
+    (void) var;
 }
 
 Value *create_int_value(const int int_value) {
@@ -80,6 +119,7 @@ Closure *create_closure(const Env *env, const Var *var, Exp *exp) {
     closure->env = create_copied_env(env);
     closure->var = create_copied_var(var);
     closure->exp = exp;
+    closure->node_function = NULL;
     return closure;
 }
 
@@ -88,7 +128,13 @@ Closure *create_copied_closure(const Closure *closure) {
         return NULL;
     }
 
-    return create_closure(closure->env, closure->var, closure->exp);
+    Closure *closure_new = create_closure(closure->env, closure->var, closure->exp);
+    if (closure_new == NULL) {
+        return NULL;
+    }
+
+    closure_new->node_function = closure->node_function;
+    return closure_new;
 }
 
 bool copy_closure(Closure *closure_dst, const Closure *closure_src) {
@@ -99,6 +145,7 @@ bool copy_closure(Closure *closure_dst, const Closure *closure_src) {
     closure_dst->env = create_copied_env(closure_src->env);
     closure_dst->var = create_copied_var(closure_src->var);
     closure_dst->exp = closure_src->exp;
+    closure_dst->node_function = closure_src->node_function;
     return true;
 }
 
@@ -133,6 +180,7 @@ RecClosure *create_rec_closure(const Env *env, const Var *var_rec, const Var *va
     rec_closure->var_rec = create_copied_var(var_rec);
     rec_closure->var = create_copied_var(var);
     rec_closure->exp = exp;
+    rec_closure->node_function = NULL;
     return rec_closure;
 }
 
@@ -141,12 +189,18 @@ RecClosure *create_copied_rec_closure(const RecClosure *rec_closure) {
         return NULL;
     }
 
-    return create_rec_closure(
+    RecClosure *rec_closure_new = create_rec_closure(
         rec_closure->env,
         rec_closure->var_rec,
         rec_closure->var,
         rec_closure->exp
     );
+    if (rec_closure_new == NULL) {
+        return NULL;
+    }
+
+    rec_closure_new->node_function = rec_closure->node_function;
+    return rec_closure_new;
 }
 
 bool copy_rec_closure(RecClosure *rec_closure_dst, const RecClosure *rec_closure_src) {
@@ -158,6 +212,7 @@ bool copy_rec_closure(RecClosure *rec_closure_dst, const RecClosure *rec_closure
     rec_closure_dst->var_rec = create_copied_var(rec_closure_src->var_rec);
     rec_closure_dst->var = create_copied_var(rec_closure_src->var);
     rec_closure_dst->exp = rec_closure_src->exp;
+    rec_closure_dst->node_function = rec_closure_src->node_function;
     return true;
 }
 
@@ -259,34 +314,7 @@ Env *create_copied_env(const Env *env) {
     }
 
     Env *env_new = malloc(sizeof(Env));
-    if (env->var_binding == NULL) {
-        env_new->var_binding = NULL;
-        return env_new;
-    }
-
-    VarBinding *var_binding_new_prev = NULL;
-    VarBinding *var_binding = env->var_binding;
-    while (var_binding != NULL) {
-        if (var_binding->var == NULL || var_binding->value == NULL) {
-            free_env(env_new);
-            return NULL;
-        }
-
-        VarBinding *var_binding_new = malloc(sizeof(VarBinding));
-        var_binding_new->var = create_copied_var(var_binding->var);
-        var_binding_new->value = create_copied_value(var_binding->value);
-        var_binding_new->next = NULL;
-
-        if (var_binding_new_prev == NULL) {
-            env_new->var_binding = var_binding_new;
-        } else {
-            var_binding_new_prev->next = var_binding_new;
-        }
-
-        var_binding_new_prev = var_binding_new;
-        var_binding = var_binding->next;
-    }
-
+    env_new->var_binding = create_copied_var_binding(env->var_binding);
     return env_new;
 }
 
@@ -299,14 +327,8 @@ Env *create_poped_env(const Env *env) {
         return NULL;
     }
 
-    Env *env_new = create_copied_env(env);
-    VarBinding *var_binding_temp = env_new->var_binding;
-    env_new->var_binding = var_binding_temp->next;
-
-    free_var(var_binding_temp->var);
-    free_value(var_binding_temp->value);
-    free(var_binding_temp);
-
+    Env *env_new = malloc(sizeof(Env));
+    env_new->var_binding = create_copied_var_binding(env->var_binding->next);
     return env_new;
 }
 
@@ -315,15 +337,14 @@ Env *create_appended_env(const Env *env, const Var *var, const Value *value) {
         return NULL;
     }
 
-    Env *env_new = create_copied_env(env);
-
     VarBinding *var_binding = malloc(sizeof(VarBinding));
     var_binding->var = create_copied_var(var);
     var_binding->value = create_copied_value(value);
-    var_binding->next = env_new->var_binding;
+    var_binding->next = create_copied_var_binding(env->var_binding);
+    var_binding->ref_count = 1;
 
+    Env *env_new = malloc(sizeof(Env));
     env_new->var_binding = var_binding;
-
     return env_new;
 }
 
@@ -332,8 +353,27 @@ void free_env(Env *env) {
         return;
     }
 
-    VarBinding *var_binding = env->var_binding;
+    free_var_binding(env->var_binding);
+    free(env);
+}
+
+VarBinding *create_copied_var_binding(const VarBinding *var_binding) {
+    if (var_binding == NULL) {
+        return NULL;
+    }
+
+    VarBinding *var_binding_shared = (VarBinding *) var_binding;
+    var_binding_shared->ref_count++;
+    return var_binding_shared;
+}
+
+void free_var_binding(VarBinding *var_binding) {
     while (var_binding != NULL) {
+        var_binding->ref_count--;
+        if (0 < var_binding->ref_count) {
+            return;
+        }
+
         VarBinding *var_binding_next = var_binding->next;
 
         free_var(var_binding->var);
@@ -342,7 +382,6 @@ void free_env(Env *env) {
 
         var_binding = var_binding_next;
     }
-    free(env);
 }
 
 Exp *create_int_exp(const int int_value) {
@@ -464,6 +503,9 @@ Exp *create_fun_exp(Var *var, Exp *exp) {
     FunExp *fun_exp = malloc(sizeof(FunExp));
     fun_exp->var = var;
     fun_exp->exp = exp;
+    fun_exp->free_vars = NULL;
+    fun_exp->free_var_count = -1;
+    fun_exp->node_function = NULL;
 
     Exp *exp_new = malloc(sizeof(Exp));
     exp_new->type = FUN_EXP;
@@ -490,6 +532,9 @@ Exp *create_let_rec_exp(Var *var_rec, Var *var, Exp *exp_1, Exp *exp_2) {
     let_rec_exp->var = var;
     let_rec_exp->exp_1 = exp_1;
     let_rec_exp->exp_2 = exp_2;
+    let_rec_exp->free_vars = NULL;
+    let_rec_exp->free_var_count = -1;
+    let_rec_exp->node_function = NULL;
 
     Exp *exp = malloc(sizeof(Exp));
     exp->type = LET_REC_EXP;
@@ -571,6 +616,8 @@ void free_exp(Exp *exp) {
 
             free_var(exp->fun_exp->var);
             free_exp(exp->fun_exp->exp);
+            free(exp->fun_exp->free_vars);
+            free_node_function(exp->fun_exp->node_function);
             free(exp->fun_exp);
             free(exp);
             return;
@@ -597,6 +644,8 @@ void free_exp(Exp *exp) {
             free_var(exp->let_rec_exp->var);
             free_exp(exp->let_rec_exp->exp_1);
             free_exp(exp->let_rec_exp->exp_2);
+            free(exp->let_rec_exp->free_vars);
+            free_node_function(exp->let_rec_exp->node_function);
             free(exp->let_rec_exp);
             free(exp);
             return;
@@ -608,393 +657,1620 @@ void free_exp(Exp *exp) {
     }
 }
 
-Value *evaluate(const Exp *exp) {
+static bool is_literal_exp(const Exp *exp) {
+    return exp->type == INT_EXP || exp->type == BOOL_EXP;
+}
+
+static Exp *create_literal_exp(const Exp *exp_literal) {
+    switch (exp_literal->type) {
+        case INT_EXP: {
+            return create_int_exp(exp_literal->int_exp->int_value);
+        }
+        case BOOL_EXP: {
+            return create_bool_exp(exp_literal->bool_exp->bool_value);
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
+
+static bool is_var_free_in_function(const Exp *exp, const Var *var, const bool is_in_function) {
     if (exp == NULL) {
-        return NULL;
+        return false;
     }
 
-    Env env = { .var_binding = NULL };
-    return evaluate_impl(&env, exp);
-}
+    switch (exp->type) {
+        case VAR_EXP: {
+            return is_in_function && is_same_var(exp->var_exp->var, var);
+        }
+        case OP_EXP: {
+            return is_var_free_in_function(exp->op_exp->exp_left, var, is_in_function)
+                || is_var_free_in_function(exp->op_exp->exp_right, var, is_in_function);
+        }
+        case IF_EXP: {
+            return is_var_free_in_function(exp->if_exp->exp_cond, var, is_in_function)
+                || is_var_free_in_function(exp->if_exp->exp_true, var, is_in_function)
+                || is_var_free_in_function(exp->if_exp->exp_false, var, is_in_function);
+        }
+        case LET_EXP: {
+            return is_var_free_in_function(exp->let_exp->exp_1, var, is_in_function)
+                || (!is_same_var(exp->let_exp->var, var)
+                    && is_var_free_in_function(exp->let_exp->exp_2, var, is_in_function));
+        }
+        case FUN_EXP: {
+            return !is_same_var(exp->fun_exp->var, var)
+                && is_var_free_in_function(exp->fun_exp->exp, var, true);
+        }
+        case APP_EXP: {
+            return is_var_free_in_function(exp->app_exp->exp_1, var, is_in_function)
+                || is_var_free_in_function(exp->app_exp->exp_2, var, is_in_function);
+        }
+        case LET_REC_EXP: {
+            if (is_same_var(exp->let_rec_exp->var_rec, var)) {
+                return false;
+            }
 
-Value *evaluate_impl(const Env *env, const Exp *exp) {
-    if (env == NULL) {
-        return NULL;
+            return (!is_same_var(exp->let_rec_exp->var, var)
+                    && is_var_free_in_function(exp->let_rec_exp->exp_1, var, true))
+                || is_var_free_in_function(exp->let_rec_exp->exp_2, var, is_in_function);
+        }
+        default: {
+            return false;
+        }
     }
+}
 
+static Exp *substitute_exp(Exp *exp, const Var *var, const Exp *exp_literal) {
     if (exp == NULL) {
         return NULL;
     }
 
     switch (exp->type) {
-        case INT_EXP: {
-            if (exp->int_exp == NULL) {
-                return NULL;
+        case VAR_EXP: {
+            if (!is_same_var(exp->var_exp->var, var)) {
+                return exp;
             }
 
-            Value *value = malloc(sizeof(Value));
-            value->type = INT_VALUE;
-            value->int_value = exp->int_exp->int_value;
-            return value;
+            free_exp(exp);
+            return create_literal_exp(exp_literal);
         }
-        case BOOL_EXP: {
-            if (exp->bool_exp == NULL) {
-                return NULL;
+        case OP_EXP: {
+            exp->op_exp->exp_left = substitute_exp(exp->op_exp->exp_left, var, exp_literal);
+            exp->op_exp->exp_right = substitute_exp(exp->op_exp->exp_right, var, exp_literal);
+            return exp;
+        }
+        case IF_EXP: {
+            exp->if_exp->exp_cond = substitute_exp(exp->if_exp->exp_cond, var, exp_literal);
+            exp->if_exp->exp_true = substitute_exp(exp->if_exp->exp_true, var, exp_literal);
+            exp->if_exp->exp_false = substitute_exp(exp->if_exp->exp_false, var, exp_literal);
+            return exp;
+        }
+        case LET_EXP: {
+            exp->let_exp->exp_1 = substitute_exp(exp->let_exp->exp_1, var, exp_literal);
+            if (!is_same_var(exp->let_exp->var, var)) {
+                exp->let_exp->exp_2 = substitute_exp(exp->let_exp->exp_2, var, exp_literal);
             }
-
-            Value *value = malloc(sizeof(Value));
-            value->type = BOOL_VALUE;
-            value->bool_value = exp->bool_exp->bool_value;
-            return value;
+            return exp;
         }
-        case VAR_EXP: {
-            if (exp->var_exp == NULL) {
-                return NULL;
+        case APP_EXP: {
+            exp->app_exp->exp_1 = substitute_exp(exp->app_exp->exp_1, var, exp_literal);
+            exp->app_exp->exp_2 = substitute_exp(exp->app_exp->exp_2, var, exp_literal);
+            return exp;
+        }
+        case LET_REC_EXP: {
+            if (!is_same_var(exp->let_rec_exp->var_rec, var)) {
+                exp->let_rec_exp->exp_2 = substitute_exp(exp->let_rec_exp->exp_2, var, exp_literal);
             }
+            return exp;
+        }
+        default: {
+            return exp;
+        }
+    }
+}
 
-            VarBinding *var_binding = env->var_binding;
-            while (var_binding != NULL) {
-                if (is_same_var(var_binding->var, exp->var_exp->var)) {
-                    return create_copied_value(var_binding->value);
-                }
+static Exp *fold_op_exp(Exp *exp) {
+    OpExp *op_exp = exp->op_exp;
+    op_exp->exp_left = fold_exp(op_exp->exp_left);
+    op_exp->exp_right = fold_exp(op_exp->exp_right);
+    if (op_exp->exp_left == NULL
+        || op_exp->exp_right == NULL
+        || op_exp->exp_left->type != INT_EXP
+        || op_exp->exp_right->type != INT_EXP) {
+        return exp;
+    }
 
-                var_binding = var_binding->next;
-            }
+    int int_value_left = op_exp->exp_left->int_exp->int_value;
+    int int_value_right = op_exp->exp_right->int_exp->int_value;
 
-            return NULL;
+    Exp *exp_folded;
+    switch (op_exp->type) {
+        case PLUS_OP_EXP: {
+            exp_folded = create_int_exp(int_value_left + int_value_right);
+            break;
         }
+        case MINUS_OP_EXP: {
+            exp_folded = create_int_exp(int_value_left - int_value_right);
+            break;
+        }
+        case TIMES_OP_EXP: {
+            exp_folded = create_int_exp(int_value_left * int_value_right);
+            break;
+        }
+        case LT_OP_EXP: {
+            exp_folded = create_bool_exp(int_value_left < int_value_right);
+            break;
+        }
+        default: {
+            return exp;
+        }
+    }
+
+    free_exp(exp);
+    return exp_folded;
+}
+
+Exp *fold_exp(Exp *exp) {
+    if (exp == NULL) {
+        return NULL;
+    }
+
+    switch (exp->type) {
         case OP_EXP: {
             if (exp->op_exp == NULL) {
-                return NULL;
+                return exp;
             }
 
-            const Exp *exp_left = exp->op_exp->exp_left;
-            if (exp_left == NULL) {
-                return NULL;
+            return fold_op_exp(exp);
+        }
+        case IF_EXP: {
+            IfExp *if_exp = exp->if_exp;
+            if (if_exp == NULL) {
+                return exp;
             }
 
-            const Exp *exp_right = exp->op_exp->exp_right;
-            if (exp_right == NULL) {
-                return NULL;
+            if_exp->exp_cond = fold_exp(if_exp->exp_cond);
+            if (if_exp->exp_cond == NULL || if_exp->exp_cond->type != BOOL_EXP) {
+                if_exp->exp_true = fold_exp(if_exp->exp_true);
+                if_exp->exp_false = fold_exp(if_exp->exp_false);
+                return exp;
             }
 
-            Value *value_left = evaluate_impl(env, exp_left);
-            if (value_left == NULL) {
-                return NULL;
+            Exp *exp_branch;
+            if (if_exp->exp_cond->bool_exp->bool_value) {
+                exp_branch = if_exp->exp_true;
+                if_exp->exp_true = NULL;
+            } else {
+                exp_branch = if_exp->exp_false;
+                if_exp->exp_false = NULL;
             }
 
-            if (value_left->type != INT_VALUE) {
-                free_value(value_left);
-                return NULL;
+            free_exp(exp);
+            return fold_exp(exp_branch);
+        }
+        case LET_EXP: {
+            LetExp *let_exp = exp->let_exp;
+            if (let_exp == NULL) {
+                return exp;
             }
 
-            Value *value_right = evaluate_impl(env, exp_right);
-            if (value_right == NULL) {
-                free_value(value_left);
-                return NULL;
+            let_exp->exp_1 = fold_exp(let_exp->exp_1);
+            if (let_exp->exp_1 == NULL
+                || !is_literal_exp(let_exp->exp_1)
+                || is_var_free_in_function(let_exp->exp_2, let_exp->var, false)) {
+                let_exp->exp_2 = fold_exp(let_exp->exp_2);
+                return exp;
             }
 
-            if (value_right->type != INT_VALUE) {
-                free_value(value_left);
-                free_value(value_right);
-                return NULL;
-            }
+            Exp *exp_body = substitute_exp(let_exp->exp_2, let_exp->var, let_exp->exp_1);
+            let_exp->exp_2 = NULL;
 
-            switch(exp->op_exp->type) {
-                case PLUS_OP_EXP: {
-                    Value *value = malloc(sizeof(Value));
-                    value->type = INT_VALUE;
-                    value->int_value = value_left->int_value + value_right->int_value;
-                    free_value(value_left);
-                    free_value(value_right);
-                    return value;
-                }
-                case MINUS_OP_EXP: {
-                    Value *value = malloc(sizeof(Value));
-                    value->type = INT_VALUE;
-                    value->int_value = value_left->int_value - value_right->int_value;
-                    free_value(value_left);
-                    free_value(value_right);
-                    return value;
-                }
-                case TIMES_OP_EXP: {
-                    Value *value = malloc(sizeof(Value));
-                    value->type = INT_VALUE;
-                    value->int_value = value_left->int_value * value_right->int_value;
-                    free_value(value_left);
-                    free_value(value_right);
-                    return value;
-                }
-                case LT_OP_EXP: {
-                    Value *value = malloc(sizeof(Value));
-                    value->type = BOOL_VALUE;
-                    value->bool_value = value_left->int_value < value_right->int_value;
-                    free_value(value_left);
-                    free_value(value_right);
-                    return value;
-                }
-                default:
-                    return NULL;
+            free_exp(exp);
+            return fold_exp(exp_body);
+        }
+        case FUN_EXP: {
+            if (exp->fun_exp != NULL) {
+                exp->fun_exp->exp = fold_exp(exp->fun_exp->exp);
             }
+            return exp;
         }
-        case IF_EXP: {
-            if (exp->if_exp == NULL) {
-                return NULL;
+        case APP_EXP: {
+            if (exp->app_exp != NULL) {
+                exp->app_exp->exp_1 = fold_exp(exp->app_exp->exp_1);
+                exp->app_exp->exp_2 = fold_exp(exp->app_exp->exp_2);
+            }
+            return exp;
+        }
+        case LET_REC_EXP: {
+            if (exp->let_rec_exp != NULL) {
+                exp->let_rec_exp->exp_1 = fold_exp(exp->let_rec_exp->exp_1);
+                exp->let_rec_exp->exp_2 = fold_exp(exp->let_rec_exp->exp_2);
             }
+            return exp;
+        }
+        default: {
+            return exp;
+        }
+    }
+}
+
+Value *evaluate(const Exp *exp) {
+    if (exp == NULL) {
+        return NULL;
+    }
+
+    Env env = { .var_binding = NULL };
+    return evaluate_impl(&env, exp);
+}
+
+typedef struct ScopeTag {
+    const Var *var;
+    const struct ScopeTag *next;
+} Scope;
+
+typedef struct {
+    Var **vars;
+    int count;
+    int capacity;
+} VarSet;
+
+static bool is_var_in_scope(const Scope *scope, const Var *var) {
+    while (scope != NULL) {
+        if (is_same_var(scope->var, var)) {
+            return true;
+        }
+
+        scope = scope->next;
+    }
+
+    return false;
+}
+
+static void add_var_to_var_set(VarSet *var_set, Var *var) {
+    for (int i = 0; i < var_set->count; i++) {
+        if (is_same_var(var_set->vars[i], var)) {
+            return;
+        }
+    }
+
+    if (var_set->count == var_set->capacity) {
+        var_set->capacity = var_set->capacity == 0 ? 8 : var_set->capacity * 2;
+        var_set->vars = realloc(var_set->vars, sizeof(Var *) * var_set->capacity);
+    }
+    var_set->vars[var_set->count] = var;
+    var_set->count++;
+}
+
+static void collect_free_vars(const Exp *exp, const Scope *scope, VarSet *var_set) {
+    if (exp == NULL) {
+        return;
+    }
+
+    switch (exp->type) {
+        case VAR_EXP: {
+            if (exp->var_exp != NULL && !is_var_in_scope(scope, exp->var_exp->var)) {
+                add_var_to_var_set(var_set, exp->var_exp->var);
+            }
+            return;
+        }
+        case OP_EXP: {
+            if (exp->op_exp != NULL) {
+                collect_free_vars(exp->op_exp->exp_left, scope, var_set);
+                collect_free_vars(exp->op_exp->exp_right, scope, var_set);
+            }
+            return;
+        }
+        case IF_EXP: {
+            if (exp->if_exp != NULL) {
+                collect_free_vars(exp->if_exp->exp_cond, scope, var_set);
+                collect_free_vars(exp->if_exp->exp_true, scope, var_set);
+                collect_free_vars(exp->if_exp->exp_false, scope, var_set);
+            }
+            return;
+        }
+        case LET_EXP: {
+            if (exp->let_exp != NULL) {
+                Scope scope_new = { .var = exp->let_exp->var, .next = scope };
+                collect_free_vars(exp->let_exp->exp_1, scope, var_set);
+                collect_free_vars(exp->let_exp->exp_2, &scope_new, var_set);
+            }
+            return;
+        }
+        case FUN_EXP: {
+            if (exp->fun_exp != NULL) {
+                Scope scope_new = { .var = exp->fun_exp->var, .next = scope };
+                collect_free_vars(exp->fun_exp->exp, &scope_new, var_set);
+            }
+            return;
+        }
+        case APP_EXP: {
+            if (exp->app_exp != NULL) {
+                collect_free_vars(exp->app_exp->exp_1, scope, var_set);
+                collect_free_vars(exp->app_exp->exp_2, scope, var_set);
+            }
+            return;
+        }
+        case LET_REC_EXP: {
+            if (exp->let_rec_exp != NULL) {
+                Scope scope_rec = { .var = exp->let_rec_exp->var_rec, .next = scope };
+                Scope scope_new = { .var = exp->let_rec_exp->var, .next = &scope_rec };
+                collect_free_vars(exp->let_rec_exp->exp_1, &scope_new, var_set);
+                collect_free_vars(exp->let_rec_exp->exp_2, &scope_rec, var_set);
+            }
+            return;
+        }
+        default: {
+            return;
+        }
+    }
+}
+
+static Env *create_captured_env(const Env *env, Var **free_vars, const int free_var_count) {
+    Env *env_captured = malloc(sizeof(Env));
+    env_captured->var_binding = NULL;
+
+    VarBinding *var_binding_captured_prev = NULL;
+    int captured_count = 0;
+    VarBinding *var_binding = env->var_binding;
+    while (var_binding != NULL && captured_count < free_var_count) {
+        bool is_free = false;
+        for (int i = 0; i < free_var_count; i++) {
+            if (is_same_var(free_vars[i], var_binding->var)) {
+                is_free = true;
+                break;
+            }
+        }
+
+        VarBinding *var_binding_shadowing = env->var_binding;
+        while (is_free && var_binding_shadowing != var_binding) {
+            if (is_same_var(var_binding_shadowing->var, var_binding->var)) {
+                is_free = false;
+            }
+            var_binding_shadowing = var_binding_shadowing->next;
+        }
+
+        if (is_free) {
+            VarBinding *var_binding_captured = malloc(sizeof(VarBinding));
+            var_binding_captured->var = create_copied_var(var_binding->var);
+            var_binding_captured->value = create_copied_value(var_binding->value);
+            var_binding_captured->next = NULL;
+            var_binding_captured->ref_count = 1;
+
+            if (var_binding_captured_prev == NULL) {
+                env_captured->var_binding = var_binding_captured;
+            } else {
+                var_binding_captured_prev->next = var_binding_captured;
+            }
+
+            var_binding_captured_prev = var_binding_captured;
+            captured_count++;
+        }
+
+        var_binding = var_binding->next;
+    }
+
+    return env_captured;
+}
+
+static void get_free_vars(const Scope *scope_bound, const Exp *exp_body, Var ***free_vars, int *free_var_count) {
+    if (*free_var_count < 0) {
+        VarSet var_set = { .vars = NULL, .count = 0, .capacity = 0 };
+        collect_free_vars(exp_body, scope_bound, &var_set);
+        *free_vars = var_set.vars;
+        *free_var_count = var_set.count;
+    }
+}
+
+Value *evaluate_impl(const Env *env, const Exp *exp) {
+    if (env == NULL) {
+        return NULL;
+    }
+
+    if (exp == NULL) {
+        return NULL;
+    }
+
+    switch (exp->type) {
+        case INT_EXP: {
+            if (exp->int_exp == NULL) {
+                return NULL;
+            }
+
+            Value *value = malloc(sizeof(Value));
+            value->type = INT_VALUE;
+            value->int_value = exp->int_exp->int_value;
+            return value;
+        }
+        case BOOL_EXP: {
+            if (exp->bool_exp == NULL) {
+                return NULL;
+            }
+
+            Value *value = malloc(sizeof(Value));
+            value->type = BOOL_VALUE;
+            value->bool_value = exp->bool_exp->bool_value;
+            return value;
+        }
+        case VAR_EXP: {
+            if (exp->var_exp == NULL) {
+                return NULL;
+            }
+
+            VarBinding *var_binding = env->var_binding;
+            while (var_binding != NULL) {
+                if (is_same_var(var_binding->var, exp->var_exp->var)) {
+                    return create_copied_value(var_binding->value);
+                }
+
+                var_binding = var_binding->next;
+            }
+
+            return NULL;
+        }
+        case OP_EXP: {
+            if (exp->op_exp == NULL) {
+                return NULL;
+            }
+
+            const Exp *exp_left = exp->op_exp->exp_left;
+            if (exp_left == NULL) {
+                return NULL;
+            }
+
+            const Exp *exp_right = exp->op_exp->exp_right;
+            if (exp_right == NULL) {
+                return NULL;
+            }
+
+            Value *value_left = evaluate_impl(env, exp_left);
+            if (value_left == NULL) {
+                return NULL;
+            }
+
+            if (value_left->type != INT_VALUE) {
+                free_value(value_left);
+                return NULL;
+            }
+
+            Value *value_right = evaluate_impl(env, exp_right);
+            if (value_right == NULL) {
+                free_value(value_left);
+                return NULL;
+            }
+
+            if (value_right->type != INT_VALUE) {
+                free_value(value_left);
+                free_value(value_right);
+                return NULL;
+            }
+
+            switch(exp->op_exp->type) {
+                case PLUS_OP_EXP: {
+                    Value *value = malloc(sizeof(Value));
+                    value->type = INT_VALUE;
+                    value->int_value = value_left->int_value + value_right->int_value;
+                    free_value(value_left);
+                    free_value(value_right);
+                    return value;
+                }
+                case MINUS_OP_EXP: {
+                    Value *value = malloc(sizeof(Value));
+                    value->type = INT_VALUE;
+                    value->int_value = value_left->int_value - value_right->int_value;
+                    free_value(value_left);
+                    free_value(value_right);
+                    return value;
+                }
+                case TIMES_OP_EXP: {
+                    Value *value = malloc(sizeof(Value));
+                    value->type = INT_VALUE;
+                    value->int_value = value_left->int_value * value_right->int_value;
+                    free_value(value_left);
+                    free_value(value_right);
+                    return value;
+                }
+                case LT_OP_EXP: {
+                    Value *value = malloc(sizeof(Value));
+                    value->type = BOOL_VALUE;
+                    value->bool_value = value_left->int_value < value_right->int_value;
+                    free_value(value_left);
+                    free_value(value_right);
+                    return value;
+                }
+                default:
+                    return NULL;
+            }
+        }
+        case IF_EXP: {
+            if (exp->if_exp == NULL) {
+                return NULL;
+            }
+
+            const Exp *exp_cond = exp->if_exp->exp_cond;
+            if (exp_cond == NULL) {
+                return NULL;
+            }
+
+            Value *value_cond = evaluate_impl(env, exp_cond);
+            if (value_cond == NULL) {
+                return NULL;
+            }
+
+            if (value_cond->type != BOOL_VALUE) {
+                free_value(value_cond);
+                return NULL;
+            }
+
+            if (value_cond->bool_value) {
+                const Exp *exp_true = exp->if_exp->exp_true;
+                if (exp_true == NULL) {
+                    free_value(value_cond);
+                    return NULL;
+                }
+
+                Value *value_true = evaluate_impl(env, exp_true);
+                if (value_true == NULL) {
+                    free_value(value_cond);
+                    return NULL;
+                }
+
+                free_value(value_cond);
+                return value_true;
+            } else {
+                const Exp *exp_false = exp->if_exp->exp_false;
+                if (exp_false == NULL) {
+                    free_value(value_cond);
+                    return NULL;
+                }
+
+                Value *value_false = evaluate_impl(env, exp_false);
+                if (value_false == NULL) {
+                    free_value(value_cond);
+                    return NULL;
+                }
+
+                free_value(value_cond);
+                return value_false;
+            }
+        }
+        case LET_EXP: {
+            if (exp->let_exp == NULL) {
+                return NULL;
+            }
+
+            if (exp->let_exp->var == NULL) {
+                return NULL;
+            }
+
+            if (exp->let_exp->exp_1 == NULL) {
+                return NULL;
+            }
+
+            if (exp->let_exp->exp_2 == NULL) {
+                return NULL;
+            }
+
+            Value *value_1 = evaluate_impl(env, exp->let_exp->exp_1);
+            if (value_1 == NULL) {
+                return NULL;
+            }
+
+            Env *env_new = create_appended_env(env, exp->let_exp->var, value_1);
+            if (env_new == NULL) {
+                free_value(value_1);
+                return NULL;
+            }
+
+            Value *value_2 = evaluate_impl(env_new, exp->let_exp->exp_2);
+
+            free_env(env_new);
+            free_value(value_1);
+
+            return value_2;
+        }
+        case FUN_EXP: {
+            if (exp->fun_exp == NULL) {
+                return NULL;
+            }
+
+            if (exp->fun_exp->var == NULL) {
+                return NULL;
+            }
+
+            if (exp->fun_exp->exp == NULL) {
+                return NULL;
+            }
+
+            FunExp *fun_exp = exp->fun_exp;
+            Scope scope_bound = { .var = fun_exp->var, .next = NULL };
+            get_free_vars(&scope_bound, fun_exp->exp, &fun_exp->free_vars, &fun_exp->free_var_count);
+
+            Env *env_captured = create_captured_env(env, fun_exp->free_vars, fun_exp->free_var_count);
+            Value *value = create_closure_value(
+                create_closure(env_captured, fun_exp->var, fun_exp->exp)
+            );
+            free_env(env_captured);
+            return value;
+        }
+        case APP_EXP: {
+            if (exp->app_exp == NULL) {
+                return NULL;
+            }
+
+            if (exp->app_exp->exp_1 == NULL) {
+                return NULL;
+            }
+
+            if (exp->app_exp->exp_2 == NULL) {
+                return NULL;
+            }
+
+            Value *value_1 = evaluate_impl(env, exp->app_exp->exp_1);
+            if (value_1 == NULL) {
+                return NULL;
+            }
+
+            switch (value_1->type) {
+                case CLOSURE_VALUE: {
+                    Closure *closure_value = value_1->closure_value;
+                    if (closure_value == NULL) {
+                        free_value(value_1);
+                        return NULL;
+                    }
+
+                    Value *value_2 = evaluate_impl(env, exp->app_exp->exp_2);
+                    if (value_2 == NULL) {
+                        free_value(value_1);
+                        return NULL;
+                    }
+
+                    Env *env_new = create_appended_env(
+                        closure_value->env,
+                        closure_value->var,
+                        value_2
+                    );
+                    if (env_new == NULL) {
+                        free_value(value_2);
+                        free_value(value_1);
+                        return NULL;
+                    }
+
+                    Value *value_3 = evaluate_impl(env_new, closure_value->exp);
+
+                    free_env(env_new);
+                    free_value(value_2);
+                    free_value(value_1);
+
+                    return value_3;
+                }
+                case REC_CLOSURE_VALUE: {
+                    RecClosure *rec_closure_value = value_1->rec_closure_value;
+                    if (rec_closure_value == NULL) {
+                        free_value(value_1);
+                        return NULL;
+                    }
+
+                    Value *value_2 = evaluate_impl(env, exp->app_exp->exp_2);
+                    if (value_2 == NULL) {
+                        free_value(value_1);
+                        return NULL;
+                    }
+
+                    Env *env_temp = create_appended_env(
+                        rec_closure_value->env,
+                        rec_closure_value->var_rec,
+                        value_1
+                    );
+                    if (env_temp == NULL) {
+                        free_value(value_2);
+                        free_value(value_1);
+                        return NULL;
+                    }
+
+                    Env *env_new = create_appended_env(
+                        env_temp,
+                        rec_closure_value->var,
+                        value_2
+                    );
+                    free_env(env_temp);
+                    if (env_new == NULL) {
+                        free_value(value_2);
+                        free_value(value_1);
+                        return NULL;
+                    }
+
+                    Value *value_3 = evaluate_impl(env_new, rec_closure_value->exp);
+
+                    free_env(env_new);
+                    free_value(value_2);
+                    free_value(value_1);
+
+                    return value_3;
+                }
+                default: {
+                    free_value(value_1);
+                    return NULL;
+                }
+            }
+        }
+        case LET_REC_EXP: {
+            if (exp->let_rec_exp == NULL) {
+                return NULL;
+            }
+
+            if (exp->let_rec_exp->var_rec == NULL) {
+                return NULL;
+            }
+
+            if (exp->let_rec_exp->var == NULL) {
+                return NULL;
+            }
+
+            if (exp->let_rec_exp->exp_1 == NULL) {
+                return NULL;
+            }
+
+            if (exp->let_rec_exp->exp_2 == NULL) {
+                return NULL;
+            }
+
+            LetRecExp *let_rec_exp = exp->let_rec_exp;
+            Scope scope_bound_rec = { .var = let_rec_exp->var_rec, .next = NULL };
+            Scope scope_bound = { .var = let_rec_exp->var, .next = &scope_bound_rec };
+            get_free_vars(
+                &scope_bound,
+                let_rec_exp->exp_1,
+                &let_rec_exp->free_vars,
+                &let_rec_exp->free_var_count
+            );
+
+            Env *env_captured = create_captured_env(
+                env,
+                let_rec_exp->free_vars,
+                let_rec_exp->free_var_count
+            );
+            Value *rec_closure_value = create_rec_closure_value(
+                create_rec_closure(
+                    env_captured,
+                    let_rec_exp->var_rec,
+                    let_rec_exp->var,
+                    let_rec_exp->exp_1
+                )
+            );
+            free_env(env_captured);
+            if (rec_closure_value == NULL) {
+                return NULL;
+            }
+
+            Env *env_new = create_appended_env(
+                env,
+                exp->let_rec_exp->var_rec,
+                rec_closure_value
+            );
+            if (env_new == NULL) {
+                free_value(rec_closure_value);
+                return NULL;
+            }
+
+            Value *value = evaluate_impl(env_new, exp->let_rec_exp->exp_2);
+
+            free_env(env_new);
+            free_value(rec_closure_value);
+
+            return value;
+        }
+        default:
+            return NULL;
+    }
+}
+
+typedef struct NodeScopeTag {
+    const Var *var;
+    int slot;
+    const struct NodeScopeTag *next;
+} NodeScope;
+
+static Value *apply_node_function(Value *value_function, Value *value_argument);
+
+static bool apply_node_function_int(Value *value_function, Value *value_argument, int *int_value);
+
+static bool evaluate_int_node(const Node *node, NodeFrame *frame, int *int_value) {
+    Value *value = node->handler(node, frame);
+    if (value == NULL) {
+        return false;
+    }
+
+    if (value->type != INT_VALUE) {
+        free_value(value);
+        return false;
+    }
+
+    *int_value = value->int_value;
+    free_value(value);
+    return true;
+}
+
+static bool evaluate_bool_node(const Node *node, NodeFrame *frame, bool *bool_value) {
+    Value *value = node->handler(node, frame);
+    if (value == NULL) {
+        return false;
+    }
+
+    if (value->type != BOOL_VALUE) {
+        free_value(value);
+        return false;
+    }
+
+    *bool_value = value->bool_value;
+    free_value(value);
+    return true;
+}
+
+static Value *evaluate_int_const_node(const Node *node, NodeFrame *frame) {
+    (void) frame;
+    return create_int_value(node->int_value);
+}
+
+static bool evaluate_int_const_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    (void) frame;
+    *int_value = node->int_value;
+    return true;
+}
+
+static Value *evaluate_bool_const_node(const Node *node, NodeFrame *frame) {
+    (void) frame;
+    return create_bool_value(node->int_value);
+}
+
+static bool evaluate_bool_const_node_bool(const Node *node, NodeFrame *frame, bool *bool_value) {
+    (void) frame;
+    *bool_value = node->int_value;
+    return true;
+}
+
+static Value *evaluate_slot_node(const Node *node, NodeFrame *frame) {
+    return create_copied_value(frame->slots[node->slot]);
+}
+
+static bool evaluate_slot_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    const Value *value = frame->slots[node->slot];
+    if (value == NULL || value->type != INT_VALUE) {
+        return false;
+    }
+
+    *int_value = value->int_value;
+    return true;
+}
+
+static bool evaluate_slot_node_bool(const Node *node, NodeFrame *frame, bool *bool_value) {
+    const Value *value = frame->slots[node->slot];
+    if (value == NULL || value->type != BOOL_VALUE) {
+        return false;
+    }
+
+    *bool_value = value->bool_value;
+    return true;
+}
+
+static Value *evaluate_int_op_node(const Node *node, NodeFrame *frame) {
+    int int_value;
+    if (!node->int_handler(node, frame, &int_value)) {
+        return NULL;
+    }
+
+    return create_int_value(int_value);
+}
+
+static Value *evaluate_bool_op_node(const Node *node, NodeFrame *frame) {
+    bool bool_value;
+    if (!node->bool_handler(node, frame, &bool_value)) {
+        return NULL;
+    }
+
+    return create_bool_value(bool_value);
+}
+
+static bool evaluate_plus_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    int int_value_left;
+    int int_value_right;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)
+        || !node->node_2->int_handler(node->node_2, frame, &int_value_right)) {
+        return false;
+    }
+
+    *int_value = int_value_left + int_value_right;
+    return true;
+}
+
+static bool evaluate_plus_const_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    int int_value_left;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)) {
+        return false;
+    }
+
+    *int_value = int_value_left + node->int_value;
+    return true;
+}
+
+static bool evaluate_minus_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    int int_value_left;
+    int int_value_right;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)
+        || !node->node_2->int_handler(node->node_2, frame, &int_value_right)) {
+        return false;
+    }
+
+    *int_value = int_value_left - int_value_right;
+    return true;
+}
+
+static bool evaluate_minus_const_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    int int_value_left;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)) {
+        return false;
+    }
+
+    *int_value = int_value_left - node->int_value;
+    return true;
+}
+
+static bool evaluate_times_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    int int_value_left;
+    int int_value_right;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)
+        || !node->node_2->int_handler(node->node_2, frame, &int_value_right)) {
+        return false;
+    }
+
+    *int_value = int_value_left * int_value_right;
+    return true;
+}
+
+static bool evaluate_times_const_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    int int_value_left;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)) {
+        return false;
+    }
+
+    *int_value = int_value_left * node->int_value;
+    return true;
+}
+
+static bool evaluate_lt_node_bool(const Node *node, NodeFrame *frame, bool *bool_value) {
+    int int_value_left;
+    int int_value_right;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)
+        || !node->node_2->int_handler(node->node_2, frame, &int_value_right)) {
+        return false;
+    }
+
+    *bool_value = int_value_left < int_value_right;
+    return true;
+}
+
+static bool evaluate_lt_const_node_bool(const Node *node, NodeFrame *frame, bool *bool_value) {
+    int int_value_left;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)) {
+        return false;
+    }
+
+    *bool_value = int_value_left < node->int_value;
+    return true;
+}
+
+static Value *evaluate_if_node(const Node *node, NodeFrame *frame) {
+    bool bool_value_cond;
+    if (!node->node_1->bool_handler(node->node_1, frame, &bool_value_cond)) {
+        return NULL;
+    }
+
+    const Node *node_branch = bool_value_cond ? node->node_2 : node->node_3;
+    return node_branch->handler(node_branch, frame);
+}
+
+static bool evaluate_if_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    bool bool_value_cond;
+    if (!node->node_1->bool_handler(node->node_1, frame, &bool_value_cond)) {
+        return false;
+    }
+
+    const Node *node_branch = bool_value_cond ? node->node_2 : node->node_3;
+    return node_branch->int_handler(node_branch, frame, int_value);
+}
+
+static Value *evaluate_let_node(const Node *node, NodeFrame *frame) {
+    Value *value_1 = node->node_1->handler(node->node_1, frame);
+    if (value_1 == NULL) {
+        return NULL;
+    }
+
+    free_value(frame->slots[node->slot]);
+    frame->slots[node->slot] = value_1;
+    return node->node_2->handler(node->node_2, frame);
+}
+
+static Env *create_captured_env_from_slots(const NodeFunction *node_function, NodeFrame *frame) {
+    Env *env_captured = malloc(sizeof(Env));
+    env_captured->var_binding = NULL;
+
+    for (int i = node_function->captured_count - 1; 0 <= i; i--) {
+        VarBinding *var_binding = malloc(sizeof(VarBinding));
+        var_binding->var = create_copied_var(node_function->captured_vars[i]);
+        var_binding->value = create_copied_value(frame->slots[node_function->captured_slots[i]]);
+        var_binding->next = env_captured->var_binding;
+        var_binding->ref_count = 1;
+        env_captured->var_binding = var_binding;
+    }
+
+    return env_captured;
+}
+
+static Value *evaluate_fun_node(const Node *node, NodeFrame *frame) {
+    NodeFunction *node_function = node->node_function;
+    Env *env_captured = create_captured_env_from_slots(node_function, frame);
+
+    Closure *closure = create_closure(env_captured, node_function->var, node_function->exp);
+    free_env(env_captured);
+    if (closure == NULL) {
+        return NULL;
+    }
+
+    closure->node_function = node_function;
+    return create_closure_value(closure);
+}
+
+static Value *evaluate_let_rec_node(const Node *node, NodeFrame *frame) {
+    NodeFunction *node_function = node->node_function;
+    Env *env_captured = create_captured_env_from_slots(node_function, frame);
+
+    RecClosure *rec_closure = create_rec_closure(
+        env_captured,
+        node_function->var_rec,
+        node_function->var,
+        node_function->exp
+    );
+    free_env(env_captured);
+    if (rec_closure == NULL) {
+        return NULL;
+    }
+
+    rec_closure->node_function = node_function;
+
+    free_value(frame->slots[node->slot]);
+    frame->slots[node->slot] = create_rec_closure_value(rec_closure);
+    return node->node_2->handler(node->node_2, frame);
+}
+
+static Value *evaluate_app_node(const Node *node, NodeFrame *frame) {
+    Value *value_1 = node->node_1->handler(node->node_1, frame);
+    if (value_1 == NULL) {
+        return NULL;
+    }
+
+    Value *value_2 = node->node_2->handler(node->node_2, frame);
+    if (value_2 == NULL) {
+        free_value(value_1);
+        return NULL;
+    }
+
+    return apply_node_function(value_1, value_2);
+}
+
+static bool evaluate_app_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    Value *value_1 = node->node_1->handler(node->node_1, frame);
+    if (value_1 == NULL) {
+        return false;
+    }
+
+    Value *value_2 = node->node_2->handler(node->node_2, frame);
+    if (value_2 == NULL) {
+        free_value(value_1);
+        return false;
+    }
+
+    return apply_node_function_int(value_1, value_2, int_value);
+}
+
+static const NodeFunction *get_node_function(const Value *value_function, const Env **env) {
+    switch (value_function->type) {
+        case CLOSURE_VALUE: {
+            *env = value_function->closure_value->env;
+            return value_function->closure_value->node_function;
+        }
+        case REC_CLOSURE_VALUE: {
+            *env = value_function->rec_closure_value->env;
+            return value_function->rec_closure_value->node_function;
+        }
+        default: {
+            *env = NULL;
+            return NULL;
+        }
+    }
+}
+
+static void enter_node_function(const NodeFunction *node_function,
+                                const Env *env,
+                                Value *value_function,
+                                Value *value_argument,
+                                Value **slots) {
+    for (int i = 0; i < node_function->slot_count; i++) {
+        slots[i] = NULL;
+    }
+
+    int slot = 0;
+    if (env != NULL) {
+        VarBinding *var_binding = env->var_binding;
+        for (; slot < node_function->captured_count; slot++) {
+            slots[slot] = create_copied_value(var_binding->value);
+            var_binding = var_binding->next;
+        }
+    }
+    if (node_function->is_rec) {
+        slots[slot++] = create_copied_value(value_function);
+    }
+    if (node_function->var != NULL) {
+        slots[slot] = value_argument;
+    }
+}
+
+static void leave_node_function(const NodeFunction *node_function, Value **slots) {
+    for (int i = 0; i < node_function->slot_count; i++) {
+        free_value(slots[i]);
+    }
+}
+
+static Value *apply_node_function(Value *value_function, Value *value_argument) {
+    const Env *env;
+    const NodeFunction *node_function = get_node_function(value_function, &env);
+    if (node_function == NULL) {
+        free_value(value_argument);
+        free_value(value_function);
+        return NULL;
+    }
+
+    Value *slots_local[NODE_SLOT_COUNT_LOCAL];
+    Value **slots = node_function->slot_count <= NODE_SLOT_COUNT_LOCAL
+        ? slots_local
+        : malloc(sizeof(Value *) * node_function->slot_count);
+    enter_node_function(node_function, env, value_function, value_argument, slots);
+
+    NodeFrame frame = { .slots = slots };
+    Value *value = node_function->node->handler(node_function->node, &frame);
+
+    leave_node_function(node_function, slots);
+    if (slots != slots_local) {
+        free(slots);
+    }
+    free_value(value_function);
+    return value;
+}
+
+static bool apply_node_function_int(Value *value_function, Value *value_argument, int *int_value) {
+    const Env *env;
+    const NodeFunction *node_function = get_node_function(value_function, &env);
+    if (node_function == NULL) {
+        free_value(value_argument);
+        free_value(value_function);
+        return false;
+    }
+
+    Value *slots_local[NODE_SLOT_COUNT_LOCAL];
+    Value **slots = node_function->slot_count <= NODE_SLOT_COUNT_LOCAL
+        ? slots_local
+        : malloc(sizeof(Value *) * node_function->slot_count);
+    enter_node_function(node_function, env, value_function, value_argument, slots);
+
+    NodeFrame frame = { .slots = slots };
+    bool is_evaluated = node_function->node->int_handler(node_function->node, &frame, int_value);
+
+    leave_node_function(node_function, slots);
+    if (slots != slots_local) {
+        free(slots);
+    }
+    free_value(value_function);
+    return is_evaluated;
+}
+
+static Node *create_node(NodeHandler handler) {
+    Node *node = malloc(sizeof(Node));
+    node->handler = handler;
+    node->int_handler = evaluate_int_node;
+    node->bool_handler = evaluate_bool_node;
+    node->int_value = 0;
+    node->slot = 0;
+    node->node_function = NULL;
+    node->node_1 = NULL;
+    node->node_2 = NULL;
+    node->node_3 = NULL;
+    return node;
+}
+
+void free_node(Node *node) {
+    if (node == NULL) {
+        return;
+    }
+
+    free_node(node->node_1);
+    free_node(node->node_2);
+    free_node(node->node_3);
+    free(node);
+}
+
+void free_node_function(NodeFunction *node_function) {
+    if (node_function == NULL) {
+        return;
+    }
+
+    free(node_function->captured_slots);
+    free(node_function->captured_vars);
+    free_node(node_function->node);
+    free(node_function);
+}
+
+static const NodeScope *find_node_scope(const NodeScope *scope, const Var *var) {
+    while (scope != NULL) {
+        if (is_same_var(scope->var, var)) {
+            return scope;
+        }
+
+        scope = scope->next;
+    }
+
+    return NULL;
+}
+
+static Node *compile_node(NodeFunction *node_function_enclosing, const NodeScope *scope, const Exp *exp);
+
+static NodeFunction *compile_node_function_impl(const NodeScope *scope,
+                                                const bool is_rec,
+                                                Var *var_rec,
+                                                Var *var,
+                                                Exp *exp_body,
+                                                Var **free_vars,
+                                                const int free_var_count) {
+    if (exp_body == NULL) {
+        return NULL;
+    }
+
+    NodeFunction *node_function = malloc(sizeof(NodeFunction));
+    node_function->node = NULL;
+    node_function->slot_count = 0;
+    node_function->is_rec = is_rec;
+    node_function->var_rec = var_rec;
+    node_function->var = var;
+    node_function->exp = exp_body;
+    node_function->captured_vars = NULL;
+    node_function->captured_slots = NULL;
+    node_function->captured_count = 0;
+
+    if (0 < free_var_count) {
+        node_function->captured_vars = malloc(sizeof(Var *) * free_var_count);
+        node_function->captured_slots = malloc(sizeof(int) * free_var_count);
+    }
+
+    for (const NodeScope *scope_enclosing = scope; scope_enclosing != NULL; scope_enclosing = scope_enclosing->next) {
+        bool is_free = false;
+        for (int i = 0; i < free_var_count; i++) {
+            if (is_same_var(free_vars[i], scope_enclosing->var)) {
+                is_free = true;
+                break;
+            }
+        }
+
+        for (int i = 0; is_free && i < node_function->captured_count; i++) {
+            if (is_same_var(node_function->captured_vars[i], scope_enclosing->var)) {
+                is_free = false;
+            }
+        }
+
+        if (is_free) {
+            node_function->captured_vars[node_function->captured_count] = (Var *) scope_enclosing->var;
+            node_function->captured_slots[node_function->captured_count] = scope_enclosing->slot;
+            node_function->captured_count++;
+        }
+    }
+
+    if (node_function->captured_count < free_var_count) {
+        free_node_function(node_function);
+        return NULL;
+    }
 
-            const Exp *exp_cond = exp->if_exp->exp_cond;
-            if (exp_cond == NULL) {
-                return NULL;
-            }
+    NodeScope *scopes_captured = NULL;
+    const NodeScope *scope_body = NULL;
+    if (0 < free_var_count) {
+        scopes_captured = malloc(sizeof(NodeScope) * free_var_count);
+        for (int i = free_var_count - 1; 0 <= i; i--) {
+            scopes_captured[i].var = node_function->captured_vars[i];
+            scopes_captured[i].slot = i;
+            scopes_captured[i].next = scope_body;
+            scope_body = &scopes_captured[i];
+        }
+    }
+    node_function->slot_count = free_var_count;
 
-            Value *value_cond = evaluate_impl(env, exp_cond);
-            if (value_cond == NULL) {
-                return NULL;
-            }
+    NodeScope scope_rec = { .var = var_rec, .slot = 0, .next = scope_body };
+    if (is_rec) {
+        scope_rec.slot = node_function->slot_count++;
+        scope_body = &scope_rec;
+    }
 
-            if (value_cond->type != BOOL_VALUE) {
-                free_value(value_cond);
-                return NULL;
-            }
+    NodeScope scope_new = { .var = var, .slot = 0, .next = scope_body };
+    if (var != NULL) {
+        scope_new.slot = node_function->slot_count++;
+        scope_body = &scope_new;
+    }
 
-            if (value_cond->bool_value) {
-                const Exp *exp_true = exp->if_exp->exp_true;
-                if (exp_true == NULL) {
-                    free_value(value_cond);
-                    return NULL;
-                }
+    node_function->node = compile_node(node_function, scope_body, exp_body);
+    free(scopes_captured);
+    if (node_function->node == NULL) {
+        free_node_function(node_function);
+        return NULL;
+    }
 
-                Value *value_true = evaluate_impl(env, exp_true);
-                if (value_true == NULL) {
-                    free_value(value_cond);
-                    return NULL;
-                }
+    return node_function;
+}
 
-                free_value(value_cond);
-                return value_true;
-            } else {
-                const Exp *exp_false = exp->if_exp->exp_false;
-                if (exp_false == NULL) {
-                    free_value(value_cond);
-                    return NULL;
-                }
+static Node *compile_op_node(NodeFunction *node_function_enclosing, const NodeScope *scope, const OpExp *op_exp) {
+    const Exp *exp_left = op_exp->exp_left;
+    const Exp *exp_right = op_exp->exp_right;
+    if (exp_left == NULL || exp_right == NULL) {
+        return NULL;
+    }
 
-                Value *value_false = evaluate_impl(env, exp_false);
-                if (value_false == NULL) {
-                    free_value(value_cond);
-                    return NULL;
-                }
+    bool is_commutative = op_exp->type == PLUS_OP_EXP || op_exp->type == TIMES_OP_EXP;
+    if (is_commutative && exp_left->type == INT_EXP && exp_right->type != INT_EXP) {
+        const Exp *exp_temp = exp_left;
+        exp_left = exp_right;
+        exp_right = exp_temp;
+    }
 
-                free_value(value_cond);
-                return value_false;
-            }
+    bool is_const = exp_right->type == INT_EXP;
+
+    Node *node = create_node(evaluate_int_op_node);
+    node->node_1 = compile_node(node_function_enclosing, scope, exp_left);
+    if (node->node_1 == NULL) {
+        free_node(node);
+        return NULL;
+    }
+
+    if (is_const) {
+        node->int_value = exp_right->int_exp->int_value;
+    } else {
+        node->node_2 = compile_node(node_function_enclosing, scope, exp_right);
+        if (node->node_2 == NULL) {
+            free_node(node);
+            return NULL;
         }
-        case LET_EXP: {
-            if (exp->let_exp == NULL) {
-                return NULL;
-            }
+    }
 
-            if (exp->let_exp->var == NULL) {
-                return NULL;
-            }
+    switch (op_exp->type) {
+        case PLUS_OP_EXP: {
+            node->int_handler = is_const ? evaluate_plus_const_node_int : evaluate_plus_node_int;
+            return node;
+        }
+        case MINUS_OP_EXP: {
+            node->int_handler = is_const ? evaluate_minus_const_node_int : evaluate_minus_node_int;
+            return node;
+        }
+        case TIMES_OP_EXP: {
+            node->int_handler = is_const ? evaluate_times_const_node_int : evaluate_times_node_int;
+            return node;
+        }
+        case LT_OP_EXP: {
+            node->handler = evaluate_bool_op_node;
+            node->bool_handler = is_const ? evaluate_lt_const_node_bool : evaluate_lt_node_bool;
+            return node;
+        }
+        default: {
+            free_node(node);
+            return NULL;
+        }
+    }
+}
 
-            if (exp->let_exp->exp_1 == NULL) {
+static Node *compile_node(NodeFunction *node_function_enclosing, const NodeScope *scope, const Exp *exp) {
+    if (exp == NULL) {
+        return NULL;
+    }
+
+    switch (exp->type) {
+        case INT_EXP: {
+            if (exp->int_exp == NULL) {
                 return NULL;
             }
 
-            if (exp->let_exp->exp_2 == NULL) {
+            Node *node = create_node(evaluate_int_const_node);
+            node->int_handler = evaluate_int_const_node_int;
+            node->int_value = exp->int_exp->int_value;
+            return node;
+        }
+        case BOOL_EXP: {
+            if (exp->bool_exp == NULL) {
                 return NULL;
             }
 
-            Value *value_1 = evaluate_impl(env, exp->let_exp->exp_1);
-            if (value_1 == NULL) {
+            Node *node = create_node(evaluate_bool_const_node);
+            node->bool_handler = evaluate_bool_const_node_bool;
+            node->int_value = exp->bool_exp->bool_value;
+            return node;
+        }
+        case VAR_EXP: {
+            if (exp->var_exp == NULL) {
                 return NULL;
             }
 
-            Env *env_new = create_appended_env(env, exp->let_exp->var, value_1);
-            if (env_new == NULL) {
-                free_value(value_1);
+            const NodeScope *scope_found = find_node_scope(scope, exp->var_exp->var);
+            if (scope_found == NULL) {
                 return NULL;
             }
 
-            Value *value_2 = evaluate_impl(env_new, exp->let_exp->exp_2);
-
-            free_env(env_new);
-            free_value(value_1);
-
-            return value_2;
+            Node *node = create_node(evaluate_slot_node);
+            node->int_handler = evaluate_slot_node_int;
+            node->bool_handler = evaluate_slot_node_bool;
+            node->slot = scope_found->slot;
+            return node;
         }
-        case FUN_EXP: {
-            if (exp->fun_exp == NULL) {
+        case OP_EXP: {
+            if (exp->op_exp == NULL) {
                 return NULL;
             }
 
-            if (exp->fun_exp->var == NULL) {
+            return compile_op_node(node_function_enclosing, scope, exp->op_exp);
+        }
+        case IF_EXP: {
+            if (exp->if_exp == NULL) {
                 return NULL;
             }
 
-            if (exp->fun_exp->exp == NULL) {
+            Node *node = create_node(evaluate_if_node);
+            node->int_handler = evaluate_if_node_int;
+            node->node_1 = compile_node(node_function_enclosing, scope, exp->if_exp->exp_cond);
+            node->node_2 = compile_node(node_function_enclosing, scope, exp->if_exp->exp_true);
+            node->node_3 = compile_node(node_function_enclosing, scope, exp->if_exp->exp_false);
+            if (node->node_1 == NULL || node->node_2 == NULL || node->node_3 == NULL) {
+                free_node(node);
                 return NULL;
             }
 
-            return create_closure_value(
-                create_closure(env, exp->fun_exp->var, exp->fun_exp->exp)
-            );
+            return node;
         }
-        case APP_EXP: {
-            if (exp->app_exp == NULL) {
+        case LET_EXP: {
+            if (exp->let_exp == NULL) {
                 return NULL;
             }
 
-            if (exp->app_exp->exp_1 == NULL) {
-                return NULL;
-            }
+            Node *node = create_node(evaluate_let_node);
+            node->node_1 = compile_node(node_function_enclosing, scope, exp->let_exp->exp_1);
+            node->slot = node_function_enclosing->slot_count++;
 
-            if (exp->app_exp->exp_2 == NULL) {
+            NodeScope scope_new = { .var = exp->let_exp->var, .slot = node->slot, .next = scope };
+            node->node_2 = compile_node(node_function_enclosing, &scope_new, exp->let_exp->exp_2);
+            if (node->node_1 == NULL || node->node_2 == NULL) {
+                free_node(node);
                 return NULL;
             }
 
-            Value *value_1 = evaluate_impl(env, exp->app_exp->exp_1);
-            if (value_1 == NULL) {
+            return node;
+        }
+        case FUN_EXP: {
+            FunExp *fun_exp = exp->fun_exp;
+            if (fun_exp == NULL || fun_exp->var == NULL) {
                 return NULL;
             }
 
-            switch (value_1->type) {
-                case CLOSURE_VALUE: {
-                    Closure *closure_value = value_1->closure_value;
-                    if (closure_value == NULL) {
-                        free_value(value_1);
-                        return NULL;
-                    }
-
-                    Value *value_2 = evaluate_impl(env, exp->app_exp->exp_2);
-                    if (value_2 == NULL) {
-                        free_value(value_1);
-                        return NULL;
-                    }
-
-                    Env *env_new = create_appended_env(
-                        closure_value->env,
-                        closure_value->var,
-                        value_2
-                    );
-                    if (env_new == NULL) {
-                        free_value(value_2);
-                        free_value(value_1);
-                        return NULL;
-                    }
-
-                    Value *value_3 = evaluate_impl(env_new, closure_value->exp);
-
-                    free_env(env_new);
-                    free_value(value_2);
-                    free_value(value_1);
-
-                    return value_3;
-                }
-                case REC_CLOSURE_VALUE: {
-                    RecClosure *rec_closure_value = value_1->rec_closure_value;
-                    if (rec_closure_value == NULL) {
-                        free_value(value_1);
-                        return NULL;
-                    }
-
-                    Value *value_2 = evaluate_impl(env, exp->app_exp->exp_2);
-                    if (value_2 == NULL) {
-                        free_value(value_1);
-                        return NULL;
-                    }
-
-                    Env *env_temp = create_appended_env(
-                        rec_closure_value->env,
-                        rec_closure_value->var_rec,
-                        value_1
-                    );
-                    if (env_temp == NULL) {
-                        free_value(value_2);
-                        free_value(value_1);
-                        return NULL;
-                    }
-
-                    Env *env_new = create_appended_env(
-                        env_temp,
-                        rec_closure_value->var,
-                        value_2
-                    );
-                    free_env(env_temp);
-                    if (env_new == NULL) {
-                        free_value(value_2);
-                        free_value(value_1);
-                        return NULL;
-                    }
-
-                    Value *value_3 = evaluate_impl(env_new, rec_closure_value->exp);
-
-                    free_env(env_new);
-                    free_value(value_2);
-                    free_value(value_1);
-
-                    return value_3;
-                }
-                default: {
-                    free_value(value_1);
+            if (fun_exp->node_function == NULL) {
+                Scope scope_bound = { .var = fun_exp->var, .next = NULL };
+                get_free_vars(&scope_bound, fun_exp->exp, &fun_exp->free_vars, &fun_exp->free_var_count);
+
+                fun_exp->node_function = compile_node_function_impl(
+                    scope,
+                    false,
+                    NULL,
+                    fun_exp->var,
+                    fun_exp->exp,
+                    fun_exp->free_vars,
+                    fun_exp->free_var_count
+                );
+                if (fun_exp->node_function == NULL) {
                     return NULL;
                 }
             }
+
+            Node *node = create_node(evaluate_fun_node);
+            node->node_function = fun_exp->node_function;
+            return node;
         }
-        case LET_REC_EXP: {
-            if (exp->let_rec_exp == NULL) {
+        case APP_EXP: {
+            if (exp->app_exp == NULL) {
                 return NULL;
             }
 
-            if (exp->let_rec_exp->var_rec == NULL) {
+            Node *node = create_node(evaluate_app_node);
+            node->int_handler = evaluate_app_node_int;
+            node->node_1 = compile_node(node_function_enclosing, scope, exp->app_exp->exp_1);
+            node->node_2 = compile_node(node_function_enclosing, scope, exp->app_exp->exp_2);
+            if (node->node_1 == NULL || node->node_2 == NULL) {
+                free_node(node);
                 return NULL;
             }
 
-            if (exp->let_rec_exp->var == NULL) {
+            return node;
+        }
+        case LET_REC_EXP: {
+            LetRecExp *let_rec_exp = exp->let_rec_exp;
+            if (let_rec_exp == NULL || let_rec_exp->var_rec == NULL || let_rec_exp->var == NULL) {
                 return NULL;
             }
 
-            if (exp->let_rec_exp->exp_1 == NULL) {
-                return NULL;
+            if (let_rec_exp->node_function == NULL) {
+                Scope scope_bound_rec = { .var = let_rec_exp->var_rec, .next = NULL };
+                Scope scope_bound = { .var = let_rec_exp->var, .next = &scope_bound_rec };
+                get_free_vars(
+                    &scope_bound,
+                    let_rec_exp->exp_1,
+                    &let_rec_exp->free_vars,
+                    &let_rec_exp->free_var_count
+                );
+
+                let_rec_exp->node_function = compile_node_function_impl(
+                    scope,
+                    true,
+                    let_rec_exp->var_rec,
+                    let_rec_exp->var,
+                    let_rec_exp->exp_1,
+                    let_rec_exp->free_vars,
+                    let_rec_exp->free_var_count
+                );
+                if (let_rec_exp->node_function == NULL) {
+                    return NULL;
+                }
             }
 
-            if (exp->let_rec_exp->exp_2 == NULL) {
-                return NULL;
-            }
+            Node *node = create_node(evaluate_let_rec_node);
+            node->node_function = let_rec_exp->node_function;
+            node->slot = node_function_enclosing->slot_count++;
 
-            Value *rec_closure_value = create_rec_closure_value(
-                create_rec_closure(
-                    env,
-                    exp->let_rec_exp->var_rec,
-                    exp->let_rec_exp->var,
-                    exp->let_rec_exp->exp_1
-                )
-            );
-            if (rec_closure_value == NULL) {
+            NodeScope scope_rec = { .var = let_rec_exp->var_rec, .slot = node->slot, .next = scope };
+            node->node_2 = compile_node(node_function_enclosing, &scope_rec, let_rec_exp->exp_2);
+            if (node->node_2 == NULL) {
+                free_node(node);
                 return NULL;
             }
 
-            Env *env_new = create_appended_env(
-                env,
-                exp->let_rec_exp->var_rec,
-                rec_closure_value
-            );
-            if (env_new == NULL) {
-                free_value(rec_closure_value);
-                return NULL;
-            }
+            return node;
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
 
-            Value *value = evaluate_impl(env_new, exp->let_rec_exp->exp_2);
+Value *evaluate_compiled(const Exp *exp) {
+    if (exp == NULL) {
+        return NULL;
+    }
 
-            free_env(env_new);
-            free_value(rec_closure_value);
+    NodeFunction *node_function = compile_node_function_impl(NULL, false, NULL, NULL, (Exp *) exp, NULL, 0);
+    if (node_function == NULL) {
+        return evaluate(exp);
+    }
 
-            return value;
-        }
-        default:
-            return NULL;
+    Value *slots_local[NODE_SLOT_COUNT_LOCAL];
+    Value **slots = node_function->slot_count <= NODE_SLOT_COUNT_LOCAL
+        ? slots_local
+        : malloc(sizeof(Value *) * node_function->slot_count);
+    enter_node_function(node_function, NULL, NULL, NULL, slots);
+
+    NodeFrame frame = { .slots = slots };
+    Value *value = node_function->node->handler(node_function->node, &frame);
+
+    leave_node_function(node_function, slots);
+    if (slots != slots_local) {
+        free(slots);
     }
+    free_node_function(node_function);
+    return value;
 }
 
 bool try_get_int_value_from_derivation(Derivation *derivation, int *int_value) {
@@ -2850,42 +4126,48 @@ bool fprint_env(FILE *fp, const Env *env) {
         return false;
     }
 
-    Env *env_reverse = create_copied_env(env);
-    VarBinding *var_binding_prev = NULL;
-    VarBinding *var_binding_current = env_reverse->var_binding;
-    while (var_binding_current != NULL) {
-        VarBinding *var_binding_next = var_binding_current->next;
+    size_t var_binding_count = 0;
+    for (VarBinding *var_binding = env->var_binding;
+         var_binding != NULL;
+         var_binding = var_binding->next) {
+        var_binding_count++;
+    }
 
-        var_binding_current->next = var_binding_prev;
+    if (var_binding_count == 0) {
+        return true;
+    }
 
-        var_binding_prev = var_binding_current;
-        var_binding_current = var_binding_next;
+    VarBinding **var_bindings = malloc(sizeof(VarBinding *) * var_binding_count);
+    size_t i = var_binding_count;
+    for (VarBinding *var_binding = env->var_binding;
+         var_binding != NULL;
+         var_binding = var_binding->next) {
+        i--;
+        var_bindings[i] = var_binding;
     }
-    env_reverse->var_binding = var_binding_prev;
 
-    VarBinding *var_binding = env_reverse->var_binding;
-    while (var_binding != NULL) {
+    for (i = 0; i < var_binding_count; i++) {
+        VarBinding *var_binding = var_bindings[i];
         if (var_binding->var == NULL || var_binding->value == NULL) {
-            free_env(env_reverse);
+            free(var_bindings);
             return false;
         }
 
         if (!fprint_var(fp, var_binding->var)) {
-            free_env(env_reverse);
+            free(var_bindings);
             return false;
         }
         fprintf(fp, " = ");
         if (!fprint_value(fp, var_binding->value)) {
-            free_env(env_reverse);
+            free(var_bindings);
             return false;
         }
-        if (var_binding->next != NULL) {
+        if (i + 1 < var_binding_count) {
             fprintf(fp, ", ");
         }
-        var_binding = var_binding->next;
     }
 
-    free_env(env_reverse);
+    free(var_bindings);
 
     return true;
 }
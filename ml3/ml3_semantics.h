@@ -6,6 +6,8 @@
 
 #define VAR_NAME_LEN_MAX (32)
 
+#define NODE_SLOT_COUNT_LOCAL (16)
+
 typedef struct {
     char *name;
     size_t name_len;
@@ -22,6 +24,8 @@ typedef struct ClosureTag Closure;
 
 typedef struct RecClosureTag RecClosure;
 
+typedef struct NodeFunctionTag NodeFunction;
+
 typedef struct {
     ValueType type;
     union {
@@ -36,6 +40,7 @@ typedef struct VarBindingTag {
     Var *var;
     Value *value;
     struct VarBindingTag *next;
+    size_t ref_count;
 } VarBinding;
 
 typedef struct {
@@ -97,6 +102,7 @@ struct ClosureTag {
     Env *env;
     Var *var;
     Exp *exp;
+    NodeFunction *node_function;
 };
 
 struct RecClosureTag {
@@ -104,6 +110,7 @@ struct RecClosureTag {
     Var *var_rec;
     Var *var;
     Exp *exp;
+    NodeFunction *node_function;
 };
 
 typedef enum {
@@ -134,6 +141,9 @@ struct LetExpTag {
 struct FunExpTag {
     Var *var;
     Exp *exp;
+    Var **free_vars;
+    int free_var_count;
+    NodeFunction *node_function;
 };
 
 struct AppExpTag {
@@ -146,6 +156,45 @@ struct LetRecExpTag {
     Var *var;
     Exp *exp_1;
     Exp *exp_2;
+    Var **free_vars;
+    int free_var_count;
+    NodeFunction *node_function;
+};
+
+typedef struct NodeTag Node;
+
+typedef struct {
+    Value **slots;
+} NodeFrame;
+
+typedef Value *(*NodeHandler)(const Node *node, NodeFrame *frame);
+
+typedef bool (*NodeIntHandler)(const Node *node, NodeFrame *frame, int *int_value);
+
+typedef bool (*NodeBoolHandler)(const Node *node, NodeFrame *frame, bool *bool_value);
+
+struct NodeTag {
+    NodeHandler handler;
+    NodeIntHandler int_handler;
+    NodeBoolHandler bool_handler;
+    int int_value;
+    int slot;
+    NodeFunction *node_function;
+    Node *node_1;
+    Node *node_2;
+    Node *node_3;
+};
+
+struct NodeFunctionTag {
+    Node *node;
+    int slot_count;
+    bool is_rec;
+    Var *var_rec;
+    Var *var;
+    Exp *exp;
+    Var **captured_vars;
+    int *captured_slots;
+    int captured_count;
 };
 
 typedef struct {
@@ -353,6 +402,10 @@ Env *create_appended_env(const Env *env, const Var *var, const Value *value);
 
 void free_env(Env *env);
 
+VarBinding *create_copied_var_binding(const VarBinding *var_binding);
+
+void free_var_binding(VarBinding *var_binding);
+
 Exp *create_int_exp(const int int_value);
 
 Exp *create_bool_exp(const bool bool_value);
@@ -379,10 +432,18 @@ Exp *create_let_rec_exp(Var *var_rec, Var *var, Exp *exp_1, Exp *exp_2);
 
 void free_exp(Exp *exp);
 
+Exp *fold_exp(Exp *exp);
+
 Value *evaluate(const Exp *exp);
 
 Value *evaluate_impl(const Env *env, const Exp *exp);
 
+void free_node(Node *node);
+
+void free_node_function(NodeFunction *node_function);
+
+Value *evaluate_compiled(const Exp *exp);
+
 bool try_get_int_value_from_derivation(Derivation *derivation, int *int_value);
 
 bool try_get_bool_value_from_derivation(Derivation *derivation, bool *bool_value);
@@ -22,11 +22,13 @@ void test1(void) {
     var_binding_1->var = create_var("x");
     var_binding_1->value = create_int_value(2);
     var_binding_1->next = NULL;
+    var_binding_1->ref_count = 1;
 
     VarBinding *var_binding_2 = malloc(sizeof(VarBinding));
     var_binding_2->var = create_var("hoge");
     var_binding_2->value = create_bool_value(true);
     var_binding_2->next = var_binding_1;
+    var_binding_2->ref_count = 1;
 
     Env *env = malloc(sizeof(Env));
     env->var_binding = var_binding_2;
@@ -286,6 +288,81 @@ void test9(void) {
     free_exp(exp1);
 }
 
+void test10(void) {
+    Exp *exp1 = create_let_exp(
+        create_var("k"),
+        create_int_exp(2),
+        create_let_rec_exp(
+            create_var("pow"),
+            create_var("n"),
+            create_if_exp(
+                create_lt_op_exp(
+                    create_var_exp(create_var("n")),
+                    create_int_exp(1)
+                ),
+                create_int_exp(1),
+                create_times_op_exp(
+                    create_var_exp(create_var("k")),
+                    create_app_exp(
+                        create_var_exp(create_var("pow")),
+                        create_minus_op_exp(
+                            create_var_exp(create_var("n")),
+                            create_int_exp(1)
+                        )
+                    )
+                )
+            ),
+            create_app_exp(
+                create_var_exp(create_var("pow")),
+                create_int_exp(10)
+            )
+        )
+    );
+
+    Value *value1 = evaluate_compiled(exp1);
+    fprint_value(stdout, value1);
+    printf("\n");
+    free_value(value1);
+
+    free_exp(exp1);
+}
+
+void test11(void) {
+    Exp *exp1 = create_let_exp(
+        create_var("y"),
+        create_int_exp(3),
+        create_plus_op_exp(
+            create_times_op_exp(
+                create_var_exp(create_var("y")),
+                create_int_exp(2)
+            ),
+            create_app_exp(
+                create_fun_exp(
+                    create_var("x"),
+                    create_plus_op_exp(
+                        create_var_exp(create_var("x")),
+                        create_plus_op_exp(
+                            create_int_exp(1),
+                            create_int_exp(1)
+                        )
+                    )
+                ),
+                create_int_exp(4)
+            )
+        )
+    );
+    exp1 = fold_exp(exp1);
+    fprint_exp(stdout, exp1);
+    printf("\n");
+
+    Value *value1 = evaluate(exp1);
+    fprint_value(stdout, value1);
+    printf("\n");
+    free_value(value1);
+
+    free_exp(exp1);
+}
+
 int main(void) {
 //    test1();
 //    test2();
@@ -296,6 +373,8 @@ int main(void) {
     test7();
     test8();
     test9();
+    test10();
+    test11();
 
     return 0;
 }
@@ -1,9 +1,15 @@
+#include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include "ml4_semantics.h"
 #include "ml4_derivation.h"
+#include "ml4_vm.h"
+#include "ml4_node.h"
+#include "ml4_jit.h"
+#include "ml4_emit.h"
 #include "y.tab.h"
 
 extern FILE *yyin;
@@ -22,180 +28,431 @@ extern bool is_interactive;
 
 typedef enum {
     OUTPUT_VALUE,
-    OUTPUT_DERIVATION
+    OUTPUT_DERIVATION,
+    OUTPUT_VM,
+    OUTPUT_CEK,
+    OUTPUT_CEK_DEPTH,
+    OUTPUT_COMPILED,
+    OUTPUT_MEMO,
+    OUTPUT_HASH_CONS,
+    OUTPUT_JIT,
+    OUTPUT_EMIT_C,
+    OUTPUT_STREAMED_DERIVATION,
+    OUTPUT_MEMO_DERIVATION,
+    OUTPUT_DERIVATION_SIZE
 } OutputType;
 
 const char *options[] = {
-    "--derivation"
+    "--derivation",
+    "--vm",
+    "--cek",
+    "--cek-depth",
+    "--compile",
+    "--memo",
+    "--hash-cons",
+    "--jit",
+    "--emit-c",
+    "--stream-derivation",
+    "--memo-derivation",
+    "--derivation-size"
 };
 
-int main(int argc, char *argv[]) {
-    if (2 < argc) {
-        printf("usage: ml4 [--derivation]\n");
-        return 1;
+const OutputType option_output_types[] = {
+    OUTPUT_DERIVATION,
+    OUTPUT_VM,
+    OUTPUT_CEK,
+    OUTPUT_CEK_DEPTH,
+    OUTPUT_COMPILED,
+    OUTPUT_MEMO,
+    OUTPUT_HASH_CONS,
+    OUTPUT_JIT,
+    OUTPUT_EMIT_C,
+    OUTPUT_STREAMED_DERIVATION,
+    OUTPUT_MEMO_DERIVATION,
+    OUTPUT_DERIVATION_SIZE
+};
+
+const int option_count = sizeof(options) / sizeof(options[0]);
+
+static bool is_derivation_output_type(const OutputType output_type) {
+    return output_type == OUTPUT_DERIVATION
+        || output_type == OUTPUT_STREAMED_DERIVATION
+        || output_type == OUTPUT_MEMO_DERIVATION
+        || output_type == OUTPUT_DERIVATION_SIZE;
+}
+
+static void print_usage(void) {
+    printf("usage: ml4 [--derivation | --vm | --cek | --cek-depth | --compile | --memo | --hash-cons | --jit | --emit-c"
+           " | --stream-derivation | --memo-derivation | --derivation-size]"
+           " [--max-derivation-nodes n] [--max-output-bytes n]\n");
+}
+
+static bool try_parse_size(const char *chars, size_t *size) {
+    if (!isdigit((unsigned char) chars[0])) {
+        return false;
     }
 
-    OutputType output_type = OUTPUT_VALUE;
+    char *chars_end;
+    unsigned long long value = strtoull(chars, &chars_end, 10);
+    if (*chars_end != '\0' || SIZE_MAX < value) {
+        return false;
+    }
 
-    if (argc == 2) {
-        if (strlen(options[0]) != strlen(argv[1])) {
-            printf("unknown option: %s\n", argv[1]);
-            printf("usage: ml4 [--derivation]\n");
-            return 1;
-        }
+    *size = (size_t) value;
+    return true;
+}
 
-        if (strncmp(options[0], argv[1], strlen(options[0])) != 0) {
-            printf("unknown option: %s\n", argv[1]);
-            printf("usage: ml4 [--derivation]\n");
-            return 1;
-        }
+static void reset_derivation_budget(DerivationBudget *derivation_budget) {
+    if (derivation_budget != NULL) {
+        derivation_budget->is_node_count_exceeded = false;
+        derivation_budget->is_output_size_exceeded = false;
+    }
+}
 
-        output_type = OUTPUT_DERIVATION;
+static void print_derivation_failure(const DerivationBudget *derivation_budget) {
+    if (derivation_budget != NULL && derivation_budget->is_node_count_exceeded) {
+        printf("derivation failed: more than %zu nodes\n", derivation_budget->node_count_max);
+    } else if (derivation_budget != NULL && derivation_budget->is_output_size_exceeded) {
+        printf("derivation failed: more than %zu bytes of output\n", derivation_budget->output_size_max);
+    } else {
+        printf("derivation failed\n");
     }
+}
 
-    Env *env_global = malloc(sizeof(Env));
-    env_global->var_binding = NULL;
+static void print_derivation(const Env *env,
+                             Exp *exp,
+                             const OutputType output_type,
+                             DerivationBudget *derivation_budget) {
+    DerivationMemo *derivation_memo = NULL;
+    if (output_type != OUTPUT_DERIVATION) {
+        derivation_memo = create_derivation_memo();
+    }
+    set_current_derivation_memo(derivation_memo);
+
+    reset_derivation_budget(derivation_budget);
+    Derivation *derivation = derive_impl(env, exp);
+    free_derivation_memo(derivation_memo);
+    if (derivation == NULL) {
+        print_derivation_failure(derivation_budget);
+        return;
+    }
 
-    is_interactive = true;
-    printf("# ");
-    while (yyparse() == 0) {
-        if (parsed_exp != NULL && parsed_def == NULL && filename == NULL) {
-            switch (output_type) {
-                case OUTPUT_VALUE: {
-                    Value *value = evaluate_impl(env_global, parsed_exp);
-                    if (value == NULL) {
-                        printf("evaluation failed\n");
-                        break;
-                    }
+    if (output_type == OUTPUT_DERIVATION_SIZE) {
+        printf("derivation: %zu nodes, %zu bytes\n",
+               derivation->sizes[0].node_count,
+               get_derivation_output_size(derivation));
+    } else {
+        fprint_derivation(stdout, derivation);
+        printf("\n");
+    }
+
+    free_derivation(derivation);
+}
+
+static Value *evaluate_exp(const OutputType output_type, const Env *env, const Exp *exp, size_t *depth) {
+    switch (output_type) {
+        case OUTPUT_VM: {
+            return evaluate_vm(env, exp);
+        }
+        case OUTPUT_CEK:
+        case OUTPUT_CEK_DEPTH: {
+            return evaluate_cek(env, exp, depth);
+        }
+        case OUTPUT_COMPILED: {
+            return evaluate_compiled(env, exp);
+        }
+        default: {
+            return evaluate_impl(env, exp);
+        }
+    }
+}
+
+static bool add_def(const OutputType output_type, Env *env, const Def *def) {
+    switch (output_type) {
+        case OUTPUT_VM: {
+            return add_def_to_env_vm(env, def);
+        }
+        case OUTPUT_CEK:
+        case OUTPUT_CEK_DEPTH: {
+            return add_def_to_env_cek(env, def);
+        }
+        case OUTPUT_COMPILED: {
+            return add_def_to_env_compiled(env, def);
+        }
+        default: {
+            return add_def_to_env(env, def);
+        }
+    }
+}
 
-                    printf("- = ");
-                    fprint_value(stdout, value);
-                    printf("\n");
+static void evaluate_phrase(const OutputType output_type, Env *env, DerivationBudget *derivation_budget) {
+    if (parsed_exp != NULL) {
+        if (!is_derivation_output_type(output_type)) {
+            parsed_exp = fold_exp(parsed_exp);
+        }
 
-                    free_value(value);
+        switch (output_type) {
+            case OUTPUT_DERIVATION:
+            case OUTPUT_MEMO_DERIVATION:
+            case OUTPUT_DERIVATION_SIZE: {
+                print_derivation(env, parsed_exp, output_type, derivation_budget);
+                break;
+            }
+            case OUTPUT_STREAMED_DERIVATION: {
+                reset_derivation_budget(derivation_budget);
+                if (!fprint_streamed_derivation(stdout, env, parsed_exp)) {
+                    print_derivation_failure(derivation_budget);
                     break;
                 }
-                case OUTPUT_DERIVATION: {
-                    Derivation *derivation = derive_impl(env_global, parsed_exp);
-                    if (derivation == NULL) {
-                        printf("derivation failed\n");
-                        break;
-                    }
 
-                    fprint_derivation(stdout, derivation);
-                    printf("\n");
+                printf("\n");
+                break;
+            }
+            default: {
+                resolve_exp(env, parsed_exp);
 
-                    free_derivation(derivation);
+                size_t depth = 0;
+                Value *value = evaluate_exp(output_type, env, parsed_exp, &depth);
+                if (value == NULL) {
+                    printf("evaluation failed\n");
                     break;
                 }
-                default: {
-                    break;
+
+                printf("- = ");
+                fprint_value(stdout, value);
+                printf("\n");
+                if (output_type == OUTPUT_CEK_DEPTH) {
+                    printf("cek depth: %zu\n", depth);
                 }
+
+                free_value(value);
+                break;
+            }
+        }
+
+        free_exp(parsed_exp);
+        parsed_exp = NULL;
+        return;
+    }
+
+    if (!is_derivation_output_type(output_type)) {
+        fold_def(parsed_def);
+        resolve_def(env, parsed_def);
+    }
+
+    if (!add_def(output_type, env, parsed_def)) {
+        printf("definition failed\n");
+        return;
+    }
+
+    VarBinding *var_binding = env->var_binding;
+    printf("val ");
+    fprint_var(stdout, var_binding->var);
+    printf(" = ");
+    switch (var_binding->value->type) {
+        case CLOSURE_VALUE: {
+            printf("<fun>");
+            break;
+        }
+        case REC_CLOSURE_VALUE: {
+            printf("<fun>");
+            break;
+        }
+        default: {
+            fprint_value(stdout, var_binding->value);
+            break;
+        }
+    }
+    printf("\n");
+
+    free_def(parsed_def);
+    parsed_def = NULL;
+}
+
+static int emit_c_program(void) {
+    Emitter *emitter = create_emitter();
+    if (emitter == NULL) {
+        fprintf(stderr, "emit failed\n");
+        return 1;
+    }
+
+    bool is_emitted = true;
+    is_interactive = false;
+    Arena *arena = create_arena();
+    set_current_arena(arena);
+    while (yyparse() == 0) {
+        set_current_arena(NULL);
+        if (parsed_exp == NULL && parsed_def == NULL) {
+            free_arena(arena);
+            arena = NULL;
+        }
+
+        if (parsed_exp != NULL && parsed_def == NULL && filename == NULL) {
+            parsed_exp = fold_exp(parsed_exp);
+            if (!add_exp_to_emitter(emitter, parsed_exp)) {
+                fprintf(stderr, "emit failed\n");
+                is_emitted = false;
             }
 
             free_exp(parsed_exp);
             parsed_exp = NULL;
         } else if (parsed_exp == NULL && parsed_def != NULL && filename == NULL) {
-            if (add_def_to_env(env_global, parsed_def)) {
-                VarBinding *var_binding = env_global->var_binding;
-                printf("val ");
-                fprint_var(stdout, var_binding->var);
-                printf(" = ");
-                switch (var_binding->value->type) {
-                    case CLOSURE_VALUE: {
-                        printf("<fun>");
-                        break;
-                    }
-                    case REC_CLOSURE_VALUE: {
-                        printf("<fun>");
-                        break;
-                    }
-                    default: {
-                        fprint_value(stdout, var_binding->value);
-                        break;
-                    }
-                }
-                printf("\n");
+            fold_def(parsed_def);
+            if (!add_def_to_emitter(emitter, parsed_def)) {
+                fprintf(stderr, "emit failed\n");
+                is_emitted = false;
+            }
 
-                free_def(parsed_def);
-                parsed_def = NULL;
+            free_def(parsed_def);
+            parsed_def = NULL;
+        } else if (parsed_exp == NULL && parsed_def == NULL && filename != NULL) {
+            fprintf(stderr, "use is not supported with --emit-c\n");
+            is_emitted = false;
+
+            free(filename);
+            filename = NULL;
+        } else {
+            break;
+        }
+
+        arena = create_arena();
+        set_current_arena(arena);
+    }
+    set_current_arena(NULL);
+    free_arena(arena);
+
+    if (is_emitted) {
+        fprint_emitter(stdout, emitter);
+    }
+    free_emitter(emitter);
+    return is_emitted ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    OutputType output_type = OUTPUT_VALUE;
+    bool is_output_type_set = false;
+    size_t node_count_max = SIZE_MAX;
+    size_t output_size_max = SIZE_MAX;
+    bool is_budget_set = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--max-derivation-nodes") == 0 || strcmp(argv[i], "--max-output-bytes") == 0) {
+            size_t size;
+            if (i + 1 == argc || !try_parse_size(argv[i + 1], &size)) {
+                printf("invalid value for %s\n", argv[i]);
+                print_usage();
+                return 1;
+            }
+
+            if (strcmp(argv[i], "--max-derivation-nodes") == 0) {
+                node_count_max = size;
             } else {
-                printf("definition failed\n");
+                output_size_max = size;
             }
+            is_budget_set = true;
+            i++;
+            continue;
+        }
+
+        if (is_output_type_set) {
+            print_usage();
+            return 1;
+        }
+
+        int option = 0;
+        while (option < option_count && strcmp(options[option], argv[i]) != 0) {
+            option++;
+        }
+
+        if (option == option_count) {
+            printf("unknown option: %s\n", argv[i]);
+            print_usage();
+            return 1;
+        }
+
+        output_type = option_output_types[option];
+        is_output_type_set = true;
+    }
+
+    if (is_budget_set && !is_derivation_output_type(output_type)) {
+        printf("derivation budgets require --derivation, --stream-derivation,"
+               " --memo-derivation or --derivation-size\n");
+        return 1;
+    }
+
+    if (output_type == OUTPUT_EMIT_C) {
+        return emit_c_program();
+    }
+
+    Env *env_global = malloc(sizeof(Env));
+    env_global->var_binding = NULL;
+
+    Memo *memo = NULL;
+    if (output_type == OUTPUT_MEMO) {
+        memo = create_memo(MEMO_SIZE_MAX);
+        set_current_memo(memo);
+    }
+
+    ValueTable *value_table = NULL;
+    if (output_type == OUTPUT_HASH_CONS) {
+        value_table = create_value_table();
+        set_current_value_table(value_table);
+    }
+
+    CodeTable *code_table = NULL;
+    if (output_type == OUTPUT_VM) {
+        code_table = create_code_table();
+        set_current_code_table(code_table);
+    }
+
+    DerivationBudget *derivation_budget = NULL;
+    if (is_budget_set || output_type == OUTPUT_DERIVATION_SIZE) {
+        derivation_budget = create_derivation_budget(node_count_max, output_size_max);
+        set_current_derivation_budget(derivation_budget);
+    }
+
+    set_jit_enabled(output_type == OUTPUT_JIT);
+
+    is_interactive = true;
+    printf("# ");
+    Arena *arena = create_arena();
+    set_current_arena(arena);
+    while (yyparse() == 0) {
+        set_current_arena(NULL);
+        if (parsed_exp == NULL && parsed_def == NULL) {
+            free_arena(arena);
+            arena = NULL;
+        }
+
+        if ((parsed_exp != NULL && parsed_def == NULL && filename == NULL)
+            || (parsed_exp == NULL && parsed_def != NULL && filename == NULL)) {
+            evaluate_phrase(output_type, env_global, derivation_budget);
         } else if (parsed_exp == NULL && parsed_def == NULL && filename != NULL) {
             FILE *fp = fopen(filename, "r");
             if (fp != NULL) {
                 yyrestart(fp);
                 is_interactive = false;
 
+                Arena *arena_file = create_arena();
+                set_current_arena(arena_file);
                 while (yyparse() == 0) {
-                    if (parsed_exp != NULL && parsed_def == NULL) {
-                        switch (output_type) {
-                            case OUTPUT_VALUE: {
-                                Value *value = evaluate_impl(env_global, parsed_exp);
-                                if (value == NULL) {
-                                    printf("evaluation failed\n");
-                                    break;
-                                }
-
-                                printf("- = ");
-                                fprint_value(stdout, value);
-                                printf("\n");
-
-                                free_value(value);
-                                break;
-                            }
-                            case OUTPUT_DERIVATION: {
-                                Derivation *derivation = derive_impl(env_global, parsed_exp);
-                                if (derivation == NULL) {
-                                    printf("derivation failed\n");
-                                    break;
-                                }
-
-                                fprint_derivation(stdout, derivation);
-                                printf("\n");
-
-                                free_derivation(derivation);
-                                break;
-                            }
-                            default: {
-                                break;
-                            }
-                        }
-
-                        free_exp(parsed_exp);
-                        parsed_exp = NULL;
-                    } else if (parsed_exp == NULL && parsed_def != NULL) {
-                        if (add_def_to_env(env_global, parsed_def)) {
-                            VarBinding *var_binding = env_global->var_binding;
-                            printf("val ");
-                            fprint_var(stdout, var_binding->var);
-                            printf(" = ");
-                            switch (var_binding->value->type) {
-                                case CLOSURE_VALUE: {
-                                    printf("<fun>");
-                                    break;
-                                }
-                                case REC_CLOSURE_VALUE: {
-                                    printf("<fun>");
-                                    break;
-                                }
-                                default: {
-                                    fprint_value(stdout, var_binding->value);
-                                    break;
-                                }
-                            }
-                            printf("\n");
-
-                            free_def(parsed_def);
-                            parsed_def = NULL;
-                        } else {
-                            printf("definition failed\n");
-                        }
+                    set_current_arena(NULL);
+                    if (parsed_exp == NULL && parsed_def == NULL) {
+                        free_arena(arena_file);
+                        arena_file = NULL;
+                    }
+
+                    if ((parsed_exp != NULL && parsed_def == NULL) || (parsed_exp == NULL && parsed_def != NULL)) {
+                        evaluate_phrase(output_type, env_global, derivation_budget);
                     } else {
                         break;
                     }
+
+                    arena_file = create_arena();
+                    set_current_arena(arena_file);
                 }
+                set_current_arena(NULL);
+                free_arena(arena_file);
 
                 is_interactive = true;
                 yyrestart(stdin);
@@ -209,13 +466,26 @@ int main(int argc, char *argv[]) {
             }
         } else {
             printf("\n");
+            free_memo(memo);
             free_env(env_global);
+            free_value_table(value_table);
+            free_code_table(code_table);
+            free_derivation_budget(derivation_budget);
             return 0;
         }
 
         printf("# ");
+
+        arena = create_arena();
+        set_current_arena(arena);
     }
+    set_current_arena(NULL);
+    free_arena(arena);
 
+    free_memo(memo);
     free_env(env_global);
+    free_value_table(value_table);
+    free_code_table(code_table);
+    free_derivation_budget(derivation_budget);
     return 0;
 }
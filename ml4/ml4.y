@@ -267,8 +267,8 @@ exp_app
 exp_primary
     : INT
     | MINUS INT {
-        $$ = create_int_exp(-$2->int_exp->int_value);
-        free_exp($2);
+        $2->int_exp->int_value = -$2->int_exp->int_value;
+        $$ = $2;
     }
     | BOOL
     | NIL {
@@ -1,4 +1,5 @@
 #include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,2421 +8,1800 @@
 #include "ml4_derivation.h"
 
 bool try_get_int_value_from_derivation(Derivation *derivation, int *int_value) {
-    if (derivation == NULL) {
+    if (derivation == NULL || derivation->value == NULL) {
         return false;
     }
 
-    switch (derivation->type) {
-        case INT_DERIVATION: {
-            if (derivation->int_derivation == NULL) {
-                return false;
-            }
-
-            *int_value = derivation->int_derivation->int_value;
-            return true;
-        }
-        case VAR_DERIVATION: {
-            if (derivation->var_derivation == NULL) {
-                return false;
-            }
+    if (derivation->value->type != INT_VALUE) {
+        return false;
+    }
 
-            Value *value = derivation->var_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+    *int_value = derivation->value->int_value;
+    return true;
+}
 
-            if (value->type != INT_VALUE) {
-                return false;
-            }
+bool try_get_bool_value_from_derivation(Derivation *derivation, bool *bool_value) {
+    if (derivation == NULL || derivation->value == NULL) {
+        return false;
+    }
 
-            *int_value = value->int_value;
-            return true;
-        }
-        case PLUS_DERIVATION: {
-            if (derivation->plus_derivation == NULL) {
-                return false;
-            }
+    if (derivation->value->type != BOOL_VALUE) {
+        return false;
+    }
 
-            *int_value = derivation->plus_derivation->int_value;
-            return true;
-        }
-        case MINUS_DERIVATION: {
-            if (derivation->minus_derivation == NULL) {
-                return false;
-            }
+    *bool_value = derivation->value->bool_value;
+    return true;
+}
 
-            *int_value = derivation->minus_derivation->int_value;
-            return true;
-        }
-        case TIMES_DERIVATION: {
-            if (derivation->times_derivation == NULL) {
-                return false;
-            }
+Value *create_value_from_derivation(Derivation *derivation) {
+    if (derivation == NULL) {
+        return NULL;
+    }
 
-            *int_value = derivation->times_derivation->int_value;
-            return true;
-        }
-        case IF_TRUE_DERIVATION: {
-            if (derivation->if_true_derivation == NULL) {
-                return false;
-            }
+    return create_copied_value(derivation->value);
+}
 
-            Value *value = derivation->if_true_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+static DerivationBudget *current_derivation_budget = NULL;
 
-            if (value->type != INT_VALUE) {
-                return false;
-            }
+static Derivation *create_derivation(const DerivationType type, const Env *env, Value *value) {
+    if (value == NULL) {
+        return NULL;
+    }
 
-            *int_value = value->int_value;
-            return true;
-        }
-        case IF_FALSE_DERIVATION: {
-            if (derivation->if_false_derivation == NULL) {
-                return false;
-            }
+    Derivation *derivation = NULL;
+    if (current_derivation_budget != NULL) {
+        derivation = malloc(sizeof(Derivation) + sizeof(DerivationSize));
+        derivation->sizes[0].node_count = 0;
+        derivation->sizes[0].output_size = 0;
+        derivation->sizes[0].line_count = 0;
+    } else {
+        derivation = malloc(sizeof(Derivation));
+    }
+    derivation->type = type;
+    derivation->env.var_binding = create_copied_var_binding(env->var_binding);
+    derivation->value = value;
+    derivation->ref_count = 1;
+    return derivation;
+}
 
-            Value *value = derivation->if_false_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+DerivationBudget *create_derivation_budget(const size_t node_count_max, const size_t output_size_max) {
+    DerivationBudget *derivation_budget = malloc(sizeof(DerivationBudget));
+    derivation_budget->node_count_max = node_count_max;
+    derivation_budget->output_size_max = output_size_max;
+    derivation_budget->is_node_count_exceeded = false;
+    derivation_budget->is_output_size_exceeded = false;
+    for (size_t i = 0; i < ENV_SIZE_CACHE_CAPACITY; i++) {
+        derivation_budget->env_size_cache[i].var_binding = NULL;
+        derivation_budget->env_size_cache[i].size = 0;
+    }
+    return derivation_budget;
+}
 
-            if (value->type != INT_VALUE) {
-                return false;
-            }
+void free_derivation_budget(DerivationBudget *derivation_budget) {
+    if (derivation_budget == NULL) {
+        return;
+    }
 
-            *int_value = value->int_value;
-            return true;
-        }
-        case LET_DERIVATION: {
-            if (derivation->let_derivation == NULL) {
-                return false;
-            }
+    if (current_derivation_budget == derivation_budget) {
+        current_derivation_budget = NULL;
+    }
+    for (size_t i = 0; i < ENV_SIZE_CACHE_CAPACITY; i++) {
+        free_var_binding(derivation_budget->env_size_cache[i].var_binding);
+    }
+    free(derivation_budget);
+}
 
-            Value *value = derivation->let_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+void set_current_derivation_budget(DerivationBudget *derivation_budget) {
+    current_derivation_budget = derivation_budget;
+}
 
-            if (value->type != INT_VALUE) {
-                return false;
-            }
+static size_t add_size(const size_t size_1, const size_t size_2) {
+    return SIZE_MAX - size_1 < size_2 ? SIZE_MAX : size_1 + size_2;
+}
 
-            *int_value = value->int_value;
-            return true;
-        }
-        case APP_DERIVATION: {
-            if (derivation->app_derivation == NULL) {
-                return false;
-            }
+static size_t get_int_size(const int int_value) {
+    size_t size = int_value < 0 ? 2 : 1;
+    unsigned int digits = int_value < 0 ? 0u - (unsigned int) int_value : (unsigned int) int_value;
+    while (10 <= digits) {
+        digits /= 10;
+        size++;
+    }
+    return size;
+}
 
-            Value *value = derivation->app_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+static size_t get_var_size(const Var *var) {
+    return var == NULL || var->name == NULL ? 0 : strlen(var->name);
+}
 
-            if (value->type != INT_VALUE) {
-                return false;
-            }
+static size_t get_exp_size(const Exp *exp) {
+    if (exp == NULL) {
+        return 0;
+    }
 
-            *int_value = value->int_value;
-            return true;
+    switch (exp->type) {
+        case INT_EXP: {
+            return get_int_size(exp->int_exp->int_value);
         }
-        case LET_REC_DERIVATION: {
-            if (derivation->let_rec_derivation == NULL) {
-                return false;
-            }
+        case BOOL_EXP: {
+            return strlen(exp->bool_exp->bool_value ? "true" : "false");
+        }
+        case VAR_EXP: {
+            return get_var_size(exp->var_exp->var);
+        }
+        case OP_EXP: {
+            return strlen("(") + get_exp_size(exp->op_exp->exp_left)
+                + strlen(" + ") + get_exp_size(exp->op_exp->exp_right) + strlen(")");
+        }
+        case IF_EXP: {
+            return strlen("(if ") + get_exp_size(exp->if_exp->exp_cond)
+                + strlen(" then ") + get_exp_size(exp->if_exp->exp_true)
+                + strlen(" else ") + get_exp_size(exp->if_exp->exp_false) + strlen(")");
+        }
+        case LET_EXP: {
+            return strlen("(let ") + get_var_size(exp->let_exp->var)
+                + strlen(" = ") + get_exp_size(exp->let_exp->exp_1)
+                + strlen(" in ") + get_exp_size(exp->let_exp->exp_2) + strlen(")");
+        }
+        case FUN_EXP: {
+            return strlen("(fun ") + get_var_size(exp->fun_exp->var)
+                + strlen(" -> ") + get_exp_size(exp->fun_exp->exp) + strlen(")");
+        }
+        case APP_EXP: {
+            return strlen("(") + get_exp_size(exp->app_exp->exp_1)
+                + strlen(" ") + get_exp_size(exp->app_exp->exp_2) + strlen(")");
+        }
+        case LET_REC_EXP: {
+            return strlen("(let rec ") + get_var_size(exp->let_rec_exp->var_rec)
+                + strlen(" = fun ") + get_var_size(exp->let_rec_exp->var)
+                + strlen(" -> ") + get_exp_size(exp->let_rec_exp->exp_1)
+                + strlen(" in ") + get_exp_size(exp->let_rec_exp->exp_2) + strlen(")");
+        }
+        case NIL_EXP: {
+            return strlen("[]");
+        }
+        case CONS_EXP: {
+            return strlen("(") + get_exp_size(exp->cons_exp->exp_elem)
+                + strlen(" :: ") + get_exp_size(exp->cons_exp->exp_list) + strlen(")");
+        }
+        case MATCH_EXP: {
+            return strlen("(match ") + get_exp_size(exp->match_exp->exp_list)
+                + strlen(" with [] -> ") + get_exp_size(exp->match_exp->exp_match_nil)
+                + strlen(" | ") + get_var_size(exp->match_exp->var_elem)
+                + strlen(" :: ") + get_var_size(exp->match_exp->var_list)
+                + strlen(" -> ") + get_exp_size(exp->match_exp->exp_match_cons) + strlen(")");
+        }
+        default: {
+            return 0;
+        }
+    }
+}
 
-            Value *value = derivation->let_rec_derivation->value;
-            if (value == NULL) {
-                return false;
+static size_t get_env_size(DerivationBudget *derivation_budget, VarBinding *var_binding);
+
+static size_t get_value_size(DerivationBudget *derivation_budget, const Value *value) {
+    size_t size = 0;
+    while (value != NULL) {
+        switch (value->type) {
+            case INT_VALUE: {
+                return add_size(size, get_int_size(value->int_value));
+            }
+            case BOOL_VALUE: {
+                return add_size(size, strlen(value->bool_value ? "true" : "false"));
+            }
+            case CLOSURE_VALUE: {
+                const Closure *closure = value->closure_value;
+                size = add_size(size, strlen("(") + strlen(")[fun ") + get_var_size(closure->var) + strlen(" -> "));
+                size = add_size(size, get_env_size(derivation_budget, closure->env->var_binding));
+                return add_size(size, get_exp_size(closure->exp) + strlen("]"));
+            }
+            case REC_CLOSURE_VALUE: {
+                const RecClosure *rec_closure = value->rec_closure_value;
+                size = add_size(size, strlen("(") + strlen(")[rec ") + get_var_size(rec_closure->var_rec));
+                size = add_size(size, strlen(" = fun ") + get_var_size(rec_closure->var) + strlen(" -> "));
+                size = add_size(size, get_env_size(derivation_budget, rec_closure->env->var_binding));
+                return add_size(size, get_exp_size(rec_closure->exp) + strlen("]"));
+            }
+            case NIL_VALUE: {
+                return add_size(size, strlen("[]"));
+            }
+            case CONS_VALUE: {
+                size = add_size(size, strlen("(") + strlen(" :: ") + strlen(")"));
+                size = add_size(size, get_value_size(derivation_budget, value->cons_value->value_elem));
+                value = value->cons_value->value_list;
+                break;
+            }
+            case PACKED_CONS_VALUE: {
+                const PackedChunk *chunk = value->packed_cons_value->chunk;
+                for (size_t i = 0; i < value->packed_cons_value->length; i++) {
+                    size = add_size(size, strlen("(") + get_int_size(chunk->int_values[i]) + strlen(" :: ") + strlen(")"));
+                }
+                value = chunk->value_list;
+                break;
             }
-
-            if (value->type != INT_VALUE) {
-                return false;
+            default: {
+                return size;
             }
-
-            *int_value = value->int_value;
-            return true;
         }
-        case APP_REC_DERIVATION: {
-            if (derivation->app_rec_derivation == NULL) {
-                return false;
-            }
+    }
+    return size;
+}
 
-            Value *value = derivation->app_rec_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+static size_t get_env_size(DerivationBudget *derivation_budget, VarBinding *var_binding) {
+    if (var_binding == NULL) {
+        return 0;
+    }
 
-            if (value->type != INT_VALUE) {
-                return false;
-            }
+    EnvSizeCacheEntry *entry =
+        &derivation_budget->env_size_cache[((uintptr_t) var_binding / sizeof(VarBinding)) % ENV_SIZE_CACHE_CAPACITY];
+    if (entry->var_binding == var_binding) {
+        return entry->size;
+    }
 
-            *int_value = value->int_value;
-            return true;
-        }
-        case MATCH_NIL_DERIVATION: {
-            if (derivation->match_nil_derivation == NULL) {
-                return false;
-            }
+    size_t size = get_var_size(var_binding->var) + strlen(" = ");
+    size = add_size(size, get_value_size(derivation_budget, var_binding->value));
+    if (var_binding->next != NULL) {
+        size = add_size(size, add_size(get_env_size(derivation_budget, var_binding->next), strlen(", ")));
+    }
 
-            Value *value = derivation->match_nil_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+    free_var_binding(entry->var_binding);
+    entry->var_binding = create_copied_var_binding(var_binding);
+    entry->size = size;
+    return size;
+}
 
-            if (value->type != INT_VALUE) {
-                return false;
-            }
+static size_t get_conclusion_size(DerivationBudget *derivation_budget,
+                                  const Env *env,
+                                  const Exp *exp,
+                                  const Value *value) {
+    size_t size = get_env_size(derivation_budget, env->var_binding);
+    if (env->var_binding != NULL) {
+        size = add_size(size, strlen(" "));
+    }
+    size = add_size(size, strlen("|- ") + get_exp_size(exp) + strlen(" evalto "));
+    return add_size(size, get_value_size(derivation_budget, value));
+}
 
-            *int_value = value->int_value;
-            return true;
-        }
-        case MATCH_CONS_DERIVATION: {
-            if (derivation->match_cons_derivation == NULL) {
-                return false;
-            }
+static size_t get_op_size(const char *op, const char *rule_op, const int int_left, const int int_right, const Value *value) {
+    return get_int_size(int_left) + strlen(" ") + strlen(op) + strlen(" ") + get_int_size(int_right)
+        + strlen(" is ") + get_value_size(NULL, value) + strlen(" by ") + strlen(rule_op) + strlen(" {}");
+}
 
-            Value *value = derivation->match_cons_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+size_t get_derivation_output_size(const Derivation *derivation) {
+    return add_size(derivation->sizes[0].output_size, strlen("\n"));
+}
 
-            if (value->type != INT_VALUE) {
-                return false;
-            }
+static size_t get_premise_output_size(const DerivationSize *premise_size) {
+    return add_size(premise_size->output_size, add_size(premise_size->line_count, premise_size->line_count));
+}
 
-            *int_value = value->int_value;
-            return true;
-        }
-        default: {
-            return false;
-        }
+static void set_judgment_size(DerivationSize *derivation_size,
+                              const size_t conclusion_size,
+                              const char *rule,
+                              const DerivationSize *premise_sizes[],
+                              const int premise_count,
+                              const size_t op_size) {
+    size_t node_count = 1;
+    size_t output_size = add_size(conclusion_size, strlen(" by ") + strlen(rule));
+    size_t line_count = 1;
+    if (premise_count == 0) {
+        output_size = add_size(output_size, strlen(" {}"));
+    } else {
+        output_size = add_size(output_size, strlen(" {\n"));
+        for (int i = 0; i < premise_count; i++) {
+            node_count = add_size(node_count, premise_sizes[i]->node_count);
+            output_size = add_size(output_size, get_premise_output_size(premise_sizes[i]));
+            line_count = add_size(line_count, premise_sizes[i]->line_count);
+            if (i + 1 < premise_count) {
+                output_size = add_size(output_size, strlen(";\n"));
+            }
+        }
+
+        if (0 < op_size) {
+            node_count = add_size(node_count, 1);
+            output_size = add_size(output_size, strlen(";\n") + strlen("  ") + op_size + strlen("\n"));
+            line_count = add_size(line_count, 1);
+        } else {
+            output_size = add_size(output_size, strlen("\n"));
+        }
+        output_size = add_size(output_size, strlen("}"));
+        line_count = add_size(line_count, 1);
     }
+
+    derivation_size->node_count = node_count;
+    derivation_size->output_size = output_size;
+    derivation_size->line_count = line_count;
 }
 
-bool try_get_bool_value_from_derivation(Derivation *derivation, bool *bool_value) {
-    if (derivation == NULL) {
+static bool is_within_derivation_budget(DerivationBudget *derivation_budget, const DerivationSize *derivation_size) {
+    if (derivation_budget->node_count_max < derivation_size->node_count) {
+        derivation_budget->is_node_count_exceeded = true;
+        return false;
+    }
+
+    if (derivation_budget->output_size_max < add_size(derivation_size->output_size, strlen("\n"))) {
+        derivation_budget->is_output_size_exceeded = true;
         return false;
     }
 
+    return true;
+}
+
+static bool set_derivation_size(DerivationBudget *derivation_budget, Derivation *derivation, const Exp *exp) {
+    const char *rule;
+    Derivation *premises[3];
+    int premise_count = 0;
+    size_t op_size = 0;
     switch (derivation->type) {
+        case INT_DERIVATION: {
+            rule = "E-Int";
+            break;
+        }
         case BOOL_DERIVATION: {
-            if (derivation->bool_derivation == NULL) {
-                return false;
-            }
-
-            *bool_value = derivation->bool_derivation->bool_value;
-            return true;
+            rule = "E-Bool";
+            break;
         }
         case VAR_DERIVATION: {
-            if (derivation->var_derivation == NULL) {
-                return false;
-            }
-
-            Value *value = derivation->var_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
-
-            if (value->type != BOOL_VALUE) {
-                return false;
-            }
-
-            *bool_value = value->bool_value;
-            return true;
+            rule = "E-Var";
+            break;
+        }
+        case PLUS_DERIVATION: {
+            rule = "E-Plus";
+            premises[premise_count++] = derivation->plus_derivation->premise_left;
+            premises[premise_count++] = derivation->plus_derivation->premise_right;
+            op_size = get_op_size("plus",
+                                  "B-Plus",
+                                  premises[0]->value->int_value,
+                                  premises[1]->value->int_value,
+                                  derivation->value);
+            break;
+        }
+        case MINUS_DERIVATION: {
+            rule = "E-Minus";
+            premises[premise_count++] = derivation->minus_derivation->premise_left;
+            premises[premise_count++] = derivation->minus_derivation->premise_right;
+            op_size = get_op_size("minus",
+                                  "B-Minus",
+                                  premises[0]->value->int_value,
+                                  premises[1]->value->int_value,
+                                  derivation->value);
+            break;
+        }
+        case TIMES_DERIVATION: {
+            rule = "E-Times";
+            premises[premise_count++] = derivation->times_derivation->premise_left;
+            premises[premise_count++] = derivation->times_derivation->premise_right;
+            op_size = get_op_size("times",
+                                  "B-Times",
+                                  premises[0]->value->int_value,
+                                  premises[1]->value->int_value,
+                                  derivation->value);
+            break;
         }
         case LT_DERIVATION: {
-            if (derivation->lt_derivation == NULL) {
-                return false;
-            }
-
-            *bool_value = derivation->lt_derivation->bool_value;
-            return true;
+            rule = "E-Lt";
+            premises[premise_count++] = derivation->lt_derivation->premise_left;
+            premises[premise_count++] = derivation->lt_derivation->premise_right;
+            op_size = get_op_size("less than",
+                                  "B-Lt",
+                                  premises[0]->value->int_value,
+                                  premises[1]->value->int_value,
+                                  derivation->value);
+            break;
         }
         case IF_TRUE_DERIVATION: {
-            if (derivation->if_true_derivation == NULL) {
-                return false;
-            }
-
-            Value *value = derivation->if_true_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
-
-            if (value->type != BOOL_VALUE) {
-                return false;
-            }
-
-            *bool_value = value->bool_value;
-            return true;
+            rule = "E-IfT";
+            premises[premise_count++] = derivation->if_true_derivation->premise_cond;
+            premises[premise_count++] = derivation->if_true_derivation->premise_true;
+            break;
         }
         case IF_FALSE_DERIVATION: {
-            if (derivation->if_false_derivation == NULL) {
-                return false;
-            }
-
-            Value *value = derivation->if_false_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
-
-            if (value->type != BOOL_VALUE) {
-                return false;
-            }
-
-            *bool_value = value->bool_value;
-            return true;
+            rule = "E-IfF";
+            premises[premise_count++] = derivation->if_false_derivation->premise_cond;
+            premises[premise_count++] = derivation->if_false_derivation->premise_false;
+            break;
         }
         case LET_DERIVATION: {
-            if (derivation->let_derivation == NULL) {
-                return false;
-            }
-
-            Value *value = derivation->let_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
-
-            if (value->type != BOOL_VALUE) {
-                return false;
-            }
-
-            *bool_value = value->bool_value;
-            return true;
+            rule = "E-Let";
+            premises[premise_count++] = derivation->let_derivation->premise_1;
+            premises[premise_count++] = derivation->let_derivation->premise_2;
+            break;
+        }
+        case FUN_DERIVATION: {
+            rule = "E-Fun";
+            break;
         }
         case APP_DERIVATION: {
-            if (derivation->app_derivation == NULL) {
-                return false;
-            }
-
-            Value *value = derivation->app_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
-
-            if (value->type != BOOL_VALUE) {
-                return false;
-            }
-
-            *bool_value = value->bool_value;
-            return true;
+            rule = "E-App";
+            premises[premise_count++] = derivation->app_derivation->premise_1;
+            premises[premise_count++] = derivation->app_derivation->premise_2;
+            premises[premise_count++] = derivation->app_derivation->premise_3;
+            break;
         }
         case LET_REC_DERIVATION: {
-            if (derivation->let_rec_derivation == NULL) {
-                return false;
-            }
-
-            Value *value = derivation->let_rec_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
-
-            if (value->type != BOOL_VALUE) {
-                return false;
-            }
-
-            *bool_value = value->bool_value;
-            return true;
+            rule = "E-LetRec";
+            premises[premise_count++] = derivation->let_rec_derivation->premise;
+            break;
         }
         case APP_REC_DERIVATION: {
-            if (derivation->app_rec_derivation == NULL) {
-                return false;
-            }
-
-            Value *value = derivation->app_rec_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
-
-            if (value->type != BOOL_VALUE) {
-                return false;
-            }
-
-            *bool_value = value->bool_value;
-            return true;
+            rule = "E-AppRec";
+            premises[premise_count++] = derivation->app_rec_derivation->premise_1;
+            premises[premise_count++] = derivation->app_rec_derivation->premise_2;
+            premises[premise_count++] = derivation->app_rec_derivation->premise_3;
+            break;
+        }
+        case NIL_DERIVATION: {
+            rule = "E-Nil";
+            break;
+        }
+        case CONS_DERIVATION: {
+            rule = "E-Cons";
+            premises[premise_count++] = derivation->cons_derivation->premise_elem;
+            premises[premise_count++] = derivation->cons_derivation->premise_list;
+            break;
         }
         case MATCH_NIL_DERIVATION: {
-            if (derivation->match_nil_derivation == NULL) {
-                return false;
-            }
-
-            Value *value = derivation->match_nil_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
-
-            if (value->type != BOOL_VALUE) {
-                return false;
-            }
-
-            *bool_value = value->bool_value;
-            return true;
+            rule = "E-MatchNil";
+            premises[premise_count++] = derivation->match_nil_derivation->premise_list;
+            premises[premise_count++] = derivation->match_nil_derivation->premise_match_nil;
+            break;
         }
         case MATCH_CONS_DERIVATION: {
-            if (derivation->match_cons_derivation == NULL) {
-                return false;
-            }
-
-            Value *value = derivation->match_cons_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
-
-            if (value->type != BOOL_VALUE) {
-                return false;
-            }
-
-            *bool_value = value->bool_value;
-            return true;
+            rule = "E-MatchCons";
+            premises[premise_count++] = derivation->match_cons_derivation->premise_list;
+            premises[premise_count++] = derivation->match_cons_derivation->premise_match_cons;
+            break;
         }
         default: {
             return false;
         }
     }
+
+    const DerivationSize *premise_sizes[3];
+    for (int i = 0; i < premise_count; i++) {
+        premise_sizes[i] = &premises[i]->sizes[0];
+    }
+
+    set_judgment_size(
+        &derivation->sizes[0],
+        get_conclusion_size(derivation_budget, &derivation->env, exp, derivation->value),
+        rule,
+        premise_sizes,
+        premise_count,
+        op_size
+    );
+    return true;
 }
 
-bool try_get_closure_value_from_derivation(Derivation *derivation, Closure *closure_value) {
-    if (derivation == NULL) {
-        return false;
+static DerivationMemo *current_derivation_memo = NULL;
+
+DerivationMemo *create_derivation_memo(void) {
+    DerivationMemo *derivation_memo = malloc(sizeof(DerivationMemo));
+    derivation_memo->buckets = calloc(DERIVATION_MEMO_BUCKET_COUNT_MIN, sizeof(DerivationMemoEntry *));
+    derivation_memo->bucket_count = DERIVATION_MEMO_BUCKET_COUNT_MIN;
+    derivation_memo->entry_count = 0;
+    return derivation_memo;
+}
+
+void free_derivation_memo(DerivationMemo *derivation_memo) {
+    if (derivation_memo == NULL) {
+        return;
     }
 
-    if (closure_value == NULL) {
-        return false;
+    for (size_t i = 0; i < derivation_memo->bucket_count; i++) {
+        DerivationMemoEntry *derivation_memo_entry = derivation_memo->buckets[i];
+        while (derivation_memo_entry != NULL) {
+            DerivationMemoEntry *derivation_memo_entry_next = derivation_memo_entry->next;
+            free_derivation(derivation_memo_entry->derivation);
+            free(derivation_memo_entry);
+            derivation_memo_entry = derivation_memo_entry_next;
+        }
     }
 
-    switch (derivation->type) {
-        case VAR_DERIVATION: {
-            if (derivation->var_derivation == NULL) {
-                return false;
-            }
+    if (current_derivation_memo == derivation_memo) {
+        current_derivation_memo = NULL;
+    }
+    free(derivation_memo->buckets);
+    free(derivation_memo);
+}
 
-            Value *value = derivation->var_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+void set_current_derivation_memo(DerivationMemo *derivation_memo) {
+    current_derivation_memo = derivation_memo;
+}
 
-            if (value->type != CLOSURE_VALUE) {
-                return false;
-            }
+static size_t hash_derivation_memo_key(const Env *env, const Exp *exp) {
+    size_t hash = hash_env(env);
+    hash ^= (size_t) exp + 0x9e3779b9u + (hash << 6) + (hash >> 2);
+    return hash ^ (hash >> 16);
+}
 
-            if (value->closure_value == NULL) {
-                return false;
-            }
+static void grow_derivation_memo_buckets(DerivationMemo *derivation_memo) {
+    size_t bucket_count_new = derivation_memo->bucket_count * 2;
+    DerivationMemoEntry **buckets_new = calloc(bucket_count_new, sizeof(DerivationMemoEntry *));
+    if (buckets_new == NULL) {
+        return;
+    }
 
-            if (!copy_closure(closure_value, value->closure_value)) {
-                return false;
-            }
+    for (size_t i = 0; i < derivation_memo->bucket_count; i++) {
+        DerivationMemoEntry *derivation_memo_entry = derivation_memo->buckets[i];
+        while (derivation_memo_entry != NULL) {
+            DerivationMemoEntry *derivation_memo_entry_next = derivation_memo_entry->next;
+            size_t j = derivation_memo_entry->hash & (bucket_count_new - 1);
+            derivation_memo_entry->next = buckets_new[j];
+            buckets_new[j] = derivation_memo_entry;
+            derivation_memo_entry = derivation_memo_entry_next;
+        }
+    }
 
-            return true;
+    free(derivation_memo->buckets);
+    derivation_memo->buckets = buckets_new;
+    derivation_memo->bucket_count = bucket_count_new;
+}
+
+static DerivationMemoEntry *find_derivation_memo_entry(const DerivationMemo *derivation_memo,
+                                                       const size_t hash,
+                                                       const Env *env,
+                                                       const Exp *exp) {
+    DerivationMemoEntry *derivation_memo_entry =
+        derivation_memo->buckets[hash & (derivation_memo->bucket_count - 1)];
+    while (derivation_memo_entry != NULL) {
+        if (derivation_memo_entry->hash == hash
+            && derivation_memo_entry->exp == exp
+            && is_same_env(&derivation_memo_entry->derivation->env, env)) {
+            return derivation_memo_entry;
         }
-        case IF_TRUE_DERIVATION: {
-            if (derivation->if_true_derivation == NULL) {
-                return false;
-            }
 
-            Value *value = derivation->if_true_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+        derivation_memo_entry = derivation_memo_entry->next;
+    }
 
-            if (value->type != CLOSURE_VALUE) {
-                return false;
-            }
+    return NULL;
+}
 
-            if (value->closure_value == NULL) {
-                return false;
-            }
+static Derivation *find_memo_derivation(const Env *env, const Exp *exp) {
+    DerivationMemo *derivation_memo = current_derivation_memo;
+    if (derivation_memo == NULL) {
+        return NULL;
+    }
 
-            if (!copy_closure(closure_value, value->closure_value)) {
-                return false;
-            }
+    size_t hash = hash_derivation_memo_key(env, exp);
+    DerivationMemoEntry *derivation_memo_entry = find_derivation_memo_entry(derivation_memo, hash, env, exp);
+    if (derivation_memo_entry == NULL) {
+        return NULL;
+    }
 
-            return true;
-        }
-        case IF_FALSE_DERIVATION: {
-            if (derivation->if_false_derivation == NULL) {
-                return false;
-            }
+    return create_copied_derivation(derivation_memo_entry->derivation);
+}
 
-            Value *value = derivation->if_false_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+static void add_memo_derivation(const Env *env, const Exp *exp, Derivation *derivation) {
+    DerivationMemo *derivation_memo = current_derivation_memo;
+    if (derivation_memo == NULL || derivation == NULL) {
+        return;
+    }
 
-            if (value->type != CLOSURE_VALUE) {
-                return false;
-            }
+    if (derivation_memo->bucket_count < derivation_memo->entry_count) {
+        grow_derivation_memo_buckets(derivation_memo);
+    }
 
-            if (value->closure_value == NULL) {
-                return false;
-            }
+    DerivationMemoEntry *derivation_memo_entry = malloc(sizeof(DerivationMemoEntry));
+    derivation_memo_entry->exp = exp;
+    derivation_memo_entry->derivation = create_copied_derivation(derivation);
+    derivation_memo_entry->hash = hash_derivation_memo_key(env, exp);
 
-            if (!copy_closure(closure_value, value->closure_value)) {
-                return false;
-            }
+    size_t i = derivation_memo_entry->hash & (derivation_memo->bucket_count - 1);
+    derivation_memo_entry->next = derivation_memo->buckets[i];
+    derivation_memo->buckets[i] = derivation_memo_entry;
+    derivation_memo->entry_count++;
+}
 
-            return true;
-        }
-        case LET_DERIVATION: {
-            if (derivation->let_derivation == NULL) {
-                return false;
-            }
+Derivation *derive(Exp *exp) {
+    if (exp == NULL) {
+        return NULL;
+    }
 
-            Value *value = derivation->let_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+    Env env = { .var_binding = NULL };
+    return derive_impl(&env, exp);
+}
 
-            if (value->type != CLOSURE_VALUE) {
-                return false;
-            }
+static Derivation *derive_node(const Env *env, Exp *exp) {
+    if (exp == NULL) {
+        return NULL;
+    }
 
-            if (value->closure_value == NULL) {
-                return false;
+    switch (exp->type) {
+        case INT_EXP: {
+            if (exp->int_exp == NULL) {
+                return NULL;
             }
 
-            if (!copy_closure(closure_value, value->closure_value)) {
-                return false;
+            Derivation *derivation = create_derivation(
+                INT_DERIVATION,
+                env,
+                create_int_value(exp->int_exp->int_value)
+            );
+            if (derivation == NULL) {
+                return NULL;
             }
 
-            return true;
+            derivation->int_derivation = malloc(sizeof(IntDerivation));
+            derivation->int_derivation->int_exp = exp->int_exp;
+            return derivation;
         }
-        case FUN_DERIVATION: {
-            if (derivation->fun_derivation == NULL) {
-                return false;
-            }
-
-            Closure *closure = derivation->fun_derivation->closure_value;
-            if (closure == NULL) {
-                return false;
+        case BOOL_EXP: {
+            if (exp->bool_exp == NULL) {
+                return NULL;
             }
 
-            if (!copy_closure(closure_value, closure)) {
-                return false;
+            Derivation *derivation = create_derivation(
+                BOOL_DERIVATION,
+                env,
+                create_bool_value(exp->bool_exp->bool_value)
+            );
+            if (derivation == NULL) {
+                return NULL;
             }
 
-            return true;
+            derivation->bool_derivation = malloc(sizeof(BoolDerivation));
+            derivation->bool_derivation->bool_exp = exp->bool_exp;
+            return derivation;
         }
-        case APP_DERIVATION: {
-            if (derivation->app_derivation == NULL) {
-                return false;
-            }
-
-            Value *value = derivation->app_derivation->value;
-            if (value == NULL) {
-                return false;
+        case VAR_EXP: {
+            if (exp->var_exp == NULL) {
+                return NULL;
             }
 
-            if (value->type != CLOSURE_VALUE) {
-                return false;
-            }
+            VarBinding *var_binding = env->var_binding;
+            while (var_binding != NULL) {
+                if (is_same_var(var_binding->var, exp->var_exp->var)) {
+                    Derivation *derivation = create_derivation(
+                        VAR_DERIVATION,
+                        env,
+                        create_copied_value(var_binding->value)
+                    );
+                    if (derivation == NULL) {
+                        return NULL;
+                    }
 
-            if (value->closure_value == NULL) {
-                return false;
-            }
+                    derivation->var_derivation = malloc(sizeof(VarDerivation));
+                    derivation->var_derivation->var_exp = exp->var_exp;
+                    return derivation;
+                }
 
-            if (!copy_closure(closure_value, value->closure_value)) {
-                return false;
+                var_binding = var_binding->next;
             }
 
-            return true;
+            return NULL;
         }
-        case LET_REC_DERIVATION: {
-            if (derivation->let_rec_derivation == NULL) {
-                return false;
+        case OP_EXP: {
+            if (exp->op_exp == NULL) {
+                return NULL;
             }
 
-            Value *value = derivation->let_rec_derivation->value;
-            if (value == NULL) {
-                return false;
+            Exp *exp_left = exp->op_exp->exp_left;
+            if (exp_left == NULL) {
+                return NULL;
             }
 
-            if (value->type != CLOSURE_VALUE) {
-                return false;
+            Exp *exp_right = exp->op_exp->exp_right;
+            if (exp_right == NULL) {
+                return NULL;
             }
 
-            if (value->closure_value == NULL) {
-                return false;
+            Derivation *premise_left = derive_impl(env, exp_left);
+            if (premise_left == NULL) {
+                return NULL;
             }
 
-            if (!copy_closure(closure_value, value->closure_value)) {
-                return false;
+            int int_value_left;
+            if (!try_get_int_value_from_derivation(premise_left, &int_value_left)) {
+                free_derivation(premise_left);
+                return NULL;
             }
 
-            return true;
-        }
-        case APP_REC_DERIVATION: {
-            if (derivation->app_rec_derivation == NULL) {
-                return false;
+            Derivation *premise_right = derive_impl(env, exp_right);
+            if (premise_right == NULL) {
+                free_derivation(premise_left);
+                return NULL;
             }
 
-            Value *value = derivation->app_rec_derivation->value;
-            if (value == NULL) {
-                return false;
+            int int_value_right;
+            if (!try_get_int_value_from_derivation(premise_right, &int_value_right)) {
+                free_derivation(premise_left);
+                free_derivation(premise_right);
+                return NULL;
             }
 
-            if (value->type != CLOSURE_VALUE) {
-                return false;
-            }
+            switch(exp->op_exp->type) {
+                case PLUS_OP_EXP: {
+                    Derivation *derivation = create_derivation(
+                        PLUS_DERIVATION,
+                        env,
+                        create_int_value(int_value_left + int_value_right)
+                    );
+                    if (derivation == NULL) {
+                        break;
+                    }
 
-            if (value->closure_value == NULL) {
-                return false;
-            }
+                    PlusDerivation *plus_derivation = malloc(sizeof(PlusDerivation));
+                    plus_derivation->premise_left = premise_left;
+                    plus_derivation->premise_right = premise_right;
+                    plus_derivation->op_exp = exp->op_exp;
 
-            if (!copy_closure(closure_value, value->closure_value)) {
-                return false;
-            }
+                    derivation->plus_derivation = plus_derivation;
+                    return derivation;
+                }
+                case MINUS_OP_EXP: {
+                    Derivation *derivation = create_derivation(
+                        MINUS_DERIVATION,
+                        env,
+                        create_int_value(int_value_left - int_value_right)
+                    );
+                    if (derivation == NULL) {
+                        break;
+                    }
 
-            return true;
-        }
-        case MATCH_NIL_DERIVATION: {
-            if (derivation->match_nil_derivation == NULL) {
-                return false;
-            }
+                    MinusDerivation *minus_derivation = malloc(sizeof(MinusDerivation));
+                    minus_derivation->premise_left = premise_left;
+                    minus_derivation->premise_right = premise_right;
+                    minus_derivation->op_exp = exp->op_exp;
 
-            Value *value = derivation->match_nil_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+                    derivation->minus_derivation = minus_derivation;
+                    return derivation;
+                }
+                case TIMES_OP_EXP: {
+                    Derivation *derivation = create_derivation(
+                        TIMES_DERIVATION,
+                        env,
+                        create_int_value(int_value_left * int_value_right)
+                    );
+                    if (derivation == NULL) {
+                        break;
+                    }
 
-            if (value->type != CLOSURE_VALUE) {
-                return false;
-            }
+                    TimesDerivation *times_derivation = malloc(sizeof(TimesDerivation));
+                    times_derivation->premise_left = premise_left;
+                    times_derivation->premise_right = premise_right;
+                    times_derivation->op_exp = exp->op_exp;
 
-            if (value->closure_value == NULL) {
-                return false;
-            }
+                    derivation->times_derivation = times_derivation;
+                    return derivation;
+                }
+                case LT_OP_EXP: {
+                    Derivation *derivation = create_derivation(
+                        LT_DERIVATION,
+                        env,
+                        create_bool_value(int_value_left < int_value_right)
+                    );
+                    if (derivation == NULL) {
+                        break;
+                    }
 
-            if (!copy_closure(closure_value, value->closure_value)) {
-                return false;
+                    LtDerivation *lt_derivation = malloc(sizeof(LtDerivation));
+                    lt_derivation->premise_left = premise_left;
+                    lt_derivation->premise_right = premise_right;
+                    lt_derivation->op_exp = exp->op_exp;
+
+                    derivation->lt_derivation = lt_derivation;
+                    return derivation;
+                }
+                default: {
+                    break;
+                }
             }
 
-            return true;
+            free_derivation(premise_left);
+            free_derivation(premise_right);
+            return NULL;
         }
-        case MATCH_CONS_DERIVATION: {
-            if (derivation->match_cons_derivation == NULL) {
-                return false;
+        case IF_EXP: {
+            if (exp->if_exp == NULL) {
+                return NULL;
             }
 
-            Value *value = derivation->match_cons_derivation->value;
-            if (value == NULL) {
-                return false;
+            Exp *exp_cond = exp->if_exp->exp_cond;
+            if (exp_cond == NULL) {
+                return NULL;
             }
 
-            if (value->type != CLOSURE_VALUE) {
-                return false;
+            Derivation *premise_cond = derive_impl(env, exp_cond);
+            if (premise_cond == NULL) {
+                return NULL;
             }
 
-            if (value->closure_value == NULL) {
-                return false;
+            bool bool_value_cond;
+            if (!try_get_bool_value_from_derivation(premise_cond, &bool_value_cond)) {
+                free_derivation(premise_cond);
+                return NULL;
             }
 
-            if (!copy_closure(closure_value, value->closure_value)) {
-                return false;
-            }
+            if (bool_value_cond) {
+                Exp *exp_true = exp->if_exp->exp_true;
+                if (exp_true == NULL) {
+                    free_derivation(premise_cond);
+                    return NULL;
+                }
 
-            return true;
-        }
-        default: {
-            return false;
-        }
-    }
-}
+                Derivation *premise_true = derive_impl(env, exp_true);
+                if (premise_true == NULL) {
+                    free_derivation(premise_cond);
+                    return NULL;
+                }
 
-bool try_get_rec_closure_value_from_derivation(Derivation *derivation,
-                                               RecClosure *rec_closure_value) {
-    if (derivation == NULL) {
-        return false;
-    }
+                Derivation *derivation = create_derivation(
+                    IF_TRUE_DERIVATION,
+                    env,
+                    create_copied_value(premise_true->value)
+                );
+                if (derivation == NULL) {
+                    free_derivation(premise_cond);
+                    free_derivation(premise_true);
+                    return NULL;
+                }
 
-    if (rec_closure_value == NULL) {
-        return false;
-    }
+                IfTrueDerivation *if_true_derivation = malloc(sizeof(IfTrueDerivation));
+                if_true_derivation->premise_cond = premise_cond;
+                if_true_derivation->premise_true = premise_true;
+                if_true_derivation->if_exp = exp->if_exp;
 
-    switch (derivation->type) {
-        case VAR_DERIVATION: {
-            if (derivation->var_derivation == NULL) {
-                return false;
-            }
+                derivation->if_true_derivation = if_true_derivation;
+                return derivation;
+            } else {
+                Exp *exp_false = exp->if_exp->exp_false;
+                if (exp_false == NULL) {
+                    free_derivation(premise_cond);
+                    return NULL;
+                }
 
-            Value *value = derivation->var_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+                Derivation *premise_false = derive_impl(env, exp_false);
+                if (premise_false == NULL) {
+                    free_derivation(premise_cond);
+                    return NULL;
+                }
 
-            if (value->type != REC_CLOSURE_VALUE) {
-                return false;
-            }
+                Derivation *derivation = create_derivation(
+                    IF_FALSE_DERIVATION,
+                    env,
+                    create_copied_value(premise_false->value)
+                );
+                if (derivation == NULL) {
+                    free_derivation(premise_cond);
+                    free_derivation(premise_false);
+                    return NULL;
+                }
 
-            if (value->rec_closure_value == NULL) {
-                return false;
-            }
+                IfFalseDerivation *if_false_derivation = malloc(sizeof(IfFalseDerivation));
+                if_false_derivation->premise_cond = premise_cond;
+                if_false_derivation->premise_false = premise_false;
+                if_false_derivation->if_exp = exp->if_exp;
 
-            if (!copy_rec_closure(rec_closure_value, value->rec_closure_value)) {
-                return false;
+                derivation->if_false_derivation = if_false_derivation;
+                return derivation;
             }
-
-            return true;
         }
-        case IF_TRUE_DERIVATION: {
-            if (derivation->if_true_derivation == NULL) {
-                return false;
-            }
-
-            Value *value = derivation->if_true_derivation->value;
-            if (value == NULL) {
-                return false;
+        case LET_EXP: {
+            if (exp->let_exp == NULL) {
+                return NULL;
             }
 
-            if (value->type != REC_CLOSURE_VALUE) {
-                return false;
+            if (exp->let_exp->var == NULL) {
+                return NULL;
             }
 
-            if (value->rec_closure_value == NULL) {
-                return false;
+            if (exp->let_exp->exp_1 == NULL) {
+                return NULL;
             }
 
-            if (!copy_rec_closure(rec_closure_value, value->rec_closure_value)) {
-                return false;
+            if (exp->let_exp->exp_2 == NULL) {
+                return NULL;
             }
 
-            return true;
-        }
-        case IF_FALSE_DERIVATION: {
-            if (derivation->if_false_derivation == NULL) {
-                return false;
+            Derivation *premise_1 = derive_impl(env, exp->let_exp->exp_1);
+            if (premise_1 == NULL) {
+                return NULL;
             }
 
-            Value *value = derivation->if_false_derivation->value;
-            if (value == NULL) {
-                return false;
+            Env *env_new = create_appended_env(env, exp->let_exp->var, premise_1->value);
+            if (env_new == NULL) {
+                free_derivation(premise_1);
+                return NULL;
             }
 
-            if (value->type != REC_CLOSURE_VALUE) {
-                return false;
+            Derivation *premise_2 = derive_impl(env_new, exp->let_exp->exp_2);
+            free_env(env_new);
+            if (premise_2 == NULL) {
+                free_derivation(premise_1);
+                return NULL;
             }
 
-            if (value->rec_closure_value == NULL) {
-                return false;
+            Derivation *derivation = create_derivation(
+                LET_DERIVATION,
+                env,
+                create_copied_value(premise_2->value)
+            );
+            if (derivation == NULL) {
+                free_derivation(premise_1);
+                free_derivation(premise_2);
+                return NULL;
             }
 
-            if (!copy_rec_closure(rec_closure_value, value->rec_closure_value)) {
-                return false;
-            }
+            LetDerivation *let_derivation = malloc(sizeof(LetDerivation));
+            let_derivation->premise_1 = premise_1;
+            let_derivation->premise_2 = premise_2;
+            let_derivation->let_exp = exp->let_exp;
 
-            return true;
+            derivation->let_derivation = let_derivation;
+            return derivation;
         }
-        case LET_DERIVATION: {
-            if (derivation->let_derivation == NULL) {
-                return false;
+        case FUN_EXP: {
+            if (exp->fun_exp == NULL) {
+                return NULL;
             }
 
-            Value *value = derivation->let_derivation->value;
-            if (value == NULL) {
-                return false;
+            if (exp->fun_exp->var == NULL) {
+                return NULL;
             }
 
-            if (value->type != REC_CLOSURE_VALUE) {
-                return false;
+            if (exp->fun_exp->exp == NULL) {
+                return NULL;
             }
 
-            if (value->rec_closure_value == NULL) {
-                return false;
+            Closure *closure_value = create_closure(env, exp->fun_exp->var, exp->fun_exp->exp);
+            if (closure_value == NULL) {
+                return NULL;
             }
 
-            if (!copy_rec_closure(rec_closure_value, value->rec_closure_value)) {
-                return false;
+            Derivation *derivation = create_derivation(
+                FUN_DERIVATION,
+                env,
+                create_closure_value(closure_value)
+            );
+            if (derivation == NULL) {
+                return NULL;
             }
 
-            return true;
+            derivation->fun_derivation = malloc(sizeof(FunDerivation));
+            derivation->fun_derivation->fun_exp = exp->fun_exp;
+            return derivation;
         }
-        case APP_DERIVATION: {
-            if (derivation->app_derivation == NULL) {
-                return false;
+        case APP_EXP: {
+            if (exp->app_exp == NULL) {
+                return NULL;
             }
 
-            Value *value = derivation->app_derivation->value;
-            if (value == NULL) {
-                return false;
+            if (exp->app_exp->exp_1 == NULL) {
+                return NULL;
             }
 
-            if (value->type != REC_CLOSURE_VALUE) {
-                return false;
+            if (exp->app_exp->exp_2 == NULL) {
+                return NULL;
             }
 
-            if (value->rec_closure_value == NULL) {
-                return false;
+            Derivation *derivation_shared = find_memo_derivation(env, exp);
+            if (derivation_shared != NULL) {
+                return derivation_shared;
             }
 
-            if (!copy_rec_closure(rec_closure_value, value->rec_closure_value)) {
-                return false;
+            Derivation *premise_1 = derive_impl(env, exp->app_exp->exp_1);
+            if (premise_1 == NULL) {
+                return NULL;
             }
 
-            return true;
-        }
-        case LET_REC_DERIVATION: {
-            if (derivation->let_rec_derivation == NULL) {
-                return false;
+            Value *value_1 = premise_1->value;
+            if (value_1->type != CLOSURE_VALUE && value_1->type != REC_CLOSURE_VALUE) {
+                free_derivation(premise_1);
+                return NULL;
             }
 
-            Value *value = derivation->let_rec_derivation->value;
-            if (value == NULL) {
-                return false;
+            Derivation *premise_2 = derive_impl(env, exp->app_exp->exp_2);
+            if (premise_2 == NULL) {
+                free_derivation(premise_1);
+                return NULL;
             }
 
-            if (value->type != REC_CLOSURE_VALUE) {
-                return false;
-            }
+            Value *value_2 = premise_2->value;
 
-            if (value->rec_closure_value == NULL) {
-                return false;
+            Env *env_new;
+            Exp *exp_body;
+            if (value_1->type == CLOSURE_VALUE) {
+                Closure *closure_value = value_1->closure_value;
+                env_new = create_appended_env(closure_value->env, closure_value->var, value_2);
+                exp_body = closure_value->exp;
+            } else {
+                RecClosure *rec_closure_value = value_1->rec_closure_value;
+                Env *env_temp = create_appended_env(
+                    rec_closure_value->env,
+                    rec_closure_value->var_rec,
+                    value_1
+                );
+                env_new = create_appended_env(env_temp, rec_closure_value->var, value_2);
+                free_env(env_temp);
+                exp_body = rec_closure_value->exp;
             }
-
-            if (!copy_rec_closure(rec_closure_value, value->rec_closure_value)) {
-                return false;
+            if (env_new == NULL) {
+                free_derivation(premise_1);
+                free_derivation(premise_2);
+                return NULL;
             }
 
-            return true;
-        }
-        case APP_REC_DERIVATION: {
-            if (derivation->app_rec_derivation == NULL) {
-                return false;
+            Derivation *premise_3 = derive_impl(env_new, exp_body);
+            free_env(env_new);
+            if (premise_3 == NULL) {
+                free_derivation(premise_1);
+                free_derivation(premise_2);
+                return NULL;
             }
 
-            Value *value = derivation->app_rec_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+            Derivation *derivation;
+            if (value_1->type == CLOSURE_VALUE) {
+                derivation = create_derivation(
+                    APP_DERIVATION,
+                    env,
+                    create_copied_value(premise_3->value)
+                );
 
-            if (value->type != REC_CLOSURE_VALUE) {
-                return false;
-            }
+                AppDerivation *app_derivation = malloc(sizeof(AppDerivation));
+                app_derivation->premise_1 = premise_1;
+                app_derivation->premise_2 = premise_2;
+                app_derivation->premise_3 = premise_3;
+                app_derivation->app_exp = exp->app_exp;
 
-            if (value->rec_closure_value == NULL) {
-                return false;
-            }
+                derivation->app_derivation = app_derivation;
+            } else {
+                derivation = create_derivation(
+                    APP_REC_DERIVATION,
+                    env,
+                    create_copied_value(premise_3->value)
+                );
 
-            if (!copy_rec_closure(rec_closure_value, value->rec_closure_value)) {
-                return false;
+                AppRecDerivation *app_rec_derivation = malloc(sizeof(AppRecDerivation));
+                app_rec_derivation->premise_1 = premise_1;
+                app_rec_derivation->premise_2 = premise_2;
+                app_rec_derivation->premise_3 = premise_3;
+                app_rec_derivation->app_exp = exp->app_exp;
+
+                derivation->app_rec_derivation = app_rec_derivation;
             }
 
-            return true;
+            add_memo_derivation(env, exp, derivation);
+            return derivation;
         }
-        case MATCH_NIL_DERIVATION: {
-            if (derivation->match_nil_derivation == NULL) {
-                return false;
+        case LET_REC_EXP: {
+            if (exp->let_rec_exp == NULL) {
+                return NULL;
             }
 
-            Value *value = derivation->match_nil_derivation->value;
-            if (value == NULL) {
-                return false;
+            if (exp->let_rec_exp->var_rec == NULL) {
+                return NULL;
             }
 
-            if (value->type != REC_CLOSURE_VALUE) {
-                return false;
+            if (exp->let_rec_exp->var == NULL) {
+                return NULL;
             }
 
-            if (value->rec_closure_value == NULL) {
-                return false;
+            if (exp->let_rec_exp->exp_1 == NULL) {
+                return NULL;
             }
 
-            if (!copy_rec_closure(rec_closure_value, value->rec_closure_value)) {
-                return false;
+            if (exp->let_rec_exp->exp_2 == NULL) {
+                return NULL;
             }
 
-            return true;
-        }
-        case MATCH_CONS_DERIVATION: {
-            if (derivation->match_cons_derivation == NULL) {
-                return false;
+            Value *rec_closure_value = create_rec_closure_value(
+                create_rec_closure(
+                    env,
+                    exp->let_rec_exp->var_rec,
+                    exp->let_rec_exp->var,
+                    exp->let_rec_exp->exp_1
+                )
+            );
+            if (rec_closure_value == NULL) {
+                return NULL;
             }
 
-            Value *value = derivation->match_cons_derivation->value;
-            if (value == NULL) {
-                return false;
+            Env *env_new = create_appended_env(
+                env,
+                exp->let_rec_exp->var_rec,
+                rec_closure_value
+            );
+            free_value(rec_closure_value);
+            if (env_new == NULL) {
+                return NULL;
             }
 
-            if (value->type != REC_CLOSURE_VALUE) {
-                return false;
+            Derivation *premise = derive_impl(env_new, exp->let_rec_exp->exp_2);
+            free_env(env_new);
+            if (premise == NULL) {
+                return NULL;
             }
 
-            if (value->rec_closure_value == NULL) {
-                return false;
-            }
+            Derivation *derivation = create_derivation(
+                LET_REC_DERIVATION,
+                env,
+                create_copied_value(premise->value)
+            );
 
-            if (!copy_rec_closure(rec_closure_value, value->rec_closure_value)) {
-                return false;
-            }
+            LetRecDerivation *let_rec_derivation = malloc(sizeof(LetRecDerivation));
+            let_rec_derivation->premise = premise;
+            let_rec_derivation->let_rec_exp = exp->let_rec_exp;
 
-            return true;
+            derivation->let_rec_derivation = let_rec_derivation;
+            return derivation;
         }
-        default: {
-            return false;
+        case NIL_EXP: {
+            return create_derivation(NIL_DERIVATION, env, create_nil_value());
         }
-    }
-}
-
-bool try_get_cons_value_from_derivation(Derivation *derivation, Cons *cons_value) {
-    if (derivation == NULL) {
-        return false;
-    }
-
-    if (cons_value == NULL) {
-        return false;
-    }
-
-    switch (derivation->type) {
-        case VAR_DERIVATION: {
-            if (derivation->var_derivation == NULL) {
-                return false;
-            }
-
-            Value *value = derivation->var_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
-
-            if (value->type != CONS_VALUE) {
-                return false;
-            }
-
-            if (value->cons_value == NULL) {
-                return false;
+        case CONS_EXP: {
+            if (exp->cons_exp == NULL) {
+                return NULL;
             }
 
-            if (!copy_cons(cons_value, value->cons_value)) {
-                return false;
+            Exp *exp_elem = exp->cons_exp->exp_elem;
+            if (exp_elem == NULL) {
+                return NULL;
             }
 
-            return true;
-        }
-        case IF_TRUE_DERIVATION: {
-            if (derivation->if_true_derivation == NULL) {
-                return false;
+            Exp *exp_list = exp->cons_exp->exp_list;
+            if (exp_list == NULL) {
+                return NULL;
             }
 
-            Value *value = derivation->if_true_derivation->value;
-            if (value == NULL) {
-                return false;
+            Derivation *premise_elem = derive_impl(env, exp_elem);
+            if (premise_elem == NULL) {
+                return NULL;
             }
 
-            if (value->type != CONS_VALUE) {
-                return false;
+            Derivation *premise_list = derive_impl(env, exp_list);
+            if (premise_list == NULL) {
+                free_derivation(premise_elem);
+                return NULL;
             }
 
-            if (value->cons_value == NULL) {
-                return false;
-            }
+            Derivation *derivation = create_derivation(
+                CONS_DERIVATION,
+                env,
+                create_cons_value(create_cons(premise_elem->value, premise_list->value))
+            );
 
-            if (!copy_cons(cons_value, value->cons_value)) {
-                return false;
-            }
+            ConsDerivation *cons_derivation = malloc(sizeof(ConsDerivation));
+            cons_derivation->premise_elem = premise_elem;
+            cons_derivation->premise_list = premise_list;
+            cons_derivation->cons_exp = exp->cons_exp;
 
-            return true;
+            derivation->cons_derivation = cons_derivation;
+            return derivation;
         }
-        case IF_FALSE_DERIVATION: {
-            if (derivation->if_false_derivation == NULL) {
-                return false;
+        case MATCH_EXP: {
+            if (exp->match_exp == NULL) {
+                return NULL;
             }
 
-            Value *value = derivation->if_false_derivation->value;
-            if (value == NULL) {
-                return false;
+            Exp *exp_list = exp->match_exp->exp_list;
+            if (exp_list == NULL) {
+                return NULL;
             }
 
-            if (value->type != CONS_VALUE) {
-                return false;
+            Derivation *premise_list = derive_impl(env, exp_list);
+            if (premise_list == NULL) {
+                return NULL;
             }
 
-            if (value->cons_value == NULL) {
-                return false;
-            }
+            Value *value_list = premise_list->value;
+            switch (value_list->type) {
+                case NIL_VALUE: {
+                    Exp *exp_match_nil = exp->match_exp->exp_match_nil;
+                    if (exp_match_nil == NULL) {
+                        free_derivation(premise_list);
+                        return NULL;
+                    }
 
-            if (!copy_cons(cons_value, value->cons_value)) {
-                return false;
-            }
+                    Derivation *premise_match_nil = derive_impl(env, exp_match_nil);
+                    if (premise_match_nil == NULL) {
+                        free_derivation(premise_list);
+                        return NULL;
+                    }
 
-            return true;
-        }
-        case LET_DERIVATION: {
-            if (derivation->let_derivation == NULL) {
-                return false;
-            }
+                    Derivation *derivation = create_derivation(
+                        MATCH_NIL_DERIVATION,
+                        env,
+                        create_copied_value(premise_match_nil->value)
+                    );
 
-            Value *value = derivation->let_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+                    MatchNilDerivation *match_nil_derivation = malloc(sizeof(MatchNilDerivation));
+                    match_nil_derivation->premise_list = premise_list;
+                    match_nil_derivation->premise_match_nil = premise_match_nil;
+                    match_nil_derivation->match_exp = exp->match_exp;
 
-            if (value->type != CONS_VALUE) {
-                return false;
-            }
+                    derivation->match_nil_derivation = match_nil_derivation;
+                    return derivation;
+                }
+                case CONS_VALUE:
+                case PACKED_CONS_VALUE: {
+                    Exp *exp_match_cons = exp->match_exp->exp_match_cons;
+                    if (exp_match_cons == NULL) {
+                        free_derivation(premise_list);
+                        return NULL;
+                    }
 
-            if (value->cons_value == NULL) {
-                return false;
-            }
+                    Value *value_elem;
+                    Value *value_subsequent_list;
+                    if (!try_get_elem_and_list(value_list, &value_elem, &value_subsequent_list)) {
+                        free_derivation(premise_list);
+                        return NULL;
+                    }
 
-            if (!copy_cons(cons_value, value->cons_value)) {
-                return false;
-            }
+                    Env *env_temp = create_appended_env(
+                        env,
+                        exp->match_exp->var_elem,
+                        value_elem
+                    );
+                    Env *env_new = create_appended_env(
+                        env_temp,
+                        exp->match_exp->var_list,
+                        value_subsequent_list
+                    );
+                    free_env(env_temp);
+                    free_value(value_subsequent_list);
+                    free_value(value_elem);
+                    if (env_new == NULL) {
+                        free_derivation(premise_list);
+                        return NULL;
+                    }
 
-            return true;
-        }
-        case APP_DERIVATION: {
-            if (derivation->app_derivation == NULL) {
-                return false;
-            }
+                    Derivation *premise_match_cons = derive_impl(env_new, exp_match_cons);
+                    free_env(env_new);
+                    if (premise_match_cons == NULL) {
+                        free_derivation(premise_list);
+                        return NULL;
+                    }
 
-            Value *value = derivation->app_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+                    Derivation *derivation = create_derivation(
+                        MATCH_CONS_DERIVATION,
+                        env,
+                        create_copied_value(premise_match_cons->value)
+                    );
 
-            if (value->type != CONS_VALUE) {
-                return false;
-            }
+                    MatchConsDerivation *match_cons_derivation = malloc(
+                        sizeof(MatchConsDerivation)
+                    );
+                    match_cons_derivation->premise_list = premise_list;
+                    match_cons_derivation->premise_match_cons = premise_match_cons;
+                    match_cons_derivation->match_exp = exp->match_exp;
 
-            if (value->cons_value == NULL) {
-                return false;
+                    derivation->match_cons_derivation = match_cons_derivation;
+                    return derivation;
+                }
+                default: {
+                    free_derivation(premise_list);
+                    return NULL;
+                }
             }
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
 
-            if (!copy_cons(cons_value, value->cons_value)) {
-                return false;
-            }
+Derivation *create_copied_derivation(const Derivation *derivation) {
+    if (derivation == NULL) {
+        return NULL;
+    }
 
-            return true;
+    Derivation *derivation_shared = (Derivation *) derivation;
+    derivation_shared->ref_count++;
+    return derivation_shared;
+}
+
+Derivation *derive_impl(const Env *env, Exp *exp) {
+    Derivation *derivation = derive_node(env, exp);
+    DerivationBudget *derivation_budget = current_derivation_budget;
+    if (derivation == NULL || derivation_budget == NULL) {
+        return derivation;
+    }
+
+    if (derivation->sizes[0].node_count == 0 && !set_derivation_size(derivation_budget, derivation, exp)) {
+        free_derivation(derivation);
+        return NULL;
+    }
+
+    if (!is_within_derivation_budget(derivation_budget, &derivation->sizes[0])) {
+        free_derivation(derivation);
+        return NULL;
+    }
+
+    return derivation;
+}
+
+void free_derivation(Derivation *derivation) {
+    if (derivation == NULL) {
+        return;
+    }
+
+    derivation->ref_count--;
+    if (0 < derivation->ref_count) {
+        return;
+    }
+
+    switch (derivation->type) {
+        case INT_DERIVATION: {
+            free(derivation->int_derivation);
+            break;
+        }
+        case BOOL_DERIVATION: {
+            free(derivation->bool_derivation);
+            break;
+        }
+        case VAR_DERIVATION: {
+            free(derivation->var_derivation);
+            break;
+        }
+        case PLUS_DERIVATION: {
+            free_derivation(derivation->plus_derivation->premise_left);
+            free_derivation(derivation->plus_derivation->premise_right);
+            free(derivation->plus_derivation);
+            break;
+        }
+        case MINUS_DERIVATION: {
+            free_derivation(derivation->minus_derivation->premise_left);
+            free_derivation(derivation->minus_derivation->premise_right);
+            free(derivation->minus_derivation);
+            break;
+        }
+        case TIMES_DERIVATION: {
+            free_derivation(derivation->times_derivation->premise_left);
+            free_derivation(derivation->times_derivation->premise_right);
+            free(derivation->times_derivation);
+            break;
+        }
+        case LT_DERIVATION: {
+            free_derivation(derivation->lt_derivation->premise_left);
+            free_derivation(derivation->lt_derivation->premise_right);
+            free(derivation->lt_derivation);
+            break;
+        }
+        case IF_TRUE_DERIVATION: {
+            free_derivation(derivation->if_true_derivation->premise_cond);
+            free_derivation(derivation->if_true_derivation->premise_true);
+            free(derivation->if_true_derivation);
+            break;
+        }
+        case IF_FALSE_DERIVATION: {
+            free_derivation(derivation->if_false_derivation->premise_cond);
+            free_derivation(derivation->if_false_derivation->premise_false);
+            free(derivation->if_false_derivation);
+            break;
+        }
+        case LET_DERIVATION: {
+            free_derivation(derivation->let_derivation->premise_1);
+            free_derivation(derivation->let_derivation->premise_2);
+            free(derivation->let_derivation);
+            break;
+        }
+        case FUN_DERIVATION: {
+            free(derivation->fun_derivation);
+            break;
+        }
+        case APP_DERIVATION: {
+            free_derivation(derivation->app_derivation->premise_1);
+            free_derivation(derivation->app_derivation->premise_2);
+            free_derivation(derivation->app_derivation->premise_3);
+            free(derivation->app_derivation);
+            break;
         }
         case LET_REC_DERIVATION: {
-            if (derivation->let_rec_derivation == NULL) {
-                return false;
-            }
+            free_derivation(derivation->let_rec_derivation->premise);
+            free(derivation->let_rec_derivation);
+            break;
+        }
+        case APP_REC_DERIVATION: {
+            free_derivation(derivation->app_rec_derivation->premise_1);
+            free_derivation(derivation->app_rec_derivation->premise_2);
+            free_derivation(derivation->app_rec_derivation->premise_3);
+            free(derivation->app_rec_derivation);
+            break;
+        }
+        case NIL_DERIVATION: {
+            break;
+        }
+        case CONS_DERIVATION: {
+            free_derivation(derivation->cons_derivation->premise_elem);
+            free_derivation(derivation->cons_derivation->premise_list);
+            free(derivation->cons_derivation);
+            break;
+        }
+        case MATCH_NIL_DERIVATION: {
+            free_derivation(derivation->match_nil_derivation->premise_list);
+            free_derivation(derivation->match_nil_derivation->premise_match_nil);
+            free(derivation->match_nil_derivation);
+            break;
+        }
+        case MATCH_CONS_DERIVATION: {
+            free_derivation(derivation->match_cons_derivation->premise_list);
+            free_derivation(derivation->match_cons_derivation->premise_match_cons);
+            free(derivation->match_cons_derivation);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
 
-            Value *value = derivation->let_rec_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+    free_value(derivation->value);
+    free_var_binding(derivation->env.var_binding);
+    free(derivation);
+}
+
+void fprint_indent(FILE *fp, const int level) {
+    for (int i = 0; i < level; i++) {
+        fprintf(fp, "  ");
+    }
+}
+
+bool fprint_derivation(FILE *fp, const Derivation *derivation) {
+    return fprint_derivation_impl(fp, derivation, 0);
+}
+
+bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int level) {
+    if (fp == NULL || derivation == NULL) {
+        return false;
+    }
 
-            if (value->type != CONS_VALUE) {
+    fprint_indent(fp, level);
+    switch (derivation->type) {
+        case INT_DERIVATION: {
+            if (derivation->int_derivation == NULL) {
                 return false;
             }
 
-            if (value->cons_value == NULL) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
+            if (derivation->env.var_binding != NULL) {
+                fprintf(fp, " ");
+            }
+            fprintf(fp, "|- ");
 
-            if (!copy_cons(cons_value, value->cons_value)) {
+            if (!fprint_int_exp(fp, derivation->int_derivation->int_exp)) {
                 return false;
             }
 
+            fprintf(fp, " evalto %d by E-Int {}", derivation->value->int_value);
+            if (level == 0) {
+                fprintf(fp, "\n");
+            }
             return true;
         }
-        case APP_REC_DERIVATION: {
-            if (derivation->app_rec_derivation == NULL) {
+        case BOOL_DERIVATION: {
+            if (derivation->bool_derivation == NULL) {
                 return false;
             }
 
-            Value *value = derivation->app_rec_derivation->value;
-            if (value == NULL) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
+            if (derivation->env.var_binding != NULL) {
+                fprintf(fp, " ");
+            }
+            fprintf(fp, "|- ");
 
-            if (value->type != CONS_VALUE) {
+            if (!fprint_bool_exp(fp, derivation->bool_derivation->bool_exp)) {
                 return false;
             }
 
-            if (value->cons_value == NULL) {
+            fprintf(fp,
+                    " evalto %s by E-Bool {}",
+                    derivation->value->bool_value ? "true" : "false");
+            if (level == 0) {
+                fprintf(fp, "\n");
+            }
+            return true;
+        }
+        case VAR_DERIVATION: {
+            if (derivation->var_derivation == NULL) {
                 return false;
             }
 
-            if (!copy_cons(cons_value, value->cons_value)) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
+            if (derivation->env.var_binding != NULL) {
+                fprintf(fp, " ");
+            }
+            fprintf(fp, "|- ");
 
-            return true;
-        }
-        case CONS_DERIVATION: {
-            if (derivation->cons_derivation == NULL) {
+            if (!fprint_var_exp(fp, derivation->var_derivation->var_exp)) {
                 return false;
             }
 
-            Cons *cons = derivation->cons_derivation->cons_value;
-            if (cons == NULL) {
+            Value *value = derivation->value;
+            if (value == NULL) {
                 return false;
             }
 
-            if (!copy_cons(cons_value, cons)) {
+            fprintf(fp, " evalto ");
+            if (!fprint_value(fp, value)) {
                 return false;
             }
-
+            fprintf(fp, " by E-Var {}");
+            if (level == 0) {
+                fprintf(fp, "\n");
+            }
             return true;
         }
-        case MATCH_NIL_DERIVATION: {
-            if (derivation->match_nil_derivation == NULL) {
+        case PLUS_DERIVATION: {
+            if (derivation->plus_derivation == NULL) {
                 return false;
             }
 
-            Value *value = derivation->match_nil_derivation->value;
-            if (value == NULL) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
+            if (derivation->env.var_binding != NULL) {
+                fprintf(fp, " ");
+            }
+            fprintf(fp, "|- ");
 
-            if (value->type != CONS_VALUE) {
+            if (!fprint_op_exp(fp, derivation->plus_derivation->op_exp)) {
                 return false;
             }
 
-            if (value->cons_value == NULL) {
+            Derivation *premise_left = derivation->plus_derivation->premise_left;
+
+            int int_value_left;
+            if (!try_get_int_value_from_derivation(premise_left, &int_value_left)) {
                 return false;
             }
 
-            if (!copy_cons(cons_value, value->cons_value)) {
+            Derivation *premise_right = derivation->plus_derivation->premise_right;
+
+            int int_value_right;
+            if (!try_get_int_value_from_derivation(premise_right, &int_value_right)) {
                 return false;
             }
 
+            fprintf(fp, " evalto %d by E-Plus {\n", derivation->value->int_value);
+            if (!fprint_derivation_impl(fp, premise_left, level + 1)) {
+                return false;
+            }
+            fprintf(fp, ";\n");
+            if (!fprint_derivation_impl(fp, premise_right, level + 1)) {
+                return false;
+            }
+            fprintf(fp, ";\n");
+            fprint_indent(fp, level + 1);
+            fprintf(fp,
+                    "%d plus %d is %d by B-Plus {}\n",
+                    int_value_left,
+                    int_value_right,
+                    derivation->value->int_value);
+            fprint_indent(fp, level);
+            fprintf(fp, "}");
+            if (level == 0) {
+                fprintf(fp, "\n");
+            }
             return true;
         }
-        case MATCH_CONS_DERIVATION: {
-            if (derivation->match_cons_derivation == NULL) {
+        case MINUS_DERIVATION: {
+            if (derivation->minus_derivation == NULL) {
                 return false;
             }
 
-            Value *value = derivation->match_cons_derivation->value;
-            if (value == NULL) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
+            if (derivation->env.var_binding != NULL) {
+                fprintf(fp, " ");
+            }
+            fprintf(fp, "|- ");
 
-            if (value->type != CONS_VALUE) {
+            if (!fprint_op_exp(fp, derivation->minus_derivation->op_exp)) {
                 return false;
             }
 
-            if (value->cons_value == NULL) {
+            Derivation *premise_left = derivation->minus_derivation->premise_left;
+
+            int int_value_left;
+            if (!try_get_int_value_from_derivation(premise_left, &int_value_left)) {
                 return false;
             }
 
-            if (!copy_cons(cons_value, value->cons_value)) {
+            Derivation *premise_right = derivation->minus_derivation->premise_right;
+
+            int int_value_right;
+            if (!try_get_int_value_from_derivation(premise_right, &int_value_right)) {
                 return false;
             }
 
+            fprintf(fp, " evalto %d by E-Minus {\n", derivation->value->int_value);
+            if (!fprint_derivation_impl(fp, premise_left, level + 1)) {
+                return false;
+            }
+            fprintf(fp, ";\n");
+            if (!fprint_derivation_impl(fp, premise_right, level + 1)) {
+                return false;
+            }
+            fprintf(fp, ";\n");
+            fprint_indent(fp, level + 1);
+            fprintf(fp,
+                    "%d minus %d is %d by B-Minus {}\n",
+                    int_value_left,
+                    int_value_right,
+                    derivation->value->int_value);
+            fprint_indent(fp, level);
+            fprintf(fp, "}");
+            if (level == 0) {
+                fprintf(fp, "\n");
+            }
             return true;
         }
-        default: {
-            return false;
-        }
-    }
-}
-
-Value *create_value_from_derivation(Derivation *derivation) {
-    if (derivation == NULL) {
-        return NULL;
-    }
-
-    switch (derivation->type) {
-        case INT_DERIVATION: {
-            if (derivation->int_derivation == NULL) {
-                return NULL;
-            }
-
-            return create_int_value(derivation->int_derivation->int_value);
-        }
-        case BOOL_DERIVATION: {
-            if (derivation->bool_derivation == NULL) {
-                return NULL;
-            }
-
-            return create_bool_value(derivation->bool_derivation->bool_value);
-        }
-        case VAR_DERIVATION: {
-            if (derivation->var_derivation == NULL) {
-                return NULL;
-            }
-
-            return create_copied_value(derivation->var_derivation->value);
-        }
-        case PLUS_DERIVATION: {
-            if (derivation->plus_derivation == NULL) {
-                return NULL;
-            }
-
-            return create_int_value(derivation->plus_derivation->int_value);
-        }
-        case MINUS_DERIVATION: {
-            if (derivation->minus_derivation == NULL) {
-                return NULL;
-            }
-
-            return create_int_value(derivation->minus_derivation->int_value);
-        }
         case TIMES_DERIVATION: {
             if (derivation->times_derivation == NULL) {
-                return NULL;
-            }
-
-            return create_int_value(derivation->times_derivation->int_value);
-        }
-        case LT_DERIVATION: {
-            if (derivation->lt_derivation == NULL) {
-                return NULL;
-            }
-
-            return create_bool_value(derivation->lt_derivation->bool_value);
-        }
-        case IF_TRUE_DERIVATION: {
-            if (derivation->if_true_derivation == NULL) {
-                return NULL;
-            }
-
-            return create_copied_value(derivation->if_true_derivation->value);
-        }
-        case IF_FALSE_DERIVATION: {
-            if (derivation->if_false_derivation == NULL) {
-                return NULL;
-            }
-
-            return create_copied_value(derivation->if_false_derivation->value);
-        }
-        case LET_DERIVATION: {
-            if (derivation->let_derivation == NULL) {
-                return NULL;
+                return false;
             }
 
-            return create_copied_value(derivation->let_derivation->value);
-        }
-        case FUN_DERIVATION: {
-            if (derivation->fun_derivation == NULL) {
-                return NULL;
+            if (!fprint_env(fp, &derivation->env)) {
+                return false;
             }
-
-            Closure *closure_value = create_copied_closure(
-                derivation->fun_derivation->closure_value
-            );
-            if (closure_value == NULL) {
-                return NULL;
+            if (derivation->env.var_binding != NULL) {
+                fprintf(fp, " ");
             }
+            fprintf(fp, "|- ");
 
-            return create_closure_value(closure_value);
-        }
-        case APP_DERIVATION: {
-            if (derivation->app_derivation == NULL) {
-                return NULL;
+            if (!fprint_op_exp(fp, derivation->times_derivation->op_exp)) {
+                return false;
             }
 
-            return create_copied_value(derivation->app_derivation->value);
-        }
-        case LET_REC_DERIVATION: {
-            if (derivation->let_rec_derivation == NULL) {
-                return NULL;
-            }
+            Derivation *premise_left = derivation->times_derivation->premise_left;
 
-            return create_copied_value(derivation->let_rec_derivation->value);
-        }
-        case APP_REC_DERIVATION: {
-            if (derivation->app_rec_derivation == NULL) {
-                return NULL;
+            int int_value_left;
+            if (!try_get_int_value_from_derivation(premise_left, &int_value_left)) {
+                return false;
             }
 
-            return create_copied_value(derivation->app_rec_derivation->value);
-        }
-        case NIL_DERIVATION: {
-            return create_nil_value();
-        }
-        case CONS_DERIVATION: {
-            if (derivation->cons_derivation == NULL) {
-                return NULL;
-            }
+            Derivation *premise_right = derivation->times_derivation->premise_right;
 
-            return create_cons_value(
-                create_copied_cons(derivation->cons_derivation->cons_value)
-            );
-        }
-        case MATCH_NIL_DERIVATION: {
-            if (derivation->match_nil_derivation == NULL) {
-                return NULL;
+            int int_value_right;
+            if (!try_get_int_value_from_derivation(premise_right, &int_value_right)) {
+                return false;
             }
 
-            return create_copied_value(derivation->match_nil_derivation->value);
-        }
-        case MATCH_CONS_DERIVATION: {
-            if (derivation->match_cons_derivation == NULL) {
-                return NULL;
+            fprintf(fp, " evalto %d by E-Times {\n", derivation->value->int_value);
+            if (!fprint_derivation_impl(fp, premise_left, level + 1)) {
+                return false;
             }
-
-            return create_copied_value(derivation->match_cons_derivation->value);
-        }
-        default: {
-            return NULL;
-        }
-    }
-}
-
-Derivation *derive(Exp *exp) {
-    if (exp == NULL) {
-        return NULL;
-    }
-
-    Env env = { .var_binding = NULL };
-    return derive_impl(&env, exp);
-}
-
-Derivation *derive_impl(const Env *env, Exp *exp) {
-    if (exp == NULL) {
-        return NULL;
-    }
-
-    switch (exp->type) {
-        case INT_EXP: {
-            if (exp->int_exp == NULL) {
-                return NULL;
+            fprintf(fp, ";\n");
+            if (!fprint_derivation_impl(fp, premise_right, level + 1)) {
+                return false;
             }
-
-            IntDerivation *int_derivation = malloc(sizeof(IntDerivation));
-            int_derivation->int_exp = exp->int_exp;
-            int_derivation->int_value = exp->int_exp->int_value;
-
-            Derivation *derivation = malloc(sizeof(Derivation));
-            derivation->type = INT_DERIVATION;
-            derivation->env = create_copied_env(env);
-            derivation->int_derivation = int_derivation;
-            return derivation;
-        }
-        case BOOL_EXP: {
-            if (exp->bool_exp == NULL) {
-                return NULL;
+            fprintf(fp, ";\n");
+            fprint_indent(fp, level + 1);
+            fprintf(fp,
+                    "%d times %d is %d by B-Times {}\n",
+                    int_value_left,
+                    int_value_right,
+                    derivation->value->int_value);
+            fprint_indent(fp, level);
+            fprintf(fp, "}");
+            if (level == 0) {
+                fprintf(fp, "\n");
             }
-
-            BoolDerivation *bool_derivation = malloc(sizeof(BoolDerivation));
-            bool_derivation->bool_exp = exp->bool_exp;
-            bool_derivation->bool_value = exp->bool_exp->bool_value;
-
-            Derivation *derivation = malloc(sizeof(Derivation));
-            derivation->type = BOOL_DERIVATION;
-            derivation->env = create_copied_env(env);
-            derivation->bool_derivation = bool_derivation;
-            return derivation;
+            return true;
         }
-        case VAR_EXP: {
-            if (exp->var_exp == NULL) {
-                return NULL;
-            }
-
-            VarBinding *var_binding = env->var_binding;
-            while (var_binding != NULL) {
-                if (is_same_var(var_binding->var, exp->var_exp->var)) {
-                    VarDerivation *var_derivation = malloc(sizeof(VarDerivation));
-                    var_derivation->var_exp = exp->var_exp;
-                    var_derivation->value = create_copied_value(var_binding->value);
-
-                    Derivation *derivation = malloc(sizeof(Derivation));
-                    derivation->type = VAR_DERIVATION;
-                    derivation->env = create_copied_env(env);
-                    derivation->var_derivation = var_derivation;
-                    return derivation;
-                }
-
-                var_binding = var_binding->next;
+        case LT_DERIVATION: {
+            if (derivation->lt_derivation == NULL) {
+                return false;
             }
 
-            return NULL;
-        }
-        case OP_EXP: {
-            if (exp->op_exp == NULL) {
-                return NULL;
+            if (!fprint_env(fp, &derivation->env)) {
+                return false;
             }
-
-            Exp *exp_left = exp->op_exp->exp_left;
-            if (exp_left == NULL) {
-                return NULL;
+            if (derivation->env.var_binding != NULL) {
+                fprintf(fp, " ");
             }
+            fprintf(fp, "|- ");
 
-            Exp *exp_right = exp->op_exp->exp_right;
-            if (exp_right == NULL) {
-                return NULL;
+            if (!fprint_op_exp(fp, derivation->lt_derivation->op_exp)) {
+                return false;
             }
 
-            Derivation *premise_left = derive_impl(env, exp_left);
-            if (premise_left == NULL) {
-                return NULL;
-            }
+            Derivation *premise_left = derivation->lt_derivation->premise_left;
 
             int int_value_left;
-            if (!try_get_int_value_from_derivation(premise_left, &int_value_left)) {
-                free_derivation(premise_left);
-                return NULL;
-            }
-
-            Derivation *premise_right = derive_impl(env, exp_right);
-            if (premise_right == NULL) {
-                free_derivation(premise_left);
-                return NULL;
-            }
-
-            int int_value_right;
-            if (!try_get_int_value_from_derivation(premise_right, &int_value_right)) {
-                free_derivation(premise_left);
-                free_derivation(premise_right);
-                return NULL;
-            }
-
-            switch(exp->op_exp->type) {
-                case PLUS_OP_EXP: {
-                    PlusDerivation *plus_derivation = malloc(sizeof(PlusDerivation));
-                    plus_derivation->premise_left = premise_left;
-                    plus_derivation->premise_right = premise_right;
-                    plus_derivation->op_exp = exp->op_exp;
-                    plus_derivation->int_value = int_value_left + int_value_right;
-
-                    Derivation *derivation = malloc(sizeof(Derivation));
-                    derivation->type = PLUS_DERIVATION;
-                    derivation->env = create_copied_env(env);
-                    derivation->plus_derivation = plus_derivation;
-                    return derivation;
-                }
-                case MINUS_OP_EXP: {
-                    MinusDerivation *minus_derivation = malloc(sizeof(MinusDerivation));
-                    minus_derivation->premise_left = premise_left;
-                    minus_derivation->premise_right = premise_right;
-                    minus_derivation->op_exp = exp->op_exp;
-                    minus_derivation->int_value = int_value_left - int_value_right;
-
-                    Derivation *derivation = malloc(sizeof(Derivation));
-                    derivation->type = MINUS_DERIVATION;
-                    derivation->env = create_copied_env(env);
-                    derivation->minus_derivation = minus_derivation;
-                    return derivation;
-                }
-                case TIMES_OP_EXP: {
-                    TimesDerivation *times_derivation = malloc(sizeof(TimesDerivation));
-                    times_derivation->premise_left = premise_left;
-                    times_derivation->premise_right = premise_right;
-                    times_derivation->op_exp = exp->op_exp;
-                    times_derivation->int_value = int_value_left * int_value_right;
-
-                    Derivation *derivation = malloc(sizeof(Derivation));
-                    derivation->type = TIMES_DERIVATION;
-                    derivation->env = create_copied_env(env);
-                    derivation->times_derivation = times_derivation;
-                    return derivation;
-                }
-                case LT_OP_EXP: {
-                    LtDerivation *lt_derivation = malloc(sizeof(LtDerivation));
-                    lt_derivation->premise_left = premise_left;
-                    lt_derivation->premise_right = premise_right;
-                    lt_derivation->op_exp = exp->op_exp;
-                    lt_derivation->bool_value = int_value_left < int_value_right;
-
-                    Derivation *derivation = malloc(sizeof(Derivation));
-                    derivation->type = LT_DERIVATION;
-                    derivation->env = create_copied_env(env);
-                    derivation->lt_derivation = lt_derivation;
-                    return derivation;
-                }
-                default: {
-                    return NULL;
-                }
-            }
-        }
-        case IF_EXP: {
-            if (exp->if_exp == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_cond = exp->if_exp->exp_cond;
-            if (exp_cond == NULL) {
-                return NULL;
-            }
-
-            Derivation *premise_cond = derive_impl(env, exp_cond);
-            if (premise_cond == NULL) {
-                return NULL;
-            }
-
-            bool bool_value_cond;
-            if (!try_get_bool_value_from_derivation(premise_cond, &bool_value_cond)) {
-                free_derivation(premise_cond);
-                return NULL;
-            }
-
-            if (bool_value_cond) {
-                Exp *exp_true = exp->if_exp->exp_true;
-                if (exp_true == NULL) {
-                    free_derivation(premise_cond);
-                    return NULL;
-                }
-
-                Derivation *premise_true = derive_impl(env, exp_true);
-                if (premise_true == NULL) {
-                    free_derivation(premise_cond);
-                    return NULL;
-                }
-
-                Value *value_true = create_value_from_derivation(premise_true);
-                if (value_true == NULL) {
-                    free_derivation(premise_cond);
-                    free_derivation(premise_true);
-                    return NULL;
-                }
-
-                IfTrueDerivation *if_true_derivation = malloc(sizeof(IfTrueDerivation));
-                if_true_derivation->premise_cond = premise_cond;
-                if_true_derivation->premise_true = premise_true;
-                if_true_derivation->if_exp = exp->if_exp;
-                if_true_derivation->value = value_true;
-
-                Derivation *derivation = malloc(sizeof(Derivation));
-                derivation->type = IF_TRUE_DERIVATION;
-                derivation->env = create_copied_env(env);
-                derivation->if_true_derivation = if_true_derivation;
-                return derivation;
-            } else {
-                Exp *exp_false = exp->if_exp->exp_false;
-                if (exp_false == NULL) {
-                    free_derivation(premise_cond);
-                    return NULL;
-                }
-
-                Derivation *premise_false = derive_impl(env, exp_false);
-                if (premise_false == NULL) {
-                    free_derivation(premise_cond);
-                    return NULL;
-                }
-
-                Value *value_false = create_value_from_derivation(premise_false);
-                if (value_false == NULL) {
-                    free_derivation(premise_cond);
-                    free_derivation(premise_false);
-                    return NULL;
-                }
-
-                IfFalseDerivation *if_false_derivation = malloc(sizeof(IfFalseDerivation));
-                if_false_derivation->premise_cond = premise_cond;
-                if_false_derivation->premise_false = premise_false;
-                if_false_derivation->if_exp = exp->if_exp;
-                if_false_derivation->value = value_false;
-
-                Derivation *derivation = malloc(sizeof(Derivation));
-                derivation->type = IF_FALSE_DERIVATION;
-                derivation->env = create_copied_env(env);
-                derivation->if_false_derivation = if_false_derivation;
-                return derivation;
-            }
-        }
-        case LET_EXP: {
-            if (exp->let_exp == NULL) {
-                return NULL;
-            }
-
-            if (exp->let_exp->var == NULL) {
-                return NULL;
-            }
-
-            if (exp->let_exp->exp_1 == NULL) {
-                return NULL;
-            }
-
-            if (exp->let_exp->exp_2 == NULL) {
-                return NULL;
-            }
-
-            Derivation *premise_1 = derive_impl(env, exp->let_exp->exp_1);
-            if (premise_1 == NULL) {
-                return NULL;
-            }
-
-            Value *value_1 = create_value_from_derivation(premise_1);
-            if (value_1 == NULL) {
-                free_derivation(premise_1);
-                return NULL;
-            }
-
-            Env *env_new = create_appended_env(env, exp->let_exp->var, value_1);
-            if (env_new == NULL) {
-                free_value(value_1);
-                free_derivation(premise_1);
-                return NULL;
-            }
-
-            Derivation *premise_2 = derive_impl(env_new, exp->let_exp->exp_2);
-            if (premise_2 == NULL) {
-                free_env(env_new);
-                free_value(value_1);
-                free_derivation(premise_1);
-                return NULL;
-            }
-
-            Value *value_2 = create_value_from_derivation(premise_2);
-            if (value_2 == NULL) {
-                free_derivation(premise_2);
-                free_env(env_new);
-                free_value(value_1);
-                free_derivation(premise_1);
-                return NULL;
-            }
-
-            LetDerivation *let_derivation = malloc(sizeof(LetDerivation));
-            let_derivation->premise_1 = premise_1;
-            let_derivation->premise_2 = premise_2;
-            let_derivation->let_exp = exp->let_exp;
-            let_derivation->value = value_2;
-
-            Derivation *derivation = malloc(sizeof(Derivation));
-            derivation->type = LET_DERIVATION;
-            derivation->env = create_copied_env(env);
-            derivation->let_derivation = let_derivation;
-
-            free_env(env_new);
-            free_value(value_1);
-
-            return derivation;
-        }
-        case FUN_EXP: {
-            if (exp->fun_exp == NULL) {
-                return NULL;
-            }
-
-            if (exp->fun_exp->var == NULL) {
-                return NULL;
-            }
-
-            if (exp->fun_exp->exp == NULL) {
-                return NULL;
-            }
-
-            Closure *closure_value = create_closure(env, exp->fun_exp->var, exp->fun_exp->exp);
-            if (closure_value == NULL) {
-                return NULL;
-            }
-
-            FunDerivation *fun_derivation = malloc(sizeof(FunDerivation));
-            fun_derivation->fun_exp = exp->fun_exp;
-            fun_derivation->closure_value = closure_value;
-
-            Derivation *derivation = malloc(sizeof(Derivation));
-            derivation->type = FUN_DERIVATION;
-            derivation->env = create_copied_env(env);
-            derivation->fun_derivation = fun_derivation;
-            return derivation;
-        }
-        case APP_EXP: {
-            if (exp->app_exp == NULL) {
-                return NULL;
-            }
-
-            if (exp->app_exp->exp_1 == NULL) {
-                return NULL;
-            }
-
-            if (exp->app_exp->exp_2 == NULL) {
-                return NULL;
-            }
-
-            Derivation *premise_1 = derive_impl(env, exp->app_exp->exp_1);
-            if (premise_1 == NULL) {
-                return NULL;
-            }
-
-            Value *value_1 = create_value_from_derivation(premise_1);
-            if (value_1 == NULL) {
-                free_derivation(premise_1);
-                return NULL;
-            }
-
-            switch (value_1->type) {
-                case CLOSURE_VALUE: {
-                    Closure *closure_value = value_1->closure_value;
-                    if (closure_value == NULL) {
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                        return NULL;
-                    }
-
-                    Derivation *premise_2 = derive_impl(env, exp->app_exp->exp_2);
-                    if (premise_2 == NULL) {
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                        return NULL;
-                    }
-
-                    Value *value_2 = create_value_from_derivation(premise_2);
-                    if (value_2 == NULL) {
-                        free_derivation(premise_2);
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                        return NULL;
-                    }
-
-                    Env *env_new = create_appended_env(
-                        closure_value->env,
-                        closure_value->var,
-                        value_2
-                    );
-                    if (env_new == NULL) {
-                        free_value(value_2);
-                        free_derivation(premise_2);
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                        return NULL;
-                    }
-
-                    Derivation *premise_3 = derive_impl(env_new, closure_value->exp);
-                    if (premise_3 == NULL) {
-                        free_env(env_new);
-                        free_value(value_2);
-                        free_derivation(premise_2);
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                        return NULL;
-                    }
-
-                    Value *value_3 = create_value_from_derivation(premise_3);
-                    if (value_3 == NULL) {
-                        free_env(env_new);
-                        free_value(value_2);
-                        free_derivation(premise_2);
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                        return NULL;
-                    }
-
-                    AppDerivation *app_derivation = malloc(sizeof(AppDerivation));
-                    app_derivation->premise_1 = premise_1;
-                    app_derivation->premise_2 = premise_2;
-                    app_derivation->premise_3 = premise_3;
-                    app_derivation->app_exp = exp->app_exp;
-                    app_derivation->value = value_3;
-
-                    Derivation *derivation = malloc(sizeof(Derivation));
-                    derivation->type = APP_DERIVATION;
-                    derivation->env = create_copied_env(env);
-                    derivation->app_derivation = app_derivation;
-
-                    free_env(env_new);
-                    free_value(value_2);
-                    free_value(value_1);
-
-                    return derivation;
-                }
-                case REC_CLOSURE_VALUE: {
-                    RecClosure *rec_closure_value = value_1->rec_closure_value;
-                    if (rec_closure_value == NULL) {
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                        return NULL;
-                    }
-
-                    Derivation *premise_2 = derive_impl(env, exp->app_exp->exp_2);
-                    if (premise_2 == NULL) {
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                        return NULL;
-                    }
-
-                    Value *value_2 = create_value_from_derivation(premise_2);
-                    if (value_2 == NULL) {
-                        free_derivation(premise_2);
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                        return NULL;
-                    }
-
-                    Env *env_temp = create_appended_env(
-                        rec_closure_value->env,
-                        rec_closure_value->var_rec,
-                        value_1
-                    );
-                    if (env_temp == NULL) {
-                        free_value(value_2);
-                        free_derivation(premise_2);
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                        return NULL;
-                    }
-
-                    Env *env_new = create_appended_env(
-                        env_temp,
-                        rec_closure_value->var,
-                        value_2
-                    );
-                    free_env(env_temp);
-                    if (env_new == NULL) {
-                        free_value(value_2);
-                        free_derivation(premise_2);
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                        return NULL;
-                    }
-
-                    Derivation *premise_3 = derive_impl(env_new, rec_closure_value->exp);
-                    if (premise_3 == NULL) {
-                        free_env(env_new);
-                        free_value(value_2);
-                        free_derivation(premise_2);
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                    }
-
-                    Value *value_3 = create_value_from_derivation(premise_3);
-                    if (value_3 == NULL) {
-                        free_derivation(premise_3);
-                        free_env(env_new);
-                        free_value(value_2);
-                        free_derivation(premise_2);
-                        free_value(value_1);
-                        free_derivation(premise_1);
-                    }
-
-                    AppRecDerivation *app_rec_derivation = malloc(sizeof(AppRecDerivation));
-                    app_rec_derivation->premise_1 = premise_1;
-                    app_rec_derivation->premise_2 = premise_2;
-                    app_rec_derivation->premise_3 = premise_3;
-                    app_rec_derivation->app_exp = exp->app_exp;
-                    app_rec_derivation->value = value_3;
-
-                    Derivation *derivation = malloc(sizeof(Derivation));
-                    derivation->type = APP_REC_DERIVATION;
-                    derivation->env = create_copied_env(env);
-                    derivation->app_rec_derivation = app_rec_derivation;
-
-                    free_env(env_new);
-                    free_value(value_2);
-                    free_value(value_1);
-
-                    return derivation;
-                }
-                default: {
-                    free_value(value_1);
-                    free_derivation(premise_1);
-                    return NULL;
-                }
-            }
-        }
-        case LET_REC_EXP: {
-            if (exp->let_rec_exp == NULL) {
-                return NULL;
-            }
-
-            if (exp->let_rec_exp->var_rec == NULL) {
-                return NULL;
-            }
-
-            if (exp->let_rec_exp->var == NULL) {
-                return NULL;
-            }
-
-            if (exp->let_rec_exp->exp_1 == NULL) {
-                return NULL;
-            }
-
-            if (exp->let_rec_exp->exp_2 == NULL) {
-                return NULL;
-            }
-
-            Value *rec_closure_value = create_rec_closure_value(
-                create_rec_closure(
-                    env,
-                    exp->let_rec_exp->var_rec,
-                    exp->let_rec_exp->var,
-                    exp->let_rec_exp->exp_1
-                )
-            );
-            if (rec_closure_value == NULL) {
-                return NULL;
-            }
-
-            Env *env_new = create_appended_env(
-                env,
-                exp->let_rec_exp->var_rec,
-                rec_closure_value
-            );
-            if (env_new == NULL) {
-                free_value(rec_closure_value);
-                return NULL;
-            }
-
-            Derivation *premise = derive_impl(env_new, exp->let_rec_exp->exp_2);
-            if (premise == NULL) {
-                free_env(env_new);
-                free_value(rec_closure_value);
-                return NULL;
-            }
-
-            Value *value = create_value_from_derivation(premise);
-            if (value == NULL) {
-                free_derivation(premise);
-                free_env(env_new);
-                free_value(rec_closure_value);
-            }
-
-            LetRecDerivation *let_rec_derivation = malloc(sizeof(LetRecDerivation));
-            let_rec_derivation->premise = premise;
-            let_rec_derivation->let_rec_exp = exp->let_rec_exp;
-            let_rec_derivation->value = value;
-
-            Derivation *derivation = malloc(sizeof(Derivation));
-            derivation->type = LET_REC_DERIVATION;
-            derivation->env = create_copied_env(env);
-            derivation->let_rec_derivation = let_rec_derivation;
-
-            free_env(env_new);
-            free_value(rec_closure_value);
-
-            return derivation;
-        }
-        case NIL_EXP: {
-            Derivation *derivation = malloc(sizeof(Derivation));
-            derivation->type = NIL_DERIVATION;
-            derivation->env = create_copied_env(env);
-            return derivation;
-        }
-        case CONS_EXP: {
-            if (exp->cons_exp == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_elem = exp->cons_exp->exp_elem;
-            if (exp_elem == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_list = exp->cons_exp->exp_list;
-            if (exp_list == NULL) {
-                return NULL;
-            }
-
-            Derivation *premise_elem = derive_impl(env, exp_elem);
-            if (premise_elem == NULL) {
-                return NULL;
-            }
-
-            Value *value_elem = create_value_from_derivation(premise_elem);
-            if (value_elem == NULL) {
-                free_derivation(premise_elem);
-                return NULL;
-            }
-
-            Derivation *premise_list = derive_impl(env, exp_list);
-            if (premise_list == NULL) {
-                free_value(value_elem);
-                free_derivation(premise_elem);
-                return NULL;
-            }
-
-            Value *value_list = create_value_from_derivation(premise_list);
-            if (value_list == NULL) {
-                free_derivation(premise_list);
-                free_value(value_elem);
-                free_derivation(premise_elem);
-                return NULL;
-            }
-
-            ConsDerivation *cons_derivation = malloc(sizeof(ConsDerivation));
-            cons_derivation->premise_elem = premise_elem;
-            cons_derivation->premise_list = premise_list;
-            cons_derivation->cons_exp = exp->cons_exp;
-            cons_derivation->cons_value = create_cons(value_elem, value_list);
-
-            Derivation *derivation = malloc(sizeof(Derivation));
-            derivation->type = CONS_DERIVATION;
-            derivation->env = create_copied_env(env);
-            derivation->cons_derivation = cons_derivation;
-
-            free_value(value_list);
-            free_value(value_elem);
-
-            return derivation;
-        }
-        case MATCH_EXP: {
-            if (exp->match_exp == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_list = exp->match_exp->exp_list;
-            if (exp_list == NULL) {
-                return NULL;
-            }
-
-            Derivation *premise_list = derive_impl(env, exp_list);
-            if (premise_list == NULL) {
-                return NULL;
-            }
-
-            Value *value_list = create_value_from_derivation(premise_list);
-            if (value_list == NULL) {
-                free_derivation(premise_list);
-                return NULL;
-            }
-
-            switch (value_list->type) {
-                case NIL_VALUE: {
-                    Exp *exp_match_nil = exp->match_exp->exp_match_nil;
-                    if (exp_match_nil == NULL) {
-                        free_derivation(premise_list);
-                        return NULL;
-                    }
-
-                    Derivation *premise_match_nil = derive_impl(env, exp_match_nil);
-                    if (premise_match_nil == NULL) {
-                        free_derivation(premise_list);
-                        return NULL;
-                    }
-
-                    Value *value_match_nil = create_value_from_derivation(premise_match_nil);
-                    if (value_match_nil == NULL) {
-                        free_derivation(premise_match_nil);
-                        free_derivation(premise_list);
-                        return NULL;
-                    }
-
-                    MatchNilDerivation *match_nil_derivation = malloc(sizeof(MatchNilDerivation));
-                    match_nil_derivation->premise_list = premise_list;
-                    match_nil_derivation->premise_match_nil = premise_match_nil;
-                    match_nil_derivation->match_exp = exp->match_exp;
-                    match_nil_derivation->value = value_match_nil;
-
-                    Derivation *derivation = malloc(sizeof(Derivation));
-                    derivation->type = MATCH_NIL_DERIVATION;
-                    derivation->env = create_copied_env(env);
-                    derivation->match_nil_derivation = match_nil_derivation;
-                    return derivation;
-                }
-                case CONS_VALUE: {
-                    Cons *cons_value = value_list->cons_value;
-                    if (cons_value == NULL) {
-                        free_value(value_list);
-                        free_derivation(premise_list);
-                        return NULL;
-                    }
-
-                    Value *value_elem = create_copied_value(cons_value->value_elem);
-                    if (value_elem == NULL) {
-                        free_value(value_list);
-                        free_derivation(premise_list);
-                        return NULL;
-                    }
-
-                    Value *value_subsequent_list = create_copied_value(cons_value->value_list);
-                    if (value_list == NULL) {
-                        free_value(value_elem);
-                        free_value(value_list);
-                        free_derivation(premise_list);
-                        return NULL;
-                    }
-
-                    Exp *exp_match_cons = exp->match_exp->exp_match_cons;
-                    if (exp_match_cons == NULL) {
-                        free_value(value_subsequent_list);
-                        free_value(value_elem);
-                        free_value(value_list);
-                        free_derivation(premise_list);
-                        return NULL;
-                    }
-
-                    Env *env_temp = create_appended_env(
-                        env,
-                        exp->match_exp->var_elem,
-                        value_elem
-                    );
-                    if (env_temp == NULL) {
-                        free_value(value_subsequent_list);
-                        free_value(value_elem);
-                        free_value(value_list);
-                        free_derivation(premise_list);
-                    }
-
-                    Env *env_new = create_appended_env(
-                        env_temp,
-                        exp->match_exp->var_list,
-                        value_subsequent_list
-                    );
-                    free_env(env_temp);
-                    if (env_new == NULL) {
-                        free_value(value_subsequent_list);
-                        free_value(value_elem);
-                        free_value(value_list);
-                        free_derivation(premise_list);
-                    }
-
-                    Derivation *premise_match_cons = derive_impl(env_new, exp_match_cons);
-                    if (premise_match_cons == NULL) {
-                        free_env(env_new);
-                        free_value(value_subsequent_list);
-                        free_value(value_elem);
-                        free_value(value_list);
-                        free_derivation(premise_list);
-                        return NULL;
-                    }
-
-                    Value *value_cons = create_value_from_derivation(premise_match_cons);
-                    if (value_cons == NULL) {
-                        free_derivation(premise_match_cons);
-                        free_env(env_new);
-                        free_value(value_subsequent_list);
-                        free_value(value_elem);
-                        free_value(value_list);
-                        free_derivation(premise_list);
-                        return NULL;
-                    }
-
-                    MatchConsDerivation *match_cons_derivation = malloc(
-                        sizeof(MatchConsDerivation)
-                    );
-                    match_cons_derivation->premise_list = premise_list;
-                    match_cons_derivation->premise_match_cons = premise_match_cons;
-                    match_cons_derivation->match_exp = exp->match_exp;
-                    match_cons_derivation->value = value_cons;
-
-                    Derivation *derivation = malloc(sizeof(Derivation));
-                    derivation->type = MATCH_CONS_DERIVATION;
-                    derivation->env = create_copied_env(env);
-                    derivation->match_cons_derivation = match_cons_derivation;
-
-                    free_env(env_new);
-                    free_value(value_subsequent_list);
-                    free_value(value_elem);
-                    free_value(value_list);
-
-                    return derivation;
-                }
-                default: {
-                    free_derivation(premise_list);
-                    return NULL;
-                }
-            }
-        }
-        default: {
-            return NULL;
-        }
-    }
-}
-
-void free_derivation(Derivation *derivation) {
-    if (derivation == NULL) {
-        return;
-    }
-
-    switch (derivation->type) {
-        case INT_DERIVATION: {
-            free_env(derivation->env);
-            free(derivation->int_derivation);
-            free(derivation);
-            return;
-        }
-        case BOOL_DERIVATION: {
-            free_env(derivation->env);
-            free(derivation->int_derivation);
-            free(derivation);
-            return;
-        }
-        case VAR_DERIVATION: {
-            if (derivation->var_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_value(derivation->var_derivation->value);
-            free(derivation->var_derivation);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case PLUS_DERIVATION: {
-            if (derivation->plus_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->plus_derivation->premise_left);
-            free_derivation(derivation->plus_derivation->premise_right);
-            free(derivation->plus_derivation);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case MINUS_DERIVATION: {
-            if (derivation->minus_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->minus_derivation->premise_left);
-            free_derivation(derivation->minus_derivation->premise_right);
-            free(derivation->minus_derivation);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case TIMES_DERIVATION: {
-            if (derivation->times_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->times_derivation->premise_left);
-            free_derivation(derivation->times_derivation->premise_right);
-            free(derivation->times_derivation);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case LT_DERIVATION: {
-            if (derivation->lt_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->lt_derivation->premise_left);
-            free_derivation(derivation->lt_derivation->premise_right);
-            free(derivation->lt_derivation);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case IF_TRUE_DERIVATION: {
-            if (derivation->if_true_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->if_true_derivation->premise_cond);
-            free_derivation(derivation->if_true_derivation->premise_true);
-            free_value(derivation->if_true_derivation->value);
-            free(derivation->if_true_derivation);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case IF_FALSE_DERIVATION: {
-            if (derivation->if_false_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->if_false_derivation->premise_cond);
-            free_derivation(derivation->if_false_derivation->premise_false);
-            free_value(derivation->if_false_derivation->value);
-            free(derivation->if_false_derivation);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case LET_DERIVATION: {
-            if (derivation->let_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->let_derivation->premise_1);
-            free_derivation(derivation->let_derivation->premise_2);
-            free_value(derivation->let_derivation->value);
-            free(derivation->let_derivation);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case FUN_DERIVATION: {
-            if (derivation->fun_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            if (derivation->fun_derivation->closure_value != NULL) {
-                free_env(derivation->fun_derivation->closure_value->env);
-                free_var(derivation->fun_derivation->closure_value->var);
-                free(derivation->fun_derivation->closure_value);
-            }
-            free(derivation->fun_derivation);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case APP_DERIVATION: {
-            if (derivation->app_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->app_derivation->premise_1);
-            free_derivation(derivation->app_derivation->premise_2);
-            free_derivation(derivation->app_derivation->premise_3);
-            free_value(derivation->app_derivation->value);
-            free(derivation->app_derivation);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case LET_REC_DERIVATION: {
-            if (derivation->let_rec_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->let_rec_derivation->premise);
-            free_value(derivation->let_rec_derivation->value);
-            free(derivation->let_rec_derivation);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case APP_REC_DERIVATION: {
-            if (derivation->app_rec_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->app_rec_derivation->premise_1);
-            free_derivation(derivation->app_rec_derivation->premise_2);
-            free_derivation(derivation->app_rec_derivation->premise_3);
-            free_value(derivation->app_rec_derivation->value);
-            free(derivation->app_rec_derivation);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case CONS_DERIVATION: {
-            if (derivation->cons_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->cons_derivation->premise_elem);
-            free_derivation(derivation->cons_derivation->premise_list);
-            free_cons(derivation->cons_derivation->cons_value);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case MATCH_NIL_DERIVATION: {
-            if (derivation->match_nil_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->match_nil_derivation->premise_list);
-            free_derivation(derivation->match_nil_derivation->premise_match_nil);
-            free_value(derivation->match_nil_derivation->value);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        case MATCH_CONS_DERIVATION: {
-            if (derivation->match_cons_derivation == NULL) {
-                free_env(derivation->env);
-                free(derivation);
-                return;
-            }
-
-            free_derivation(derivation->match_cons_derivation->premise_list);
-            free_derivation(derivation->match_cons_derivation->premise_match_cons);
-            free_value(derivation->match_cons_derivation->value);
-            free_env(derivation->env);
-            free(derivation);
-            return;
-        }
-        default: {
-            free(derivation);
-            return;
-        }
-    }
-}
-
-void fprint_indent(FILE *fp, const int level) {
-    for (int i = 0; i < level; i++) {
-        fprintf(fp, "  ");
-    }
-}
-
-bool fprint_derivation(FILE *fp, const Derivation *derivation) {
-    return fprint_derivation_impl(fp, derivation, 0);
-}
-
-bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int level) {
-    if (fp == NULL || derivation == NULL) {
-        return false;
-    }
-
-    fprint_indent(fp, level);
-    switch (derivation->type) {
-        case INT_DERIVATION: {
-            if (derivation->int_derivation == NULL) {
+            if (!try_get_int_value_from_derivation(premise_left, &int_value_left)) {
                 return false;
             }
 
-            if (!fprint_env(fp, derivation->env)) {
+            Derivation *premise_right = derivation->lt_derivation->premise_right;
+
+            int int_value_right;
+            if (!try_get_int_value_from_derivation(premise_right, &int_value_right)) {
                 return false;
             }
-            if (derivation->env->var_binding != NULL) {
-                fprintf(fp, " ");
-            }
-            fprintf(fp, "|- ");
 
-            if (!fprint_int_exp(fp, derivation->int_derivation->int_exp)) {
+            fprintf(fp,
+                    " evalto %s by E-Lt {\n",
+                    derivation->value->bool_value ? "true" : "false");
+            if (!fprint_derivation_impl(fp, premise_left, level + 1)) {
                 return false;
             }
-
-            fprintf(fp, " evalto %d by E-Int {}", derivation->int_derivation->int_value);
+            fprintf(fp, ";\n");
+            if (!fprint_derivation_impl(fp, premise_right, level + 1)) {
+                return false;
+            }
+            fprintf(fp, ";\n");
+            fprint_indent(fp, level + 1);
+            fprintf(fp,
+                    "%d less than %d is %s by B-Lt {}\n",
+                    int_value_left,
+                    int_value_right,
+                    derivation->value->bool_value ? "true" : "false");
+            fprint_indent(fp, level);
+            fprintf(fp, "}");
             if (level == 0) {
                 fprintf(fp, "\n");
             }
             return true;
         }
-        case BOOL_DERIVATION: {
-            if (derivation->bool_derivation == NULL) {
+        case IF_TRUE_DERIVATION: {
+            IfTrueDerivation *if_true_derivation = derivation->if_true_derivation;
+            if (if_true_derivation == NULL) {
                 return false;
             }
 
-            if (!fprint_env(fp, derivation->env)) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
-            if (derivation->env->var_binding != NULL) {
+            if (derivation->env.var_binding != NULL) {
                 fprintf(fp, " ");
             }
             fprintf(fp, "|- ");
 
-            if (!fprint_bool_exp(fp, derivation->bool_derivation->bool_exp)) {
+            if (!fprint_if_exp(fp, if_true_derivation->if_exp)) {
                 return false;
             }
 
-            fprintf(fp,
-                    " evalto %s by E-Bool {}",
-                    derivation->bool_derivation->bool_value ? "true" : "false");
+            Value *value = derivation->value;
+            if (value == NULL) {
+                return false;
+            }
+
+            fprintf(fp, " evalto ");
+            if (!fprint_value(fp, value)) {
+                return false;
+            }
+            fprintf(fp, " by E-IfT {\n");
+            if (!fprint_derivation_impl(fp, if_true_derivation->premise_cond, level + 1)) {
+                return false;
+            }
+            fprintf(fp, ";\n");
+            if (!fprint_derivation_impl(fp, if_true_derivation->premise_true, level + 1)) {
+                return false;
+            }
+            fprintf(fp, "\n");
+            fprint_indent(fp, level);
+            fprintf(fp, "}");
             if (level == 0) {
                 fprintf(fp, "\n");
             }
             return true;
         }
-        case VAR_DERIVATION: {
-            if (derivation->var_derivation == NULL) {
+        case IF_FALSE_DERIVATION: {
+            IfFalseDerivation *if_false_derivation = derivation->if_false_derivation;
+            if (if_false_derivation == NULL) {
                 return false;
             }
 
-            if (!fprint_env(fp, derivation->env)) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
-            if (derivation->env->var_binding != NULL) {
+            if (derivation->env.var_binding != NULL) {
                 fprintf(fp, " ");
             }
             fprintf(fp, "|- ");
 
-            if (!fprint_var_exp(fp, derivation->var_derivation->var_exp)) {
+            if (!fprint_if_exp(fp, if_false_derivation->if_exp)) {
                 return false;
             }
 
-            Value *value = derivation->var_derivation->value;
+            Value *value = derivation->value;
             if (value == NULL) {
                 return false;
             }
@@ -2430,58 +1810,58 @@ bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int le
             if (!fprint_value(fp, value)) {
                 return false;
             }
-            fprintf(fp, " by E-Var {}");
+            fprintf(fp, " by E-IfF {\n");
+            if (!fprint_derivation_impl(fp, if_false_derivation->premise_cond, level + 1)) {
+                return false;
+            }
+            fprintf(fp, ";\n");
+            if (!fprint_derivation_impl(fp, if_false_derivation->premise_false, level + 1)) {
+                return false;
+            }
+            fprintf(fp, "\n");
+            fprint_indent(fp, level);
+            fprintf(fp, "}");
             if (level == 0) {
                 fprintf(fp, "\n");
             }
             return true;
         }
-        case PLUS_DERIVATION: {
-            if (derivation->plus_derivation == NULL) {
+        case LET_DERIVATION: {
+            LetDerivation *let_derivation = derivation->let_derivation;
+            if (let_derivation == NULL) {
                 return false;
             }
 
-            if (!fprint_env(fp, derivation->env)) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
-            if (derivation->env->var_binding != NULL) {
+            if (derivation->env.var_binding != NULL) {
                 fprintf(fp, " ");
             }
             fprintf(fp, "|- ");
 
-            if (!fprint_op_exp(fp, derivation->plus_derivation->op_exp)) {
+            if (!fprint_let_exp(fp, let_derivation->let_exp)) {
                 return false;
             }
 
-            Derivation *premise_left = derivation->plus_derivation->premise_left;
-
-            int int_value_left;
-            if (!try_get_int_value_from_derivation(premise_left, &int_value_left)) {
+            Value *value = derivation->value;
+            if (value == NULL) {
                 return false;
             }
 
-            Derivation *premise_right = derivation->plus_derivation->premise_right;
-
-            int int_value_right;
-            if (!try_get_int_value_from_derivation(premise_right, &int_value_right)) {
+            fprintf(fp, " evalto ");
+            if (!fprint_value(fp, value)) {
                 return false;
             }
-
-            fprintf(fp, " evalto %d by E-Plus {\n", derivation->plus_derivation->int_value);
-            if (!fprint_derivation_impl(fp, premise_left, level + 1)) {
+            fprintf(fp, " by E-Let {\n");
+            if (!fprint_derivation_impl(fp, let_derivation->premise_1, level + 1)) {
                 return false;
             }
             fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp, premise_right, level + 1)) {
+            if (!fprint_derivation_impl(fp, let_derivation->premise_2, level + 1)) {
                 return false;
             }
-            fprintf(fp, ";\n");
-            fprint_indent(fp, level + 1);
-            fprintf(fp,
-                    "%d plus %d is %d by B-Plus {}\n",
-                    int_value_left,
-                    int_value_right,
-                    derivation->plus_derivation->int_value);
+            fprintf(fp, "\n");
             fprint_indent(fp, level);
             fprintf(fp, "}");
             if (level == 0) {
@@ -2489,52 +1869,78 @@ bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int le
             }
             return true;
         }
-        case MINUS_DERIVATION: {
-            if (derivation->minus_derivation == NULL) {
+        case FUN_DERIVATION: {
+            FunDerivation *fun_derivation = derivation->fun_derivation;
+            if (fun_derivation == NULL) {
                 return false;
             }
 
-            if (!fprint_env(fp, derivation->env)) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
-            if (derivation->env->var_binding != NULL) {
+            if (derivation->env.var_binding != NULL) {
                 fprintf(fp, " ");
             }
             fprintf(fp, "|- ");
 
-            if (!fprint_op_exp(fp, derivation->minus_derivation->op_exp)) {
+            if (!fprint_fun_exp(fp, fun_derivation->fun_exp)) {
                 return false;
             }
 
-            Derivation *premise_left = derivation->minus_derivation->premise_left;
+            if (derivation->value->closure_value == NULL) {
+                return false;
+            }
 
-            int int_value_left;
-            if (!try_get_int_value_from_derivation(premise_left, &int_value_left)) {
+            fprintf(fp, " evalto ");
+            if (!fprint_closure(fp, derivation->value->closure_value)) {
+                return false;
+            }
+            fprintf(fp, " by E-Fun {}");
+            if (level == 0) {
+                fprintf(fp, "\n");
+            }
+            return true;
+        }
+        case APP_DERIVATION: {
+            AppDerivation *app_derivation = derivation->app_derivation;
+            if (app_derivation == NULL) {
                 return false;
             }
 
-            Derivation *premise_right = derivation->minus_derivation->premise_right;
+            if (!fprint_env(fp, &derivation->env)) {
+                return false;
+            }
+            if (derivation->env.var_binding != NULL) {
+                fprintf(fp, " ");
+            }
+            fprintf(fp, "|- ");
 
-            int int_value_right;
-            if (!try_get_int_value_from_derivation(premise_right, &int_value_right)) {
+            if (!fprint_app_exp(fp, app_derivation->app_exp)) {
                 return false;
             }
 
-            fprintf(fp, " evalto %d by E-Minus {\n", derivation->minus_derivation->int_value);
-            if (!fprint_derivation_impl(fp, premise_left, level + 1)) {
+            Value *value = derivation->value;
+            if (value == NULL) {
+                return false;
+            }
+
+            fprintf(fp, " evalto ");
+            if (!fprint_value(fp, value)) {
+                return false;
+            }
+            fprintf(fp, " by E-App {\n");
+            if (!fprint_derivation_impl(fp, app_derivation->premise_1, level + 1)) {
                 return false;
             }
             fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp, premise_right, level + 1)) {
+            if (!fprint_derivation_impl(fp, app_derivation->premise_2, level + 1)) {
                 return false;
             }
             fprintf(fp, ";\n");
-            fprint_indent(fp, level + 1);
-            fprintf(fp,
-                    "%d minus %d is %d by B-Minus {}\n",
-                    int_value_left,
-                    int_value_right,
-                    derivation->minus_derivation->int_value);
+            if (!fprint_derivation_impl(fp, app_derivation->premise_3, level + 1)) {
+                return false;
+            }
+            fprintf(fp, "\n");
             fprint_indent(fp, level);
             fprintf(fp, "}");
             if (level == 0) {
@@ -2542,52 +1948,38 @@ bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int le
             }
             return true;
         }
-        case TIMES_DERIVATION: {
-            if (derivation->times_derivation == NULL) {
+        case LET_REC_DERIVATION: {
+            LetRecDerivation *let_rec_derivation = derivation->let_rec_derivation;
+            if (let_rec_derivation == NULL) {
                 return false;
             }
 
-            if (!fprint_env(fp, derivation->env)) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
-            if (derivation->env->var_binding != NULL) {
+            if (derivation->env.var_binding != NULL) {
                 fprintf(fp, " ");
             }
             fprintf(fp, "|- ");
 
-            if (!fprint_op_exp(fp, derivation->times_derivation->op_exp)) {
-                return false;
-            }
-
-            Derivation *premise_left = derivation->times_derivation->premise_left;
-
-            int int_value_left;
-            if (!try_get_int_value_from_derivation(premise_left, &int_value_left)) {
+            if (!fprint_let_rec_exp(fp, let_rec_derivation->let_rec_exp)) {
                 return false;
             }
 
-            Derivation *premise_right = derivation->times_derivation->premise_right;
-
-            int int_value_right;
-            if (!try_get_int_value_from_derivation(premise_right, &int_value_right)) {
+            Value *value = derivation->value;
+            if (value == NULL) {
                 return false;
             }
 
-            fprintf(fp, " evalto %d by E-Times {\n", derivation->times_derivation->int_value);
-            if (!fprint_derivation_impl(fp, premise_left, level + 1)) {
+            fprintf(fp, " evalto ");
+            if (!fprint_value(fp, value)) {
                 return false;
             }
-            fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp, premise_right, level + 1)) {
+            fprintf(fp, " by E-LetRec {\n");
+            if (!fprint_derivation_impl(fp, let_rec_derivation->premise, level + 1)) {
                 return false;
             }
-            fprintf(fp, ";\n");
-            fprint_indent(fp, level + 1);
-            fprintf(fp,
-                    "%d times %d is %d by B-Times {}\n",
-                    int_value_left,
-                    int_value_right,
-                    derivation->times_derivation->int_value);
+            fprintf(fp, "\n");
             fprint_indent(fp, level);
             fprintf(fp, "}");
             if (level == 0) {
@@ -2595,54 +1987,46 @@ bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int le
             }
             return true;
         }
-        case LT_DERIVATION: {
-            if (derivation->lt_derivation == NULL) {
+        case APP_REC_DERIVATION: {
+            AppRecDerivation *app_rec_derivation = derivation->app_rec_derivation;
+            if (app_rec_derivation == NULL) {
                 return false;
             }
 
-            if (!fprint_env(fp, derivation->env)) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
-            if (derivation->env->var_binding != NULL) {
+            if (derivation->env.var_binding != NULL) {
                 fprintf(fp, " ");
             }
             fprintf(fp, "|- ");
 
-            if (!fprint_op_exp(fp, derivation->lt_derivation->op_exp)) {
+            if (!fprint_app_exp(fp, app_rec_derivation->app_exp)) {
                 return false;
             }
 
-            Derivation *premise_left = derivation->lt_derivation->premise_left;
-
-            int int_value_left;
-            if (!try_get_int_value_from_derivation(premise_left, &int_value_left)) {
+            Value *value = derivation->value;
+            if (value == NULL) {
                 return false;
             }
 
-            Derivation *premise_right = derivation->lt_derivation->premise_right;
-
-            int int_value_right;
-            if (!try_get_int_value_from_derivation(premise_right, &int_value_right)) {
+            fprintf(fp, " evalto ");
+            if (!fprint_value(fp, value)) {
                 return false;
             }
-
-            fprintf(fp,
-                    " evalto %s by E-Lt {\n",
-                    derivation->lt_derivation->bool_value ? "true" : "false");
-            if (!fprint_derivation_impl(fp, premise_left, level + 1)) {
+            fprintf(fp, " by E-AppRec {\n");
+            if (!fprint_derivation_impl(fp, app_rec_derivation->premise_1, level + 1)) {
                 return false;
             }
             fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp, premise_right, level + 1)) {
+            if (!fprint_derivation_impl(fp, app_rec_derivation->premise_2, level + 1)) {
                 return false;
             }
             fprintf(fp, ";\n");
-            fprint_indent(fp, level + 1);
-            fprintf(fp,
-                    "%d less than %d is %s by B-Lt {}\n",
-                    int_value_left,
-                    int_value_right,
-                    derivation->lt_derivation->bool_value ? "true" : "false");
+            if (!fprint_derivation_impl(fp, app_rec_derivation->premise_3, level + 1)) {
+                return false;
+            }
+            fprintf(fp, "\n");
             fprint_indent(fp, level);
             fprintf(fp, "}");
             if (level == 0) {
@@ -2650,39 +2034,49 @@ bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int le
             }
             return true;
         }
-        case IF_TRUE_DERIVATION: {
-            IfTrueDerivation *if_true_derivation = derivation->if_true_derivation;
-            if (if_true_derivation == NULL) {
+        case NIL_DERIVATION: {
+            if (!fprint_env(fp, &derivation->env)) {
+                return false;
+            }
+            if (derivation->env.var_binding != NULL) {
+                fprintf(fp, " ");
+            }
+            fprintf(fp, "|- [] evalto [] by E-Nil {}");
+            if (level == 0) {
+                fprintf(fp, "\n");
+            }
+            return true;
+        }
+        case CONS_DERIVATION: {
+            if (derivation->cons_derivation == NULL) {
                 return false;
             }
 
-            if (!fprint_env(fp, derivation->env)) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
-            if (derivation->env->var_binding != NULL) {
+            if (derivation->env.var_binding != NULL) {
                 fprintf(fp, " ");
             }
             fprintf(fp, "|- ");
 
-            if (!fprint_if_exp(fp, if_true_derivation->if_exp)) {
+            if (!fprint_cons_exp(fp, derivation->cons_derivation->cons_exp)) {
                 return false;
             }
 
-            Value *value = if_true_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+            Derivation *premise_elem = derivation->cons_derivation->premise_elem;
+            Derivation *premise_list = derivation->cons_derivation->premise_list;
 
             fprintf(fp, " evalto ");
-            if (!fprint_value(fp, value)) {
+            if (!fprint_value(fp, derivation->value)) {
                 return false;
             }
-            fprintf(fp, " by E-IfT {\n");
-            if (!fprint_derivation_impl(fp, if_true_derivation->premise_cond, level + 1)) {
+            fprintf(fp, " by E-Cons {\n");
+            if (!fprint_derivation_impl(fp, premise_elem, level + 1)) {
                 return false;
             }
             fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp, if_true_derivation->premise_true, level + 1)) {
+            if (!fprint_derivation_impl(fp, premise_list, level + 1)) {
                 return false;
             }
             fprintf(fp, "\n");
@@ -2693,25 +2087,25 @@ bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int le
             }
             return true;
         }
-        case IF_FALSE_DERIVATION: {
-            IfFalseDerivation *if_false_derivation = derivation->if_false_derivation;
-            if (if_false_derivation == NULL) {
+        case MATCH_NIL_DERIVATION: {
+            MatchNilDerivation *match_nil_derivation = derivation->match_nil_derivation;
+            if (match_nil_derivation == NULL) {
                 return false;
             }
 
-            if (!fprint_env(fp, derivation->env)) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
-            if (derivation->env->var_binding != NULL) {
+            if (derivation->env.var_binding != NULL) {
                 fprintf(fp, " ");
             }
             fprintf(fp, "|- ");
 
-            if (!fprint_if_exp(fp, if_false_derivation->if_exp)) {
+            if (!fprint_match_exp(fp, match_nil_derivation->match_exp)) {
                 return false;
             }
 
-            Value *value = if_false_derivation->value;
+            Value *value = derivation->value;
             if (value == NULL) {
                 return false;
             }
@@ -2720,12 +2114,14 @@ bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int le
             if (!fprint_value(fp, value)) {
                 return false;
             }
-            fprintf(fp, " by E-IfF {\n");
-            if (!fprint_derivation_impl(fp, if_false_derivation->premise_cond, level + 1)) {
+            fprintf(fp, " by E-MatchNil {\n");
+            if (!fprint_derivation_impl(fp, match_nil_derivation->premise_list, level + 1)) {
                 return false;
             }
             fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp, if_false_derivation->premise_false, level + 1)) {
+            if (!fprint_derivation_impl(fp,
+                                        match_nil_derivation->premise_match_nil,
+                                        level + 1)) {
                 return false;
             }
             fprintf(fp, "\n");
@@ -2736,25 +2132,25 @@ bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int le
             }
             return true;
         }
-        case LET_DERIVATION: {
-            LetDerivation *let_derivation = derivation->let_derivation;
-            if (let_derivation == NULL) {
+        case MATCH_CONS_DERIVATION: {
+            MatchConsDerivation *match_cons_derivation = derivation->match_cons_derivation;
+            if (match_cons_derivation == NULL) {
                 return false;
             }
 
-            if (!fprint_env(fp, derivation->env)) {
+            if (!fprint_env(fp, &derivation->env)) {
                 return false;
             }
-            if (derivation->env->var_binding != NULL) {
+            if (derivation->env.var_binding != NULL) {
                 fprintf(fp, " ");
             }
             fprintf(fp, "|- ");
 
-            if (!fprint_let_exp(fp, let_derivation->let_exp)) {
+            if (!fprint_match_exp(fp, match_cons_derivation->match_exp)) {
                 return false;
             }
 
-            Value *value = let_derivation->value;
+            Value *value = derivation->value;
             if (value == NULL) {
                 return false;
             }
@@ -2763,12 +2159,14 @@ bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int le
             if (!fprint_value(fp, value)) {
                 return false;
             }
-            fprintf(fp, " by E-Let {\n");
-            if (!fprint_derivation_impl(fp, let_derivation->premise_1, level + 1)) {
+            fprintf(fp, " by E-MatchCons {\n");
+            if (!fprint_derivation_impl(fp, match_cons_derivation->premise_list, level + 1)) {
                 return false;
             }
             fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp, let_derivation->premise_2, level + 1)) {
+            if (!fprint_derivation_impl(fp,
+                                        match_cons_derivation->premise_match_cons,
+                                        level + 1)) {
                 return false;
             }
             fprintf(fp, "\n");
@@ -2779,328 +2177,745 @@ bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int le
             }
             return true;
         }
-        case FUN_DERIVATION: {
-            FunDerivation *fun_derivation = derivation->fun_derivation;
-            if (fun_derivation == NULL) {
-                return false;
-            }
+        default: {
+            return false;
+        }
+    }
+}
 
-            if (!fprint_env(fp, derivation->env)) {
-                return false;
-            }
-            if (derivation->env->var_binding != NULL) {
-                fprintf(fp, " ");
-            }
-            fprintf(fp, "|- ");
+typedef struct {
+    Value *values[VALUE_TRACE_CAPACITY];
+    size_t count;
+    size_t index;
+    bool is_overflowed;
+    bool is_sized;
+} ValueTrace;
+
+static size_t push_value_trace(ValueTrace *value_trace) {
+    if (value_trace->is_overflowed || value_trace->count == VALUE_TRACE_CAPACITY) {
+        value_trace->is_overflowed = true;
+        return SIZE_MAX;
+    }
 
-            if (!fprint_fun_exp(fp, fun_derivation->fun_exp)) {
-                return false;
-            }
+    value_trace->values[value_trace->count] = NULL;
+    return value_trace->count++;
+}
 
-            if (fun_derivation->closure_value == NULL) {
-                return false;
-            }
+static void clear_value_trace(ValueTrace *value_trace) {
+    for (size_t i = value_trace->index; i < value_trace->count; i++) {
+        free_value(value_trace->values[i]);
+    }
+    value_trace->count = 0;
+    value_trace->index = 0;
+    value_trace->is_overflowed = false;
+}
 
-            fprintf(fp, " evalto ");
-            if (!fprint_closure(fp, fun_derivation->closure_value)) {
-                return false;
-            }
-            fprintf(fp, " by E-Fun {}");
-            if (level == 0) {
-                fprintf(fp, "\n");
-            }
-            return true;
+static Env *create_app_env(const Value *value_1, const Value *value_2, const Exp **exp_body, const char **rule) {
+    switch (value_1->type) {
+        case CLOSURE_VALUE: {
+            *rule = "E-App";
+            *exp_body = value_1->closure_value->exp;
+            return create_appended_env(value_1->closure_value->env, value_1->closure_value->var, value_2);
+        }
+        case REC_CLOSURE_VALUE: {
+            *rule = "E-AppRec";
+            *exp_body = value_1->rec_closure_value->exp;
+            Env *env_temp = create_appended_env(
+                value_1->rec_closure_value->env,
+                value_1->rec_closure_value->var_rec,
+                value_1
+            );
+            Env *env_new = create_appended_env(env_temp, value_1->rec_closure_value->var, value_2);
+            free_env(env_temp);
+            return env_new;
         }
-        case APP_DERIVATION: {
-            AppDerivation *app_derivation = derivation->app_derivation;
-            if (app_derivation == NULL) {
-                return false;
+        default: {
+            return NULL;
+        }
+    }
+}
+
+static Env *create_match_env(const Env *env,
+                             const Exp *exp,
+                             const Value *value_list,
+                             const Exp **exp_match,
+                             const char **rule) {
+    switch (value_list->type) {
+        case NIL_VALUE: {
+            *rule = "E-MatchNil";
+            *exp_match = exp->match_exp->exp_match_nil;
+            return create_copied_env(env);
+        }
+        case CONS_VALUE:
+        case PACKED_CONS_VALUE: {
+            Value *value_elem;
+            Value *value_rest;
+            if (!try_get_elem_and_list(value_list, &value_elem, &value_rest)) {
+                return NULL;
+            }
+
+            *rule = "E-MatchCons";
+            *exp_match = exp->match_exp->exp_match_cons;
+            Env *env_temp = create_appended_env(env, exp->match_exp->var_elem, value_elem);
+            Env *env_new = create_appended_env(env_temp, exp->match_exp->var_list, value_rest);
+            free_env(env_temp);
+            free_value(value_elem);
+            free_value(value_rest);
+            return env_new;
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
+
+static Value *trace_values_impl(ValueTrace *value_trace,
+                                const Env *env,
+                                const Exp *exp,
+                                DerivationSize *derivation_size) {
+    if (exp == NULL) {
+        return NULL;
+    }
+
+    size_t index = push_value_trace(value_trace);
+    DerivationSize premise_sizes[3];
+    int premise_count = 0;
+    const char *rule;
+    size_t op_size = 0;
+    Value *value;
+    switch (exp->type) {
+        case INT_EXP: {
+            rule = "E-Int";
+            value = evaluate_impl(env, exp);
+            break;
+        }
+        case BOOL_EXP: {
+            rule = "E-Bool";
+            value = evaluate_impl(env, exp);
+            break;
+        }
+        case VAR_EXP: {
+            rule = "E-Var";
+            value = evaluate_impl(env, exp);
+            break;
+        }
+        case OP_EXP: {
+            const char *op;
+            const char *rule_op;
+            switch (exp->op_exp->type) {
+                case PLUS_OP_EXP: {
+                    rule = "E-Plus";
+                    rule_op = "B-Plus";
+                    op = "plus";
+                    break;
+                }
+                case MINUS_OP_EXP: {
+                    rule = "E-Minus";
+                    rule_op = "B-Minus";
+                    op = "minus";
+                    break;
+                }
+                case TIMES_OP_EXP: {
+                    rule = "E-Times";
+                    rule_op = "B-Times";
+                    op = "times";
+                    break;
+                }
+                case LT_OP_EXP: {
+                    rule = "E-Lt";
+                    rule_op = "B-Lt";
+                    op = "less than";
+                    break;
+                }
+                default: {
+                    return NULL;
+                }
             }
 
-            if (!fprint_env(fp, derivation->env)) {
-                return false;
+            Value *value_left = trace_values_impl(
+                value_trace,
+                env,
+                exp->op_exp->exp_left,
+                &premise_sizes[premise_count++]
+            );
+            Value *value_right = value_left == NULL
+                ? NULL
+                : trace_values_impl(value_trace, env, exp->op_exp->exp_right, &premise_sizes[premise_count++]);
+            value = NULL;
+            if (value_right != NULL && value_left->type == INT_VALUE && value_right->type == INT_VALUE) {
+                int int_left = value_left->int_value;
+                int int_right = value_right->int_value;
+                switch (exp->op_exp->type) {
+                    case PLUS_OP_EXP: {
+                        value = create_int_value(int_left + int_right);
+                        break;
+                    }
+                    case MINUS_OP_EXP: {
+                        value = create_int_value(int_left - int_right);
+                        break;
+                    }
+                    case TIMES_OP_EXP: {
+                        value = create_int_value(int_left * int_right);
+                        break;
+                    }
+                    default: {
+                        value = create_bool_value(int_left < int_right);
+                        break;
+                    }
+                }
+                op_size = get_op_size(op, rule_op, int_left, int_right, value);
             }
-            if (derivation->env->var_binding != NULL) {
-                fprintf(fp, " ");
+            free_value(value_left);
+            free_value(value_right);
+            break;
+        }
+        case IF_EXP: {
+            Value *value_cond = trace_values_impl(
+                value_trace,
+                env,
+                exp->if_exp->exp_cond,
+                &premise_sizes[premise_count++]
+            );
+            if (value_cond == NULL || value_cond->type != BOOL_VALUE) {
+                free_value(value_cond);
+                return NULL;
             }
-            fprintf(fp, "|- ");
 
-            if (!fprint_app_exp(fp, app_derivation->app_exp)) {
-                return false;
+            rule = value_cond->bool_value ? "E-IfT" : "E-IfF";
+            value = trace_values_impl(
+                value_trace,
+                env,
+                value_cond->bool_value ? exp->if_exp->exp_true : exp->if_exp->exp_false,
+                &premise_sizes[premise_count++]
+            );
+            free_value(value_cond);
+            break;
+        }
+        case LET_EXP: {
+            rule = "E-Let";
+            Value *value_1 = trace_values_impl(value_trace, env, exp->let_exp->exp_1, &premise_sizes[premise_count++]);
+            if (value_1 == NULL) {
+                return NULL;
             }
 
-            Value *value = app_derivation->value;
-            if (value == NULL) {
-                return false;
+            Env *env_new = create_appended_env(env, exp->let_exp->var, value_1);
+            free_value(value_1);
+            value = trace_values_impl(value_trace, env_new, exp->let_exp->exp_2, &premise_sizes[premise_count++]);
+            free_env(env_new);
+            break;
+        }
+        case FUN_EXP: {
+            rule = "E-Fun";
+            value = evaluate_impl(env, exp);
+            break;
+        }
+        case APP_EXP: {
+            Value *value_1 = trace_values_impl(value_trace, env, exp->app_exp->exp_1, &premise_sizes[premise_count++]);
+            Value *value_2 = value_1 == NULL
+                ? NULL
+                : trace_values_impl(value_trace, env, exp->app_exp->exp_2, &premise_sizes[premise_count++]);
+            if (value_2 == NULL) {
+                free_value(value_1);
+                return NULL;
             }
 
-            fprintf(fp, " evalto ");
-            if (!fprint_value(fp, value)) {
-                return false;
-            }
-            fprintf(fp, " by E-App {\n");
-            if (!fprint_derivation_impl(fp, app_derivation->premise_1, level + 1)) {
-                return false;
+            const Exp *exp_body;
+            Env *env_new = create_app_env(value_1, value_2, &exp_body, &rule);
+            free_value(value_1);
+            free_value(value_2);
+            if (env_new == NULL) {
+                return NULL;
             }
-            fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp, app_derivation->premise_2, level + 1)) {
-                return false;
+
+            value = trace_values_impl(value_trace, env_new, exp_body, &premise_sizes[premise_count++]);
+            free_env(env_new);
+            break;
+        }
+        case LET_REC_EXP: {
+            rule = "E-LetRec";
+            Value *rec_closure_value = create_rec_closure_value(
+                create_rec_closure(
+                    env,
+                    exp->let_rec_exp->var_rec,
+                    exp->let_rec_exp->var,
+                    exp->let_rec_exp->exp_1
+                )
+            );
+            Env *env_new = create_appended_env(env, exp->let_rec_exp->var_rec, rec_closure_value);
+            free_value(rec_closure_value);
+            if (env_new == NULL) {
+                return NULL;
             }
-            fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp, app_derivation->premise_3, level + 1)) {
-                return false;
+
+            value = trace_values_impl(value_trace, env_new, exp->let_rec_exp->exp_2, &premise_sizes[premise_count++]);
+            free_env(env_new);
+            break;
+        }
+        case NIL_EXP: {
+            rule = "E-Nil";
+            value = evaluate_impl(env, exp);
+            break;
+        }
+        case CONS_EXP: {
+            rule = "E-Cons";
+            Value *value_elem = trace_values_impl(
+                value_trace,
+                env,
+                exp->cons_exp->exp_elem,
+                &premise_sizes[premise_count++]
+            );
+            Value *value_list = value_elem == NULL
+                ? NULL
+                : trace_values_impl(value_trace, env, exp->cons_exp->exp_list, &premise_sizes[premise_count++]);
+            value = create_list_value(value_elem, value_list);
+            free_value(value_elem);
+            free_value(value_list);
+            break;
+        }
+        case MATCH_EXP: {
+            Value *value_list = trace_values_impl(
+                value_trace,
+                env,
+                exp->match_exp->exp_list,
+                &premise_sizes[premise_count++]
+            );
+            if (value_list == NULL) {
+                return NULL;
             }
-            fprintf(fp, "\n");
-            fprint_indent(fp, level);
-            fprintf(fp, "}");
-            if (level == 0) {
-                fprintf(fp, "\n");
+
+            const Exp *exp_match;
+            Env *env_new = create_match_env(env, exp, value_list, &exp_match, &rule);
+            free_value(value_list);
+            if (env_new == NULL) {
+                return NULL;
             }
-            return true;
+
+            value = trace_values_impl(value_trace, env_new, exp_match, &premise_sizes[premise_count++]);
+            free_env(env_new);
+            break;
         }
-        case LET_REC_DERIVATION: {
-            LetRecDerivation *let_rec_derivation = derivation->let_rec_derivation;
-            if (let_rec_derivation == NULL) {
-                return false;
-            }
+        default: {
+            return NULL;
+        }
+    }
+    if (value == NULL) {
+        return NULL;
+    }
+
+    DerivationBudget *derivation_budget = current_derivation_budget;
+    if (derivation_budget != NULL && value_trace->is_sized) {
+        const DerivationSize *premise_size_list[3];
+        for (int i = 0; i < premise_count; i++) {
+            premise_size_list[i] = &premise_sizes[i];
+        }
+
+        set_judgment_size(
+            derivation_size,
+            get_conclusion_size(derivation_budget, env, exp, value),
+            rule,
+            premise_size_list,
+            premise_count,
+            op_size
+        );
+        if (!is_within_derivation_budget(derivation_budget, derivation_size)) {
+            free_value(value);
+            return NULL;
+        }
+    }
+
+    if (index != SIZE_MAX) {
+        value_trace->values[index] = create_copied_value(value);
+    }
+    return value;
+}
+
+static Value *get_streamed_value(ValueTrace *value_trace, const Env *env, const Exp *exp) {
+    if (value_trace->index < value_trace->count) {
+        return value_trace->values[value_trace->index++];
+    }
+
+    clear_value_trace(value_trace);
+    DerivationSize derivation_size;
+    Value *value = trace_values_impl(value_trace, env, exp, &derivation_size);
+    if (value == NULL || value_trace->is_overflowed) {
+        clear_value_trace(value_trace);
+        return value;
+    }
+
+    free_value(value);
+    return value_trace->values[value_trace->index++];
+}
+
+static bool fprint_streamed_conclusion(FILE *fp, const Env *env, const Exp *exp, const Value *value) {
+    if (!fprint_env(fp, env)) {
+        return false;
+    }
+    if (env->var_binding != NULL) {
+        fprintf(fp, " ");
+    }
+    fprintf(fp, "|- ");
+
+    if (!fprint_exp(fp, exp)) {
+        return false;
+    }
+
+    fprintf(fp, " evalto ");
+    return fprint_value(fp, value);
+}
+
+static void fprint_streamed_end(FILE *fp, const int level) {
+    fprint_indent(fp, level);
+    fprintf(fp, "}");
+    if (level == 0) {
+        fprintf(fp, "\n");
+    }
+}
+
+static bool fprint_streamed_derivation_impl(FILE *fp,
+                                            ValueTrace *value_trace,
+                                            const Env *env,
+                                            const Exp *exp,
+                                            const Value *value,
+                                            const int level);
+
+static Value *fprint_streamed_premise(FILE *fp,
+                                      ValueTrace *value_trace,
+                                      const Env *env,
+                                      const Exp *exp,
+                                      const int level) {
+    Value *value = get_streamed_value(value_trace, env, exp);
+    if (value == NULL) {
+        return NULL;
+    }
+
+    if (!fprint_streamed_derivation_impl(fp, value_trace, env, exp, value, level)) {
+        free_value(value);
+        return NULL;
+    }
+    return value;
+}
+
+static bool fprint_streamed_op_derivation(FILE *fp,
+                                          ValueTrace *value_trace,
+                                          const Env *env,
+                                          const Exp *exp,
+                                          const Value *value,
+                                          const int level) {
+    const char *rule;
+    const char *rule_op;
+    const char *op;
+    switch (exp->op_exp->type) {
+        case PLUS_OP_EXP: {
+            rule = "E-Plus";
+            rule_op = "B-Plus";
+            op = "plus";
+            break;
+        }
+        case MINUS_OP_EXP: {
+            rule = "E-Minus";
+            rule_op = "B-Minus";
+            op = "minus";
+            break;
+        }
+        case TIMES_OP_EXP: {
+            rule = "E-Times";
+            rule_op = "B-Times";
+            op = "times";
+            break;
+        }
+        case LT_OP_EXP: {
+            rule = "E-Lt";
+            rule_op = "B-Lt";
+            op = "less than";
+            break;
+        }
+        default: {
+            return false;
+        }
+    }
+
+    fprintf(fp, " by %s {\n", rule);
+    Value *value_left = fprint_streamed_premise(fp, value_trace, env, exp->op_exp->exp_left, level + 1);
+    if (value_left == NULL) {
+        return false;
+    }
+
+    fprintf(fp, ";\n");
+    Value *value_right = fprint_streamed_premise(fp, value_trace, env, exp->op_exp->exp_right, level + 1);
+    if (value_right == NULL) {
+        free_value(value_left);
+        return false;
+    }
 
-            if (!fprint_env(fp, derivation->env)) {
-                return false;
-            }
-            if (derivation->env->var_binding != NULL) {
-                fprintf(fp, " ");
-            }
-            fprintf(fp, "|- ");
+    fprintf(fp, ";\n");
+    fprint_indent(fp, level + 1);
+    fprintf(fp, "%d %s %d is ", value_left->int_value, op, value_right->int_value);
+    fprint_value(fp, value);
+    fprintf(fp, " by %s {}\n", rule_op);
+    fprint_streamed_end(fp, level);
 
-            if (!fprint_let_rec_exp(fp, let_rec_derivation->let_rec_exp)) {
-                return false;
-            }
+    free_value(value_left);
+    free_value(value_right);
+    return true;
+}
 
-            Value *value = let_rec_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+static bool fprint_streamed_app_derivation(FILE *fp,
+                                           ValueTrace *value_trace,
+                                           const Env *env,
+                                           const Exp *exp,
+                                           const int level) {
+    Value *value_1 = get_streamed_value(value_trace, env, exp->app_exp->exp_1);
+    if (value_1 == NULL) {
+        return false;
+    }
 
-            fprintf(fp, " evalto ");
-            if (!fprint_value(fp, value)) {
-                return false;
-            }
-            fprintf(fp, " by E-LetRec {\n");
-            if (!fprint_derivation_impl(fp, let_rec_derivation->premise, level + 1)) {
-                return false;
-            }
-            fprintf(fp, "\n");
-            fprint_indent(fp, level);
-            fprintf(fp, "}");
-            if (level == 0) {
-                fprintf(fp, "\n");
-            }
-            return true;
-        }
-        case APP_REC_DERIVATION: {
-            AppRecDerivation *app_rec_derivation = derivation->app_rec_derivation;
-            if (app_rec_derivation == NULL) {
-                return false;
-            }
+    const char *rule = value_1->type == REC_CLOSURE_VALUE ? "E-AppRec" : "E-App";
+    fprintf(fp, " by %s {\n", rule);
+    if (!fprint_streamed_derivation_impl(fp, value_trace, env, exp->app_exp->exp_1, value_1, level + 1)) {
+        free_value(value_1);
+        return false;
+    }
 
-            if (!fprint_env(fp, derivation->env)) {
-                return false;
-            }
-            if (derivation->env->var_binding != NULL) {
-                fprintf(fp, " ");
-            }
-            fprintf(fp, "|- ");
+    fprintf(fp, ";\n");
+    Value *value_2 = fprint_streamed_premise(fp, value_trace, env, exp->app_exp->exp_2, level + 1);
+    if (value_2 == NULL) {
+        free_value(value_1);
+        return false;
+    }
 
-            if (!fprint_app_exp(fp, app_rec_derivation->app_exp)) {
-                return false;
-            }
+    const Exp *exp_body;
+    Env *env_new = create_app_env(value_1, value_2, &exp_body, &rule);
+    free_value(value_1);
+    free_value(value_2);
+    if (env_new == NULL) {
+        return false;
+    }
 
-            Value *value = app_rec_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
+    fprintf(fp, ";\n");
+    Value *value = fprint_streamed_premise(fp, value_trace, env_new, exp_body, level + 1);
+    free_env(env_new);
+    if (value == NULL) {
+        return false;
+    }
 
-            fprintf(fp, " evalto ");
-            if (!fprint_value(fp, value)) {
-                return false;
-            }
-            fprintf(fp, " by E-AppRec {\n");
-            if (!fprint_derivation_impl(fp, app_rec_derivation->premise_1, level + 1)) {
-                return false;
-            }
-            fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp, app_rec_derivation->premise_2, level + 1)) {
-                return false;
-            }
-            fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp, app_rec_derivation->premise_3, level + 1)) {
-                return false;
-            }
-            fprintf(fp, "\n");
-            fprint_indent(fp, level);
-            fprintf(fp, "}");
-            if (level == 0) {
-                fprintf(fp, "\n");
-            }
-            return true;
-        }
-        case NIL_DERIVATION: {
-            if (!fprint_env(fp, derivation->env)) {
-                return false;
-            }
-            if (derivation->env->var_binding != NULL) {
-                fprintf(fp, " ");
-            }
-            fprintf(fp, "|- [] evalto [] by E-Nil {}");
-            if (level == 0) {
-                fprintf(fp, "\n");
-            }
-            return true;
-        }
-        case CONS_DERIVATION: {
-            if (derivation->cons_derivation == NULL) {
-                return false;
-            }
+    free_value(value);
+    fprintf(fp, "\n");
+    fprint_streamed_end(fp, level);
+    return true;
+}
 
-            if (!fprint_env(fp, derivation->env)) {
-                return false;
-            }
-            if (derivation->env->var_binding != NULL) {
-                fprintf(fp, " ");
-            }
-            fprintf(fp, "|- ");
+static bool fprint_streamed_match_derivation(FILE *fp,
+                                             ValueTrace *value_trace,
+                                             const Env *env,
+                                             const Exp *exp,
+                                             const int level) {
+    Value *value_list = get_streamed_value(value_trace, env, exp->match_exp->exp_list);
+    if (value_list == NULL) {
+        return false;
+    }
 
-            if (!fprint_cons_exp(fp, derivation->cons_derivation->cons_exp)) {
-                return false;
-            }
+    const char *rule = value_list->type == NIL_VALUE ? "E-MatchNil" : "E-MatchCons";
+    fprintf(fp, " by %s {\n", rule);
+    if (!fprint_streamed_derivation_impl(fp, value_trace, env, exp->match_exp->exp_list, value_list, level + 1)) {
+        free_value(value_list);
+        return false;
+    }
 
-            Derivation *premise_elem = derivation->cons_derivation->premise_elem;
+    const Exp *exp_match;
+    Env *env_new = create_match_env(env, exp, value_list, &exp_match, &rule);
+    free_value(value_list);
+    if (env_new == NULL) {
+        return false;
+    }
 
-            Value *value_elem = create_value_from_derivation(premise_elem);
-            if (value_elem == NULL) {
-                return false;
-            }
+    fprintf(fp, ";\n");
+    Value *value = fprint_streamed_premise(fp, value_trace, env_new, exp_match, level + 1);
+    free_env(env_new);
+    if (value == NULL) {
+        return false;
+    }
 
-            Derivation *premise_list = derivation->cons_derivation->premise_list;
+    free_value(value);
+    fprintf(fp, "\n");
+    fprint_streamed_end(fp, level);
+    return true;
+}
 
-            Value *value_list = create_value_from_derivation(premise_list);
-            if (value_list == NULL) {
-                free_value(value_elem);
+static bool fprint_streamed_premises(FILE *fp,
+                                     ValueTrace *value_trace,
+                                     const Env *env,
+                                     const Exp *exp,
+                                     const Value *value,
+                                     const int level) {
+    switch (exp->type) {
+        case INT_EXP: {
+            fprintf(fp, " by E-Int {}");
+            break;
+        }
+        case BOOL_EXP: {
+            fprintf(fp, " by E-Bool {}");
+            break;
+        }
+        case VAR_EXP: {
+            fprintf(fp, " by E-Var {}");
+            break;
+        }
+        case OP_EXP: {
+            return fprint_streamed_op_derivation(fp, value_trace, env, exp, value, level);
+        }
+        case IF_EXP: {
+            Value *value_cond = get_streamed_value(value_trace, env, exp->if_exp->exp_cond);
+            if (value_cond == NULL || value_cond->type != BOOL_VALUE) {
+                free_value(value_cond);
                 return false;
             }
 
-            fprintf(fp, " evalto ");
-            if (!fprint_cons(fp, derivation->cons_derivation->cons_value)) {
-                return false;
-            }
-            fprintf(fp, " by E-Cons {\n");
-            if (!fprint_derivation_impl(fp, premise_elem, level + 1)) {
+            bool bool_value = value_cond->bool_value;
+            fprintf(fp, " by %s {\n", bool_value ? "E-IfT" : "E-IfF");
+            bool is_printed = fprint_streamed_derivation_impl(
+                fp,
+                value_trace,
+                env,
+                exp->if_exp->exp_cond,
+                value_cond,
+                level + 1
+            );
+            free_value(value_cond);
+            if (!is_printed) {
                 return false;
             }
+
             fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp, premise_list, level + 1)) {
+            Value *value_branch = fprint_streamed_premise(
+                fp,
+                value_trace,
+                env,
+                bool_value ? exp->if_exp->exp_true : exp->if_exp->exp_false,
+                level + 1
+            );
+            if (value_branch == NULL) {
                 return false;
             }
+            free_value(value_branch);
             fprintf(fp, "\n");
-            fprint_indent(fp, level);
-            fprintf(fp, "}");
-            if (level == 0) {
-                fprintf(fp, "\n");
-            }
+            fprint_streamed_end(fp, level);
             return true;
         }
-        case MATCH_NIL_DERIVATION: {
-            MatchNilDerivation *match_nil_derivation = derivation->match_nil_derivation;
-            if (match_nil_derivation == NULL) {
-                return false;
-            }
-
-            if (!fprint_env(fp, derivation->env)) {
-                return false;
-            }
-            if (derivation->env->var_binding != NULL) {
-                fprintf(fp, " ");
-            }
-            fprintf(fp, "|- ");
-
-            if (!fprint_match_exp(fp, match_nil_derivation->match_exp)) {
-                return false;
-            }
-
-            Value *value = match_nil_derivation->value;
-            if (value == NULL) {
-                return false;
-            }
-
-            fprintf(fp, " evalto ");
-            if (!fprint_value(fp, value)) {
-                return false;
-            }
-            fprintf(fp, " by E-MatchNil {\n");
-            if (!fprint_derivation_impl(fp, match_nil_derivation->premise_list, level + 1)) {
+        case LET_EXP: {
+            fprintf(fp, " by E-Let {\n");
+            Value *value_1 = fprint_streamed_premise(fp, value_trace, env, exp->let_exp->exp_1, level + 1);
+            if (value_1 == NULL) {
                 return false;
             }
             fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp,
-                                        match_nil_derivation->premise_match_nil,
-                                        level + 1)) {
+
+            Env *env_new = create_appended_env(env, exp->let_exp->var, value_1);
+            free_value(value_1);
+            Value *value_2 = fprint_streamed_premise(fp, value_trace, env_new, exp->let_exp->exp_2, level + 1);
+            free_env(env_new);
+            if (value_2 == NULL) {
                 return false;
             }
+            free_value(value_2);
             fprintf(fp, "\n");
-            fprint_indent(fp, level);
-            fprintf(fp, "}");
-            if (level == 0) {
-                fprintf(fp, "\n");
-            }
+            fprint_streamed_end(fp, level);
             return true;
         }
-        case MATCH_CONS_DERIVATION: {
-            MatchConsDerivation *match_cons_derivation = derivation->match_cons_derivation;
-            if (match_cons_derivation == NULL) {
-                return false;
-            }
-
-            if (!fprint_env(fp, derivation->env)) {
+        case FUN_EXP: {
+            fprintf(fp, " by E-Fun {}");
+            break;
+        }
+        case APP_EXP: {
+            return fprint_streamed_app_derivation(fp, value_trace, env, exp, level);
+        }
+        case LET_REC_EXP: {
+            Value *rec_closure_value = create_rec_closure_value(
+                create_rec_closure(
+                    env,
+                    exp->let_rec_exp->var_rec,
+                    exp->let_rec_exp->var,
+                    exp->let_rec_exp->exp_1
+                )
+            );
+            Env *env_new = create_appended_env(env, exp->let_rec_exp->var_rec, rec_closure_value);
+            free_value(rec_closure_value);
+            if (env_new == NULL) {
                 return false;
             }
-            if (derivation->env->var_binding != NULL) {
-                fprintf(fp, " ");
-            }
-            fprintf(fp, "|- ");
 
-            if (!fprint_match_exp(fp, match_cons_derivation->match_exp)) {
+            fprintf(fp, " by E-LetRec {\n");
+            Value *value_2 = fprint_streamed_premise(fp, value_trace, env_new, exp->let_rec_exp->exp_2, level + 1);
+            free_env(env_new);
+            if (value_2 == NULL) {
                 return false;
             }
-
-            Value *value = match_cons_derivation->value;
-            if (value == NULL) {
+            free_value(value_2);
+            fprintf(fp, "\n");
+            fprint_streamed_end(fp, level);
+            return true;
+        }
+        case NIL_EXP: {
+            fprintf(fp, " by E-Nil {}");
+            break;
+        }
+        case CONS_EXP: {
+            fprintf(fp, " by E-Cons {\n");
+            Value *value_elem = fprint_streamed_premise(fp, value_trace, env, exp->cons_exp->exp_elem, level + 1);
+            if (value_elem == NULL) {
                 return false;
             }
+            free_value(value_elem);
 
-            fprintf(fp, " evalto ");
-            if (!fprint_value(fp, value)) {
-                return false;
-            }
-            fprintf(fp, " by E-MatchCons {\n");
-            if (!fprint_derivation_impl(fp, match_cons_derivation->premise_list, level + 1)) {
-                return false;
-            }
             fprintf(fp, ";\n");
-            if (!fprint_derivation_impl(fp,
-                                        match_cons_derivation->premise_match_cons,
-                                        level + 1)) {
+            Value *value_list = fprint_streamed_premise(fp, value_trace, env, exp->cons_exp->exp_list, level + 1);
+            if (value_list == NULL) {
                 return false;
             }
+            free_value(value_list);
             fprintf(fp, "\n");
-            fprint_indent(fp, level);
-            fprintf(fp, "}");
-            if (level == 0) {
-                fprintf(fp, "\n");
-            }
+            fprint_streamed_end(fp, level);
             return true;
         }
+        case MATCH_EXP: {
+            return fprint_streamed_match_derivation(fp, value_trace, env, exp, level);
+        }
         default: {
             return false;
         }
     }
+
+    if (level == 0) {
+        fprintf(fp, "\n");
+    }
+    return true;
+}
+
+static bool fprint_streamed_derivation_impl(FILE *fp,
+                                            ValueTrace *value_trace,
+                                            const Env *env,
+                                            const Exp *exp,
+                                            const Value *value,
+                                            const int level) {
+    fprint_indent(fp, level);
+    return fprint_streamed_conclusion(fp, env, exp, value)
+        && fprint_streamed_premises(fp, value_trace, env, exp, value, level);
+}
+
+bool fprint_streamed_derivation(FILE *fp, const Env *env, const Exp *exp) {
+    if (fp == NULL || env == NULL || exp == NULL) {
+        return false;
+    }
+
+    ValueTrace *value_trace = malloc(sizeof(ValueTrace));
+    value_trace->count = 0;
+    value_trace->index = 0;
+    value_trace->is_overflowed = false;
+    value_trace->is_sized = true;
+    Value *value = get_streamed_value(value_trace, env, exp);
+    value_trace->is_sized = false;
+    bool is_printed = value != NULL && fprint_streamed_derivation_impl(fp, value_trace, env, exp, value, 0);
+    free_value(value);
+    clear_value_trace(value_trace);
+    free(value_trace);
+    return is_printed;
 }
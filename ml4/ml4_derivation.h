@@ -4,14 +4,16 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#define DERIVATION_MEMO_BUCKET_COUNT_MIN (1024)
+#define ENV_SIZE_CACHE_CAPACITY (1024)
+#define VALUE_TRACE_CAPACITY (65536)
+
 typedef struct {
     IntExp *int_exp;
-    int int_value;
 } IntDerivation;
 
 typedef struct {
     BoolExp *bool_exp;
-    bool bool_value;
 } BoolDerivation;
 
 typedef struct VarDerivationTag VarDerivation;
@@ -36,7 +38,6 @@ typedef struct LetRecDerivationTag LetRecDerivation;
 
 typedef struct {
     FunExp *fun_exp;
-    Closure *closure_value;
 } FunDerivation;
 
 typedef struct AppRecDerivationTag AppRecDerivation;
@@ -68,9 +69,17 @@ typedef enum {
     MATCH_CONS_DERIVATION
 } DerivationType;
 
+typedef struct {
+    size_t node_count;
+    size_t output_size;
+    size_t line_count;
+} DerivationSize;
+
 typedef struct {
     DerivationType type;
-    Env *env;
+    Env env;
+    Value *value;
+    size_t ref_count;
     union {
         IntDerivation *int_derivation;
         BoolDerivation *bool_derivation;
@@ -90,60 +99,53 @@ typedef struct {
         MatchNilDerivation *match_nil_derivation;
         MatchConsDerivation *match_cons_derivation;
     };
+    DerivationSize sizes[];
 } Derivation;
 
 struct VarDerivationTag {
     VarExp *var_exp;
-    Value *value;
 };
 
 struct PlusDerivationTag {
     Derivation *premise_left;
     Derivation *premise_right;
     OpExp *op_exp;
-    int int_value;
 };
 
 struct MinusDerivationTag {
     Derivation *premise_left;
     Derivation *premise_right;
     OpExp *op_exp;
-    int int_value;
 };
 
 struct TimesDerivationTag {
     Derivation *premise_left;
     Derivation *premise_right;
     OpExp *op_exp;
-    int int_value;
 };
 
 struct LtDerivationTag {
     Derivation *premise_left;
     Derivation *premise_right;
     OpExp *op_exp;
-    bool bool_value;
 };
 
 struct IfTrueDerivationTag {
     Derivation *premise_cond;
     Derivation *premise_true;
     IfExp *if_exp;
-    Value *value;
 };
 
 struct IfFalseDerivationTag {
     Derivation *premise_cond;
     Derivation *premise_false;
     IfExp *if_exp;
-    Value *value;
 };
 
 struct LetDerivationTag {
     Derivation *premise_1;
     Derivation *premise_2;
     LetExp *let_exp;
-    Value *value;
 };
 
 struct AppDerivationTag {
@@ -151,13 +153,11 @@ struct AppDerivationTag {
     Derivation *premise_2;
     Derivation *premise_3;
     AppExp *app_exp;
-    Value *value;
 };
 
 struct LetRecDerivationTag {
     Derivation *premise;
     LetRecExp *let_rec_exp;
-    Value *value;
 };
 
 struct AppRecDerivationTag {
@@ -165,47 +165,78 @@ struct AppRecDerivationTag {
     Derivation *premise_2;
     Derivation *premise_3;
     AppExp *app_exp;
-    Value *value;
 };
 
 struct ConsDerivationTag {
     Derivation *premise_elem;
     Derivation *premise_list;
     ConsExp *cons_exp;
-    Cons *cons_value;
 };
 
 struct MatchNilDerivationTag {
     Derivation *premise_list;
     Derivation *premise_match_nil;
     MatchExp *match_exp;
-    Value *value;
 };
 
 struct MatchConsDerivationTag {
     Derivation *premise_list;
     Derivation *premise_match_cons;
     MatchExp *match_exp;
-    Value *value;
 };
 
+typedef struct DerivationMemoEntryTag {
+    const Exp *exp;
+    Derivation *derivation;
+    size_t hash;
+    struct DerivationMemoEntryTag *next;
+} DerivationMemoEntry;
+
+typedef struct {
+    DerivationMemoEntry **buckets;
+    size_t bucket_count;
+    size_t entry_count;
+} DerivationMemo;
+
+typedef struct {
+    VarBinding *var_binding;
+    size_t size;
+} EnvSizeCacheEntry;
+
+typedef struct {
+    size_t node_count_max;
+    size_t output_size_max;
+    bool is_node_count_exceeded;
+    bool is_output_size_exceeded;
+    EnvSizeCacheEntry env_size_cache[ENV_SIZE_CACHE_CAPACITY];
+} DerivationBudget;
+
 bool try_get_int_value_from_derivation(Derivation *derivation, int *int_value);
 
 bool try_get_bool_value_from_derivation(Derivation *derivation, bool *bool_value);
 
-bool try_get_closure_value_from_derivation(Derivation *derivation, Closure *closure_value);
+Value *create_value_from_derivation(Derivation *derivation);
+
+DerivationMemo *create_derivation_memo(void);
 
-bool try_get_rec_closure_value_from_derivation(Derivation *derivation,
-                                               RecClosure *rec_closure_value);
+void free_derivation_memo(DerivationMemo *derivation_memo);
 
-bool try_get_cons_value_from_derivation(Derivation *derivation, Cons *cons_value);
+void set_current_derivation_memo(DerivationMemo *derivation_memo);
 
-Value *create_value_from_derivation(Derivation *derivation);
+DerivationBudget *create_derivation_budget(const size_t node_count_max, const size_t output_size_max);
+
+void free_derivation_budget(DerivationBudget *derivation_budget);
+
+void set_current_derivation_budget(DerivationBudget *derivation_budget);
+
+size_t get_derivation_output_size(const Derivation *derivation);
 
 Derivation *derive(Exp *exp);
 
 Derivation *derive_impl(const Env *env, Exp *exp);
 
+Derivation *create_copied_derivation(const Derivation *derivation);
+
 void free_derivation(Derivation *derivation);
 
 void fprint_indent(FILE *fp, const int level);
@@ -214,4 +245,6 @@ bool fprint_derivation(FILE *fp, const Derivation *derivation);
 
 bool fprint_derivation_impl(FILE *fp, const Derivation *derivation, const int level);
 
+bool fprint_streamed_derivation(FILE *fp, const Env *env, const Exp *exp);
+
 #endif // ML4_DERIVATION_H
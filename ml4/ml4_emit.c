@@ -0,0 +1,1317 @@
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ml4_semantics.h"
+#include "ml4_emit.h"
+
+typedef struct EmitScopeTag {
+    const Var *var;
+    char name[EMIT_NAME_LEN_MAX];
+    bool is_self;
+    const struct EmitScopeTag *next;
+} EmitScope;
+
+typedef struct {
+    Emitter *emitter;
+    FILE *fp;
+    int index;
+    int local_count;
+    int indent;
+} EmitFunction;
+
+typedef struct {
+    const Var **vars;
+    int count;
+    int capacity;
+} EmitVarSet;
+
+static const char *runtime_lines[] = {
+    "#include <setjmp.h>",
+    "#include <stdbool.h>",
+    "#include <stdint.h>",
+    "#include <stdio.h>",
+    "#include <stdlib.h>",
+    "#include <string.h>",
+    "",
+    "typedef enum {",
+    "    INT_VALUE,",
+    "    BOOL_VALUE,",
+    "    CLOSURE_VALUE,",
+    "    NIL_VALUE,",
+    "    CONS_VALUE,",
+    "    UNBOUND_VALUE",
+    "} ValueType;",
+    "",
+    "typedef struct ClosureTag Closure;",
+    "",
+    "typedef struct ConsTag Cons;",
+    "",
+    "typedef struct BindingTag Binding;",
+    "",
+    "typedef struct {",
+    "    ValueType type;",
+    "    union {",
+    "        int int_value;",
+    "        bool bool_value;",
+    "        Closure *closure_value;",
+    "        Cons *cons_value;",
+    "    };",
+    "} Value;",
+    "",
+    "typedef Value (*Code)(Closure *closure, Value value);",
+    "",
+    "struct ClosureTag {",
+    "    Code code;",
+    "    const char *text;",
+    "    const char *const *names;",
+    "    const Binding *bindings;",
+    "    int count;",
+    "    Value values[];",
+    "};",
+    "",
+    "struct ConsTag {",
+    "    Value elem;",
+    "    Value list;",
+    "};",
+    "",
+    "struct BindingTag {",
+    "    const char *name;",
+    "    Value value;",
+    "    const Binding *next;",
+    "};",
+    "",
+    "#define CHUNK_SIZE (256 * 1024)",
+    "",
+    "#define SMALL_SIZE_MAX (256)",
+    "",
+    "#define COLLECT_SIZE_MIN (8 * 1024 * 1024)",
+    "",
+    "typedef struct {",
+    "    char *start;",
+    "    size_t object_size;",
+    "    size_t object_count;",
+    "    unsigned char *marks;",
+    "} Chunk;",
+    "",
+    "static jmp_buf fail_jmp_buf;",
+    "",
+    "static Chunk *chunks = NULL;",
+    "",
+    "static size_t chunk_count = 0;",
+    "",
+    "static size_t chunk_capacity = 0;",
+    "",
+    "static void *free_lists[SMALL_SIZE_MAX / 16 + 1];",
+    "",
+    "static char **mark_stack = NULL;",
+    "",
+    "static size_t mark_stack_count = 0;",
+    "",
+    "static size_t mark_stack_capacity = 0;",
+    "",
+    "static size_t allocated_size = 0;",
+    "",
+    "static size_t collect_size = COLLECT_SIZE_MIN;",
+    "",
+    "static char *stack_bottom = NULL;",
+    "",
+    "static const Binding *globals = NULL;",
+    "",
+    "static void fail(void) __attribute__((noreturn));",
+    "",
+    "static void fail(void) {",
+    "    longjmp(fail_jmp_buf, 1);",
+    "}",
+    "",
+    "static void *reallocate_or_exit(void *chars, size_t size) {",
+    "    chars = realloc(chars, size);",
+    "    if (chars == NULL) {",
+    "        fprintf(stderr, \"out of memory\\n\");",
+    "        exit(1);",
+    "    }",
+    "    return chars;",
+    "}",
+    "",
+    "static Chunk *add_chunk(size_t object_size, size_t object_count) {",
+    "    if (chunk_count == chunk_capacity) {",
+    "        chunk_capacity = chunk_capacity == 0 ? 64 : chunk_capacity * 2;",
+    "        chunks = reallocate_or_exit(chunks, sizeof(Chunk) * chunk_capacity);",
+    "    }",
+    "",
+    "    char *start = reallocate_or_exit(NULL, object_size * object_count);",
+    "    size_t i = chunk_count;",
+    "    while (0 < i && start < chunks[i - 1].start) {",
+    "        chunks[i] = chunks[i - 1];",
+    "        i--;",
+    "    }",
+    "    chunks[i].start = start;",
+    "    chunks[i].object_size = object_size;",
+    "    chunks[i].object_count = object_count;",
+    "    chunks[i].marks = calloc(object_count, 1);",
+    "    if (chunks[i].marks == NULL) {",
+    "        fprintf(stderr, \"out of memory\\n\");",
+    "        exit(1);",
+    "    }",
+    "    chunk_count++;",
+    "    return &chunks[i];",
+    "}",
+    "",
+    "static Chunk *find_chunk(const char *chars) {",
+    "    if (chunk_count == 0 || chars < chunks[0].start) {",
+    "        return NULL;",
+    "    }",
+    "",
+    "    size_t low = 0;",
+    "    size_t high = chunk_count;",
+    "    while (low < high) {",
+    "        size_t middle = low + (high - low) / 2;",
+    "        Chunk *chunk = &chunks[middle];",
+    "        if (chars < chunk->start) {",
+    "            high = middle;",
+    "        } else if (chunk->start + chunk->object_size * chunk->object_count <= chars) {",
+    "            low = middle + 1;",
+    "        } else {",
+    "            return chunk;",
+    "        }",
+    "    }",
+    "    return NULL;",
+    "}",
+    "",
+    "static void mark_word(uintptr_t word) {",
+    "    Chunk *chunk = find_chunk((const char *) word);",
+    "    if (chunk == NULL) {",
+    "        return;",
+    "    }",
+    "",
+    "    size_t index = ((const char *) word - chunk->start) / chunk->object_size;",
+    "    if (chunk->marks[index]) {",
+    "        return;",
+    "    }",
+    "",
+    "    chunk->marks[index] = 1;",
+    "    if (mark_stack_count == mark_stack_capacity) {",
+    "        mark_stack_capacity = mark_stack_capacity == 0 ? 1024 : mark_stack_capacity * 2;",
+    "        mark_stack = reallocate_or_exit(mark_stack, sizeof(char *) * mark_stack_capacity);",
+    "    }",
+    "    mark_stack[mark_stack_count++] = chunk->start + index * chunk->object_size;",
+    "}",
+    "",
+    "static void mark_range(const char *from, const char *to) {",
+    "    from = (const char *) (((uintptr_t) from + sizeof(uintptr_t) - 1) & ~(uintptr_t) (sizeof(uintptr_t) - 1));",
+    "    for (const char *chars = from; chars + sizeof(uintptr_t) <= to; chars += sizeof(uintptr_t)) {",
+    "        uintptr_t word;",
+    "        memcpy(&word, chars, sizeof(uintptr_t));",
+    "        mark_word(word);",
+    "    }",
+    "}",
+    "",
+    "static void sweep(void) {",
+    "    memset(free_lists, 0, sizeof(free_lists));",
+    "    size_t live_size = 0;",
+    "    size_t count = 0;",
+    "    for (size_t i = 0; i < chunk_count; i++) {",
+    "        Chunk chunk = chunks[i];",
+    "        if (SMALL_SIZE_MAX < chunk.object_size) {",
+    "            if (!chunk.marks[0]) {",
+    "                free(chunk.start);",
+    "                free(chunk.marks);",
+    "                continue;",
+    "            }",
+    "            chunk.marks[0] = 0;",
+    "            live_size += chunk.object_size;",
+    "        } else {",
+    "            void **free_list = &free_lists[chunk.object_size / 16];",
+    "            for (size_t j = chunk.object_count; 0 < j; j--) {",
+    "                if (chunk.marks[j - 1]) {",
+    "                    chunk.marks[j - 1] = 0;",
+    "                    live_size += chunk.object_size;",
+    "                } else {",
+    "                    void **object = (void **) (chunk.start + (j - 1) * chunk.object_size);",
+    "                    *object = *free_list;",
+    "                    *free_list = object;",
+    "                }",
+    "            }",
+    "        }",
+    "        chunks[count++] = chunk;",
+    "    }",
+    "    chunk_count = count;",
+    "    allocated_size = 0;",
+    "    collect_size = COLLECT_SIZE_MIN < live_size * 2 ? live_size * 2 : COLLECT_SIZE_MIN;",
+    "}",
+    "",
+    "static void collect(void) __attribute__((noinline));",
+    "",
+    "static void collect(void) {",
+    "    jmp_buf registers;",
+    "    setjmp(registers);",
+    "    mark_range((const char *) &registers, (const char *) &registers + sizeof(registers));",
+    "    mark_range(__builtin_frame_address(0), stack_bottom);",
+    "    mark_word((uintptr_t) globals);",
+    "    while (0 < mark_stack_count) {",
+    "        char *object = mark_stack[--mark_stack_count];",
+    "        mark_range(object, object + find_chunk(object)->object_size);",
+    "    }",
+    "    sweep();",
+    "}",
+    "",
+    "static void *allocate(size_t size) {",
+    "    size = (size + 15) & ~(size_t) 15;",
+    "    if (collect_size <= allocated_size) {",
+    "        collect();",
+    "    }",
+    "    allocated_size += size;",
+    "",
+    "    if (SMALL_SIZE_MAX < size) {",
+    "        return add_chunk(size, 1)->start;",
+    "    }",
+    "",
+    "    void **free_list = &free_lists[size / 16];",
+    "    if (*free_list == NULL) {",
+    "        Chunk *chunk = add_chunk(size, CHUNK_SIZE / size);",
+    "        for (size_t j = chunk->object_count; 0 < j; j--) {",
+    "            void **object = (void **) (chunk->start + (j - 1) * size);",
+    "            *object = *free_list;",
+    "            *free_list = object;",
+    "        }",
+    "    }",
+    "",
+    "    void **object = *free_list;",
+    "    *free_list = *object;",
+    "    return object;",
+    "}",
+    "",
+    "static inline Value int_value(int int_value) {",
+    "    Value value = { .type = INT_VALUE, .int_value = int_value };",
+    "    return value;",
+    "}",
+    "",
+    "static inline Value bool_value(bool bool_value) {",
+    "    Value value = { .type = BOOL_VALUE, .bool_value = bool_value };",
+    "    return value;",
+    "}",
+    "",
+    "static inline Value nil_value(void) {",
+    "    Value value = { .type = NIL_VALUE };",
+    "    return value;",
+    "}",
+    "",
+    "static inline Value unbound_value(void) {",
+    "    Value value = { .type = UNBOUND_VALUE };",
+    "    return value;",
+    "}",
+    "",
+    "static inline Value bound_value(Value value) {",
+    "    if (value.type == UNBOUND_VALUE) {",
+    "        fail();",
+    "    }",
+    "    return value;",
+    "}",
+    "",
+    "static inline int as_int(Value value) {",
+    "    if (value.type != INT_VALUE) {",
+    "        fail();",
+    "    }",
+    "    return value.int_value;",
+    "}",
+    "",
+    "static inline bool as_bool(Value value) {",
+    "    if (value.type != BOOL_VALUE) {",
+    "        fail();",
+    "    }",
+    "    return value.bool_value;",
+    "}",
+    "",
+    "static inline Value plus_value(Value value_left, Value value_right) {",
+    "    return int_value((int) ((unsigned int) as_int(value_left) + (unsigned int) as_int(value_right)));",
+    "}",
+    "",
+    "static inline Value minus_value(Value value_left, Value value_right) {",
+    "    return int_value((int) ((unsigned int) as_int(value_left) - (unsigned int) as_int(value_right)));",
+    "}",
+    "",
+    "static inline Value times_value(Value value_left, Value value_right) {",
+    "    return int_value((int) ((unsigned int) as_int(value_left) * (unsigned int) as_int(value_right)));",
+    "}",
+    "",
+    "static inline Value lt_value(Value value_left, Value value_right) {",
+    "    return bool_value(as_int(value_left) < as_int(value_right));",
+    "}",
+    "",
+    "static inline Value cons_value(Value value_elem, Value value_list) {",
+    "    Cons *cons = allocate(sizeof(Cons));",
+    "    cons->elem = value_elem;",
+    "    cons->list = value_list;",
+    "    Value value = { .type = CONS_VALUE, .cons_value = cons };",
+    "    return value;",
+    "}",
+    "",
+    "static inline Closure *create_closure(Code code, const char *text, const char *const *names, int count) {",
+    "    Closure *closure = allocate(sizeof(Closure) + sizeof(Value) * count);",
+    "    closure->code = code;",
+    "    closure->text = text;",
+    "    closure->names = names;",
+    "    closure->bindings = NULL;",
+    "    closure->count = count;",
+    "    return closure;",
+    "}",
+    "",
+    "static inline Value closure_value(Closure *closure) {",
+    "    Value value = { .type = CLOSURE_VALUE, .closure_value = closure };",
+    "    return value;",
+    "}",
+    "",
+    "static inline Value apply(Value value_function, Value value_argument) {",
+    "    if (value_function.type != CLOSURE_VALUE) {",
+    "        fail();",
+    "    }",
+    "    return value_function.closure_value->code(value_function.closure_value, value_argument);",
+    "}",
+    "",
+    "static inline void add_global(const char *name, Value value) {",
+    "    Binding *binding = allocate(sizeof(Binding));",
+    "    binding->name = name;",
+    "    binding->value = value;",
+    "    binding->next = globals;",
+    "    globals = binding;",
+    "}",
+    "",
+    "static inline void print_value(Value value);",
+    "",
+    "static inline void print_bindings(const Binding *binding) {",
+    "    if (binding->next != NULL) {",
+    "        print_bindings(binding->next);",
+    "        printf(\", \");",
+    "    }",
+    "    printf(\"%s = \", binding->name);",
+    "    print_value(binding->value);",
+    "}",
+    "",
+    "static inline void print_closure(const Closure *closure) {",
+    "    printf(\"(\");",
+    "    if (closure->bindings != NULL) {",
+    "        print_bindings(closure->bindings);",
+    "    } else {",
+    "        for (int i = 0; i < closure->count; i++) {",
+    "            if (0 < i) {",
+    "                printf(\", \");",
+    "            }",
+    "            printf(\"%s = \", closure->names[i]);",
+    "            print_value(closure->values[i]);",
+    "        }",
+    "    }",
+    "    printf(\")[%s]\", closure->text);",
+    "}",
+    "",
+    "static inline void print_value(Value value) {",
+    "    size_t cons_count = 0;",
+    "    while (value.type == CONS_VALUE) {",
+    "        printf(\"(\");",
+    "        print_value(value.cons_value->elem);",
+    "        printf(\" :: \");",
+    "        cons_count++;",
+    "        value = value.cons_value->list;",
+    "    }",
+    "",
+    "    switch (value.type) {",
+    "        case INT_VALUE: {",
+    "            printf(\"%d\", value.int_value);",
+    "            break;",
+    "        }",
+    "        case BOOL_VALUE: {",
+    "            printf(\"%s\", value.bool_value ? \"true\" : \"false\");",
+    "            break;",
+    "        }",
+    "        case CLOSURE_VALUE: {",
+    "            print_closure(value.closure_value);",
+    "            break;",
+    "        }",
+    "        case NIL_VALUE: {",
+    "            printf(\"[]\");",
+    "            break;",
+    "        }",
+    "        default: {",
+    "            break;",
+    "        }",
+    "    }",
+    "",
+    "    for (size_t i = 0; i < cons_count; i++) {",
+    "        printf(\")\");",
+    "    }",
+    "}",
+    "",
+    "static inline void print_exp_value(Value value) {",
+    "    printf(\"- = \");",
+    "    print_value(value);",
+    "    printf(\"\\n\");",
+    "}",
+    "",
+    "static inline void print_def_value(const char *name, Value value) {",
+    "    printf(\"val %s = \", name);",
+    "    if (value.type == CLOSURE_VALUE) {",
+    "        printf(\"<fun>\");",
+    "    } else {",
+    "        print_value(value);",
+    "    }",
+    "    printf(\"\\n\");",
+    "}",
+    ""
+};
+
+static bool open_emit_stream(EmitStream *stream) {
+    stream->chars = NULL;
+    stream->size = 0;
+    stream->fp = open_memstream(&stream->chars, &stream->size);
+    return stream->fp != NULL;
+}
+
+static void close_emit_stream(EmitStream *stream) {
+    if (stream->fp != NULL) {
+        fclose(stream->fp);
+        stream->fp = NULL;
+    }
+    free(stream->chars);
+    stream->chars = NULL;
+    stream->size = 0;
+}
+
+static void fprint_c_string(FILE *fp, const char *chars) {
+    fprintf(fp, "\"");
+    for (const char *c = chars; *c != '\0'; c++) {
+        switch (*c) {
+            case '"': {
+                fprintf(fp, "\\\"");
+                break;
+            }
+            case '\\': {
+                fprintf(fp, "\\\\");
+                break;
+            }
+            case '\n': {
+                fprintf(fp, "\\n");
+                break;
+            }
+            default: {
+                fputc(*c, fp);
+                break;
+            }
+        }
+    }
+    fprintf(fp, "\"");
+}
+
+static void emit_line(EmitFunction *function, const char *format, ...) {
+    for (int i = 0; i < function->indent; i++) {
+        fprintf(function->fp, "    ");
+    }
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(function->fp, format, args);
+    va_end(args);
+    fprintf(function->fp, "\n");
+}
+
+static int create_local(EmitFunction *function) {
+    return function->local_count++;
+}
+
+static const EmitScope *lookup_emit_scope(const EmitScope *scope, const Var *var) {
+    while (scope != NULL) {
+        if (is_same_var(scope->var, var)) {
+            return scope;
+        }
+
+        scope = scope->next;
+    }
+
+    return NULL;
+}
+
+static bool is_var_in_emit_var_set(const EmitVarSet *var_set, const Var *var) {
+    for (int i = 0; i < var_set->count; i++) {
+        if (is_same_var(var_set->vars[i], var)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void add_var_to_emit_var_set(EmitVarSet *var_set, const Var *var) {
+    if (is_var_in_emit_var_set(var_set, var)) {
+        return;
+    }
+
+    if (var_set->count == var_set->capacity) {
+        var_set->capacity = var_set->capacity == 0 ? 8 : var_set->capacity * 2;
+        var_set->vars = realloc(var_set->vars, sizeof(Var *) * var_set->capacity);
+    }
+    var_set->vars[var_set->count] = var;
+    var_set->count++;
+}
+
+static void collect_emit_free_vars(const Exp *exp, const EmitScope *scope, EmitVarSet *var_set) {
+    if (exp == NULL) {
+        return;
+    }
+
+    switch (exp->type) {
+        case VAR_EXP: {
+            if (lookup_emit_scope(scope, exp->var_exp->var) == NULL) {
+                add_var_to_emit_var_set(var_set, exp->var_exp->var);
+            }
+            return;
+        }
+        case OP_EXP: {
+            collect_emit_free_vars(exp->op_exp->exp_left, scope, var_set);
+            collect_emit_free_vars(exp->op_exp->exp_right, scope, var_set);
+            return;
+        }
+        case IF_EXP: {
+            collect_emit_free_vars(exp->if_exp->exp_cond, scope, var_set);
+            collect_emit_free_vars(exp->if_exp->exp_true, scope, var_set);
+            collect_emit_free_vars(exp->if_exp->exp_false, scope, var_set);
+            return;
+        }
+        case LET_EXP: {
+            EmitScope scope_new = { .var = exp->let_exp->var, .next = scope };
+            collect_emit_free_vars(exp->let_exp->exp_1, scope, var_set);
+            collect_emit_free_vars(exp->let_exp->exp_2, &scope_new, var_set);
+            return;
+        }
+        case FUN_EXP: {
+            EmitScope scope_new = { .var = exp->fun_exp->var, .next = scope };
+            collect_emit_free_vars(exp->fun_exp->exp, &scope_new, var_set);
+            return;
+        }
+        case APP_EXP: {
+            collect_emit_free_vars(exp->app_exp->exp_1, scope, var_set);
+            collect_emit_free_vars(exp->app_exp->exp_2, scope, var_set);
+            return;
+        }
+        case LET_REC_EXP: {
+            EmitScope scope_rec = { .var = exp->let_rec_exp->var_rec, .next = scope };
+            EmitScope scope_new = { .var = exp->let_rec_exp->var, .next = &scope_rec };
+            collect_emit_free_vars(exp->let_rec_exp->exp_1, &scope_new, var_set);
+            collect_emit_free_vars(exp->let_rec_exp->exp_2, &scope_rec, var_set);
+            return;
+        }
+        case CONS_EXP: {
+            collect_emit_free_vars(exp->cons_exp->exp_elem, scope, var_set);
+            collect_emit_free_vars(exp->cons_exp->exp_list, scope, var_set);
+            return;
+        }
+        case MATCH_EXP: {
+            EmitScope scope_elem = { .var = exp->match_exp->var_elem, .next = scope };
+            EmitScope scope_list = { .var = exp->match_exp->var_list, .next = &scope_elem };
+            collect_emit_free_vars(exp->match_exp->exp_list, scope, var_set);
+            collect_emit_free_vars(exp->match_exp->exp_match_nil, scope, var_set);
+            collect_emit_free_vars(exp->match_exp->exp_match_cons, &scope_list, var_set);
+            return;
+        }
+        default: {
+            return;
+        }
+    }
+}
+
+static bool is_emit_var_used(const Exp *exp, const Var *var) {
+    EmitVarSet var_set = { .vars = NULL, .count = 0, .capacity = 0 };
+    collect_emit_free_vars(exp, NULL, &var_set);
+    bool is_used = is_var_in_emit_var_set(&var_set, var);
+    free(var_set.vars);
+    return is_used;
+}
+
+static bool emit_value_exp(EmitFunction *function, const EmitScope *scope, const Exp *exp, char *name);
+
+static bool emit_return_exp(EmitFunction *function, const EmitScope *scope, const Exp *exp);
+
+static bool emit_closure(EmitFunction *function,
+                         const EmitScope *scope,
+                         const Var *var_rec,
+                         const Var *var,
+                         const Exp *exp,
+                         const bool is_global_env,
+                         char *name) {
+    Emitter *emitter = function->emitter;
+
+    EmitVarSet var_set = { .vars = NULL, .count = 0, .capacity = 0 };
+    collect_emit_free_vars(exp, NULL, &var_set);
+
+    bool is_argument_used = false;
+    bool is_closure_used = false;
+    int captured_count = 0;
+    for (int i = 0; i < var_set.count; i++) {
+        if (is_same_var(var_set.vars[i], var)) {
+            is_argument_used = true;
+        } else if (var_rec != NULL && is_same_var(var_set.vars[i], var_rec)) {
+            is_closure_used = true;
+        } else if (lookup_emit_scope(scope, var_set.vars[i]) != NULL) {
+            var_set.vars[captured_count] = var_set.vars[i];
+            captured_count++;
+            is_closure_used = true;
+        }
+    }
+
+    int index = emitter->function_count++;
+    FILE *fp_declarations = emitter->declarations.fp;
+    fprintf(fp_declarations, "static Value function_%d(Closure *closure, Value v0);\n\n", index);
+
+    EmitStream text;
+    if (!open_emit_stream(&text)) {
+        free(var_set.vars);
+        return false;
+    }
+    if (var_rec != NULL) {
+        fprintf(text.fp, "rec ");
+        fprint_var(text.fp, var_rec);
+        fprintf(text.fp, " = ");
+    }
+    fprintf(text.fp, "fun ");
+    fprint_var(text.fp, var);
+    fprintf(text.fp, " -> ");
+    fprint_exp(text.fp, exp);
+    fflush(text.fp);
+    fprintf(fp_declarations, "static const char text_%d[] = ", index);
+    fprint_c_string(fp_declarations, text.chars);
+    fprintf(fp_declarations, ";\n\n");
+    close_emit_stream(&text);
+
+    if (0 < captured_count) {
+        fprintf(fp_declarations, "static const char *const names_%d[] = {", index);
+        for (int i = 0; i < captured_count; i++) {
+            fprintf(fp_declarations, i == 0 ? " " : ", ");
+            fprint_c_string(fp_declarations, var_set.vars[i]->name);
+        }
+        fprintf(fp_declarations, " };\n\n");
+    }
+
+    EmitScope *scopes_captured = NULL;
+    if (0 < captured_count) {
+        scopes_captured = malloc(sizeof(EmitScope) * captured_count);
+    }
+    for (int i = 0; i < captured_count; i++) {
+        scopes_captured[i].var = var_set.vars[i];
+        snprintf(scopes_captured[i].name, EMIT_NAME_LEN_MAX, "closure->values[%d]", i);
+        scopes_captured[i].is_self = false;
+        scopes_captured[i].next = i == 0 ? NULL : &scopes_captured[i - 1];
+    }
+    EmitScope scope_rec = {
+        .var = var_rec,
+        .name = "closure_value(closure)",
+        .is_self = true,
+        .next = scopes_captured == NULL ? NULL : &scopes_captured[captured_count - 1]
+    };
+    EmitScope scope_new = {
+        .var = var,
+        .name = "v0",
+        .is_self = false,
+        .next = var_rec != NULL ? &scope_rec : scope_rec.next
+    };
+
+    EmitStream body;
+    if (!open_emit_stream(&body)) {
+        free(scopes_captured);
+        free(var_set.vars);
+        return false;
+    }
+    EmitFunction function_new = {
+        .emitter = emitter,
+        .fp = body.fp,
+        .index = index,
+        .local_count = 1,
+        .indent = 0
+    };
+    emit_line(&function_new, "static Value function_%d(Closure *closure, Value v0) {", index);
+    function_new.indent++;
+    if (!is_closure_used) {
+        emit_line(&function_new, "(void) closure;");
+    }
+    if (!is_argument_used) {
+        emit_line(&function_new, "(void) v0;");
+    }
+    bool is_emitted = emit_return_exp(&function_new, &scope_new, exp);
+    function_new.indent--;
+    emit_line(&function_new, "}");
+    emit_line(&function_new, "");
+    fflush(body.fp);
+    fwrite(body.chars, 1, body.size, emitter->functions.fp);
+    close_emit_stream(&body);
+    free(scopes_captured);
+
+    if (!is_emitted) {
+        free(var_set.vars);
+        return false;
+    }
+
+    int local = create_local(function);
+    if (0 < captured_count) {
+        emit_line(
+            function,
+            "Closure *c%d = create_closure(function_%d, text_%d, names_%d, %d);",
+            local,
+            index,
+            index,
+            index,
+            captured_count
+        );
+    } else {
+        emit_line(function, "Closure *c%d = create_closure(function_%d, text_%d, NULL, 0);", local, index, index);
+    }
+    for (int i = 0; i < captured_count; i++) {
+        const EmitScope *scope_captured = lookup_emit_scope(scope, var_set.vars[i]);
+        emit_line(function, "c%d->values[%d] = %s;", local, i, scope_captured->name);
+    }
+    if (is_global_env) {
+        emit_line(function, "c%d->bindings = globals;", local);
+    }
+    snprintf(name, EMIT_NAME_LEN_MAX, "closure_value(c%d)", local);
+
+    free(var_set.vars);
+    return true;
+}
+
+static bool is_self_app_exp(const EmitScope *scope, const Exp *exp) {
+    if (exp->app_exp->exp_1 == NULL || exp->app_exp->exp_1->type != VAR_EXP) {
+        return false;
+    }
+
+    const EmitScope *scope_found = lookup_emit_scope(scope, exp->app_exp->exp_1->var_exp->var);
+    return scope_found != NULL && scope_found->is_self;
+}
+
+static bool emit_value_exp(EmitFunction *function, const EmitScope *scope, const Exp *exp, char *name) {
+    if (exp == NULL) {
+        return false;
+    }
+
+    switch (exp->type) {
+        case INT_EXP: {
+            if (exp->int_exp->int_value == INT_MIN) {
+                snprintf(name, EMIT_NAME_LEN_MAX, "int_value(%d - 1)", INT_MIN + 1);
+            } else {
+                snprintf(name, EMIT_NAME_LEN_MAX, "int_value(%d)", exp->int_exp->int_value);
+            }
+            return true;
+        }
+        case BOOL_EXP: {
+            snprintf(name, EMIT_NAME_LEN_MAX, "bool_value(%s)", exp->bool_exp->bool_value ? "true" : "false");
+            return true;
+        }
+        case VAR_EXP: {
+            const EmitScope *scope_found = lookup_emit_scope(scope, exp->var_exp->var);
+            if (scope_found == NULL) {
+                snprintf(name, EMIT_NAME_LEN_MAX, "bound_value(unbound_value())");
+                return true;
+            }
+
+            snprintf(name, EMIT_NAME_LEN_MAX, "%s", scope_found->name);
+            return true;
+        }
+        case OP_EXP: {
+            char name_left[EMIT_NAME_LEN_MAX];
+            char name_right[EMIT_NAME_LEN_MAX];
+            if (!emit_value_exp(function, scope, exp->op_exp->exp_left, name_left)
+                || !emit_value_exp(function, scope, exp->op_exp->exp_right, name_right)) {
+                return false;
+            }
+
+            const char *op_name;
+            switch (exp->op_exp->type) {
+                case PLUS_OP_EXP: {
+                    op_name = "plus";
+                    break;
+                }
+                case MINUS_OP_EXP: {
+                    op_name = "minus";
+                    break;
+                }
+                case TIMES_OP_EXP: {
+                    op_name = "times";
+                    break;
+                }
+                case LT_OP_EXP: {
+                    op_name = "lt";
+                    break;
+                }
+                default: {
+                    return false;
+                }
+            }
+
+            int local = create_local(function);
+            emit_line(function, "Value v%d = %s_value(%s, %s);", local, op_name, name_left, name_right);
+            snprintf(name, EMIT_NAME_LEN_MAX, "v%d", local);
+            return true;
+        }
+        case IF_EXP: {
+            char name_cond[EMIT_NAME_LEN_MAX];
+            char name_branch[EMIT_NAME_LEN_MAX];
+            if (!emit_value_exp(function, scope, exp->if_exp->exp_cond, name_cond)) {
+                return false;
+            }
+
+            int local = create_local(function);
+            emit_line(function, "Value v%d;", local);
+            emit_line(function, "if (as_bool(%s)) {", name_cond);
+            function->indent++;
+            if (!emit_value_exp(function, scope, exp->if_exp->exp_true, name_branch)) {
+                return false;
+            }
+            emit_line(function, "v%d = %s;", local, name_branch);
+            function->indent--;
+            emit_line(function, "} else {");
+            function->indent++;
+            if (!emit_value_exp(function, scope, exp->if_exp->exp_false, name_branch)) {
+                return false;
+            }
+            emit_line(function, "v%d = %s;", local, name_branch);
+            function->indent--;
+            emit_line(function, "}");
+            snprintf(name, EMIT_NAME_LEN_MAX, "v%d", local);
+            return true;
+        }
+        case LET_EXP: {
+            char name_1[EMIT_NAME_LEN_MAX];
+            if (!emit_value_exp(function, scope, exp->let_exp->exp_1, name_1)) {
+                return false;
+            }
+
+            if (!is_emit_var_used(exp->let_exp->exp_2, exp->let_exp->var)) {
+                emit_line(function, "(void) %s;", name_1);
+                return emit_value_exp(function, scope, exp->let_exp->exp_2, name);
+            }
+
+            EmitScope scope_new = { .var = exp->let_exp->var, .is_self = false, .next = scope };
+            snprintf(scope_new.name, EMIT_NAME_LEN_MAX, "v%d", create_local(function));
+            emit_line(function, "Value %s = %s;", scope_new.name, name_1);
+            return emit_value_exp(function, &scope_new, exp->let_exp->exp_2, name);
+        }
+        case FUN_EXP: {
+            return emit_closure(function, scope, NULL, exp->fun_exp->var, exp->fun_exp->exp, false, name);
+        }
+        case APP_EXP: {
+            char name_1[EMIT_NAME_LEN_MAX];
+            char name_2[EMIT_NAME_LEN_MAX];
+            if (!emit_value_exp(function, scope, exp->app_exp->exp_1, name_1)
+                || !emit_value_exp(function, scope, exp->app_exp->exp_2, name_2)) {
+                return false;
+            }
+
+            int local = create_local(function);
+            if (is_self_app_exp(scope, exp)) {
+                emit_line(function, "Value v%d = function_%d(closure, %s);", local, function->index, name_2);
+            } else {
+                emit_line(function, "Value v%d = apply(%s, %s);", local, name_1, name_2);
+            }
+            snprintf(name, EMIT_NAME_LEN_MAX, "v%d", local);
+            return true;
+        }
+        case LET_REC_EXP: {
+            char name_1[EMIT_NAME_LEN_MAX];
+            if (!emit_closure(
+                    function,
+                    scope,
+                    exp->let_rec_exp->var_rec,
+                    exp->let_rec_exp->var,
+                    exp->let_rec_exp->exp_1,
+                    false,
+                    name_1
+                )) {
+                return false;
+            }
+
+            EmitScope scope_new = { .var = exp->let_rec_exp->var_rec, .is_self = false, .next = scope };
+            snprintf(scope_new.name, EMIT_NAME_LEN_MAX, "v%d", create_local(function));
+            emit_line(function, "Value %s = %s;", scope_new.name, name_1);
+            return emit_value_exp(function, &scope_new, exp->let_rec_exp->exp_2, name);
+        }
+        case NIL_EXP: {
+            snprintf(name, EMIT_NAME_LEN_MAX, "nil_value()");
+            return true;
+        }
+        case CONS_EXP: {
+            char name_elem[EMIT_NAME_LEN_MAX];
+            char name_list[EMIT_NAME_LEN_MAX];
+            if (!emit_value_exp(function, scope, exp->cons_exp->exp_elem, name_elem)
+                || !emit_value_exp(function, scope, exp->cons_exp->exp_list, name_list)) {
+                return false;
+            }
+
+            int local = create_local(function);
+            emit_line(function, "Value v%d = cons_value(%s, %s);", local, name_elem, name_list);
+            snprintf(name, EMIT_NAME_LEN_MAX, "v%d", local);
+            return true;
+        }
+        case MATCH_EXP: {
+            char name_list[EMIT_NAME_LEN_MAX];
+            char name_branch[EMIT_NAME_LEN_MAX];
+            if (!emit_value_exp(function, scope, exp->match_exp->exp_list, name_list)) {
+                return false;
+            }
+
+            int local_list = create_local(function);
+            int local = create_local(function);
+            emit_line(function, "Value v%d = %s;", local_list, name_list);
+            emit_line(function, "Value v%d;", local);
+            emit_line(function, "if (v%d.type == NIL_VALUE) {", local_list);
+            function->indent++;
+            if (!emit_value_exp(function, scope, exp->match_exp->exp_match_nil, name_branch)) {
+                return false;
+            }
+            emit_line(function, "v%d = %s;", local, name_branch);
+            function->indent--;
+            emit_line(function, "} else if (v%d.type == CONS_VALUE) {", local_list);
+            function->indent++;
+            EmitScope scope_elem = { .var = exp->match_exp->var_elem, .is_self = false, .next = scope };
+            snprintf(scope_elem.name, EMIT_NAME_LEN_MAX, "v%d.cons_value->elem", local_list);
+            EmitScope scope_list = { .var = exp->match_exp->var_list, .is_self = false, .next = &scope_elem };
+            snprintf(scope_list.name, EMIT_NAME_LEN_MAX, "v%d.cons_value->list", local_list);
+            if (!emit_value_exp(function, &scope_list, exp->match_exp->exp_match_cons, name_branch)) {
+                return false;
+            }
+            emit_line(function, "v%d = %s;", local, name_branch);
+            function->indent--;
+            emit_line(function, "} else {");
+            emit_line(function, "    fail();");
+            emit_line(function, "}");
+            snprintf(name, EMIT_NAME_LEN_MAX, "v%d", local);
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+static bool emit_return_exp(EmitFunction *function, const EmitScope *scope, const Exp *exp) {
+    if (exp == NULL) {
+        return false;
+    }
+
+    switch (exp->type) {
+        case IF_EXP: {
+            char name_cond[EMIT_NAME_LEN_MAX];
+            if (!emit_value_exp(function, scope, exp->if_exp->exp_cond, name_cond)) {
+                return false;
+            }
+
+            emit_line(function, "if (as_bool(%s)) {", name_cond);
+            function->indent++;
+            if (!emit_return_exp(function, scope, exp->if_exp->exp_true)) {
+                return false;
+            }
+            function->indent--;
+            emit_line(function, "} else {");
+            function->indent++;
+            if (!emit_return_exp(function, scope, exp->if_exp->exp_false)) {
+                return false;
+            }
+            function->indent--;
+            emit_line(function, "}");
+            return true;
+        }
+        case LET_EXP: {
+            char name_1[EMIT_NAME_LEN_MAX];
+            if (!emit_value_exp(function, scope, exp->let_exp->exp_1, name_1)) {
+                return false;
+            }
+
+            if (!is_emit_var_used(exp->let_exp->exp_2, exp->let_exp->var)) {
+                emit_line(function, "(void) %s;", name_1);
+                return emit_return_exp(function, scope, exp->let_exp->exp_2);
+            }
+
+            EmitScope scope_new = { .var = exp->let_exp->var, .is_self = false, .next = scope };
+            snprintf(scope_new.name, EMIT_NAME_LEN_MAX, "v%d", create_local(function));
+            emit_line(function, "Value %s = %s;", scope_new.name, name_1);
+            return emit_return_exp(function, &scope_new, exp->let_exp->exp_2);
+        }
+        case APP_EXP: {
+            char name_1[EMIT_NAME_LEN_MAX];
+            char name_2[EMIT_NAME_LEN_MAX];
+            if (!emit_value_exp(function, scope, exp->app_exp->exp_1, name_1)
+                || !emit_value_exp(function, scope, exp->app_exp->exp_2, name_2)) {
+                return false;
+            }
+
+            if (is_self_app_exp(scope, exp)) {
+                emit_line(function, "return function_%d(closure, %s);", function->index, name_2);
+            } else {
+                emit_line(function, "return apply(%s, %s);", name_1, name_2);
+            }
+            return true;
+        }
+        case LET_REC_EXP: {
+            char name_1[EMIT_NAME_LEN_MAX];
+            if (!emit_closure(
+                    function,
+                    scope,
+                    exp->let_rec_exp->var_rec,
+                    exp->let_rec_exp->var,
+                    exp->let_rec_exp->exp_1,
+                    false,
+                    name_1
+                )) {
+                return false;
+            }
+
+            EmitScope scope_new = { .var = exp->let_rec_exp->var_rec, .is_self = false, .next = scope };
+            snprintf(scope_new.name, EMIT_NAME_LEN_MAX, "v%d", create_local(function));
+            emit_line(function, "Value %s = %s;", scope_new.name, name_1);
+            return emit_return_exp(function, &scope_new, exp->let_rec_exp->exp_2);
+        }
+        case MATCH_EXP: {
+            char name_list[EMIT_NAME_LEN_MAX];
+            if (!emit_value_exp(function, scope, exp->match_exp->exp_list, name_list)) {
+                return false;
+            }
+
+            int local_list = create_local(function);
+            emit_line(function, "Value v%d = %s;", local_list, name_list);
+            emit_line(function, "if (v%d.type == NIL_VALUE) {", local_list);
+            function->indent++;
+            if (!emit_return_exp(function, scope, exp->match_exp->exp_match_nil)) {
+                return false;
+            }
+            function->indent--;
+            emit_line(function, "} else if (v%d.type == CONS_VALUE) {", local_list);
+            function->indent++;
+            EmitScope scope_elem = { .var = exp->match_exp->var_elem, .is_self = false, .next = scope };
+            snprintf(scope_elem.name, EMIT_NAME_LEN_MAX, "v%d.cons_value->elem", local_list);
+            EmitScope scope_list = { .var = exp->match_exp->var_list, .is_self = false, .next = &scope_elem };
+            snprintf(scope_list.name, EMIT_NAME_LEN_MAX, "v%d.cons_value->list", local_list);
+            if (!emit_return_exp(function, &scope_list, exp->match_exp->exp_match_cons)) {
+                return false;
+            }
+            function->indent--;
+            emit_line(function, "}");
+            emit_line(function, "fail();");
+            return true;
+        }
+        default: {
+            char name[EMIT_NAME_LEN_MAX];
+            if (!emit_value_exp(function, scope, exp, name)) {
+                return false;
+            }
+
+            emit_line(function, "return %s;", name);
+            return true;
+        }
+    }
+}
+
+static EmitScope *create_global_scopes(const Emitter *emitter) {
+    if (emitter->global_count == 0) {
+        return NULL;
+    }
+
+    EmitScope *scopes = malloc(sizeof(EmitScope) * emitter->global_count);
+    for (int i = 0; i < emitter->global_count; i++) {
+        scopes[i].var = emitter->globals[i].var;
+        snprintf(scopes[i].name, EMIT_NAME_LEN_MAX, "bound_value(g%d)", emitter->globals[i].index);
+        scopes[i].is_self = false;
+        scopes[i].next = i == 0 ? NULL : &scopes[i - 1];
+    }
+    return scopes;
+}
+
+static bool emit_item(Emitter *emitter, const Var *var_rec, const Var *var, const Exp *exp, int *index) {
+    EmitScope *scopes_global = create_global_scopes(emitter);
+    const EmitScope *scope = scopes_global == NULL ? NULL : &scopes_global[emitter->global_count - 1];
+
+    EmitStream body;
+    if (!open_emit_stream(&body)) {
+        free(scopes_global);
+        return false;
+    }
+
+    *index = emitter->item_count++;
+    EmitFunction function = {
+        .emitter = emitter,
+        .fp = body.fp,
+        .index = -1,
+        .local_count = 0,
+        .indent = 0
+    };
+    emit_line(&function, "static Value item_%d(void) {", *index);
+    function.indent++;
+
+    bool is_emitted;
+    if (var_rec != NULL) {
+        char name[EMIT_NAME_LEN_MAX];
+        is_emitted = emit_closure(&function, scope, var_rec, var, exp, true, name);
+        if (is_emitted) {
+            emit_line(&function, "return %s;", name);
+        }
+    } else {
+        is_emitted = emit_return_exp(&function, scope, exp);
+    }
+
+    function.indent--;
+    emit_line(&function, "}");
+    emit_line(&function, "");
+    fflush(body.fp);
+    if (is_emitted) {
+        fwrite(body.chars, 1, body.size, emitter->functions.fp);
+    }
+    close_emit_stream(&body);
+    free(scopes_global);
+    return is_emitted;
+}
+
+Emitter *create_emitter(void) {
+    Emitter *emitter = malloc(sizeof(Emitter));
+    emitter->globals = NULL;
+    emitter->global_count = 0;
+    emitter->global_capacity = 0;
+    emitter->function_count = 0;
+    emitter->item_count = 0;
+    if (!open_emit_stream(&emitter->declarations)
+        || !open_emit_stream(&emitter->functions)
+        || !open_emit_stream(&emitter->main)) {
+        free_emitter(emitter);
+        return NULL;
+    }
+    return emitter;
+}
+
+void free_emitter(Emitter *emitter) {
+    if (emitter == NULL) {
+        return;
+    }
+
+    close_emit_stream(&emitter->declarations);
+    close_emit_stream(&emitter->functions);
+    close_emit_stream(&emitter->main);
+    for (int i = 0; i < emitter->global_count; i++) {
+        free_var(emitter->globals[i].var);
+    }
+    free(emitter->globals);
+    free(emitter);
+}
+
+bool add_exp_to_emitter(Emitter *emitter, const Exp *exp) {
+    if (emitter == NULL || exp == NULL) {
+        return false;
+    }
+
+    int index;
+    if (!emit_item(emitter, NULL, NULL, exp, &index)) {
+        return false;
+    }
+
+    FILE *fp = emitter->main.fp;
+    fprintf(fp, "    if (setjmp(fail_jmp_buf) == 0) {\n");
+    fprintf(fp, "        print_exp_value(item_%d());\n", index);
+    fprintf(fp, "    } else {\n");
+    fprintf(fp, "        printf(\"evaluation failed\\n\");\n");
+    fprintf(fp, "    }\n");
+    return true;
+}
+
+bool add_def_to_emitter(Emitter *emitter, const Def *def) {
+    if (emitter == NULL || def == NULL) {
+        return false;
+    }
+
+    Var *var;
+    int index;
+    switch (def->type) {
+        case LET_DEF: {
+            if (def->let_def == NULL) {
+                return false;
+            }
+
+            var = def->let_def->var;
+            if (!emit_item(emitter, NULL, NULL, def->let_def->exp_1, &index)) {
+                return false;
+            }
+            break;
+        }
+        case LET_REC_DEF: {
+            if (def->let_rec_def == NULL) {
+                return false;
+            }
+
+            var = def->let_rec_def->var_rec;
+            if (!emit_item(
+                    emitter,
+                    def->let_rec_def->var_rec,
+                    def->let_rec_def->var,
+                    def->let_rec_def->exp_1,
+                    &index
+                )) {
+                return false;
+            }
+            break;
+        }
+        default: {
+            return false;
+        }
+    }
+
+    int index_previous = -1;
+    for (int i = emitter->global_count - 1; 0 <= i; i--) {
+        if (is_same_var(emitter->globals[i].var, var)) {
+            index_previous = emitter->globals[i].index;
+            break;
+        }
+    }
+
+    FILE *fp_declarations = emitter->declarations.fp;
+    fprintf(fp_declarations, "static Value g%d;\n\n", index);
+    fprintf(fp_declarations, "static const char global_name_%d[] = ", index);
+    fprint_c_string(fp_declarations, var->name);
+    fprintf(fp_declarations, ";\n\n");
+
+    FILE *fp = emitter->main.fp;
+    fprintf(fp, "    if (setjmp(fail_jmp_buf) == 0) {\n");
+    fprintf(fp, "        g%d = item_%d();\n", index, index);
+    fprintf(fp, "        add_global(global_name_%d, g%d);\n", index, index);
+    fprintf(fp, "        print_def_value(global_name_%d, g%d);\n", index, index);
+    fprintf(fp, "    } else {\n");
+    if (0 <= index_previous) {
+        fprintf(fp, "        g%d = g%d;\n", index, index_previous);
+    } else {
+        fprintf(fp, "        g%d = unbound_value();\n", index);
+    }
+    fprintf(fp, "        printf(\"definition failed\\n\");\n");
+    fprintf(fp, "    }\n");
+
+    if (emitter->global_count == emitter->global_capacity) {
+        emitter->global_capacity = emitter->global_capacity == 0 ? 8 : emitter->global_capacity * 2;
+        emitter->globals = realloc(emitter->globals, sizeof(EmitGlobal) * emitter->global_capacity);
+    }
+    emitter->globals[emitter->global_count].var = create_copied_var(var);
+    emitter->globals[emitter->global_count].index = index;
+    emitter->global_count++;
+    return true;
+}
+
+bool fprint_emitter(FILE *fp, Emitter *emitter) {
+    if (fp == NULL || emitter == NULL) {
+        return false;
+    }
+
+    fflush(emitter->declarations.fp);
+    fflush(emitter->functions.fp);
+    fflush(emitter->main.fp);
+
+    fprintf(fp, "/* generated by ml4 --emit-c; build with gcc -O2 so that tail calls become jumps */\n\n");
+    for (size_t i = 0; i < sizeof(runtime_lines) / sizeof(runtime_lines[0]); i++) {
+        fprintf(fp, "%s\n", runtime_lines[i]);
+    }
+    fwrite(emitter->declarations.chars, 1, emitter->declarations.size, fp);
+    fwrite(emitter->functions.chars, 1, emitter->functions.size, fp);
+    fprintf(fp, "int main(void) {\n");
+    fprintf(fp, "    stack_bottom = __builtin_frame_address(0);\n");
+    fwrite(emitter->main.chars, 1, emitter->main.size, fp);
+    fprintf(fp, "    return 0;\n");
+    fprintf(fp, "}\n");
+    return true;
+}
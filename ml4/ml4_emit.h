@@ -0,0 +1,41 @@
+#ifndef ML4_EMIT_H
+#define ML4_EMIT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define EMIT_NAME_LEN_MAX (64)
+
+typedef struct {
+    FILE *fp;
+    char *chars;
+    size_t size;
+} EmitStream;
+
+typedef struct {
+    Var *var;
+    int index;
+} EmitGlobal;
+
+typedef struct {
+    EmitStream declarations;
+    EmitStream functions;
+    EmitStream main;
+    EmitGlobal *globals;
+    int global_count;
+    int global_capacity;
+    int function_count;
+    int item_count;
+} Emitter;
+
+Emitter *create_emitter(void);
+
+void free_emitter(Emitter *emitter);
+
+bool add_exp_to_emitter(Emitter *emitter, const Exp *exp);
+
+bool add_def_to_emitter(Emitter *emitter, const Def *def);
+
+bool fprint_emitter(FILE *fp, Emitter *emitter);
+
+#endif // ML4_EMIT_H
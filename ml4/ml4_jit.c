@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ml4_semantics.h"
+#include "ml4_jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+typedef struct {
+    unsigned char *bytes;
+    size_t size;
+    size_t capacity;
+    const Var *var_rec;
+    const Var *var;
+    size_t body_offset;
+} JitCompiler;
+
+static bool is_jit_enabled = false;
+
+void set_jit_enabled(const bool is_enabled) {
+    is_jit_enabled = is_enabled;
+}
+
+static bool emit_bytes(JitCompiler *jit_compiler, const unsigned char *bytes, const size_t size) {
+    if (JIT_CODE_SIZE_MAX < jit_compiler->size + size) {
+        return false;
+    }
+
+    if (jit_compiler->capacity < jit_compiler->size + size) {
+        size_t capacity = jit_compiler->capacity == 0 ? 256 : jit_compiler->capacity * 2;
+        while (capacity < jit_compiler->size + size) {
+            capacity *= 2;
+        }
+
+        unsigned char *bytes_new = realloc(jit_compiler->bytes, capacity);
+        if (bytes_new == NULL) {
+            return false;
+        }
+
+        jit_compiler->bytes = bytes_new;
+        jit_compiler->capacity = capacity;
+    }
+
+    memcpy(jit_compiler->bytes + jit_compiler->size, bytes, size);
+    jit_compiler->size += size;
+    return true;
+}
+
+static bool emit_int32(JitCompiler *jit_compiler, const int int_value) {
+    unsigned char bytes[4];
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (unsigned char) ((unsigned int) int_value >> (8 * i));
+    }
+
+    return emit_bytes(jit_compiler, bytes, 4);
+}
+
+static void patch_int32(JitCompiler *jit_compiler, const size_t offset, const int int_value) {
+    for (int i = 0; i < 4; i++) {
+        jit_compiler->bytes[offset + i] = (unsigned char) ((unsigned int) int_value >> (8 * i));
+    }
+}
+
+static bool emit_jump(JitCompiler *jit_compiler,
+                      const unsigned char *opcode,
+                      const size_t opcode_size,
+                      size_t *offset_patch) {
+    if (!emit_bytes(jit_compiler, opcode, opcode_size)) {
+        return false;
+    }
+
+    *offset_patch = jit_compiler->size;
+    return emit_int32(jit_compiler, 0);
+}
+
+static void patch_jump_here(JitCompiler *jit_compiler, const size_t offset_patch) {
+    patch_int32(jit_compiler, offset_patch, (int) (jit_compiler->size - (offset_patch + 4)));
+}
+
+static bool emit_jump_to(JitCompiler *jit_compiler,
+                         const unsigned char *opcode,
+                         const size_t opcode_size,
+                         const size_t offset_target) {
+    if (!emit_bytes(jit_compiler, opcode, opcode_size)) {
+        return false;
+    }
+
+    return emit_int32(jit_compiler, (int) offset_target - (int) (jit_compiler->size + 4));
+}
+
+static bool compile_jit_int_exp(JitCompiler *jit_compiler, const Exp *exp, const bool is_tail);
+
+static bool compile_jit_bool_exp(JitCompiler *jit_compiler, const Exp *exp);
+
+static bool compile_jit_operands(JitCompiler *jit_compiler, const OpExp *op_exp) {
+    static const unsigned char push_rax[] = { 0x50 };
+    static const unsigned char mov_ecx_eax_pop_rax[] = { 0x89, 0xc1, 0x58 };
+
+    return compile_jit_int_exp(jit_compiler, op_exp->exp_left, false)
+        && emit_bytes(jit_compiler, push_rax, sizeof(push_rax))
+        && compile_jit_int_exp(jit_compiler, op_exp->exp_right, false)
+        && emit_bytes(jit_compiler, mov_ecx_eax_pop_rax, sizeof(mov_ecx_eax_pop_rax));
+}
+
+static bool compile_jit_lt(JitCompiler *jit_compiler, const OpExp *op_exp) {
+    static const unsigned char cmp_eax_imm32[] = { 0x3d };
+    static const unsigned char cmp_eax_ecx[] = { 0x39, 0xc8 };
+
+    const Exp *exp_right = op_exp->exp_right;
+    if (exp_right != NULL && exp_right->type == INT_EXP) {
+        return compile_jit_int_exp(jit_compiler, op_exp->exp_left, false)
+            && emit_bytes(jit_compiler, cmp_eax_imm32, sizeof(cmp_eax_imm32))
+            && emit_int32(jit_compiler, exp_right->int_exp->int_value);
+    }
+
+    return compile_jit_operands(jit_compiler, op_exp)
+        && emit_bytes(jit_compiler, cmp_eax_ecx, sizeof(cmp_eax_ecx));
+}
+
+static bool compile_jit_jump_if_false(JitCompiler *jit_compiler, const Exp *exp_cond, size_t *offset_patch) {
+    static const unsigned char jge[] = { 0x0f, 0x8d };
+    static const unsigned char test_eax_eax[] = { 0x85, 0xc0 };
+    static const unsigned char je[] = { 0x0f, 0x84 };
+
+    if (exp_cond == NULL) {
+        return false;
+    }
+
+    if (exp_cond->type == OP_EXP && exp_cond->op_exp->type == LT_OP_EXP) {
+        return compile_jit_lt(jit_compiler, exp_cond->op_exp)
+            && emit_jump(jit_compiler, jge, sizeof(jge), offset_patch);
+    }
+
+    return compile_jit_bool_exp(jit_compiler, exp_cond)
+        && emit_bytes(jit_compiler, test_eax_eax, sizeof(test_eax_eax))
+        && emit_jump(jit_compiler, je, sizeof(je), offset_patch);
+}
+
+static bool compile_jit_if_exp(JitCompiler *jit_compiler, const IfExp *if_exp, const bool is_int, const bool is_tail) {
+    static const unsigned char jmp[] = { 0xe9 };
+
+    size_t offset_false;
+    if (!compile_jit_jump_if_false(jit_compiler, if_exp->exp_cond, &offset_false)) {
+        return false;
+    }
+
+    if (is_int
+        ? !compile_jit_int_exp(jit_compiler, if_exp->exp_true, is_tail)
+        : !compile_jit_bool_exp(jit_compiler, if_exp->exp_true)) {
+        return false;
+    }
+
+    size_t offset_end;
+    if (!emit_jump(jit_compiler, jmp, sizeof(jmp), &offset_end)) {
+        return false;
+    }
+
+    patch_jump_here(jit_compiler, offset_false);
+    if (is_int
+        ? !compile_jit_int_exp(jit_compiler, if_exp->exp_false, is_tail)
+        : !compile_jit_bool_exp(jit_compiler, if_exp->exp_false)) {
+        return false;
+    }
+
+    patch_jump_here(jit_compiler, offset_end);
+    return true;
+}
+
+static bool compile_jit_bool_exp(JitCompiler *jit_compiler, const Exp *exp) {
+    static const unsigned char mov_eax_imm32[] = { 0xb8 };
+    static const unsigned char setl_al_movzx_eax_al[] = { 0x0f, 0x9c, 0xc0, 0x0f, 0xb6, 0xc0 };
+
+    if (exp == NULL) {
+        return false;
+    }
+
+    switch (exp->type) {
+        case BOOL_EXP: {
+            return emit_bytes(jit_compiler, mov_eax_imm32, sizeof(mov_eax_imm32))
+                && emit_int32(jit_compiler, exp->bool_exp->bool_value ? 1 : 0);
+        }
+        case OP_EXP: {
+            if (exp->op_exp->type != LT_OP_EXP) {
+                return false;
+            }
+
+            return compile_jit_lt(jit_compiler, exp->op_exp)
+                && emit_bytes(jit_compiler, setl_al_movzx_eax_al, sizeof(setl_al_movzx_eax_al));
+        }
+        case IF_EXP: {
+            return compile_jit_if_exp(jit_compiler, exp->if_exp, false, false);
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+static bool compile_jit_int_exp(JitCompiler *jit_compiler, const Exp *exp, const bool is_tail) {
+    static const unsigned char mov_eax_imm32[] = { 0xb8 };
+    static const unsigned char mov_eax_ebx[] = { 0x89, 0xd8 };
+    static const unsigned char add_eax_imm32[] = { 0x05 };
+    static const unsigned char sub_eax_imm32[] = { 0x2d };
+    static const unsigned char imul_eax_eax_imm32[] = { 0x69, 0xc0 };
+    static const unsigned char add_eax_ecx[] = { 0x01, 0xc8 };
+    static const unsigned char sub_eax_ecx[] = { 0x29, 0xc8 };
+    static const unsigned char imul_eax_ecx[] = { 0x0f, 0xaf, 0xc1 };
+    static const unsigned char mov_ebx_eax_jmp[] = { 0x89, 0xc3, 0xe9 };
+    static const unsigned char mov_edi_eax_call[] = { 0x89, 0xc7, 0xe8 };
+
+    if (exp == NULL) {
+        return false;
+    }
+
+    switch (exp->type) {
+        case INT_EXP: {
+            return emit_bytes(jit_compiler, mov_eax_imm32, sizeof(mov_eax_imm32))
+                && emit_int32(jit_compiler, exp->int_exp->int_value);
+        }
+        case VAR_EXP: {
+            if (!is_same_var(exp->var_exp->var, jit_compiler->var)) {
+                return false;
+            }
+
+            return emit_bytes(jit_compiler, mov_eax_ebx, sizeof(mov_eax_ebx));
+        }
+        case OP_EXP: {
+            const OpExp *op_exp = exp->op_exp;
+            const unsigned char *op_imm32;
+            size_t op_imm32_size;
+            const unsigned char *op;
+            size_t op_size;
+            switch (op_exp->type) {
+                case PLUS_OP_EXP: {
+                    op_imm32 = add_eax_imm32;
+                    op_imm32_size = sizeof(add_eax_imm32);
+                    op = add_eax_ecx;
+                    op_size = sizeof(add_eax_ecx);
+                    break;
+                }
+                case MINUS_OP_EXP: {
+                    op_imm32 = sub_eax_imm32;
+                    op_imm32_size = sizeof(sub_eax_imm32);
+                    op = sub_eax_ecx;
+                    op_size = sizeof(sub_eax_ecx);
+                    break;
+                }
+                case TIMES_OP_EXP: {
+                    op_imm32 = imul_eax_eax_imm32;
+                    op_imm32_size = sizeof(imul_eax_eax_imm32);
+                    op = imul_eax_ecx;
+                    op_size = sizeof(imul_eax_ecx);
+                    break;
+                }
+                default: {
+                    return false;
+                }
+            }
+
+            const Exp *exp_right = op_exp->exp_right;
+            if (exp_right != NULL && exp_right->type == INT_EXP) {
+                return compile_jit_int_exp(jit_compiler, op_exp->exp_left, false)
+                    && emit_bytes(jit_compiler, op_imm32, op_imm32_size)
+                    && emit_int32(jit_compiler, exp_right->int_exp->int_value);
+            }
+
+            return compile_jit_operands(jit_compiler, op_exp)
+                && emit_bytes(jit_compiler, op, op_size);
+        }
+        case IF_EXP: {
+            return compile_jit_if_exp(jit_compiler, exp->if_exp, true, is_tail);
+        }
+        case APP_EXP: {
+            const Exp *exp_function = exp->app_exp->exp_1;
+            if (exp_function == NULL
+                || exp_function->type != VAR_EXP
+                || is_same_var(exp_function->var_exp->var, jit_compiler->var)
+                || !is_same_var(exp_function->var_exp->var, jit_compiler->var_rec)) {
+                return false;
+            }
+
+            if (!compile_jit_int_exp(jit_compiler, exp->app_exp->exp_2, false)) {
+                return false;
+            }
+
+            if (is_tail) {
+                return emit_jump_to(jit_compiler, mov_ebx_eax_jmp, sizeof(mov_ebx_eax_jmp), jit_compiler->body_offset);
+            }
+
+            return emit_jump_to(jit_compiler, mov_edi_eax_call, sizeof(mov_edi_eax_call), 0);
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+static bool compile_jit_body(JitCompiler *jit_compiler, const Exp *exp) {
+    static const unsigned char push_rbx_mov_ebx_edi[] = { 0x53, 0x89, 0xfb };
+    static const unsigned char pop_rbx_ret[] = { 0x5b, 0xc3 };
+
+    if (!emit_bytes(jit_compiler, push_rbx_mov_ebx_edi, sizeof(push_rbx_mov_ebx_edi))) {
+        return false;
+    }
+
+    jit_compiler->body_offset = jit_compiler->size;
+    return compile_jit_int_exp(jit_compiler, exp, true)
+        && emit_bytes(jit_compiler, pop_rbx_ret, sizeof(pop_rbx_ret));
+}
+
+static bool install_jit_function(JitFunction *jit_function, const JitCompiler *jit_compiler) {
+#if defined(__x86_64__) && defined(__linux__)
+    void *code = mmap(
+        NULL,
+        jit_compiler->size,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0
+    );
+    if (code == MAP_FAILED) {
+        return false;
+    }
+
+    memcpy(code, jit_compiler->bytes, jit_compiler->size);
+    if (mprotect(code, jit_compiler->size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, jit_compiler->size);
+        return false;
+    }
+
+    jit_function->entry = (JitEntry) code;
+    jit_function->code = code;
+    jit_function->code_size = jit_compiler->size;
+    return true;
+#else
+    return false;
+#endif
+}
+
+JitFunction *compile_jit_function(const RecClosure *rec_closure) {
+    if (rec_closure == NULL) {
+        return NULL;
+    }
+
+    JitFunction *jit_function = malloc(sizeof(JitFunction));
+    jit_function->entry = NULL;
+    jit_function->code = NULL;
+    jit_function->code_size = 0;
+    jit_function->ref_count = 1;
+
+    JitCompiler jit_compiler = {
+        .bytes = NULL,
+        .size = 0,
+        .capacity = 0,
+        .var_rec = rec_closure->var_rec,
+        .var = rec_closure->var,
+        .body_offset = 0
+    };
+    if (compile_jit_body(&jit_compiler, rec_closure->exp)) {
+        install_jit_function(jit_function, &jit_compiler);
+    }
+
+    free(jit_compiler.bytes);
+    return jit_function;
+}
+
+JitFunction *create_copied_jit_function(const JitFunction *jit_function) {
+    if (jit_function == NULL) {
+        return NULL;
+    }
+
+    JitFunction *jit_function_shared = (JitFunction *) jit_function;
+    jit_function_shared->ref_count++;
+    return jit_function_shared;
+}
+
+void free_jit_function(JitFunction *jit_function) {
+    if (jit_function == NULL) {
+        return;
+    }
+
+    jit_function->ref_count--;
+    if (0 < jit_function->ref_count) {
+        return;
+    }
+
+#if defined(__x86_64__) && defined(__linux__)
+    if (jit_function->code != NULL) {
+        munmap(jit_function->code, jit_function->code_size);
+    }
+#endif
+    free(jit_function);
+}
+
+bool try_apply_jit(RecClosure *rec_closure, const Value *value_argument, Value **value) {
+    if (!is_jit_enabled || value_argument->type != INT_VALUE) {
+        return false;
+    }
+
+    if (rec_closure->jit_function == NULL) {
+        rec_closure->apply_count++;
+        if (rec_closure->apply_count < JIT_HOT_COUNT_MIN) {
+            return false;
+        }
+
+        rec_closure->jit_function = compile_jit_function(rec_closure);
+    }
+
+    if (rec_closure->jit_function->entry == NULL) {
+        return false;
+    }
+
+    *value = create_int_value(rec_closure->jit_function->entry(value_argument->int_value));
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef ML4_JIT_H
+#define ML4_JIT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define JIT_HOT_COUNT_MIN (16)
+
+#define JIT_CODE_SIZE_MAX (64 * 1024)
+
+typedef int (*JitEntry)(int int_argument);
+
+struct JitFunctionTag {
+    JitEntry entry;
+    void *code;
+    size_t code_size;
+    size_t ref_count;
+};
+
+void set_jit_enabled(const bool is_enabled);
+
+JitFunction *compile_jit_function(const RecClosure *rec_closure);
+
+JitFunction *create_copied_jit_function(const JitFunction *jit_function);
+
+void free_jit_function(JitFunction *jit_function);
+
+bool try_apply_jit(RecClosure *rec_closure, const Value *value_argument, Value **value);
+
+#endif // ML4_JIT_H
@@ -0,0 +1,1103 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ml4_semantics.h"
+#include "ml4_node.h"
+
+typedef struct NodeScopeTag {
+    const Var *var;
+    int slot;
+    const struct NodeScopeTag *next;
+} NodeScope;
+
+typedef struct {
+    const Env *env;
+    NodeFunction *node_function;
+} NodeCompiler;
+
+static Value value_tail_call = { .type = NIL_VALUE, .ref_count = 0 };
+
+static Value *apply_node_function(Value *value_function, Value *value_argument);
+
+static bool apply_node_function_int(Value *value_function, Value *value_argument, int *int_value);
+
+static Value *evaluate_app_node(const Node *node, NodeFrame *frame);
+
+static bool evaluate_int_node(const Node *node, NodeFrame *frame, int *int_value) {
+    Value *value = node->handler(node, frame);
+    if (value == &value_tail_call) {
+        value = apply_node_function(frame->value_function, frame->value_argument);
+    }
+    if (value == NULL) {
+        return false;
+    }
+
+    if (value->type != INT_VALUE) {
+        free_value(value);
+        return false;
+    }
+
+    *int_value = value->int_value;
+    free_value(value);
+    return true;
+}
+
+static bool evaluate_bool_node(const Node *node, NodeFrame *frame, bool *bool_value) {
+    Value *value = node->handler(node, frame);
+    if (value == NULL) {
+        return false;
+    }
+
+    if (value->type != BOOL_VALUE) {
+        free_value(value);
+        return false;
+    }
+
+    *bool_value = value->bool_value;
+    free_value(value);
+    return true;
+}
+
+static Value *evaluate_int_const_node(const Node *node, NodeFrame *frame) {
+    (void) frame;
+    return create_int_value(node->int_value);
+}
+
+static bool evaluate_int_const_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    (void) frame;
+    *int_value = node->int_value;
+    return true;
+}
+
+static Value *evaluate_bool_const_node(const Node *node, NodeFrame *frame) {
+    (void) frame;
+    return create_bool_value(node->int_value);
+}
+
+static bool evaluate_bool_const_node_bool(const Node *node, NodeFrame *frame, bool *bool_value) {
+    (void) frame;
+    *bool_value = node->int_value;
+    return true;
+}
+
+static Value *evaluate_nil_node(const Node *node, NodeFrame *frame) {
+    (void) node;
+    (void) frame;
+    return create_nil_value();
+}
+
+static Value *evaluate_slot_node(const Node *node, NodeFrame *frame) {
+    return create_copied_value(frame->slots[node->slot]);
+}
+
+static bool evaluate_slot_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    const Value *value = frame->slots[node->slot];
+    if (value == NULL || value->type != INT_VALUE) {
+        return false;
+    }
+
+    *int_value = value->int_value;
+    return true;
+}
+
+static bool evaluate_slot_node_bool(const Node *node, NodeFrame *frame, bool *bool_value) {
+    const Value *value = frame->slots[node->slot];
+    if (value == NULL || value->type != BOOL_VALUE) {
+        return false;
+    }
+
+    *bool_value = value->bool_value;
+    return true;
+}
+
+static Value *evaluate_global_node(const Node *node, NodeFrame *frame) {
+    (void) frame;
+    return create_copied_value(node->var_binding->value);
+}
+
+static bool evaluate_global_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    (void) frame;
+    const Value *value = node->var_binding->value;
+    if (value->type != INT_VALUE) {
+        return false;
+    }
+
+    *int_value = value->int_value;
+    return true;
+}
+
+static bool evaluate_global_node_bool(const Node *node, NodeFrame *frame, bool *bool_value) {
+    (void) frame;
+    const Value *value = node->var_binding->value;
+    if (value->type != BOOL_VALUE) {
+        return false;
+    }
+
+    *bool_value = value->bool_value;
+    return true;
+}
+
+static Value *evaluate_int_op_node(const Node *node, NodeFrame *frame) {
+    int int_value;
+    if (!node->int_handler(node, frame, &int_value)) {
+        return NULL;
+    }
+
+    return create_int_value(int_value);
+}
+
+static Value *evaluate_bool_op_node(const Node *node, NodeFrame *frame) {
+    bool bool_value;
+    if (!node->bool_handler(node, frame, &bool_value)) {
+        return NULL;
+    }
+
+    return create_bool_value(bool_value);
+}
+
+static bool evaluate_plus_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    int int_value_left;
+    int int_value_right;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)
+        || !node->node_2->int_handler(node->node_2, frame, &int_value_right)) {
+        return false;
+    }
+
+    *int_value = int_value_left + int_value_right;
+    return true;
+}
+
+static bool evaluate_plus_const_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    int int_value_left;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)) {
+        return false;
+    }
+
+    *int_value = int_value_left + node->int_value;
+    return true;
+}
+
+static bool evaluate_minus_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    int int_value_left;
+    int int_value_right;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)
+        || !node->node_2->int_handler(node->node_2, frame, &int_value_right)) {
+        return false;
+    }
+
+    *int_value = int_value_left - int_value_right;
+    return true;
+}
+
+static bool evaluate_minus_const_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    int int_value_left;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)) {
+        return false;
+    }
+
+    *int_value = int_value_left - node->int_value;
+    return true;
+}
+
+static bool evaluate_times_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    int int_value_left;
+    int int_value_right;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)
+        || !node->node_2->int_handler(node->node_2, frame, &int_value_right)) {
+        return false;
+    }
+
+    *int_value = int_value_left * int_value_right;
+    return true;
+}
+
+static bool evaluate_times_const_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    int int_value_left;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)) {
+        return false;
+    }
+
+    *int_value = int_value_left * node->int_value;
+    return true;
+}
+
+static bool evaluate_lt_node_bool(const Node *node, NodeFrame *frame, bool *bool_value) {
+    int int_value_left;
+    int int_value_right;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)
+        || !node->node_2->int_handler(node->node_2, frame, &int_value_right)) {
+        return false;
+    }
+
+    *bool_value = int_value_left < int_value_right;
+    return true;
+}
+
+static bool evaluate_lt_const_node_bool(const Node *node, NodeFrame *frame, bool *bool_value) {
+    int int_value_left;
+    if (!node->node_1->int_handler(node->node_1, frame, &int_value_left)) {
+        return false;
+    }
+
+    *bool_value = int_value_left < node->int_value;
+    return true;
+}
+
+static Value *evaluate_if_node(const Node *node, NodeFrame *frame) {
+    bool bool_value_cond;
+    if (!node->node_1->bool_handler(node->node_1, frame, &bool_value_cond)) {
+        return NULL;
+    }
+
+    const Node *node_branch = bool_value_cond ? node->node_2 : node->node_3;
+    return node_branch->handler(node_branch, frame);
+}
+
+static bool evaluate_if_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    bool bool_value_cond;
+    if (!node->node_1->bool_handler(node->node_1, frame, &bool_value_cond)) {
+        return false;
+    }
+
+    const Node *node_branch = bool_value_cond ? node->node_2 : node->node_3;
+    return node_branch->int_handler(node_branch, frame, int_value);
+}
+
+static Value *evaluate_let_node(const Node *node, NodeFrame *frame) {
+    Value *value_1 = node->node_1->handler(node->node_1, frame);
+    if (value_1 == NULL) {
+        return NULL;
+    }
+
+    free_value(frame->slots[node->slot]);
+    frame->slots[node->slot] = value_1;
+    return node->node_2->handler(node->node_2, frame);
+}
+
+static Env *create_captured_env(const NodeFunction *node_function, NodeFrame *frame) {
+    Env *env_captured = malloc(sizeof(Env));
+    env_captured->var_binding = NULL;
+
+    for (int i = 0; i < node_function->captured_count; i++) {
+        const Value *value = node_function->captured_var_bindings[i] != NULL
+            ? node_function->captured_var_bindings[i]->value
+            : frame->slots[node_function->captured_slots[i]];
+
+        VarBinding *var_binding = malloc(sizeof(VarBinding));
+        var_binding->var = create_copied_var(node_function->captured_vars[i]);
+        var_binding->value = create_copied_value(value);
+        var_binding->next = env_captured->var_binding;
+        var_binding->ref_count = 1;
+        env_captured->var_binding = var_binding;
+    }
+
+    return env_captured;
+}
+
+static Value *evaluate_fun_node(const Node *node, NodeFrame *frame) {
+    const NodeFunction *node_function = node->node_function;
+    Env *env_captured = create_captured_env(node_function, frame);
+
+    Closure *closure = create_closure(env_captured, node_function->var, node_function->exp);
+    free_env(env_captured);
+    if (closure == NULL) {
+        return NULL;
+    }
+
+    closure->node_function = create_copied_node_function(node_function);
+    return create_closure_value(closure);
+}
+
+static Value *evaluate_let_rec_node(const Node *node, NodeFrame *frame) {
+    const NodeFunction *node_function = node->node_function;
+    Env *env_captured = create_captured_env(node_function, frame);
+
+    RecClosure *rec_closure = create_rec_closure(
+        env_captured,
+        node_function->var_rec,
+        node_function->var,
+        node_function->exp
+    );
+    free_env(env_captured);
+    if (rec_closure == NULL) {
+        return NULL;
+    }
+
+    rec_closure->node_function = create_copied_node_function(node_function);
+
+    free_value(frame->slots[node->slot]);
+    frame->slots[node->slot] = create_rec_closure_value(rec_closure);
+    return node->node_2->handler(node->node_2, frame);
+}
+
+static Value *evaluate_app_node(const Node *node, NodeFrame *frame) {
+    Value *value_1 = node->node_1->handler(node->node_1, frame);
+    if (value_1 == NULL) {
+        return NULL;
+    }
+
+    Value *value_2 = node->node_2->handler(node->node_2, frame);
+    if (value_2 == NULL) {
+        free_value(value_1);
+        return NULL;
+    }
+
+    return apply_node_function(value_1, value_2);
+}
+
+static bool evaluate_app_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    Value *value_1 = node->node_1->handler(node->node_1, frame);
+    if (value_1 == NULL) {
+        return false;
+    }
+
+    Value *value_2 = node->node_2->handler(node->node_2, frame);
+    if (value_2 == NULL) {
+        free_value(value_1);
+        return false;
+    }
+
+    return apply_node_function_int(value_1, value_2, int_value);
+}
+
+static bool evaluate_tail_app_node_int(const Node *node, NodeFrame *frame, int *int_value) {
+    Value *value = evaluate_app_node(node, frame);
+    if (value == NULL) {
+        return false;
+    }
+
+    bool is_int = value->type == INT_VALUE;
+    *int_value = value->int_value;
+    free_value(value);
+    return is_int;
+}
+
+static Value *evaluate_tail_app_node(const Node *node, NodeFrame *frame) {
+    Value *value_1 = node->node_1->handler(node->node_1, frame);
+    if (value_1 == NULL) {
+        return NULL;
+    }
+
+    Value *value_2 = node->node_2->handler(node->node_2, frame);
+    if (value_2 == NULL) {
+        free_value(value_1);
+        return NULL;
+    }
+
+    frame->value_function = value_1;
+    frame->value_argument = value_2;
+    return &value_tail_call;
+}
+
+static Value *evaluate_cons_node(const Node *node, NodeFrame *frame) {
+    Value *value_elem = node->node_1->handler(node->node_1, frame);
+    if (value_elem == NULL) {
+        return NULL;
+    }
+
+    Value *value_list = node->node_2->handler(node->node_2, frame);
+    if (value_list == NULL) {
+        free_value(value_elem);
+        return NULL;
+    }
+
+    Value *value = create_list_value(value_elem, value_list);
+    free_value(value_elem);
+    free_value(value_list);
+    return value;
+}
+
+static Value *evaluate_match_node(const Node *node, NodeFrame *frame) {
+    Value *value_list = node->node_1->handler(node->node_1, frame);
+    if (value_list == NULL) {
+        return NULL;
+    }
+
+    switch (value_list->type) {
+        case NIL_VALUE: {
+            free_value(value_list);
+            return node->node_2->handler(node->node_2, frame);
+        }
+        case CONS_VALUE:
+        case PACKED_CONS_VALUE: {
+            free_value(frame->slots[node->slot]);
+            frame->slots[node->slot] = NULL;
+            free_value(frame->slots[node->slot_list]);
+            frame->slots[node->slot_list] = NULL;
+            if (!try_take_elem_and_list(value_list, &frame->slots[node->slot], &frame->slots[node->slot_list])) {
+                return NULL;
+            }
+            return node->node_3->handler(node->node_3, frame);
+        }
+        default: {
+            free_value(value_list);
+            return NULL;
+        }
+    }
+}
+
+static const NodeFunction *get_node_function(const Value *value_function, const Env **env) {
+    switch (value_function->type) {
+        case CLOSURE_VALUE: {
+            *env = value_function->closure_value->env;
+            return value_function->closure_value->node_function;
+        }
+        case REC_CLOSURE_VALUE: {
+            *env = value_function->rec_closure_value->env;
+            return value_function->rec_closure_value->node_function;
+        }
+        default: {
+            *env = NULL;
+            return NULL;
+        }
+    }
+}
+
+static void enter_node_function(const NodeFunction *node_function,
+                                const Env *env,
+                                Value *value_function,
+                                Value *value_argument,
+                                Value **slots) {
+    for (int i = 0; i < node_function->slot_count; i++) {
+        slots[i] = NULL;
+    }
+
+    int slot = node_function->captured_count;
+    if (env != NULL) {
+        VarBinding *var_binding = env->var_binding;
+        for (int i = slot - 1; 0 <= i; i--) {
+            slots[i] = create_copied_value(var_binding->value);
+            var_binding = var_binding->next;
+        }
+    }
+    if (node_function->is_rec) {
+        slots[slot++] = create_copied_value(value_function);
+    }
+    if (node_function->var != NULL) {
+        slots[slot] = value_argument;
+    }
+}
+
+static void leave_node_function(const NodeFunction *node_function, Value **slots) {
+    for (int i = 0; i < node_function->slot_count; i++) {
+        free_value(slots[i]);
+    }
+}
+
+static Value *apply_node_function(Value *value_function, Value *value_argument) {
+    while (true) {
+        const Env *env;
+        const NodeFunction *node_function = get_node_function(value_function, &env);
+        if (node_function == NULL) {
+            Value *value = apply_closure_value(value_function, value_argument);
+            free_value(value_argument);
+            free_value(value_function);
+            return value;
+        }
+
+        Value *slots_local[NODE_SLOT_COUNT_LOCAL];
+        Value **slots = node_function->slot_count <= NODE_SLOT_COUNT_LOCAL
+            ? slots_local
+            : malloc(sizeof(Value *) * node_function->slot_count);
+        enter_node_function(node_function, env, value_function, value_argument, slots);
+
+        NodeFrame frame = { .slots = slots, .value_function = NULL, .value_argument = NULL };
+        Value *value = node_function->node->handler(node_function->node, &frame);
+
+        leave_node_function(node_function, slots);
+        if (slots != slots_local) {
+            free(slots);
+        }
+        free_value(value_function);
+        if (value != &value_tail_call) {
+            return value;
+        }
+
+        value_function = frame.value_function;
+        value_argument = frame.value_argument;
+    }
+}
+
+static bool apply_node_function_int(Value *value_function, Value *value_argument, int *int_value) {
+    const Env *env;
+    const NodeFunction *node_function = get_node_function(value_function, &env);
+    if (node_function == NULL) {
+        Value *value = apply_node_function(value_function, value_argument);
+        if (value == NULL) {
+            return false;
+        }
+
+        bool is_int = value->type == INT_VALUE;
+        *int_value = value->int_value;
+        free_value(value);
+        return is_int;
+    }
+
+    Value *slots_local[NODE_SLOT_COUNT_LOCAL];
+    Value **slots = node_function->slot_count <= NODE_SLOT_COUNT_LOCAL
+        ? slots_local
+        : malloc(sizeof(Value *) * node_function->slot_count);
+    enter_node_function(node_function, env, value_function, value_argument, slots);
+
+    NodeFrame frame = { .slots = slots, .value_function = NULL, .value_argument = NULL };
+    bool is_evaluated = node_function->node->int_handler(node_function->node, &frame, int_value);
+
+    leave_node_function(node_function, slots);
+    if (slots != slots_local) {
+        free(slots);
+    }
+    free_value(value_function);
+    return is_evaluated;
+}
+
+static Node *create_node(NodeHandler handler) {
+    Node *node = malloc(sizeof(Node));
+    node->handler = handler;
+    node->int_handler = evaluate_int_node;
+    node->bool_handler = evaluate_bool_node;
+    node->int_value = 0;
+    node->slot = 0;
+    node->slot_list = 0;
+    node->var_binding = NULL;
+    node->node_function = NULL;
+    node->node_1 = NULL;
+    node->node_2 = NULL;
+    node->node_3 = NULL;
+    return node;
+}
+
+void free_node(Node *node) {
+    if (node == NULL) {
+        return;
+    }
+
+    free_node(node->node_1);
+    free_node(node->node_2);
+    free_node(node->node_3);
+    free_node_function(node->node_function);
+    free_var_binding(node->var_binding);
+    free(node);
+}
+
+NodeFunction *create_copied_node_function(const NodeFunction *node_function) {
+    if (node_function == NULL) {
+        return NULL;
+    }
+
+    NodeFunction *node_function_new = (NodeFunction *) node_function;
+    node_function_new->ref_count++;
+    return node_function_new;
+}
+
+void free_node_function(NodeFunction *node_function) {
+    if (node_function == NULL) {
+        return;
+    }
+
+    node_function->ref_count--;
+    if (0 < node_function->ref_count) {
+        return;
+    }
+
+    for (int i = 0; i < node_function->captured_count; i++) {
+        free_var_binding(node_function->captured_var_bindings[i]);
+    }
+    free(node_function->captured_var_bindings);
+    free(node_function->captured_slots);
+    free(node_function->captured_vars);
+    free_node(node_function->node);
+    free_exp(node_function->exp);
+    free(node_function);
+}
+
+static VarBinding *find_var_binding(const Env *env, const Var *var, VarBinding *var_binding) {
+    if (var_binding != NULL || env == NULL) {
+        return var_binding;
+    }
+
+    var_binding = env->var_binding;
+    while (var_binding != NULL) {
+        if (is_same_var(var_binding->var, var)) {
+            return var_binding;
+        }
+
+        var_binding = var_binding->next;
+    }
+
+    return NULL;
+}
+
+static const NodeScope *find_node_scope(const NodeScope *scope, const Var *var) {
+    while (scope != NULL) {
+        if (is_same_var(scope->var, var)) {
+            return scope;
+        }
+
+        scope = scope->next;
+    }
+
+    return NULL;
+}
+
+static Node *compile_node(NodeCompiler *compiler, const NodeScope *scope, const Exp *exp, const bool is_tail);
+
+static NodeFunction *compile_node_function_impl(const Env *env,
+                                                const NodeScope *scope,
+                                                const Env *env_body,
+                                                const bool is_rec,
+                                                const Var *var_rec,
+                                                const Var *var,
+                                                const Exp *exp_body,
+                                                const VarExp *captured_var_exps,
+                                                const int captured_var_count) {
+    if (exp_body == NULL || captured_var_count < 0) {
+        return NULL;
+    }
+
+    NodeFunction *node_function = malloc(sizeof(NodeFunction));
+    node_function->node = NULL;
+    node_function->slot_count = 0;
+    node_function->is_rec = is_rec;
+    node_function->var_rec = create_copied_var(var_rec);
+    node_function->var = create_copied_var(var);
+    node_function->exp = create_copied_exp(exp_body);
+    node_function->captured_vars = NULL;
+    node_function->captured_slots = NULL;
+    node_function->captured_var_bindings = NULL;
+    node_function->captured_count = 0;
+    node_function->ref_count = 1;
+
+    if (0 < captured_var_count) {
+        node_function->captured_vars = malloc(sizeof(Var *) * captured_var_count);
+        node_function->captured_slots = malloc(sizeof(int) * captured_var_count);
+        node_function->captured_var_bindings = malloc(sizeof(VarBinding *) * captured_var_count);
+    }
+
+    for (int i = 0; i < captured_var_count; i++) {
+        const VarExp *var_exp = &captured_var_exps[i];
+        node_function->captured_vars[i] = var_exp->var;
+        node_function->captured_slots[i] = -1;
+        node_function->captured_var_bindings[i] = NULL;
+        node_function->captured_count++;
+
+        const NodeScope *scope_found = find_node_scope(scope, var_exp->var);
+        if (scope_found != NULL) {
+            node_function->captured_slots[i] = scope_found->slot;
+            continue;
+        }
+
+        VarBinding *var_binding = find_var_binding(env, var_exp->var, var_exp->var_binding);
+        if (var_binding == NULL) {
+            free_node_function(node_function);
+            return NULL;
+        }
+
+        node_function->captured_var_bindings[i] = create_copied_var_binding(var_binding);
+    }
+
+    NodeScope *scopes_captured = NULL;
+    if (0 < captured_var_count) {
+        scopes_captured = malloc(sizeof(NodeScope) * captured_var_count);
+        for (int i = 0; i < captured_var_count; i++) {
+            scopes_captured[i].var = node_function->captured_vars[i];
+            scopes_captured[i].slot = node_function->slot_count++;
+            scopes_captured[i].next = i == 0 ? NULL : &scopes_captured[i - 1];
+        }
+    }
+    const NodeScope *scope_body = scopes_captured == NULL ? NULL : &scopes_captured[captured_var_count - 1];
+
+    NodeScope scope_rec = { .var = var_rec, .slot = 0, .next = scope_body };
+    if (is_rec) {
+        scope_rec.slot = node_function->slot_count++;
+        scope_body = &scope_rec;
+    }
+
+    NodeScope scope_new = { .var = var, .slot = 0, .next = scope_body };
+    if (var != NULL) {
+        scope_new.slot = node_function->slot_count++;
+        scope_body = &scope_new;
+    }
+
+    NodeCompiler compiler = { .env = env_body, .node_function = node_function };
+    node_function->node = compile_node(&compiler, scope_body, exp_body, var != NULL);
+    free(scopes_captured);
+    if (node_function->node == NULL) {
+        free_node_function(node_function);
+        return NULL;
+    }
+
+    return node_function;
+}
+
+static Node *compile_op_node(NodeCompiler *compiler, const NodeScope *scope, const OpExp *op_exp) {
+    const Exp *exp_left = op_exp->exp_left;
+    const Exp *exp_right = op_exp->exp_right;
+    if (exp_left == NULL || exp_right == NULL) {
+        return NULL;
+    }
+
+    bool is_commutative = op_exp->type == PLUS_OP_EXP || op_exp->type == TIMES_OP_EXP;
+    if (is_commutative && exp_left->type == INT_EXP && exp_right->type != INT_EXP) {
+        const Exp *exp_temp = exp_left;
+        exp_left = exp_right;
+        exp_right = exp_temp;
+    }
+
+    bool is_const = exp_right->type == INT_EXP;
+
+    Node *node = create_node(evaluate_int_op_node);
+    node->node_1 = compile_node(compiler, scope, exp_left, false);
+    if (node->node_1 == NULL) {
+        free_node(node);
+        return NULL;
+    }
+
+    if (is_const) {
+        node->int_value = exp_right->int_exp->int_value;
+    } else {
+        node->node_2 = compile_node(compiler, scope, exp_right, false);
+        if (node->node_2 == NULL) {
+            free_node(node);
+            return NULL;
+        }
+    }
+
+    switch (op_exp->type) {
+        case PLUS_OP_EXP: {
+            node->int_handler = is_const ? evaluate_plus_const_node_int : evaluate_plus_node_int;
+            return node;
+        }
+        case MINUS_OP_EXP: {
+            node->int_handler = is_const ? evaluate_minus_const_node_int : evaluate_minus_node_int;
+            return node;
+        }
+        case TIMES_OP_EXP: {
+            node->int_handler = is_const ? evaluate_times_const_node_int : evaluate_times_node_int;
+            return node;
+        }
+        case LT_OP_EXP: {
+            node->handler = evaluate_bool_op_node;
+            node->bool_handler = is_const ? evaluate_lt_const_node_bool : evaluate_lt_node_bool;
+            return node;
+        }
+        default: {
+            free_node(node);
+            return NULL;
+        }
+    }
+}
+
+static Node *compile_node(NodeCompiler *compiler, const NodeScope *scope, const Exp *exp, const bool is_tail) {
+    if (exp == NULL) {
+        return NULL;
+    }
+
+    switch (exp->type) {
+        case INT_EXP: {
+            if (exp->int_exp == NULL) {
+                return NULL;
+            }
+
+            Node *node = create_node(evaluate_int_const_node);
+            node->int_handler = evaluate_int_const_node_int;
+            node->int_value = exp->int_exp->int_value;
+            return node;
+        }
+        case BOOL_EXP: {
+            if (exp->bool_exp == NULL) {
+                return NULL;
+            }
+
+            Node *node = create_node(evaluate_bool_const_node);
+            node->bool_handler = evaluate_bool_const_node_bool;
+            node->int_value = exp->bool_exp->bool_value;
+            return node;
+        }
+        case VAR_EXP: {
+            if (exp->var_exp == NULL) {
+                return NULL;
+            }
+
+            const NodeScope *scope_found = find_node_scope(scope, exp->var_exp->var);
+            if (scope_found != NULL) {
+                Node *node = create_node(evaluate_slot_node);
+                node->int_handler = evaluate_slot_node_int;
+                node->bool_handler = evaluate_slot_node_bool;
+                node->slot = scope_found->slot;
+                return node;
+            }
+
+            VarBinding *var_binding = find_var_binding(
+                compiler->env,
+                exp->var_exp->var,
+                exp->var_exp->var_binding
+            );
+            if (var_binding == NULL) {
+                return NULL;
+            }
+
+            Node *node = create_node(evaluate_global_node);
+            node->int_handler = evaluate_global_node_int;
+            node->bool_handler = evaluate_global_node_bool;
+            node->var_binding = create_copied_var_binding(var_binding);
+            return node;
+        }
+        case OP_EXP: {
+            if (exp->op_exp == NULL) {
+                return NULL;
+            }
+
+            return compile_op_node(compiler, scope, exp->op_exp);
+        }
+        case IF_EXP: {
+            if (exp->if_exp == NULL) {
+                return NULL;
+            }
+
+            Node *node = create_node(evaluate_if_node);
+            node->int_handler = evaluate_if_node_int;
+            node->node_1 = compile_node(compiler, scope, exp->if_exp->exp_cond, false);
+            node->node_2 = compile_node(compiler, scope, exp->if_exp->exp_true, is_tail);
+            node->node_3 = compile_node(compiler, scope, exp->if_exp->exp_false, is_tail);
+            if (node->node_1 == NULL || node->node_2 == NULL || node->node_3 == NULL) {
+                free_node(node);
+                return NULL;
+            }
+
+            return node;
+        }
+        case LET_EXP: {
+            if (exp->let_exp == NULL) {
+                return NULL;
+            }
+
+            Node *node = create_node(evaluate_let_node);
+            node->node_1 = compile_node(compiler, scope, exp->let_exp->exp_1, false);
+            node->slot = compiler->node_function->slot_count++;
+
+            NodeScope scope_new = { .var = exp->let_exp->var, .slot = node->slot, .next = scope };
+            node->node_2 = compile_node(compiler, &scope_new, exp->let_exp->exp_2, is_tail);
+            if (node->node_1 == NULL || node->node_2 == NULL) {
+                free_node(node);
+                return NULL;
+            }
+
+            return node;
+        }
+        case FUN_EXP: {
+            if (exp->fun_exp == NULL || exp->fun_exp->var == NULL) {
+                return NULL;
+            }
+
+            NodeFunction *node_function = compile_node_function_impl(
+                compiler->env,
+                scope,
+                NULL,
+                false,
+                NULL,
+                exp->fun_exp->var,
+                exp->fun_exp->exp,
+                exp->fun_exp->captured_var_exps,
+                exp->fun_exp->captured_var_count
+            );
+            if (node_function == NULL) {
+                return NULL;
+            }
+
+            Node *node = create_node(evaluate_fun_node);
+            node->node_function = node_function;
+            return node;
+        }
+        case APP_EXP: {
+            if (exp->app_exp == NULL) {
+                return NULL;
+            }
+
+            Node *node = create_node(is_tail ? evaluate_tail_app_node : evaluate_app_node);
+            node->int_handler = is_tail ? evaluate_tail_app_node_int : evaluate_app_node_int;
+            node->node_1 = compile_node(compiler, scope, exp->app_exp->exp_1, false);
+            node->node_2 = compile_node(compiler, scope, exp->app_exp->exp_2, false);
+            if (node->node_1 == NULL || node->node_2 == NULL) {
+                free_node(node);
+                return NULL;
+            }
+
+            return node;
+        }
+        case LET_REC_EXP: {
+            if (exp->let_rec_exp == NULL || exp->let_rec_exp->var == NULL) {
+                return NULL;
+            }
+
+            NodeFunction *node_function = compile_node_function_impl(
+                compiler->env,
+                scope,
+                NULL,
+                true,
+                exp->let_rec_exp->var_rec,
+                exp->let_rec_exp->var,
+                exp->let_rec_exp->exp_1,
+                exp->let_rec_exp->captured_var_exps,
+                exp->let_rec_exp->captured_var_count
+            );
+            if (node_function == NULL) {
+                return NULL;
+            }
+
+            Node *node = create_node(evaluate_let_rec_node);
+            node->node_function = node_function;
+            node->slot = compiler->node_function->slot_count++;
+
+            NodeScope scope_rec = { .var = exp->let_rec_exp->var_rec, .slot = node->slot, .next = scope };
+            node->node_2 = compile_node(compiler, &scope_rec, exp->let_rec_exp->exp_2, is_tail);
+            if (node->node_2 == NULL) {
+                free_node(node);
+                return NULL;
+            }
+
+            return node;
+        }
+        case NIL_EXP: {
+            return create_node(evaluate_nil_node);
+        }
+        case CONS_EXP: {
+            if (exp->cons_exp == NULL) {
+                return NULL;
+            }
+
+            Node *node = create_node(evaluate_cons_node);
+            node->node_1 = compile_node(compiler, scope, exp->cons_exp->exp_elem, false);
+            node->node_2 = compile_node(compiler, scope, exp->cons_exp->exp_list, false);
+            if (node->node_1 == NULL || node->node_2 == NULL) {
+                free_node(node);
+                return NULL;
+            }
+
+            return node;
+        }
+        case MATCH_EXP: {
+            if (exp->match_exp == NULL) {
+                return NULL;
+            }
+
+            Node *node = create_node(evaluate_match_node);
+            node->node_1 = compile_node(compiler, scope, exp->match_exp->exp_list, false);
+            node->node_2 = compile_node(compiler, scope, exp->match_exp->exp_match_nil, is_tail);
+            node->slot = compiler->node_function->slot_count++;
+            node->slot_list = compiler->node_function->slot_count++;
+
+            NodeScope scope_elem = { .var = exp->match_exp->var_elem, .slot = node->slot, .next = scope };
+            NodeScope scope_list = { .var = exp->match_exp->var_list, .slot = node->slot_list, .next = &scope_elem };
+            node->node_3 = compile_node(compiler, &scope_list, exp->match_exp->exp_match_cons, is_tail);
+            if (node->node_1 == NULL || node->node_2 == NULL || node->node_3 == NULL) {
+                free_node(node);
+                return NULL;
+            }
+
+            return node;
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
+
+NodeFunction *compile_node_function(const Env *env, const Exp *exp) {
+    if (env == NULL || exp == NULL) {
+        return NULL;
+    }
+
+    return compile_node_function_impl(NULL, NULL, env, false, NULL, NULL, exp, NULL, 0);
+}
+
+Value *evaluate_compiled(const Env *env, const Exp *exp) {
+    if (env == NULL || exp == NULL) {
+        return NULL;
+    }
+
+    NodeFunction *node_function = compile_node_function(env, exp);
+    if (node_function == NULL) {
+        return evaluate_impl(env, exp);
+    }
+
+    Value *slots_local[NODE_SLOT_COUNT_LOCAL];
+    Value **slots = node_function->slot_count <= NODE_SLOT_COUNT_LOCAL
+        ? slots_local
+        : malloc(sizeof(Value *) * node_function->slot_count);
+    enter_node_function(node_function, NULL, NULL, NULL, slots);
+
+    NodeFrame frame = { .slots = slots, .value_function = NULL, .value_argument = NULL };
+    Value *value = node_function->node->handler(node_function->node, &frame);
+
+    leave_node_function(node_function, slots);
+    if (slots != slots_local) {
+        free(slots);
+    }
+    free_node_function(node_function);
+    return value;
+}
+
+bool add_def_to_env_compiled(Env *env, const Def *def) {
+    if (env == NULL || def == NULL) {
+        return false;
+    }
+
+    switch (def->type) {
+        case LET_DEF: {
+            if (def->let_def == NULL) {
+                return false;
+            }
+
+            Value *value_1 = evaluate_compiled(env, def->let_def->exp_1);
+            if (value_1 == NULL) {
+                return false;
+            }
+
+            VarBinding *var_binding = malloc(sizeof(VarBinding));
+            var_binding->var = create_copied_var(def->let_def->var);
+            var_binding->value = value_1;
+            var_binding->next = env->var_binding;
+            var_binding->ref_count = 1;
+            env->var_binding = var_binding;
+            return true;
+        }
+        case LET_REC_DEF: {
+            if (def->let_rec_def == NULL) {
+                return false;
+            }
+
+            RecClosure *rec_closure = create_def_rec_closure(env, def->let_rec_def);
+            if (rec_closure == NULL) {
+                return false;
+            }
+
+            rec_closure->node_function = compile_node_function_impl(
+                NULL,
+                NULL,
+                env,
+                true,
+                def->let_rec_def->var_rec,
+                def->let_rec_def->var,
+                def->let_rec_def->exp_1,
+                NULL,
+                0
+            );
+
+            Value *rec_closure_value = create_rec_closure_value(rec_closure);
+            if (rec_closure_value == NULL) {
+                return false;
+            }
+
+            VarBinding *var_binding = malloc(sizeof(VarBinding));
+            var_binding->var = create_copied_var(def->let_rec_def->var_rec);
+            var_binding->value = rec_closure_value;
+            var_binding->next = env->var_binding;
+            var_binding->ref_count = 1;
+            env->var_binding = var_binding;
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef ML4_NODE_H
+#define ML4_NODE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define NODE_SLOT_COUNT_LOCAL (16)
+
+typedef struct NodeTag Node;
+
+typedef struct {
+    Value **slots;
+    Value *value_function;
+    Value *value_argument;
+} NodeFrame;
+
+typedef Value *(*NodeHandler)(const Node *node, NodeFrame *frame);
+
+typedef bool (*NodeIntHandler)(const Node *node, NodeFrame *frame, int *int_value);
+
+typedef bool (*NodeBoolHandler)(const Node *node, NodeFrame *frame, bool *bool_value);
+
+struct NodeTag {
+    NodeHandler handler;
+    NodeIntHandler int_handler;
+    NodeBoolHandler bool_handler;
+    int int_value;
+    int slot;
+    int slot_list;
+    VarBinding *var_binding;
+    NodeFunction *node_function;
+    Node *node_1;
+    Node *node_2;
+    Node *node_3;
+};
+
+struct NodeFunctionTag {
+    Node *node;
+    int slot_count;
+    bool is_rec;
+    Var *var_rec;
+    Var *var;
+    Exp *exp;
+    Var **captured_vars;
+    int *captured_slots;
+    VarBinding **captured_var_bindings;
+    int captured_count;
+    size_t ref_count;
+};
+
+NodeFunction *compile_node_function(const Env *env, const Exp *exp);
+
+NodeFunction *create_copied_node_function(const NodeFunction *node_function);
+
+void free_node_function(NodeFunction *node_function);
+
+void free_node(Node *node);
+
+Value *evaluate_compiled(const Env *env, const Exp *exp);
+
+bool add_def_to_env_compiled(Env *env, const Def *def);
+
+#endif // ML4_NODE_H
@@ -4,6 +4,47 @@
 #include <string.h>
 
 #include "ml4_semantics.h"
+#include "ml4_node.h"
+#include "ml4_jit.h"
+
+static Var **var_table = NULL;
+static size_t var_table_size = 0;
+static size_t var_table_count = 0;
+
+static size_t hash_var_name(const char *name, const size_t name_len) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < name_len; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool grow_var_table() {
+    size_t var_table_size_new = var_table_size == 0 ? 64 : var_table_size * 2;
+    Var **var_table_new = calloc(var_table_size_new, sizeof(Var *));
+    if (var_table_new == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < var_table_size; i++) {
+        Var *var = var_table[i];
+        if (var == NULL) {
+            continue;
+        }
+
+        size_t j = hash_var_name(var->name, var->name_len) & (var_table_size_new - 1);
+        while (var_table_new[j] != NULL) {
+            j = (j + 1) & (var_table_size_new - 1);
+        }
+        var_table_new[j] = var;
+    }
+
+    free(var_table);
+    var_table = var_table_new;
+    var_table_size = var_table_size_new;
+    return true;
+}
 
 Var *create_var(const char *src_name) {
     if (src_name == NULL) {
@@ -15,21 +56,33 @@ Var *create_var(const char *src_name) {
         return NULL;
     }
 
+    if (var_table_size <= var_table_count * 2 && !grow_var_table()) {
+        return NULL;
+    }
+
+    size_t i = hash_var_name(src_name, name_len) & (var_table_size - 1);
+    while (var_table[i] != NULL) {
+        Var *var = var_table[i];
+        if (var->name_len == name_len && strncmp(var->name, src_name, name_len) == 0) {
+            return var;
+        }
+        i = (i + 1) & (var_table_size - 1);
+    }
+
     char *dst_name = malloc(name_len + 1);
-    snprintf(dst_name, VAR_NAME_LEN_MAX, "%s", src_name);
+    snprintf(dst_name, name_len + 1, "%s", src_name);
 
     Var *var = malloc(sizeof(Var));
     var->name = dst_name;
     var->name_len = name_len;
+
+    var_table[i] = var;
+    var_table_count++;
     return var;
 }
 
 Var *create_copied_var(const Var* var) {
-    if (var == NULL) {
-        return NULL;
-    }
-
-    return create_var(var->name);
+    return (Var *) var;
 }
 
 bool is_same_var(const Var *var_1, const Var *var_2) {
@@ -37,38 +90,184 @@ bool is_same_var(const Var *var_1, const Var *var_2) {
         return false;
     }
 
-    if (var_1->name == NULL || var_2->name == NULL) {
-        return false;
+    return var_1 == var_2;
+}
+
+void free_var(Var *var) {
+    // Vars are interned in var_table and live until the program exits.
+    (void) var;
+}
+
+static Value value_true = { .type = BOOL_VALUE, .bool_value = true, .ref_count = 0 };
+
+static Value value_false = { .type = BOOL_VALUE, .bool_value = false, .ref_count = 0 };
+
+static Value value_nil = { .type = NIL_VALUE, .ref_count = 0 };
+
+static Value value_small_ints[SMALL_INT_VALUE_MAX - SMALL_INT_VALUE_MIN + 1];
+
+static bool is_value_small_ints_initialized = false;
+
+static ValueTable *current_value_table = NULL;
+
+ValueTable *create_value_table(void) {
+    ValueTable *value_table = malloc(sizeof(ValueTable));
+    value_table->values = calloc(VALUE_TABLE_CAPACITY_MIN, sizeof(Value *));
+    value_table->capacity = VALUE_TABLE_CAPACITY_MIN;
+    value_table->count = 0;
+    return value_table;
+}
+
+void free_value_table(ValueTable *value_table) {
+    if (value_table == NULL) {
+        return;
+    }
+
+    if (current_value_table == value_table) {
+        current_value_table = NULL;
+    }
+    free(value_table->values);
+    free(value_table);
+}
+
+void set_current_value_table(ValueTable *value_table) {
+    current_value_table = value_table;
+}
+
+static size_t hash_value_table_key(const Value *value) {
+    size_t hash;
+    if (value->type == INT_VALUE) {
+        hash = (unsigned int) value->int_value;
+    } else {
+        hash = (size_t) value->cons_value->value_elem * 31 + (size_t) value->cons_value->value_list;
     }
 
-    if (var_1->name_len != var_2->name_len) {
+    hash = (hash ^ (hash >> 16)) * 16777619u;
+    return hash ^ (hash >> 16);
+}
+
+static bool is_same_value_table_key(const Value *value_1, const Value *value_2) {
+    if (value_1->type != value_2->type) {
         return false;
     }
 
-    return strncmp(var_1->name, var_2->name, var_1->name_len) == 0;
+    if (value_1->type == INT_VALUE) {
+        return value_1->int_value == value_2->int_value;
+    }
+
+    return value_1->cons_value->value_elem == value_2->cons_value->value_elem
+        && value_1->cons_value->value_list == value_2->cons_value->value_list;
 }
 
-void free_var(Var *var) {
-    if (var == NULL) {
-        return;
+static Value *find_value_in_table(const ValueTable *value_table, const Value *value_key) {
+    size_t mask = value_table->capacity - 1;
+    size_t i = hash_value_table_key(value_key) & mask;
+    while (value_table->values[i] != NULL) {
+        if (is_same_value_table_key(value_table->values[i], value_key)) {
+            return value_table->values[i];
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    return NULL;
+}
+
+static void insert_value_to_table(ValueTable *value_table, Value *value) {
+    size_t mask = value_table->capacity - 1;
+    size_t i = hash_value_table_key(value) & mask;
+    while (value_table->values[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+
+    value_table->values[i] = value;
+    value_table->count++;
+}
+
+static void add_value_to_table(ValueTable *value_table, Value *value) {
+    if (value_table->capacity < (value_table->count + 1) * 2) {
+        Value **values = value_table->values;
+        size_t capacity = value_table->capacity;
+
+        value_table->values = calloc(capacity * 2, sizeof(Value *));
+        value_table->capacity = capacity * 2;
+        value_table->count = 0;
+        for (size_t i = 0; i < capacity; i++) {
+            if (values[i] != NULL) {
+                insert_value_to_table(value_table, values[i]);
+            }
+        }
+        free(values);
+    }
+
+    insert_value_to_table(value_table, value);
+}
+
+static void remove_value_from_table(ValueTable *value_table, const Value *value) {
+    size_t mask = value_table->capacity - 1;
+    size_t i = hash_value_table_key(value) & mask;
+    while (value_table->values[i] != value) {
+        if (value_table->values[i] == NULL) {
+            return;
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (value_table->values[j] == NULL) {
+            break;
+        }
+
+        size_t k = hash_value_table_key(value_table->values[j]) & mask;
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+            continue;
+        }
+
+        value_table->values[i] = value_table->values[j];
+        i = j;
     }
 
-    free(var->name);
-    free(var);
+    value_table->values[i] = NULL;
+    value_table->count--;
 }
 
 Value *create_int_value(const int int_value) {
+    if (SMALL_INT_VALUE_MIN <= int_value && int_value <= SMALL_INT_VALUE_MAX) {
+        if (!is_value_small_ints_initialized) {
+            for (int i = SMALL_INT_VALUE_MIN; i <= SMALL_INT_VALUE_MAX; i++) {
+                value_small_ints[i - SMALL_INT_VALUE_MIN].type = INT_VALUE;
+                value_small_ints[i - SMALL_INT_VALUE_MIN].int_value = i;
+                value_small_ints[i - SMALL_INT_VALUE_MIN].ref_count = 0;
+            }
+            is_value_small_ints_initialized = true;
+        }
+
+        return &value_small_ints[int_value - SMALL_INT_VALUE_MIN];
+    }
+
+    if (current_value_table != NULL) {
+        Value value_key = { .type = INT_VALUE, .int_value = int_value };
+        Value *value_shared = find_value_in_table(current_value_table, &value_key);
+        if (value_shared != NULL) {
+            return create_copied_value(value_shared);
+        }
+    }
+
     Value *value = malloc(sizeof(Value));
     value->type = INT_VALUE;
     value->int_value = int_value;
+    value->ref_count = 1;
+    if (current_value_table != NULL) {
+        add_value_to_table(current_value_table, value);
+    }
     return value;
 }
 
 Value *create_bool_value(const bool bool_value) {
-    Value *value = malloc(sizeof(Value));
-    value->type = BOOL_VALUE;
-    value->bool_value = bool_value;
-    return value;
+    return bool_value ? &value_true : &value_false;
 }
 
 Closure *create_closure(const Env *env, const Var *var, const Exp *exp) {
@@ -80,6 +279,7 @@ Closure *create_closure(const Env *env, const Var *var, const Exp *exp) {
     closure->env = create_copied_env(env);
     closure->var = create_copied_var(var);
     closure->exp = create_copied_exp(exp);
+    closure->node_function = NULL;
     return closure;
 }
 
@@ -88,7 +288,13 @@ Closure *create_copied_closure(const Closure *closure) {
         return NULL;
     }
 
-    return create_closure(closure->env, closure->var, closure->exp);
+    Closure *closure_new = create_closure(closure->env, closure->var, closure->exp);
+    if (closure_new == NULL) {
+        return NULL;
+    }
+
+    closure_new->node_function = create_copied_node_function(closure->node_function);
+    return closure_new;
 }
 
 bool copy_closure(Closure *closure_dst, const Closure *closure_src) {
@@ -99,6 +305,7 @@ bool copy_closure(Closure *closure_dst, const Closure *closure_src) {
     closure_dst->env = create_copied_env(closure_src->env);
     closure_dst->var = create_copied_var(closure_src->var);
     closure_dst->exp = create_copied_exp(closure_src->exp);
+    closure_dst->node_function = create_copied_node_function(closure_src->node_function);
     return true;
 }
 
@@ -110,6 +317,7 @@ Value *create_closure_value(Closure *closure_value) {
     Value *value = malloc(sizeof(Value));
     value->type = CLOSURE_VALUE;
     value->closure_value = closure_value;
+    value->ref_count = 1;
     return value;
 }
 
@@ -120,7 +328,8 @@ void free_closure(Closure *closure) {
 
     free_env(closure->env);
     free_var(closure->var);
-//    free_exp(closure->exp); // FIXME コメントを外すと導出の結果がおかしい（やたら解放してる）
+    free_exp(closure->exp);
+    free_node_function(closure->node_function);
     free(closure);
 }
 
@@ -137,6 +346,9 @@ RecClosure *create_rec_closure(const Env *env,
     rec_closure->var_rec = create_copied_var(var_rec);
     rec_closure->var = create_copied_var(var);
     rec_closure->exp = create_copied_exp(exp);
+    rec_closure->node_function = NULL;
+    rec_closure->jit_function = NULL;
+    rec_closure->apply_count = 0;
     return rec_closure;
 }
 
@@ -145,12 +357,20 @@ RecClosure *create_copied_rec_closure(const RecClosure *rec_closure) {
         return NULL;
     }
 
-    return create_rec_closure(
+    RecClosure *rec_closure_new = create_rec_closure(
         rec_closure->env,
         rec_closure->var_rec,
         rec_closure->var,
         rec_closure->exp
     );
+    if (rec_closure_new == NULL) {
+        return NULL;
+    }
+
+    rec_closure_new->node_function = create_copied_node_function(rec_closure->node_function);
+    rec_closure_new->jit_function = create_copied_jit_function(rec_closure->jit_function);
+    rec_closure_new->apply_count = rec_closure->apply_count;
+    return rec_closure_new;
 }
 
 bool copy_rec_closure(RecClosure *rec_closure_dst, const RecClosure *rec_closure_src) {
@@ -162,6 +382,9 @@ bool copy_rec_closure(RecClosure *rec_closure_dst, const RecClosure *rec_closure
     rec_closure_dst->var_rec = create_copied_var(rec_closure_src->var_rec);
     rec_closure_dst->var = create_copied_var(rec_closure_src->var);
     rec_closure_dst->exp = create_copied_exp(rec_closure_src->exp);
+    rec_closure_dst->node_function = create_copied_node_function(rec_closure_src->node_function);
+    rec_closure_dst->jit_function = create_copied_jit_function(rec_closure_src->jit_function);
+    rec_closure_dst->apply_count = rec_closure_src->apply_count;
     return true;
 }
 
@@ -173,6 +396,7 @@ Value *create_rec_closure_value(RecClosure *rec_closure_value) {
     Value *value = malloc(sizeof(Value));
     value->type = REC_CLOSURE_VALUE;
     value->rec_closure_value = rec_closure_value;
+    value->ref_count = 1;
     return value;
 }
 
@@ -184,14 +408,14 @@ void free_rec_closure(RecClosure *rec_closure) {
     free_env(rec_closure->env);
     free_var(rec_closure->var_rec);
     free_var(rec_closure->var);
-//    free_exp(rec_closure->exp); // FIXME コメントを外すと導出の結果がおかしい（やたら解放してる）
+    free_exp(rec_closure->exp);
+    free_node_function(rec_closure->node_function);
+    free_jit_function(rec_closure->jit_function);
     free(rec_closure);
 }
 
 Value *create_nil_value() {
-    Value *value = malloc(sizeof(Value));
-    value->type = NIL_VALUE;
-    return value;
+    return &value_nil;
 }
 
 Cons *create_cons(const Value *value_elem, const Value *value_list) {
@@ -228,65 +452,239 @@ Value *create_cons_value(Cons *cons_value) {
         return NULL;
     }
 
+    if (current_value_table != NULL) {
+        Value value_key = { .type = CONS_VALUE, .cons_value = cons_value };
+        Value *value_shared = find_value_in_table(current_value_table, &value_key);
+        if (value_shared != NULL) {
+            free_cons(cons_value);
+            return create_copied_value(value_shared);
+        }
+    }
+
     Value *value = malloc(sizeof(Value));
     value->type = CONS_VALUE;
     value->cons_value = cons_value;
+    value->ref_count = 1;
+    if (current_value_table != NULL) {
+        add_value_to_table(current_value_table, value);
+    }
     return value;
 }
 
 void free_cons(Cons *cons) {
-    free(cons);
-}
+    while (cons != NULL) {
+        Value *value_list = cons->value_list;
 
-Value *create_copied_value(const Value *value) {
-    if (value == NULL) {
-        return NULL;
-    }
+        free_value(cons->value_elem);
+        free(cons);
 
-    switch (value->type) {
-        case INT_VALUE:
-            return create_int_value(value->int_value);
-        case BOOL_VALUE:
-            return create_bool_value(value->bool_value);
-        case CLOSURE_VALUE: {
-            if (value->closure_value == NULL) {
-                return NULL;
+        cons = NULL;
+        if (value_list != NULL && value_list->type == CONS_VALUE && value_list->ref_count == 1) {
+            if (current_value_table != NULL) {
+                remove_value_from_table(current_value_table, value_list);
             }
+            cons = value_list->cons_value;
+            free(value_list);
+        } else {
+            free_value(value_list);
+        }
+    }
+}
 
-            return create_closure_value(create_copied_closure(value->closure_value));
+Value *create_packed_cons_value(PackedChunk *chunk, const size_t length) {
+    Value *value = malloc(sizeof(Value) + sizeof(PackedCons));
+    value->type = PACKED_CONS_VALUE;
+    value->packed_cons_value = (PackedCons *) (value + 1);
+    value->packed_cons_value->chunk = chunk;
+    value->packed_cons_value->length = length;
+    value->ref_count = 1;
+    return value;
+}
+
+static Value *create_packed_list_value(const int int_value, const Value *value_list) {
+    size_t capacity = PACKED_CHUNK_CAPACITY_MIN;
+    if (value_list->type == PACKED_CONS_VALUE) {
+        PackedCons *packed_cons = value_list->packed_cons_value;
+        PackedChunk *chunk = packed_cons->chunk;
+        if (packed_cons->length == chunk->count && chunk->count < chunk->capacity) {
+            chunk->int_values[chunk->count++] = int_value;
+            chunk->ref_count++;
+            return create_packed_cons_value(chunk, chunk->count);
         }
-        case REC_CLOSURE_VALUE: {
-            if (value->rec_closure_value == NULL) {
-                return NULL;
-            }
 
-            return create_rec_closure_value(
-                create_copied_rec_closure(value->rec_closure_value)
-            );
+        capacity = chunk->capacity * 2 < PACKED_CHUNK_CAPACITY_MAX
+            ? chunk->capacity * 2
+            : PACKED_CHUNK_CAPACITY_MAX;
+    }
+
+    PackedChunk *chunk = malloc(sizeof(PackedChunk) + sizeof(int) * capacity);
+    chunk->count = 1;
+    chunk->capacity = capacity;
+    chunk->value_list = create_copied_value(value_list);
+    chunk->ref_count = 1;
+    chunk->int_values[0] = int_value;
+    return create_packed_cons_value(chunk, 1);
+}
+
+void free_packed_chunk(PackedChunk *chunk) {
+    while (chunk != NULL) {
+        chunk->ref_count--;
+        if (0 < chunk->ref_count) {
+            return;
         }
-        case NIL_VALUE: {
-            return create_nil_value();
+
+        Value *value_list = chunk->value_list;
+        free(chunk);
+
+        chunk = NULL;
+        if (value_list->type == PACKED_CONS_VALUE && value_list->ref_count == 1) {
+            chunk = value_list->packed_cons_value->chunk;
+            free(value_list);
+        } else {
+            free_value(value_list);
         }
+    }
+}
+
+Value *create_list_value(const Value *value_elem, const Value *value_list) {
+    if (value_elem == NULL || value_list == NULL) {
+        return NULL;
+    }
+
+    if (current_value_table == NULL
+        && value_elem->type == INT_VALUE
+        && (value_list->type == NIL_VALUE || value_list->type == PACKED_CONS_VALUE)) {
+        return create_packed_list_value(value_elem->int_value, value_list);
+    }
+
+    return create_cons_value(create_cons(value_elem, value_list));
+}
+
+bool try_get_elem_and_list(const Value *value, Value **value_elem, Value **value_list) {
+    if (value == NULL) {
+        return false;
+    }
+
+    switch (value->type) {
         case CONS_VALUE: {
             if (value->cons_value == NULL) {
-                return NULL;
+                return false;
             }
 
-            return create_cons_value(create_copied_cons(value->cons_value));
+            *value_elem = create_copied_value(value->cons_value->value_elem);
+            *value_list = create_copied_value(value->cons_value->value_list);
+            return true;
+        }
+        case PACKED_CONS_VALUE: {
+            PackedCons *packed_cons = value->packed_cons_value;
+            PackedChunk *chunk = packed_cons->chunk;
+            *value_elem = create_int_value(chunk->int_values[packed_cons->length - 1]);
+            if (1 < packed_cons->length) {
+                chunk->ref_count++;
+                *value_list = create_packed_cons_value(chunk, packed_cons->length - 1);
+            } else {
+                *value_list = create_copied_value(chunk->value_list);
+            }
+            return true;
         }
         default: {
-            return NULL;
+            return false;
         }
     }
 }
 
+bool try_take_elem_and_list(Value *value, Value **value_elem, Value **value_list) {
+    if (value != NULL
+        && value->type == PACKED_CONS_VALUE
+        && value->ref_count == 1
+        && 1 < value->packed_cons_value->length) {
+        PackedCons *packed_cons = value->packed_cons_value;
+        *value_elem = create_int_value(packed_cons->chunk->int_values[--packed_cons->length]);
+        *value_list = value;
+        return true;
+    }
+
+    bool is_cons = try_get_elem_and_list(value, value_elem, value_list);
+    free_value(value);
+    return is_cons;
+}
+
+typedef struct {
+    const Value *value;
+    size_t length;
+    Value value_elem;
+} ListCursor;
+
+static void set_list_cursor(ListCursor *list_cursor, const Value *value) {
+    list_cursor->value = value;
+    list_cursor->length = 0;
+    if (value != NULL && value->type == PACKED_CONS_VALUE) {
+        list_cursor->length = value->packed_cons_value->length;
+    }
+}
+
+static bool is_list_cursor_at_cons(const ListCursor *list_cursor) {
+    const Value *value = list_cursor->value;
+    return value != NULL
+        && ((value->type == CONS_VALUE && value->cons_value != NULL) || value->type == PACKED_CONS_VALUE);
+}
+
+static const Value *get_list_cursor_elem(ListCursor *list_cursor) {
+    const Value *value = list_cursor->value;
+    if (value->type == CONS_VALUE) {
+        return value->cons_value->value_elem;
+    }
+
+    list_cursor->value_elem.type = INT_VALUE;
+    list_cursor->value_elem.int_value = value->packed_cons_value->chunk->int_values[list_cursor->length - 1];
+    list_cursor->value_elem.ref_count = 0;
+    return &list_cursor->value_elem;
+}
+
+static void advance_list_cursor(ListCursor *list_cursor) {
+    const Value *value = list_cursor->value;
+    if (value->type == CONS_VALUE) {
+        set_list_cursor(list_cursor, value->cons_value->value_list);
+    } else if (1 < list_cursor->length) {
+        list_cursor->length--;
+    } else {
+        set_list_cursor(list_cursor, value->packed_cons_value->chunk->value_list);
+    }
+}
+
+Value *create_copied_value(const Value *value) {
+    if (value == NULL) {
+        return NULL;
+    }
+
+    Value *value_shared = (Value *) value;
+    if (value_shared->ref_count == 0) {
+        return value_shared;
+    }
+
+    value_shared->ref_count++;
+    return value_shared;
+}
+
 void free_value(Value *value) {
     if (value == NULL) {
         return;
     }
 
+    if (value->ref_count == 0) {
+        return;
+    }
+
+    value->ref_count--;
+    if (0 < value->ref_count) {
+        return;
+    }
+
     switch (value->type) {
         case INT_VALUE: {
+            if (current_value_table != NULL) {
+                remove_value_from_table(current_value_table, value);
+            }
             free(value);
             break;
         }
@@ -324,10 +722,18 @@ void free_value(Value *value) {
                 return;
             }
 
+            if (current_value_table != NULL) {
+                remove_value_from_table(current_value_table, value);
+            }
             free_cons(value->cons_value);
             free(value);
             break;
         }
+        case PACKED_CONS_VALUE: {
+            free_packed_chunk(value->packed_cons_value->chunk);
+            free(value);
+            break;
+        }
         default: {
             free(value);
         }
@@ -340,34 +746,7 @@ Env *create_copied_env(const Env *env) {
     }
 
     Env *env_new = malloc(sizeof(Env));
-    if (env->var_binding == NULL) {
-        env_new->var_binding = NULL;
-        return env_new;
-    }
-
-    VarBinding *var_binding_new_prev = NULL;
-    VarBinding *var_binding = env->var_binding;
-    while (var_binding != NULL) {
-        if (var_binding->var == NULL || var_binding->value == NULL) {
-            free_env(env_new);
-            return NULL;
-        }
-
-        VarBinding *var_binding_new = malloc(sizeof(VarBinding));
-        var_binding_new->var = create_copied_var(var_binding->var);
-        var_binding_new->value = create_copied_value(var_binding->value);
-        var_binding_new->next = NULL;
-
-        if (var_binding_new_prev == NULL) {
-            env_new->var_binding = var_binding_new;
-        } else {
-            var_binding_new_prev->next = var_binding_new;
-        }
-
-        var_binding_new_prev = var_binding_new;
-        var_binding = var_binding->next;
-    }
-
+    env_new->var_binding = create_copied_var_binding(env->var_binding);
     return env_new;
 }
 
@@ -380,14 +759,8 @@ Env *create_poped_env(const Env *env) {
         return NULL;
     }
 
-    Env *env_new = create_copied_env(env);
-    VarBinding *var_binding_temp = env_new->var_binding;
-    env_new->var_binding = var_binding_temp->next;
-
-    free_var(var_binding_temp->var);
-    free_value(var_binding_temp->value);
-    free(var_binding_temp);
-
+    Env *env_new = malloc(sizeof(Env));
+    env_new->var_binding = create_copied_var_binding(env->var_binding->next);
     return env_new;
 }
 
@@ -396,15 +769,14 @@ Env *create_appended_env(const Env *env, const Var *var, const Value *value) {
         return NULL;
     }
 
-    Env *env_new = create_copied_env(env);
-
     VarBinding *var_binding = malloc(sizeof(VarBinding));
     var_binding->var = create_copied_var(var);
     var_binding->value = create_copied_value(value);
-    var_binding->next = env_new->var_binding;
+    var_binding->next = create_copied_var_binding(env->var_binding);
+    var_binding->ref_count = 1;
 
+    Env *env_new = malloc(sizeof(Env));
     env_new->var_binding = var_binding;
-
     return env_new;
 }
 
@@ -413,8 +785,27 @@ void free_env(Env *env) {
         return;
     }
 
-    VarBinding *var_binding = env->var_binding;
+    free_var_binding(env->var_binding);
+    free(env);
+}
+
+VarBinding *create_copied_var_binding(const VarBinding *var_binding) {
+    if (var_binding == NULL) {
+        return NULL;
+    }
+
+    VarBinding *var_binding_shared = (VarBinding *) var_binding;
+    var_binding_shared->ref_count++;
+    return var_binding_shared;
+}
+
+void free_var_binding(VarBinding *var_binding) {
     while (var_binding != NULL) {
+        var_binding->ref_count--;
+        if (0 < var_binding->ref_count) {
+            return;
+        }
+
         VarBinding *var_binding_next = var_binding->next;
 
         free_var(var_binding->var);
@@ -423,41 +814,534 @@ void free_env(Env *env) {
 
         var_binding = var_binding_next;
     }
-    free(env);
 }
 
-Exp *create_int_exp(const int int_value) {
-    IntExp *int_exp = malloc(sizeof(IntExp));
-    int_exp->int_value = int_value;
+static Arena *current_arena = NULL;
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = INT_EXP;
-    exp->int_exp = int_exp;
+Arena *create_arena() {
+    Arena *arena = malloc(sizeof(Arena));
+    arena->block = NULL;
+    arena->arena_var_binding = NULL;
+    arena->ref_count = 1;
+    return arena;
+}
 
-    return exp;
+Arena *create_copied_arena(const Arena *arena) {
+    if (arena == NULL) {
+        return NULL;
+    }
+
+    Arena *arena_shared = (Arena *) arena;
+    arena_shared->ref_count++;
+    return arena_shared;
 }
 
-Exp *create_bool_exp(const bool bool_value) {
-    BoolExp *bool_exp = malloc(sizeof(BoolExp));
-    bool_exp->bool_value = bool_value;
+void free_arena(Arena *arena) {
+    if (arena == NULL) {
+        return;
+    }
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = BOOL_EXP;
-    exp->bool_exp = bool_exp;
+    arena->ref_count--;
+    if (0 < arena->ref_count) {
+        return;
+    }
 
-    return exp;
+    ArenaVarBinding *arena_var_binding = arena->arena_var_binding;
+    while (arena_var_binding != NULL) {
+        free_var_binding(arena_var_binding->var_binding);
+        arena_var_binding = arena_var_binding->next;
+    }
+
+    ArenaBlock *block = arena->block;
+    while (block != NULL) {
+        ArenaBlock *block_next = block->next;
+        free(block);
+        block = block_next;
+    }
+
+    if (current_arena == arena) {
+        current_arena = NULL;
+    }
+    free(arena);
 }
 
-Exp *create_var_exp(Var *var) {
-    if (var == NULL) {
+void *allocate_from_arena(Arena *arena, size_t size) {
+    if (arena == NULL) {
         return NULL;
     }
 
-    VarExp *var_exp = malloc(sizeof(VarExp));
-    var_exp->var = var;
+    size = (size + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+
+    ArenaBlock *block = arena->block;
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = block == NULL ? ARENA_BLOCK_SIZE_MIN : block->size * 2;
+        if (ARENA_BLOCK_SIZE_MAX < block_size) {
+            block_size = ARENA_BLOCK_SIZE_MAX;
+        }
+        if (block_size < size) {
+            block_size = size;
+        }
+
+        ArenaBlock *block_new = malloc(sizeof(ArenaBlock) + block_size);
+        if (block_new == NULL) {
+            return NULL;
+        }
+        block_new->next = block;
+        block_new->size = block_size;
+        block_new->used = 0;
+        arena->block = block_new;
+        block = block_new;
+    }
+
+    void *ptr = (char *) (block + 1) + block->used;
+    block->used += size;
+    return ptr;
+}
+
+bool add_var_binding_to_arena(Arena *arena, VarBinding *var_binding) {
+    if (arena == NULL || var_binding == NULL) {
+        return false;
+    }
+
+    ArenaVarBinding *arena_var_binding = allocate_from_arena(arena, sizeof(ArenaVarBinding));
+    if (arena_var_binding == NULL) {
+        return false;
+    }
+
+    arena_var_binding->var_binding = create_copied_var_binding(var_binding);
+    arena_var_binding->next = arena->arena_var_binding;
+    arena->arena_var_binding = arena_var_binding;
+    return true;
+}
+
+void set_current_arena(Arena *arena) {
+    current_arena = arena;
+}
+
+static Memo *current_memo = NULL;
+
+Memo *create_memo(const size_t size_max) {
+    Memo *memo = malloc(sizeof(Memo));
+    memo->buckets = calloc(MEMO_BUCKET_COUNT_MIN, sizeof(MemoEntry *));
+    memo->bucket_count = MEMO_BUCKET_COUNT_MIN;
+    memo->entry_count = 0;
+    memo->lru_head = NULL;
+    memo->lru_tail = NULL;
+    memo->size = 0;
+    memo->size_max = size_max;
+    return memo;
+}
+
+static void free_memo_entry(MemoEntry *memo_entry) {
+    free_value(memo_entry->value_function);
+    free_value(memo_entry->value_argument);
+    free_value(memo_entry->value);
+    free(memo_entry);
+}
+
+void free_memo(Memo *memo) {
+    if (memo == NULL) {
+        return;
+    }
+
+    MemoEntry *memo_entry = memo->lru_head;
+    while (memo_entry != NULL) {
+        MemoEntry *memo_entry_next = memo_entry->lru_next;
+        free_memo_entry(memo_entry);
+        memo_entry = memo_entry_next;
+    }
+
+    if (current_memo == memo) {
+        current_memo = NULL;
+    }
+    free(memo->buckets);
+    free(memo);
+}
+
+void set_current_memo(Memo *memo) {
+    current_memo = memo;
+}
+
+static size_t hash_value_impl(const Value *value, size_t *cell_count);
+
+static size_t hash_env_impl(const Env *env, size_t *cell_count) {
+    size_t hash = 2166136261u;
+    int count = 0;
+    const VarBinding *var_binding = env->var_binding;
+    while (var_binding != NULL && count < MEMO_HASH_VAR_BINDING_COUNT_MAX) {
+        const Value *value = var_binding->value;
+        hash = (hash ^ (size_t) var_binding->var) * 16777619u;
+        switch (value->type) {
+            case CLOSURE_VALUE: {
+                hash = (hash ^ (size_t) value->closure_value->exp) * 16777619u;
+                break;
+            }
+            case REC_CLOSURE_VALUE: {
+                hash = (hash ^ (size_t) value->rec_closure_value->exp) * 16777619u;
+                break;
+            }
+            default: {
+                hash = (hash ^ hash_value_impl(value, cell_count)) * 16777619u;
+                break;
+            }
+        }
+
+        var_binding = var_binding->next;
+        count++;
+    }
+
+    return hash;
+}
+
+bool is_same_env(const Env *env_1, const Env *env_2) {
+    const VarBinding *var_binding_1 = env_1->var_binding;
+    const VarBinding *var_binding_2 = env_2->var_binding;
+    while (var_binding_1 != var_binding_2) {
+        if (var_binding_1 == NULL
+            || var_binding_2 == NULL
+            || !is_same_var(var_binding_1->var, var_binding_2->var)
+            || !is_same_value(var_binding_1->value, var_binding_2->value)) {
+            return false;
+        }
+
+        var_binding_1 = var_binding_1->next;
+        var_binding_2 = var_binding_2->next;
+    }
+
+    return true;
+}
+
+static size_t hash_value_impl(const Value *value, size_t *cell_count) {
+    size_t hash = 2166136261u;
+    ListCursor list_cursor;
+    set_list_cursor(&list_cursor, value);
+    while (list_cursor.value != NULL && *cell_count > 0) {
+        (*cell_count)--;
+        if (is_list_cursor_at_cons(&list_cursor)) {
+            hash = (hash ^ CONS_VALUE) * 16777619u;
+            hash = (hash ^ hash_value_impl(get_list_cursor_elem(&list_cursor), cell_count)) * 16777619u;
+            advance_list_cursor(&list_cursor);
+            continue;
+        }
+
+        value = list_cursor.value;
+        hash = (hash ^ value->type) * 16777619u;
+        switch (value->type) {
+            case INT_VALUE: {
+                return (hash ^ (unsigned int) value->int_value) * 16777619u;
+            }
+            case BOOL_VALUE: {
+                return (hash ^ value->bool_value) * 16777619u;
+            }
+            case CLOSURE_VALUE: {
+                hash = (hash ^ (size_t) value->closure_value->exp) * 16777619u;
+                return (hash ^ hash_env_impl(value->closure_value->env, cell_count)) * 16777619u;
+            }
+            case REC_CLOSURE_VALUE: {
+                hash = (hash ^ (size_t) value->rec_closure_value->exp) * 16777619u;
+                return (hash ^ hash_env_impl(value->rec_closure_value->env, cell_count)) * 16777619u;
+            }
+            default: {
+                return hash;
+            }
+        }
+    }
+
+    return hash;
+}
+
+size_t hash_value(const Value *value) {
+    size_t cell_count = MEMO_HASH_CELL_COUNT_MAX;
+    return hash_value_impl(value, &cell_count);
+}
+
+size_t hash_env(const Env *env) {
+    size_t cell_count = MEMO_HASH_CELL_COUNT_MAX;
+    return hash_env_impl(env, &cell_count);
+}
+
+bool is_same_value(const Value *value_1, const Value *value_2) {
+    ListCursor list_cursor_1;
+    ListCursor list_cursor_2;
+    set_list_cursor(&list_cursor_1, value_1);
+    set_list_cursor(&list_cursor_2, value_2);
+    while (true) {
+        value_1 = list_cursor_1.value;
+        value_2 = list_cursor_2.value;
+        if (value_1 == value_2 && list_cursor_1.length == list_cursor_2.length) {
+            return true;
+        }
+
+        if (value_1 == NULL || value_2 == NULL) {
+            return false;
+        }
+
+        if (value_1->type == PACKED_CONS_VALUE
+            && value_2->type == PACKED_CONS_VALUE
+            && value_1->packed_cons_value->chunk == value_2->packed_cons_value->chunk
+            && list_cursor_1.length == list_cursor_2.length) {
+            return true;
+        }
+
+        bool is_cons_1 = is_list_cursor_at_cons(&list_cursor_1);
+        bool is_cons_2 = is_list_cursor_at_cons(&list_cursor_2);
+        if (is_cons_1 || is_cons_2) {
+            if (!is_cons_1
+                || !is_cons_2
+                || !is_same_value(get_list_cursor_elem(&list_cursor_1), get_list_cursor_elem(&list_cursor_2))) {
+                return false;
+            }
+
+            advance_list_cursor(&list_cursor_1);
+            advance_list_cursor(&list_cursor_2);
+            continue;
+        }
+
+        if (value_1->type != value_2->type) {
+            return false;
+        }
+
+        switch (value_1->type) {
+            case INT_VALUE: {
+                return value_1->int_value == value_2->int_value;
+            }
+            case BOOL_VALUE: {
+                return value_1->bool_value == value_2->bool_value;
+            }
+            case CLOSURE_VALUE: {
+                const Closure *closure_1 = value_1->closure_value;
+                const Closure *closure_2 = value_2->closure_value;
+                return closure_1 == closure_2
+                    || (closure_1->exp == closure_2->exp
+                        && is_same_var(closure_1->var, closure_2->var)
+                        && is_same_env(closure_1->env, closure_2->env));
+            }
+            case REC_CLOSURE_VALUE: {
+                const RecClosure *rec_closure_1 = value_1->rec_closure_value;
+                const RecClosure *rec_closure_2 = value_2->rec_closure_value;
+                return rec_closure_1 == rec_closure_2
+                    || (rec_closure_1->exp == rec_closure_2->exp
+                        && is_same_var(rec_closure_1->var_rec, rec_closure_2->var_rec)
+                        && is_same_var(rec_closure_1->var, rec_closure_2->var)
+                        && is_same_env(rec_closure_1->env, rec_closure_2->env));
+            }
+            case NIL_VALUE: {
+                return true;
+            }
+            default: {
+                return false;
+            }
+        }
+    }
+}
+
+static size_t get_value_cell_count(const Value *value, const size_t cell_count_max) {
+    if (value->type == CLOSURE_VALUE || value->type == REC_CLOSURE_VALUE) {
+        // A closure keeps its whole environment alive, which no cell count can bound.
+        return cell_count_max + 1;
+    }
+
+    size_t cell_count = 1;
+    ListCursor list_cursor;
+    set_list_cursor(&list_cursor, value);
+    while (is_list_cursor_at_cons(&list_cursor) && cell_count <= cell_count_max) {
+        cell_count += get_value_cell_count(get_list_cursor_elem(&list_cursor), cell_count_max - cell_count);
+        advance_list_cursor(&list_cursor);
+    }
+
+    return cell_count;
+}
+
+static bool is_memo_value(const Value *value) {
+    return get_value_cell_count(value, MEMO_VALUE_CELL_COUNT_MAX) <= MEMO_VALUE_CELL_COUNT_MAX;
+}
+
+static size_t hash_memo_key(const Value *value_function, const Value *value_argument) {
+    size_t hash = hash_value(value_function);
+    hash ^= hash_value(value_argument) + 0x9e3779b9u + (hash << 6) + (hash >> 2);
+    return hash ^ (hash >> 16);
+}
+
+static void unlink_memo_entry(Memo *memo, MemoEntry *memo_entry) {
+    if (memo_entry->lru_prev == NULL) {
+        memo->lru_head = memo_entry->lru_next;
+    } else {
+        memo_entry->lru_prev->lru_next = memo_entry->lru_next;
+    }
+
+    if (memo_entry->lru_next == NULL) {
+        memo->lru_tail = memo_entry->lru_prev;
+    } else {
+        memo_entry->lru_next->lru_prev = memo_entry->lru_prev;
+    }
+}
+
+static void link_memo_entry(Memo *memo, MemoEntry *memo_entry) {
+    memo_entry->lru_prev = NULL;
+    memo_entry->lru_next = memo->lru_head;
+    if (memo->lru_head == NULL) {
+        memo->lru_tail = memo_entry;
+    } else {
+        memo->lru_head->lru_prev = memo_entry;
+    }
+    memo->lru_head = memo_entry;
+}
+
+static void evict_memo_entry(Memo *memo) {
+    MemoEntry *memo_entry = memo->lru_tail;
+    unlink_memo_entry(memo, memo_entry);
+
+    MemoEntry **memo_entry_ref = &memo->buckets[memo_entry->hash & (memo->bucket_count - 1)];
+    while (*memo_entry_ref != memo_entry) {
+        memo_entry_ref = &(*memo_entry_ref)->next;
+    }
+    *memo_entry_ref = memo_entry->next;
+
+    memo->size -= memo_entry->size;
+    memo->entry_count--;
+    free_memo_entry(memo_entry);
+}
+
+static void grow_memo_buckets(Memo *memo) {
+    size_t bucket_count_new = memo->bucket_count * 2;
+    MemoEntry **buckets_new = calloc(bucket_count_new, sizeof(MemoEntry *));
+    if (buckets_new == NULL) {
+        return;
+    }
+
+    for (MemoEntry *memo_entry = memo->lru_head; memo_entry != NULL; memo_entry = memo_entry->lru_next) {
+        size_t i = memo_entry->hash & (bucket_count_new - 1);
+        memo_entry->next = buckets_new[i];
+        buckets_new[i] = memo_entry;
+    }
+
+    free(memo->buckets);
+    memo->buckets = buckets_new;
+    memo->bucket_count = bucket_count_new;
+}
+
+static MemoEntry *find_memo_entry(const Memo *memo,
+                                  const size_t hash,
+                                  const Value *value_function,
+                                  const Value *value_argument) {
+    MemoEntry *memo_entry = memo->buckets[hash & (memo->bucket_count - 1)];
+    while (memo_entry != NULL) {
+        if (memo_entry->hash == hash
+            && is_same_value(memo_entry->value_function, value_function)
+            && is_same_value(memo_entry->value_argument, value_argument)) {
+            return memo_entry;
+        }
+
+        memo_entry = memo_entry->next;
+    }
+
+    return NULL;
+}
+
+static Value *find_memo_value(const Value *value_function, const Value *value_argument) {
+    Memo *memo = current_memo;
+    size_t hash = hash_memo_key(value_function, value_argument);
+    MemoEntry *memo_entry = find_memo_entry(memo, hash, value_function, value_argument);
+    if (memo_entry == NULL) {
+        return NULL;
+    }
+
+    unlink_memo_entry(memo, memo_entry);
+    link_memo_entry(memo, memo_entry);
+    return create_copied_value(memo_entry->value);
+}
+
+static void add_memo_value(const Value *value_function, const Value *value_argument, const Value *value) {
+    Memo *memo = current_memo;
+    size_t cell_count_argument = get_value_cell_count(value_argument, MEMO_VALUE_CELL_COUNT_MAX);
+    size_t cell_count_value = get_value_cell_count(value, MEMO_VALUE_CELL_COUNT_MAX);
+    if (MEMO_VALUE_CELL_COUNT_MAX < cell_count_argument || MEMO_VALUE_CELL_COUNT_MAX < cell_count_value) {
+        return;
+    }
+
+    size_t hash = hash_memo_key(value_function, value_argument);
+    if (find_memo_entry(memo, hash, value_function, value_argument) != NULL) {
+        return;
+    }
+
+    size_t cell_count = cell_count_argument + cell_count_value;
+    size_t size = sizeof(MemoEntry) + cell_count * (sizeof(Value) + sizeof(Cons));
+    if (memo->size_max < size) {
+        return;
+    }
+
+    while (memo->size_max - memo->size < size) {
+        evict_memo_entry(memo);
+    }
+
+    if (memo->bucket_count < memo->entry_count) {
+        grow_memo_buckets(memo);
+    }
+
+    MemoEntry *memo_entry = malloc(sizeof(MemoEntry));
+    memo_entry->value_function = create_copied_value(value_function);
+    memo_entry->value_argument = create_copied_value(value_argument);
+    memo_entry->value = create_copied_value(value);
+    memo_entry->hash = hash;
+    memo_entry->size = size;
+
+    size_t i = hash & (memo->bucket_count - 1);
+    memo_entry->next = memo->buckets[i];
+    memo->buckets[i] = memo_entry;
+    link_memo_entry(memo, memo_entry);
+
+    memo->size += size;
+    memo->entry_count++;
+}
+
+static Exp *allocate_exp(const ExpType type, const size_t payload_size) {
+    Exp *exp = NULL;
+    if (current_arena != NULL) {
+        exp = allocate_from_arena(current_arena, sizeof(Exp) + payload_size);
+    } else {
+        exp = malloc(sizeof(Exp) + payload_size);
+    }
+    if (exp == NULL) {
+        return NULL;
+    }
+
+    exp->type = type;
+    exp->ref_count = 1;
+    exp->arena = current_arena;
+    return exp;
+}
+
+Exp *create_int_exp(const int int_value) {
+    Exp *exp = allocate_exp(INT_EXP, sizeof(IntExp));
+    IntExp *int_exp = (IntExp *) (exp + 1);
+    int_exp->int_value = int_value;
+
+    exp->int_exp = int_exp;
+
+    return exp;
+}
+
+Exp *create_bool_exp(const bool bool_value) {
+    Exp *exp = allocate_exp(BOOL_EXP, sizeof(BoolExp));
+    BoolExp *bool_exp = (BoolExp *) (exp + 1);
+    bool_exp->bool_value = bool_value;
+
+    exp->bool_exp = bool_exp;
+
+    return exp;
+}
+
+Exp *create_var_exp(Var *var) {
+    if (var == NULL) {
+        return NULL;
+    }
+
+    Exp *exp = allocate_exp(VAR_EXP, sizeof(VarExp));
+    VarExp *var_exp = (VarExp *) (exp + 1);
+    var_exp->var = var;
+    var_exp->index = -1;
+    var_exp->var_binding = NULL;
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = VAR_EXP;
     exp->var_exp = var_exp;
 
     return exp;
@@ -468,13 +1352,12 @@ Exp *create_plus_op_exp(Exp *exp_left, Exp *exp_right) {
         return NULL;
     }
 
-    OpExp *op_exp = malloc(sizeof(OpExp));
+    Exp *exp = allocate_exp(OP_EXP, sizeof(OpExp));
+    OpExp *op_exp = (OpExp *) (exp + 1);
     op_exp->type = PLUS_OP_EXP;
     op_exp->exp_left = exp_left;
     op_exp->exp_right = exp_right;
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = OP_EXP;
     exp->op_exp = op_exp;
 
     return exp;
@@ -485,13 +1368,12 @@ Exp *create_minus_op_exp(Exp *exp_left, Exp *exp_right) {
         return NULL;
     }
 
-    OpExp *op_exp = malloc(sizeof(OpExp));
+    Exp *exp = allocate_exp(OP_EXP, sizeof(OpExp));
+    OpExp *op_exp = (OpExp *) (exp + 1);
     op_exp->type = MINUS_OP_EXP;
     op_exp->exp_left = exp_left;
     op_exp->exp_right = exp_right;
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = OP_EXP;
     exp->op_exp = op_exp;
 
     return exp;
@@ -502,13 +1384,12 @@ Exp *create_times_op_exp(Exp *exp_left, Exp *exp_right) {
         return NULL;
     }
 
-    OpExp *op_exp = malloc(sizeof(OpExp));
+    Exp *exp = allocate_exp(OP_EXP, sizeof(OpExp));
+    OpExp *op_exp = (OpExp *) (exp + 1);
     op_exp->type = TIMES_OP_EXP;
     op_exp->exp_left = exp_left;
     op_exp->exp_right = exp_right;
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = OP_EXP;
     exp->op_exp = op_exp;
 
     return exp;
@@ -519,13 +1400,12 @@ Exp *create_lt_op_exp(Exp *exp_left, Exp *exp_right) {
         return NULL;
     }
 
-    OpExp *op_exp = malloc(sizeof(OpExp));
+    Exp *exp = allocate_exp(OP_EXP, sizeof(OpExp));
+    OpExp *op_exp = (OpExp *) (exp + 1);
     op_exp->type = LT_OP_EXP;
     op_exp->exp_left = exp_left;
     op_exp->exp_right = exp_right;
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = OP_EXP;
     exp->op_exp = op_exp;
 
     return exp;
@@ -536,13 +1416,12 @@ Exp *create_if_exp(Exp *exp_cond, Exp *exp_true, Exp *exp_false) {
         return NULL;
     }
 
-    IfExp *if_exp = malloc(sizeof(IfExp));
+    Exp *exp = allocate_exp(IF_EXP, sizeof(IfExp));
+    IfExp *if_exp = (IfExp *) (exp + 1);
     if_exp->exp_cond = exp_cond;
     if_exp->exp_true = exp_true;
     if_exp->exp_false = exp_false;
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = IF_EXP;
     exp->if_exp = if_exp;
 
     return exp;
@@ -553,13 +1432,12 @@ Exp *create_let_exp(Var *var, Exp *exp_1, Exp *exp_2) {
         return NULL;
     }
 
-    LetExp *let_exp = malloc(sizeof(LetExp));
+    Exp *exp = allocate_exp(LET_EXP, sizeof(LetExp));
+    LetExp *let_exp = (LetExp *) (exp + 1);
     let_exp->var = var;
     let_exp->exp_1 = exp_1;
     let_exp->exp_2 = exp_2;
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = LET_EXP;
     exp->let_exp = let_exp;
 
     return exp;
@@ -570,12 +1448,13 @@ Exp *create_fun_exp(Var *var, Exp *exp) {
         return NULL;
     }
 
-    FunExp *fun_exp = malloc(sizeof(FunExp));
+    Exp *exp_new = allocate_exp(FUN_EXP, sizeof(FunExp));
+    FunExp *fun_exp = (FunExp *) (exp_new + 1);
     fun_exp->var = var;
     fun_exp->exp = exp;
+    fun_exp->captured_var_exps = NULL;
+    fun_exp->captured_var_count = -1;
 
-    Exp *exp_new = malloc(sizeof(Exp));
-    exp_new->type = FUN_EXP;
     exp_new->fun_exp = fun_exp;
 
     return exp_new;
@@ -586,12 +1465,11 @@ Exp *create_app_exp(Exp *exp_1, Exp *exp_2) {
         return NULL;
     }
 
-    AppExp *app_exp = malloc(sizeof(AppExp));
+    Exp *exp = allocate_exp(APP_EXP, sizeof(AppExp));
+    AppExp *app_exp = (AppExp *) (exp + 1);
     app_exp->exp_1 = exp_1;
     app_exp->exp_2 = exp_2;
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = APP_EXP;
     exp->app_exp = app_exp;
 
     return exp;
@@ -602,22 +1480,22 @@ Exp *create_let_rec_exp(Var *var_rec, Var *var, Exp *exp_1, Exp *exp_2) {
         return NULL;
     }
 
-    LetRecExp *let_rec_exp = malloc(sizeof(LetRecExp));
+    Exp *exp = allocate_exp(LET_REC_EXP, sizeof(LetRecExp));
+    LetRecExp *let_rec_exp = (LetRecExp *) (exp + 1);
     let_rec_exp->var_rec = var_rec;
     let_rec_exp->var = var;
     let_rec_exp->exp_1 = exp_1;
     let_rec_exp->exp_2 = exp_2;
+    let_rec_exp->captured_var_exps = NULL;
+    let_rec_exp->captured_var_count = -1;
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = LET_REC_EXP;
     exp->let_rec_exp = let_rec_exp;
 
     return exp;
 }
 
 Exp *create_nil_exp() {
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = NIL_EXP;
+    Exp *exp = allocate_exp(NIL_EXP, 0);
 
     return exp;
 }
@@ -627,12 +1505,11 @@ Exp *create_cons_exp(Exp *exp_elem, Exp *exp_list) {
         return NULL;
     }
 
-    ConsExp *cons_exp = malloc(sizeof(ConsExp));
+    Exp *exp = allocate_exp(CONS_EXP, sizeof(ConsExp));
+    ConsExp *cons_exp = (ConsExp *) (exp + 1);
     cons_exp->exp_elem = exp_elem;
     cons_exp->exp_list = exp_list;
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = CONS_EXP;
     exp->cons_exp = cons_exp;
 
     return exp;
@@ -655,15 +1532,14 @@ Exp *create_match_exp(Exp *exp_list,
         return NULL;
     }
 
-    MatchExp *match_exp = malloc(sizeof(MatchExp));
+    Exp *exp = allocate_exp(MATCH_EXP, sizeof(MatchExp));
+    MatchExp *match_exp = (MatchExp *) (exp + 1);
     match_exp->exp_list = exp_list;
     match_exp->exp_match_nil = exp_match_nil;
     match_exp->var_elem = var_elem;
     match_exp->var_list = var_list;
     match_exp->exp_match_cons = exp_match_cons;
 
-    Exp *exp = malloc(sizeof(Exp));
-    exp->type = MATCH_EXP;
     exp->match_exp = match_exp;
 
     return exp;
@@ -674,303 +1550,78 @@ Exp *create_copied_exp(const Exp *exp) {
         return NULL;
     }
 
+    Exp *exp_shared = (Exp *) exp;
+    if (exp_shared->arena != NULL) {
+        create_copied_arena(exp_shared->arena);
+        return exp_shared;
+    }
+
+    exp_shared->ref_count++;
+    return exp_shared;
+}
+
+static void free_captured_var_exps(VarExp *captured_var_exps, const int captured_var_count) {
+    for (int i = 0; i < captured_var_count; i++) {
+        free_var_binding(captured_var_exps[i].var_binding);
+    }
+    free(captured_var_exps);
+}
+
+void free_exp(Exp *exp) {
+    if (exp == NULL) {
+        return;
+    }
+
+    if (exp->arena != NULL) {
+        free_arena(exp->arena);
+        return;
+    }
+
+    exp->ref_count--;
+    if (0 < exp->ref_count) {
+        return;
+    }
+
     switch (exp->type) {
         case INT_EXP: {
-            if (exp->int_exp == NULL) {
-                return NULL;
-            }
-
-            return create_int_exp(exp->int_exp->int_value);
+            free(exp);
+            return;
         }
         case BOOL_EXP: {
-            if (exp->bool_exp == NULL) {
-                return NULL;
-            }
-
-            return create_bool_exp(exp->bool_exp->bool_value);
+            free(exp);
+            return;
         }
         case VAR_EXP: {
             if (exp->var_exp == NULL) {
-                return NULL;
+                free(exp);
+                return;
             }
 
-            return create_var_exp(create_copied_var(exp->var_exp->var));
+            free_var(exp->var_exp->var);
+            free_var_binding(exp->var_exp->var_binding);
+            free(exp);
+            return;
         }
         case OP_EXP: {
             if (exp->op_exp == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_left = create_copied_exp(exp->op_exp->exp_left);
-            if (exp_left == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_right = create_copied_exp(exp->op_exp->exp_right);
-            if (exp_right == NULL) {
-                free_exp(exp_left);
-                return NULL;
+                free(exp);
+                return;
             }
 
-            switch (exp->op_exp->type) {
-                case PLUS_OP_EXP: {
-                    return create_plus_op_exp(exp_left, exp_right);
-                }
-                case MINUS_OP_EXP: {
-                    return create_minus_op_exp(exp_left, exp_right);
-                }
-                case TIMES_OP_EXP: {
-                    return create_times_op_exp(exp_left, exp_right);
-                }
-                case LT_OP_EXP: {
-                    return create_lt_op_exp(exp_left, exp_right);
-                }
-                default: {
-                    free_exp(exp_right);
-                    free_exp(exp_left);
-                    return NULL;
-                }
-            }
+            free_exp(exp->op_exp->exp_left);
+            free_exp(exp->op_exp->exp_right);
+            free(exp);
+            return;
         }
         case IF_EXP: {
             if (exp->if_exp == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_cond = create_copied_exp(exp->if_exp->exp_cond);
-            if (exp_cond == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_true = create_copied_exp(exp->if_exp->exp_true);
-            if (exp_true == NULL) {
-                free_exp(exp_cond);
-                return NULL;
-            }
-
-            Exp *exp_false = create_copied_exp(exp->if_exp->exp_false);
-            if (exp_false == NULL) {
-                free_exp(exp_true);
-                free_exp(exp_cond);
-                return NULL;
-            }
-
-            return create_if_exp(exp_cond, exp_true, exp_false);
-        }
-        case LET_EXP: {
-            if (exp->let_exp == NULL) {
-                return NULL;
-            }
-
-            Var *var = create_copied_var(exp->let_exp->var);
-            if (var == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_1 = create_copied_exp(exp->let_exp->exp_1);
-            if (exp_1 == NULL) {
-                free_var(var);
-                return NULL;
-            }
-
-            Exp *exp_2 = create_copied_exp(exp->let_exp->exp_2);
-            if (exp_2 == NULL) {
-                free_exp(exp_1);
-                free_var(var);
-                return NULL;
-            }
-
-            return create_let_exp(var, exp_1, exp_2);
-        }
-        case FUN_EXP: {
-            if (exp->fun_exp == NULL) {
-                return NULL;
-            }
-
-            Var *var = create_copied_var(exp->fun_exp->var);
-            if (var == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_body = create_copied_exp(exp->fun_exp->exp);
-            if (exp_body == NULL) {
-                free_var(var);
-                return NULL;
-            }
-
-            return create_fun_exp(var, exp_body);
-        }
-        case APP_EXP: {
-            if (exp->app_exp == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_1 = create_copied_exp(exp->app_exp->exp_1);
-            if (exp_1 == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_2 = create_copied_exp(exp->app_exp->exp_2);
-            if (exp_2 == NULL) {
-                free_exp(exp_1);
-                return NULL;
-            }
-
-            return create_app_exp(exp_1, exp_2);
-        }
-        case LET_REC_EXP: {
-            if (exp->let_rec_exp == NULL) {
-                return NULL;
-            }
-
-            Var *var_rec = create_copied_var(exp->let_rec_exp->var_rec);
-            if (var_rec == NULL) {
-                return NULL;
-            }
-
-            Var *var = create_copied_var(exp->let_rec_exp->var);
-            if (var == NULL) {
-                free_var(var_rec);
-                return NULL;
-            }
-
-            Exp *exp_1 = create_copied_exp(exp->let_rec_exp->exp_1);
-            if (exp_1 == NULL) {
-                free_var(var);
-                free_var(var_rec);
-                return NULL;
-            }
-
-            Exp *exp_2 = create_copied_exp(exp->let_rec_exp->exp_2);
-            if (exp_2 == NULL) {
-                free_exp(exp_1);
-                free_var(var);
-                free_var(var_rec);
-                return NULL;
-            }
-        }
-        case NIL_EXP: {
-            return create_nil_exp();
-        }
-        case CONS_EXP: {
-            if (exp->cons_exp == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_elem = create_copied_exp(exp->cons_exp->exp_elem);
-            if (exp_elem == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_list = create_copied_exp(exp->cons_exp->exp_list);
-            if (exp_list == NULL) {
-                free_exp(exp_elem);
-                return NULL;
-            }
-
-            return create_cons_exp(exp_elem, exp_list);
-        }
-        case MATCH_EXP: {
-            if (exp->match_exp == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_list = create_copied_exp(exp->match_exp->exp_list);
-            if (exp_list == NULL) {
-                return NULL;
-            }
-
-            Exp *exp_match_nil = create_copied_exp(exp->match_exp->exp_match_nil);
-            if (exp_match_nil == NULL) {
-                free_exp(exp_list);
-                return NULL;
-            }
-
-            Var *var_elem = create_copied_var(exp->match_exp->var_elem);
-            if (var_elem == NULL) {
-                free_exp(exp_match_nil);
-                free_exp(exp_list);
-                return NULL;
-            }
-
-            Var *var_list = create_copied_var(exp->match_exp->var_list);
-            if (var_list == NULL) {
-                free_var(var_elem);
-                free_exp(exp_match_nil);
-                free_exp(exp_list);
-                return NULL;
-            }
-
-            Exp *exp_match_cons = create_copied_exp(exp->match_exp->exp_match_cons);
-            if (exp_match_cons == NULL) {
-                free_var(var_list);
-                free_var(var_elem);
-                free_exp(exp_match_nil);
-                free_exp(exp_list);
-                return NULL;
-            }
-
-            return create_match_exp(exp_list,
-                                    exp_match_nil,
-                                    var_elem,
-                                    var_list,
-                                    exp_match_cons);
-        }
-        default: {
-            return NULL;
-        }
-    }
-}
-
-void free_exp(Exp *exp) {
-    if (exp == NULL) {
-        return;
-    }
-
-    switch (exp->type) {
-        case INT_EXP: {
-            free(exp->int_exp);
-            free(exp);
-            return;
-        }
-        case BOOL_EXP: {
-            free(exp->bool_exp);
-            free(exp);
-            return;
-        }
-        case VAR_EXP: {
-            if (exp->var_exp == NULL) {
-                free(exp);
-                return;
-            }
-
-            free_var(exp->var_exp->var);
-            free(exp->var_exp);
-            free(exp);
-            return;
-        }
-        case OP_EXP: {
-            if (exp->op_exp == NULL) {
-                free(exp);
-                return;
-            }
-
-            free_exp(exp->op_exp->exp_left);
-            free_exp(exp->op_exp->exp_right);
-            free(exp->op_exp);
-            free(exp);
-            return;
-        }
-        case IF_EXP: {
-            if (exp->if_exp == NULL) {
-                free(exp);
-                return;
+                free(exp);
+                return;
             }
 
             free_exp(exp->if_exp->exp_cond);
             free_exp(exp->if_exp->exp_true);
             free_exp(exp->if_exp->exp_false);
-            free(exp->if_exp);
             free(exp);
             return;
         }
@@ -983,7 +1634,6 @@ void free_exp(Exp *exp) {
             free_var(exp->let_exp->var);
             free_exp(exp->let_exp->exp_1);
             free_exp(exp->let_exp->exp_2);
-            free(exp->let_exp);
             free(exp);
             return;
         }
@@ -995,7 +1645,10 @@ void free_exp(Exp *exp) {
 
             free_var(exp->fun_exp->var);
             free_exp(exp->fun_exp->exp);
-            free(exp->fun_exp);
+            free_captured_var_exps(
+                exp->fun_exp->captured_var_exps,
+                exp->fun_exp->captured_var_count
+            );
             free(exp);
             return;
         }
@@ -1007,7 +1660,6 @@ void free_exp(Exp *exp) {
 
             free_exp(exp->app_exp->exp_1);
             free_exp(exp->app_exp->exp_2);
-            free(exp->app_exp);
             free(exp);
             return;
         }
@@ -1021,7 +1673,10 @@ void free_exp(Exp *exp) {
             free_var(exp->let_rec_exp->var);
             free_exp(exp->let_rec_exp->exp_1);
             free_exp(exp->let_rec_exp->exp_2);
-            free(exp->let_rec_exp);
+            free_captured_var_exps(
+                exp->let_rec_exp->captured_var_exps,
+                exp->let_rec_exp->captured_var_count
+            );
             free(exp);
             return;
         }
@@ -1070,177 +1725,394 @@ Value *evaluate(const Exp *exp) {
     return evaluate_impl(&env, exp);
 }
 
-Value *evaluate_impl(const Env *env, const Exp *exp) {
-    if (env == NULL) {
-        return NULL;
+static Value *lookup_var_exp(const Env *env, const VarExp *var_exp) {
+    if (var_exp->var_binding != NULL) {
+        return create_copied_value(var_exp->var_binding->value);
     }
 
-    if (exp == NULL) {
-        return NULL;
+    VarBinding *var_binding = env->var_binding;
+    for (int i = 0; i < var_exp->index && var_binding != NULL; i++) {
+        var_binding = var_binding->next;
+    }
+    if (var_binding != NULL && is_same_var(var_binding->var, var_exp->var)) {
+        return create_copied_value(var_binding->value);
     }
 
-    switch (exp->type) {
-        case INT_EXP: {
-            if (exp->int_exp == NULL) {
-                return NULL;
-            }
-
-            Value *value = malloc(sizeof(Value));
-            value->type = INT_VALUE;
-            value->int_value = exp->int_exp->int_value;
-            return value;
+    var_binding = env->var_binding;
+    while (var_binding != NULL) {
+        if (is_same_var(var_binding->var, var_exp->var)) {
+            return create_copied_value(var_binding->value);
         }
-        case BOOL_EXP: {
-            if (exp->bool_exp == NULL) {
-                return NULL;
-            }
 
-            Value *value = malloc(sizeof(Value));
-            value->type = BOOL_VALUE;
-            value->bool_value = exp->bool_exp->bool_value;
-            return value;
-        }
-        case VAR_EXP: {
-            if (exp->var_exp == NULL) {
-                return NULL;
-            }
+        var_binding = var_binding->next;
+    }
 
-            VarBinding *var_binding = env->var_binding;
-            while (var_binding != NULL) {
-                if (is_same_var(var_binding->var, exp->var_exp->var)) {
-                    return create_copied_value(var_binding->value);
-                }
+    return NULL;
+}
 
-                var_binding = var_binding->next;
-            }
+static Env *create_captured_env(const Env *env,
+                                const VarExp *captured_var_exps,
+                                const int captured_var_count) {
+    Env *env_captured = malloc(sizeof(Env));
+    env_captured->var_binding = NULL;
 
+    for (int i = 0; i < captured_var_count; i++) {
+        Value *value = lookup_var_exp(env, &captured_var_exps[i]);
+        if (value == NULL) {
+            free_env(env_captured);
             return NULL;
         }
-        case OP_EXP: {
-            if (exp->op_exp == NULL) {
-                return NULL;
-            }
 
-            const Exp *exp_left = exp->op_exp->exp_left;
-            if (exp_left == NULL) {
-                return NULL;
-            }
+        VarBinding *var_binding = malloc(sizeof(VarBinding));
+        var_binding->var = create_copied_var(captured_var_exps[i].var);
+        var_binding->value = value;
+        var_binding->next = env_captured->var_binding;
+        var_binding->ref_count = 1;
+        env_captured->var_binding = var_binding;
+    }
 
-            const Exp *exp_right = exp->op_exp->exp_right;
-            if (exp_right == NULL) {
-                return NULL;
-            }
+    return env_captured;
+}
 
-            Value *value_left = evaluate_impl(env, exp_left);
-            if (value_left == NULL) {
-                return NULL;
+static bool evaluate_int_impl(const Env *env, const Exp *exp, int *int_value) {
+    if (exp == NULL) {
+        return false;
+    }
+
+    switch (exp->type) {
+        case INT_EXP: {
+            if (exp->int_exp == NULL) {
+                return false;
             }
 
-            if (value_left->type != INT_VALUE) {
-                free_value(value_left);
-                return NULL;
+            *int_value = exp->int_exp->int_value;
+            return true;
+        }
+        case OP_EXP: {
+            if (exp->op_exp == NULL || exp->op_exp->type == LT_OP_EXP) {
+                break;
             }
 
-            Value *value_right = evaluate_impl(env, exp_right);
-            if (value_right == NULL) {
-                free_value(value_left);
-                return NULL;
+            int int_value_left;
+            if (!evaluate_int_impl(env, exp->op_exp->exp_left, &int_value_left)) {
+                return false;
             }
 
-            if (value_right->type != INT_VALUE) {
-                free_value(value_left);
-                free_value(value_right);
-                return NULL;
+            int int_value_right;
+            if (!evaluate_int_impl(env, exp->op_exp->exp_right, &int_value_right)) {
+                return false;
             }
 
-            switch(exp->op_exp->type) {
+            switch (exp->op_exp->type) {
                 case PLUS_OP_EXP: {
-                    Value *value = malloc(sizeof(Value));
-                    value->type = INT_VALUE;
-                    value->int_value = value_left->int_value + value_right->int_value;
-                    free_value(value_left);
-                    free_value(value_right);
-                    return value;
+                    *int_value = int_value_left + int_value_right;
+                    return true;
                 }
                 case MINUS_OP_EXP: {
-                    Value *value = malloc(sizeof(Value));
-                    value->type = INT_VALUE;
-                    value->int_value = value_left->int_value - value_right->int_value;
-                    free_value(value_left);
-                    free_value(value_right);
-                    return value;
+                    *int_value = int_value_left - int_value_right;
+                    return true;
                 }
                 case TIMES_OP_EXP: {
-                    Value *value = malloc(sizeof(Value));
-                    value->type = INT_VALUE;
-                    value->int_value = value_left->int_value * value_right->int_value;
-                    free_value(value_left);
-                    free_value(value_right);
-                    return value;
-                }
-                case LT_OP_EXP: {
-                    Value *value = malloc(sizeof(Value));
-                    value->type = BOOL_VALUE;
-                    value->bool_value = value_left->int_value < value_right->int_value;
-                    free_value(value_left);
-                    free_value(value_right);
-                    return value;
+                    *int_value = int_value_left * int_value_right;
+                    return true;
                 }
                 default: {
-                    return NULL;
+                    return false;
                 }
             }
         }
-        case IF_EXP: {
-            if (exp->if_exp == NULL) {
-                return NULL;
-            }
+        default: {
+            break;
+        }
+    }
 
-            const Exp *exp_cond = exp->if_exp->exp_cond;
-            if (exp_cond == NULL) {
-                return NULL;
+    Value *value = evaluate_impl(env, exp);
+    if (value == NULL) {
+        return false;
+    }
+
+    if (value->type != INT_VALUE) {
+        free_value(value);
+        return false;
+    }
+
+    *int_value = value->int_value;
+    free_value(value);
+    return true;
+}
+
+static bool evaluate_bool_impl(const Env *env, const Exp *exp, bool *bool_value) {
+    if (exp == NULL) {
+        return false;
+    }
+
+    switch (exp->type) {
+        case BOOL_EXP: {
+            if (exp->bool_exp == NULL) {
+                return false;
             }
 
-            Value *value_cond = evaluate_impl(env, exp_cond);
-            if (value_cond == NULL) {
-                return NULL;
+            *bool_value = exp->bool_exp->bool_value;
+            return true;
+        }
+        case OP_EXP: {
+            if (exp->op_exp == NULL || exp->op_exp->type != LT_OP_EXP) {
+                break;
             }
 
-            if (value_cond->type != BOOL_VALUE) {
-                free_value(value_cond);
-                return NULL;
+            int int_value_left;
+            if (!evaluate_int_impl(env, exp->op_exp->exp_left, &int_value_left)) {
+                return false;
             }
 
-            if (value_cond->bool_value) {
-                const Exp *exp_true = exp->if_exp->exp_true;
-                if (exp_true == NULL) {
-                    free_value(value_cond);
-                    return NULL;
-                }
+            int int_value_right;
+            if (!evaluate_int_impl(env, exp->op_exp->exp_right, &int_value_right)) {
+                return false;
+            }
 
-                Value *value_true = evaluate_impl(env, exp_true);
-                if (value_true == NULL) {
-                    free_value(value_cond);
+            *bool_value = int_value_left < int_value_right;
+            return true;
+        }
+        default: {
+            break;
+        }
+    }
+
+    Value *value = evaluate_impl(env, exp);
+    if (value == NULL) {
+        return false;
+    }
+
+    if (value->type != BOOL_VALUE) {
+        free_value(value);
+        return false;
+    }
+
+    *bool_value = value->bool_value;
+    free_value(value);
+    return true;
+}
+
+static bool try_evaluate_uncurried_app(const Env *env,
+                                       const Exp *exp,
+                                       const Exp **exp_next,
+                                       Env **env_next,
+                                       Value **value_next) {
+    const Exp *exp_arguments[UNCURRIED_ARG_COUNT_MAX];
+    int argument_count = 0;
+    const Exp *exp_function = exp;
+    while (exp_function->type == APP_EXP) {
+        if (argument_count == UNCURRIED_ARG_COUNT_MAX
+            || exp_function->app_exp == NULL
+            || exp_function->app_exp->exp_1 == NULL
+            || exp_function->app_exp->exp_2 == NULL) {
+            return false;
+        }
+
+        exp_arguments[argument_count++] = exp_function->app_exp->exp_2;
+        exp_function = exp_function->app_exp->exp_1;
+    }
+
+    if (argument_count < 2 || exp_function->type != VAR_EXP || exp_function->var_exp == NULL) {
+        return false;
+    }
+
+    Value *value_function = lookup_var_exp(env, exp_function->var_exp);
+    if (value_function == NULL) {
+        return false;
+    }
+
+    Env *env_current;
+    const Var *var;
+    const Exp *exp_body;
+    switch (value_function->type) {
+        case CLOSURE_VALUE: {
+            env_current = create_copied_env(value_function->closure_value->env);
+            var = value_function->closure_value->var;
+            exp_body = value_function->closure_value->exp;
+            break;
+        }
+        case REC_CLOSURE_VALUE: {
+            env_current = NULL;
+            var = value_function->rec_closure_value->var;
+            exp_body = value_function->rec_closure_value->exp;
+            break;
+        }
+        default: {
+            free_value(value_function);
+            return false;
+        }
+    }
+
+    const Exp *exp_fun = exp_body;
+    for (int i = 1; i < argument_count; i++) {
+        if (exp_fun == NULL
+            || exp_fun->type != FUN_EXP
+            || exp_fun->fun_exp == NULL
+            || exp_fun->fun_exp->captured_var_count < 0) {
+            free_env(env_current);
+            free_value(value_function);
+            return false;
+        }
+
+        exp_fun = exp_fun->fun_exp->exp;
+    }
+
+    if (value_function->type == REC_CLOSURE_VALUE) {
+        env_current = create_appended_env(
+            value_function->rec_closure_value->env,
+            value_function->rec_closure_value->var_rec,
+            value_function
+        );
+    }
+
+    for (int i = argument_count - 1; 0 <= i; i--) {
+        Value *value_argument = evaluate_impl(env, exp_arguments[i]);
+        if (value_argument == NULL) {
+            free_env(env_current);
+            free_value(value_function);
+            return true;
+        }
+
+        Env *env_new = create_appended_env(env_current, var, value_argument);
+        free_value(value_argument);
+        free_env(env_current);
+        env_current = env_new;
+        if (i == 0) {
+            break;
+        }
+
+        Env *env_captured = create_captured_env(
+            env_current,
+            exp_body->fun_exp->captured_var_exps,
+            exp_body->fun_exp->captured_var_count
+        );
+        free_env(env_current);
+        if (env_captured == NULL) {
+            free_value(value_function);
+            return true;
+        }
+
+        env_current = env_captured;
+        var = exp_body->fun_exp->var;
+        exp_body = exp_body->fun_exp->exp;
+    }
+
+    *exp_next = exp_body;
+    *env_next = env_current;
+    *value_next = value_function;
+    return true;
+}
+
+static Value *evaluate_tail_impl(const Env *env,
+                                 const Exp *exp,
+                                 const Exp **exp_next,
+                                 Env **env_next,
+                                 Value **value_next) {
+    if (env == NULL) {
+        return NULL;
+    }
+
+    if (exp == NULL) {
+        return NULL;
+    }
+
+    switch (exp->type) {
+        case INT_EXP: {
+            if (exp->int_exp == NULL) {
+                return NULL;
+            }
+
+            return create_int_value(exp->int_exp->int_value);
+        }
+        case BOOL_EXP: {
+            if (exp->bool_exp == NULL) {
+                return NULL;
+            }
+
+            return create_bool_value(exp->bool_exp->bool_value);
+        }
+        case VAR_EXP: {
+            if (exp->var_exp == NULL) {
+                return NULL;
+            }
+
+            return lookup_var_exp(env, exp->var_exp);
+        }
+        case OP_EXP: {
+            if (exp->op_exp == NULL) {
+                return NULL;
+            }
+
+            const Exp *exp_left = exp->op_exp->exp_left;
+            if (exp_left == NULL) {
+                return NULL;
+            }
+
+            const Exp *exp_right = exp->op_exp->exp_right;
+            if (exp_right == NULL) {
+                return NULL;
+            }
+
+            int int_value_left;
+            if (!evaluate_int_impl(env, exp_left, &int_value_left)) {
+                return NULL;
+            }
+
+            int int_value_right;
+            if (!evaluate_int_impl(env, exp_right, &int_value_right)) {
+                return NULL;
+            }
+
+            switch(exp->op_exp->type) {
+                case PLUS_OP_EXP: {
+                    return create_int_value(int_value_left + int_value_right);
+                }
+                case MINUS_OP_EXP: {
+                    return create_int_value(int_value_left - int_value_right);
+                }
+                case TIMES_OP_EXP: {
+                    return create_int_value(int_value_left * int_value_right);
+                }
+                case LT_OP_EXP: {
+                    return create_bool_value(int_value_left < int_value_right);
+                }
+                default: {
                     return NULL;
                 }
+            }
+        }
+        case IF_EXP: {
+            if (exp->if_exp == NULL) {
+                return NULL;
+            }
 
-                free_value(value_cond);
-                return value_true;
-            } else {
-                const Exp *exp_false = exp->if_exp->exp_false;
-                if (exp_false == NULL) {
-                    free_value(value_cond);
+            const Exp *exp_cond = exp->if_exp->exp_cond;
+            if (exp_cond == NULL) {
+                return NULL;
+            }
+
+            bool bool_value_cond;
+            if (!evaluate_bool_impl(env, exp_cond, &bool_value_cond)) {
+                return NULL;
+            }
+
+            if (bool_value_cond) {
+                const Exp *exp_true = exp->if_exp->exp_true;
+                if (exp_true == NULL) {
                     return NULL;
                 }
 
-                Value *value_false = evaluate_impl(env, exp_false);
-                if (value_false == NULL) {
-                    free_value(value_cond);
+                *exp_next = exp_true;
+                return NULL;
+            } else {
+                const Exp *exp_false = exp->if_exp->exp_false;
+                if (exp_false == NULL) {
                     return NULL;
                 }
 
-                free_value(value_cond);
-                return value_false;
+                *exp_next = exp_false;
+                return NULL;
             }
         }
         case LET_EXP: {
@@ -1271,12 +2143,11 @@ Value *evaluate_impl(const Env *env, const Exp *exp) {
                 return NULL;
             }
 
-            Value *value_2 = evaluate_impl(env_new, exp->let_exp->exp_2);
-
-            free_env(env_new);
             free_value(value_1);
 
-            return value_2;
+            *exp_next = exp->let_exp->exp_2;
+            *env_next = env_new;
+            return NULL;
         }
         case FUN_EXP: {
             if (exp->fun_exp == NULL) {
@@ -1291,9 +2162,27 @@ Value *evaluate_impl(const Env *env, const Exp *exp) {
                 return NULL;
             }
 
-            return create_closure_value(
-                create_closure(env, exp->fun_exp->var, exp->fun_exp->exp)
+            if (exp->fun_exp->captured_var_count < 0) {
+                return create_closure_value(
+                    create_closure(env, exp->fun_exp->var, exp->fun_exp->exp)
+                );
+            }
+
+            Env *env_captured = create_captured_env(
+                env,
+                exp->fun_exp->captured_var_exps,
+                exp->fun_exp->captured_var_count
+            );
+            if (env_captured == NULL) {
+                return NULL;
+            }
+
+            Value *value = create_closure_value(
+                create_closure(env_captured, exp->fun_exp->var, exp->fun_exp->exp)
             );
+
+            free_env(env_captured);
+            return value;
         }
         case APP_EXP: {
             if (exp->app_exp == NULL) {
@@ -1308,6 +2197,11 @@ Value *evaluate_impl(const Env *env, const Exp *exp) {
                 return NULL;
             }
 
+            if (current_memo == NULL
+                && try_evaluate_uncurried_app(env, exp, exp_next, env_next, value_next)) {
+                return NULL;
+            }
+
             Value *value_1 = evaluate_impl(env, exp->app_exp->exp_1);
             if (value_1 == NULL) {
                 return NULL;
@@ -1338,13 +2232,12 @@ Value *evaluate_impl(const Env *env, const Exp *exp) {
                         return NULL;
                     }
 
-                    Value *value_3 = evaluate_impl(env_new, closure_value->exp);
-
-                    free_env(env_new);
                     free_value(value_2);
-                    free_value(value_1);
 
-                    return value_3;
+                    *exp_next = closure_value->exp;
+                    *env_next = env_new;
+                    *value_next = value_1;
+                    return NULL;
                 }
                 case REC_CLOSURE_VALUE: {
                     RecClosure *rec_closure_value = value_1->rec_closure_value;
@@ -1359,6 +2252,22 @@ Value *evaluate_impl(const Env *env, const Exp *exp) {
                         return NULL;
                     }
 
+                    if (current_memo != NULL && is_memo_value(value_2)) {
+                        Value *value_memo = find_memo_value(value_1, value_2);
+                        if (value_memo != NULL) {
+                            free_value(value_2);
+                            free_value(value_1);
+                            return value_memo;
+                        }
+                    }
+
+                    Value *value_jit;
+                    if (try_apply_jit(rec_closure_value, value_2, &value_jit)) {
+                        free_value(value_2);
+                        free_value(value_1);
+                        return value_jit;
+                    }
+
                     Env *env_temp = create_appended_env(
                         rec_closure_value->env,
                         rec_closure_value->var_rec,
@@ -1382,13 +2291,12 @@ Value *evaluate_impl(const Env *env, const Exp *exp) {
                         return NULL;
                     }
 
-                    Value *value_3 = evaluate_impl(env_new, rec_closure_value->exp);
-
-                    free_env(env_new);
                     free_value(value_2);
-                    free_value(value_1);
 
-                    return value_3;
+                    *exp_next = rec_closure_value->exp;
+                    *env_next = env_new;
+                    *value_next = value_1;
+                    return NULL;
                 }
                 default: {
                     free_value(value_1);
@@ -1417,14 +2325,27 @@ Value *evaluate_impl(const Env *env, const Exp *exp) {
                 return NULL;
             }
 
+            Env *env_captured = NULL;
+            if (0 <= exp->let_rec_exp->captured_var_count) {
+                env_captured = create_captured_env(
+                    env,
+                    exp->let_rec_exp->captured_var_exps,
+                    exp->let_rec_exp->captured_var_count
+                );
+                if (env_captured == NULL) {
+                    return NULL;
+                }
+            }
+
             Value *rec_closure_value = create_rec_closure_value(
                 create_rec_closure(
-                    env,
+                    env_captured != NULL ? env_captured : env,
                     exp->let_rec_exp->var_rec,
                     exp->let_rec_exp->var,
                     exp->let_rec_exp->exp_1
                 )
             );
+            free_env(env_captured);
             if (rec_closure_value == NULL) {
                 return NULL;
             }
@@ -1439,160 +2360,1331 @@ Value *evaluate_impl(const Env *env, const Exp *exp) {
                 return NULL;
             }
 
-            Value *value = evaluate_impl(env_new, exp->let_rec_exp->exp_2);
+            free_value(rec_closure_value);
+
+            *exp_next = exp->let_rec_exp->exp_2;
+            *env_next = env_new;
+            return NULL;
+        }
+        case NIL_EXP: {
+            return create_nil_value();
+        }
+        case CONS_EXP: {
+            if (exp->cons_exp == NULL) {
+                return NULL;
+            }
+
+            const Exp *exp_elem = exp->cons_exp->exp_elem;
+            if (exp_elem == NULL) {
+                return NULL;
+            }
+
+            const Exp *exp_list = exp->cons_exp->exp_list;
+            if (exp_list == NULL) {
+                return NULL;
+            }
+
+            Value *value_elem = evaluate_impl(env, exp_elem);
+            if (value_elem == NULL) {
+                return NULL;
+            }
+
+            Value *value_list = evaluate_impl(env, exp_list);
+            if (value_list == NULL) {
+                free_value(value_elem);
+                return NULL;
+            }
+
+            Value *value = create_list_value(value_elem, value_list);
+            free_value(value_elem);
+            free_value(value_list);
+            return value;
+        }
+        case MATCH_EXP: {
+            if (exp->match_exp == NULL) {
+                return NULL;
+            }
+
+            const Exp *exp_list = exp->match_exp->exp_list;
+            if (exp_list == NULL) {
+                return NULL;
+            }
+
+            Value *value_list = evaluate_impl(env, exp_list);
+            if (value_list == NULL) {
+                return NULL;
+            }
+
+            switch (value_list->type) {
+                case NIL_VALUE: {
+                    const Exp *exp_match_nil = exp->match_exp->exp_match_nil;
+                    if (exp_match_nil == NULL) {
+                        free_value(value_list);
+                        return NULL;
+                    }
+
+                    free_value(value_list);
+
+                    *exp_next = exp_match_nil;
+                    return NULL;
+                }
+                case CONS_VALUE:
+                case PACKED_CONS_VALUE: {
+                    Value *value_elem;
+                    Value *value_subsequent_list;
+                    if (!try_take_elem_and_list(value_list, &value_elem, &value_subsequent_list)) {
+                        return NULL;
+                    }
+
+                    const Exp *exp_match_cons = exp->match_exp->exp_match_cons;
+                    if (exp_match_cons == NULL) {
+                        free_value(value_subsequent_list);
+                        free_value(value_elem);
+                        return NULL;
+                    }
+
+                    Env *env_temp = create_appended_env(
+                        env,
+                        exp->match_exp->var_elem,
+                        value_elem
+                    );
+                    free_value(value_elem);
+                    if (env_temp == NULL) {
+                        free_value(value_subsequent_list);
+                        return NULL;
+                    }
+
+                    Env *env_new = create_appended_env(
+                        env_temp,
+                        exp->match_exp->var_list,
+                        value_subsequent_list
+                    );
+                    free_env(env_temp);
+                    free_value(value_subsequent_list);
+                    if (env_new == NULL) {
+                        return NULL;
+                    }
+
+                    *exp_next = exp_match_cons;
+                    *env_next = env_new;
+                    return NULL;
+                }
+                default: {
+                    free_value(value_list);
+                    return NULL;
+                }
+            }
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
+
+Value *evaluate_impl(const Env *env, const Exp *exp) {
+    Env *env_held = NULL;
+    Value *value_held = NULL;
+    Value *value_memo_function = NULL;
+    Value *value_memo_argument = NULL;
+    Value *value;
+    while (true) {
+        const Exp *exp_next = NULL;
+        Env *env_next = NULL;
+        Value *value_next = NULL;
+        value = evaluate_tail_impl(env, exp, &exp_next, &env_next, &value_next);
+        if (exp_next == NULL) {
+            break;
+        }
+
+        if (current_memo != NULL
+            && value_memo_function == NULL
+            && value_next != NULL
+            && value_next->type == REC_CLOSURE_VALUE) {
+            value_memo_function = create_copied_value(value_next);
+            value_memo_argument = create_copied_value(env_next->var_binding->value);
+        }
+
+        if (env_next != NULL) {
+            free_env(env_held);
+            env_held = env_next;
+            env = env_next;
+        }
+
+        if (value_next != NULL) {
+            free_value(value_held);
+            value_held = value_next;
+        }
+
+        exp = exp_next;
+    }
+
+    if (value_memo_function != NULL) {
+        if (value != NULL) {
+            add_memo_value(value_memo_function, value_memo_argument, value);
+        }
+        free_value(value_memo_function);
+        free_value(value_memo_argument);
+    }
+
+    free_env(env_held);
+    free_value(value_held);
+    return value;
+}
+
+Value *apply_closure_value(const Value *value_1, const Value *value_2) {
+    if (value_1 == NULL || value_2 == NULL) {
+        return NULL;
+    }
+
+    switch (value_1->type) {
+        case CLOSURE_VALUE: {
+            Env *env_new = create_appended_env(
+                value_1->closure_value->env,
+                value_1->closure_value->var,
+                value_2
+            );
+            if (env_new == NULL) {
+                return NULL;
+            }
+
+            Value *value = evaluate_impl(env_new, value_1->closure_value->exp);
+            free_env(env_new);
+            return value;
+        }
+        case REC_CLOSURE_VALUE: {
+            Env *env_temp = create_appended_env(
+                value_1->rec_closure_value->env,
+                value_1->rec_closure_value->var_rec,
+                value_1
+            );
+            if (env_temp == NULL) {
+                return NULL;
+            }
+
+            Env *env_new = create_appended_env(
+                env_temp,
+                value_1->rec_closure_value->var,
+                value_2
+            );
+            free_env(env_temp);
+            if (env_new == NULL) {
+                return NULL;
+            }
+
+            Value *value = evaluate_impl(env_new, value_1->rec_closure_value->exp);
+            free_env(env_new);
+            return value;
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
+
+typedef enum {
+    OP_LEFT_CONTINUATION,
+    OP_RIGHT_CONTINUATION,
+    IF_CONTINUATION,
+    LET_CONTINUATION,
+    APP_FUNCTION_CONTINUATION,
+    APP_ARGUMENT_CONTINUATION,
+    RETURN_CONTINUATION,
+    CONS_ELEM_CONTINUATION,
+    CONS_LIST_CONTINUATION,
+    MATCH_CONTINUATION
+} ContinuationType;
+
+typedef struct {
+    ContinuationType type;
+    const Exp *exp;
+    Env *env;
+    Value *value;
+} Continuation;
+
+typedef struct {
+    Continuation *continuations;
+    size_t count;
+    size_t capacity;
+    size_t depth_max;
+} ContinuationStack;
+
+static void push_continuation(ContinuationStack *stack,
+                              const ContinuationType type,
+                              const Exp *exp,
+                              Env *env,
+                              Value *value) {
+    if (stack->count == stack->capacity) {
+        stack->capacity = stack->capacity == 0 ? 64 : stack->capacity * 2;
+        stack->continuations = realloc(stack->continuations, sizeof(Continuation) * stack->capacity);
+    }
+
+    Continuation *continuation = &stack->continuations[stack->count++];
+    continuation->type = type;
+    continuation->exp = exp;
+    continuation->env = env;
+    continuation->value = value;
+
+    if (stack->depth_max < stack->count) {
+        stack->depth_max = stack->count;
+    }
+}
+
+static Value *create_function_value(const Env *env, const Exp *exp) {
+    if (exp->type == FUN_EXP) {
+        if (exp->fun_exp->captured_var_count < 0) {
+            return create_closure_value(
+                create_closure(env, exp->fun_exp->var, exp->fun_exp->exp)
+            );
+        }
+
+        Env *env_captured = create_captured_env(
+            env,
+            exp->fun_exp->captured_var_exps,
+            exp->fun_exp->captured_var_count
+        );
+        if (env_captured == NULL) {
+            return NULL;
+        }
+
+        Value *value = create_closure_value(
+            create_closure(env_captured, exp->fun_exp->var, exp->fun_exp->exp)
+        );
+
+        free_env(env_captured);
+        return value;
+    }
+
+    Env *env_captured = NULL;
+    if (0 <= exp->let_rec_exp->captured_var_count) {
+        env_captured = create_captured_env(
+            env,
+            exp->let_rec_exp->captured_var_exps,
+            exp->let_rec_exp->captured_var_count
+        );
+        if (env_captured == NULL) {
+            return NULL;
+        }
+    }
+
+    Value *value = create_rec_closure_value(
+        create_rec_closure(
+            env_captured != NULL ? env_captured : env,
+            exp->let_rec_exp->var_rec,
+            exp->let_rec_exp->var,
+            exp->let_rec_exp->exp_1
+        )
+    );
+
+    free_env(env_captured);
+    return value;
+}
+
+Value *evaluate_cek(const Env *env, const Exp *exp, size_t *depth) {
+    if (env == NULL || exp == NULL) {
+        return NULL;
+    }
+
+    ContinuationStack stack = { .continuations = NULL, .count = 0, .capacity = 0, .depth_max = 0 };
+    Env *env_current = create_copied_env(env);
+    const Exp *exp_current = exp;
+    Value *value = NULL;
+
+    while (true) {
+        if (exp_current != NULL) {
+            exp = exp_current;
+            exp_current = NULL;
+            switch (exp->type) {
+                case INT_EXP: {
+                    value = create_int_value(exp->int_exp->int_value);
+                    break;
+                }
+                case BOOL_EXP: {
+                    value = create_bool_value(exp->bool_exp->bool_value);
+                    break;
+                }
+                case VAR_EXP: {
+                    value = lookup_var_exp(env_current, exp->var_exp);
+                    if (value == NULL) {
+                        goto error;
+                    }
+                    break;
+                }
+                case OP_EXP: {
+                    push_continuation(&stack, OP_LEFT_CONTINUATION, exp, create_copied_env(env_current), NULL);
+                    exp_current = exp->op_exp->exp_left;
+                    break;
+                }
+                case IF_EXP: {
+                    push_continuation(&stack, IF_CONTINUATION, exp, create_copied_env(env_current), NULL);
+                    exp_current = exp->if_exp->exp_cond;
+                    break;
+                }
+                case LET_EXP: {
+                    push_continuation(&stack, LET_CONTINUATION, exp, create_copied_env(env_current), NULL);
+                    exp_current = exp->let_exp->exp_1;
+                    break;
+                }
+                case FUN_EXP: {
+                    value = create_function_value(env_current, exp);
+                    if (value == NULL) {
+                        goto error;
+                    }
+                    break;
+                }
+                case APP_EXP: {
+                    push_continuation(&stack, APP_FUNCTION_CONTINUATION, exp, create_copied_env(env_current), NULL);
+                    exp_current = exp->app_exp->exp_1;
+                    break;
+                }
+                case LET_REC_EXP: {
+                    Value *rec_closure_value = create_function_value(env_current, exp);
+                    if (rec_closure_value == NULL) {
+                        goto error;
+                    }
+
+                    Env *env_new = create_appended_env(env_current, exp->let_rec_exp->var_rec, rec_closure_value);
+                    free_value(rec_closure_value);
+                    free_env(env_current);
+                    env_current = env_new;
+                    exp_current = exp->let_rec_exp->exp_2;
+                    break;
+                }
+                case NIL_EXP: {
+                    value = create_nil_value();
+                    break;
+                }
+                case CONS_EXP: {
+                    push_continuation(&stack, CONS_ELEM_CONTINUATION, exp, create_copied_env(env_current), NULL);
+                    exp_current = exp->cons_exp->exp_elem;
+                    break;
+                }
+                case MATCH_EXP: {
+                    push_continuation(&stack, MATCH_CONTINUATION, exp, create_copied_env(env_current), NULL);
+                    exp_current = exp->match_exp->exp_list;
+                    break;
+                }
+                default: {
+                    goto error;
+                }
+            }
+            continue;
+        }
+
+        if (stack.count == 0) {
+            break;
+        }
+
+        Continuation continuation = stack.continuations[--stack.count];
+        exp = continuation.exp;
+        switch (continuation.type) {
+            case OP_LEFT_CONTINUATION: {
+                if (value->type != INT_VALUE) {
+                    free_env(continuation.env);
+                    goto error;
+                }
+
+                push_continuation(&stack, OP_RIGHT_CONTINUATION, exp, NULL, value);
+                value = NULL;
+                free_env(env_current);
+                env_current = continuation.env;
+                exp_current = exp->op_exp->exp_right;
+                break;
+            }
+            case OP_RIGHT_CONTINUATION: {
+                if (value->type != INT_VALUE) {
+                    free_value(continuation.value);
+                    goto error;
+                }
+
+                int int_value_left = continuation.value->int_value;
+                int int_value_right = value->int_value;
+                free_value(continuation.value);
+                free_value(value);
+                switch (exp->op_exp->type) {
+                    case PLUS_OP_EXP: {
+                        value = create_int_value(int_value_left + int_value_right);
+                        break;
+                    }
+                    case MINUS_OP_EXP: {
+                        value = create_int_value(int_value_left - int_value_right);
+                        break;
+                    }
+                    case TIMES_OP_EXP: {
+                        value = create_int_value(int_value_left * int_value_right);
+                        break;
+                    }
+                    case LT_OP_EXP: {
+                        value = create_bool_value(int_value_left < int_value_right);
+                        break;
+                    }
+                    default: {
+                        value = NULL;
+                        goto error;
+                    }
+                }
+                break;
+            }
+            case IF_CONTINUATION: {
+                if (value->type != BOOL_VALUE) {
+                    free_env(continuation.env);
+                    goto error;
+                }
+
+                exp_current = value->bool_value ? exp->if_exp->exp_true : exp->if_exp->exp_false;
+                free_value(value);
+                value = NULL;
+                free_env(env_current);
+                env_current = continuation.env;
+                break;
+            }
+            case LET_CONTINUATION: {
+                free_env(env_current);
+                env_current = create_appended_env(continuation.env, exp->let_exp->var, value);
+                free_env(continuation.env);
+                free_value(value);
+                value = NULL;
+                exp_current = exp->let_exp->exp_2;
+                break;
+            }
+            case APP_FUNCTION_CONTINUATION: {
+                if (value->type != CLOSURE_VALUE && value->type != REC_CLOSURE_VALUE) {
+                    free_env(continuation.env);
+                    goto error;
+                }
+
+                push_continuation(&stack, APP_ARGUMENT_CONTINUATION, exp, NULL, value);
+                value = NULL;
+                free_env(env_current);
+                env_current = continuation.env;
+                exp_current = exp->app_exp->exp_2;
+                break;
+            }
+            case APP_ARGUMENT_CONTINUATION: {
+                Value *value_function = continuation.value;
+                Env *env_new;
+                if (value_function->type == CLOSURE_VALUE) {
+                    env_new = create_appended_env(
+                        value_function->closure_value->env,
+                        value_function->closure_value->var,
+                        value
+                    );
+                    exp_current = value_function->closure_value->exp;
+                } else {
+                    Env *env_temp = create_appended_env(
+                        value_function->rec_closure_value->env,
+                        value_function->rec_closure_value->var_rec,
+                        value_function
+                    );
+                    env_new = create_appended_env(
+                        env_temp,
+                        value_function->rec_closure_value->var,
+                        value
+                    );
+                    free_env(env_temp);
+                    exp_current = value_function->rec_closure_value->exp;
+                }
+                free_value(value);
+                value = NULL;
+                free_env(env_current);
+                env_current = env_new;
+
+                if (0 < stack.count && stack.continuations[stack.count - 1].type == RETURN_CONTINUATION) {
+                    free_value(stack.continuations[stack.count - 1].value);
+                    stack.continuations[stack.count - 1].value = value_function;
+                } else {
+                    push_continuation(&stack, RETURN_CONTINUATION, NULL, NULL, value_function);
+                }
+                break;
+            }
+            case RETURN_CONTINUATION: {
+                free_value(continuation.value);
+                break;
+            }
+            case CONS_ELEM_CONTINUATION: {
+                push_continuation(&stack, CONS_LIST_CONTINUATION, exp, NULL, value);
+                value = NULL;
+                free_env(env_current);
+                env_current = continuation.env;
+                exp_current = exp->cons_exp->exp_list;
+                break;
+            }
+            case CONS_LIST_CONTINUATION: {
+                Value *value_cons = create_list_value(continuation.value, value);
+                free_value(continuation.value);
+                free_value(value);
+                value = value_cons;
+                if (value == NULL) {
+                    goto error;
+                }
+                break;
+            }
+            case MATCH_CONTINUATION: {
+                switch (value->type) {
+                    case NIL_VALUE: {
+                        free_env(env_current);
+                        env_current = continuation.env;
+                        exp_current = exp->match_exp->exp_match_nil;
+                        break;
+                    }
+                    case CONS_VALUE:
+                    case PACKED_CONS_VALUE: {
+                        Value *value_elem;
+                        Value *value_list;
+                        bool is_cons = try_take_elem_and_list(value, &value_elem, &value_list);
+                        value = NULL;
+                        if (!is_cons) {
+                            free_env(continuation.env);
+                            goto error;
+                        }
+
+                        Env *env_temp = create_appended_env(
+                            continuation.env,
+                            exp->match_exp->var_elem,
+                            value_elem
+                        );
+                        free_env(continuation.env);
+                        free_env(env_current);
+                        env_current = create_appended_env(
+                            env_temp,
+                            exp->match_exp->var_list,
+                            value_list
+                        );
+                        free_env(env_temp);
+                        free_value(value_list);
+                        free_value(value_elem);
+                        exp_current = exp->match_exp->exp_match_cons;
+                        break;
+                    }
+                    default: {
+                        free_env(continuation.env);
+                        goto error;
+                    }
+                }
+                free_value(value);
+                value = NULL;
+                break;
+            }
+            default: {
+                goto error;
+            }
+        }
+    }
+
+    free_env(env_current);
+    free(stack.continuations);
+    if (depth != NULL) {
+        *depth = stack.depth_max;
+    }
+    return value;
+
+error:
+    free_value(value);
+    while (0 < stack.count) {
+        Continuation *continuation = &stack.continuations[--stack.count];
+        free_env(continuation->env);
+        free_value(continuation->value);
+    }
+    free_env(env_current);
+    free(stack.continuations);
+    if (depth != NULL) {
+        *depth = stack.depth_max;
+    }
+    return NULL;
+}
+
+typedef struct ScopeTag {
+    const Var *var;
+    const struct ScopeTag *next;
+} Scope;
+
+typedef struct {
+    Var **vars;
+    int count;
+    int capacity;
+} VarSet;
+
+static bool is_var_in_scope(const Scope *scope, const Var *var) {
+    while (scope != NULL) {
+        if (is_same_var(scope->var, var)) {
+            return true;
+        }
+
+        scope = scope->next;
+    }
+
+    return false;
+}
+
+static void add_var_to_var_set(VarSet *var_set, Var *var) {
+    for (int i = 0; i < var_set->count; i++) {
+        if (is_same_var(var_set->vars[i], var)) {
+            return;
+        }
+    }
+
+    if (var_set->count == var_set->capacity) {
+        var_set->capacity = var_set->capacity == 0 ? 8 : var_set->capacity * 2;
+        var_set->vars = realloc(var_set->vars, sizeof(Var *) * var_set->capacity);
+    }
+    var_set->vars[var_set->count] = var;
+    var_set->count++;
+}
+
+static void collect_free_vars(const Exp *exp, const Scope *scope, VarSet *var_set) {
+    if (exp == NULL) {
+        return;
+    }
+
+    switch (exp->type) {
+        case VAR_EXP: {
+            if (exp->var_exp != NULL && !is_var_in_scope(scope, exp->var_exp->var)) {
+                add_var_to_var_set(var_set, exp->var_exp->var);
+            }
+            return;
+        }
+        case OP_EXP: {
+            if (exp->op_exp != NULL) {
+                collect_free_vars(exp->op_exp->exp_left, scope, var_set);
+                collect_free_vars(exp->op_exp->exp_right, scope, var_set);
+            }
+            return;
+        }
+        case IF_EXP: {
+            if (exp->if_exp != NULL) {
+                collect_free_vars(exp->if_exp->exp_cond, scope, var_set);
+                collect_free_vars(exp->if_exp->exp_true, scope, var_set);
+                collect_free_vars(exp->if_exp->exp_false, scope, var_set);
+            }
+            return;
+        }
+        case LET_EXP: {
+            if (exp->let_exp != NULL) {
+                Scope scope_new = { .var = exp->let_exp->var, .next = scope };
+                collect_free_vars(exp->let_exp->exp_1, scope, var_set);
+                collect_free_vars(exp->let_exp->exp_2, &scope_new, var_set);
+            }
+            return;
+        }
+        case FUN_EXP: {
+            if (exp->fun_exp != NULL) {
+                Scope scope_new = { .var = exp->fun_exp->var, .next = scope };
+                collect_free_vars(exp->fun_exp->exp, &scope_new, var_set);
+            }
+            return;
+        }
+        case APP_EXP: {
+            if (exp->app_exp != NULL) {
+                collect_free_vars(exp->app_exp->exp_1, scope, var_set);
+                collect_free_vars(exp->app_exp->exp_2, scope, var_set);
+            }
+            return;
+        }
+        case LET_REC_EXP: {
+            if (exp->let_rec_exp != NULL) {
+                Scope scope_rec = { .var = exp->let_rec_exp->var_rec, .next = scope };
+                Scope scope_new = { .var = exp->let_rec_exp->var, .next = &scope_rec };
+                collect_free_vars(exp->let_rec_exp->exp_1, &scope_new, var_set);
+                collect_free_vars(exp->let_rec_exp->exp_2, &scope_rec, var_set);
+            }
+            return;
+        }
+        case CONS_EXP: {
+            if (exp->cons_exp != NULL) {
+                collect_free_vars(exp->cons_exp->exp_elem, scope, var_set);
+                collect_free_vars(exp->cons_exp->exp_list, scope, var_set);
+            }
+            return;
+        }
+        case MATCH_EXP: {
+            if (exp->match_exp != NULL) {
+                Scope scope_elem = { .var = exp->match_exp->var_elem, .next = scope };
+                Scope scope_list = { .var = exp->match_exp->var_list, .next = &scope_elem };
+                collect_free_vars(exp->match_exp->exp_list, scope, var_set);
+                collect_free_vars(exp->match_exp->exp_match_nil, scope, var_set);
+                collect_free_vars(exp->match_exp->exp_match_cons, &scope_list, var_set);
+            }
+            return;
+        }
+        default: {
+            return;
+        }
+    }
+}
+
+static bool resolve_var_exp(const Env *env, const Scope *scope, Arena *arena, VarExp *var_exp) {
+    int index = 0;
+    while (scope != NULL) {
+        if (is_same_var(scope->var, var_exp->var)) {
+            var_exp->index = index;
+            return true;
+        }
+
+        scope = scope->next;
+        index++;
+    }
+
+    VarBinding *var_binding = env->var_binding;
+    while (var_binding != NULL) {
+        if (is_same_var(var_binding->var, var_exp->var)) {
+            if (arena != NULL) {
+                var_exp->var_binding = var_binding;
+                return add_var_binding_to_arena(arena, var_binding);
+            }
+
+            free_var_binding(var_exp->var_binding);
+            var_exp->var_binding = create_copied_var_binding(var_binding);
+            return true;
+        }
+
+        var_binding = var_binding->next;
+    }
+
+    return false;
+}
+
+static bool resolve_captured_var_exps(const Env *env,
+                                      const Scope *scope,
+                                      Arena *arena,
+                                      const Scope *scope_bound,
+                                      const Exp *exp_body,
+                                      VarExp **captured_var_exps,
+                                      int *captured_var_count) {
+    if (arena == NULL) {
+        free_captured_var_exps(*captured_var_exps, *captured_var_count);
+    }
+    *captured_var_exps = NULL;
+    *captured_var_count = -1;
+
+    VarSet var_set = { .vars = NULL, .count = 0, .capacity = 0 };
+    collect_free_vars(exp_body, scope_bound, &var_set);
+
+    VarExp *var_exps = NULL;
+    if (0 < var_set.count) {
+        if (arena != NULL) {
+            var_exps = allocate_from_arena(arena, sizeof(VarExp) * var_set.count);
+        } else {
+            var_exps = malloc(sizeof(VarExp) * var_set.count);
+        }
+    }
+
+    for (int i = 0; i < var_set.count; i++) {
+        var_exps[i].var = var_set.vars[i];
+        var_exps[i].index = -1;
+        var_exps[i].var_binding = NULL;
+        if (!resolve_var_exp(env, scope, arena, &var_exps[i])) {
+            if (arena == NULL) {
+                free_captured_var_exps(var_exps, i + 1);
+            }
+            free(var_set.vars);
+            return false;
+        }
+    }
+
+    free(var_set.vars);
+    *captured_var_exps = var_exps;
+    *captured_var_count = var_set.count;
+    return true;
+}
+
+static Scope *create_captured_scopes(const VarExp *captured_var_exps, const int captured_var_count) {
+    if (captured_var_count <= 0) {
+        return NULL;
+    }
+
+    Scope *scopes = malloc(sizeof(Scope) * captured_var_count);
+    for (int i = 0; i < captured_var_count; i++) {
+        scopes[i].var = captured_var_exps[i].var;
+        scopes[i].next = i == 0 ? NULL : &scopes[i - 1];
+    }
+    return scopes;
+}
+
+static bool resolve_exp_impl(const Env *env, const Scope *scope, Exp *exp) {
+    if (exp == NULL) {
+        return false;
+    }
+
+    switch (exp->type) {
+        case INT_EXP: {
+            return true;
+        }
+        case BOOL_EXP: {
+            return true;
+        }
+        case VAR_EXP: {
+            if (exp->var_exp == NULL) {
+                return false;
+            }
+
+            resolve_var_exp(env, scope, exp->arena, exp->var_exp);
+            return true;
+        }
+        case OP_EXP: {
+            if (exp->op_exp == NULL) {
+                return false;
+            }
+
+            return resolve_exp_impl(env, scope, exp->op_exp->exp_left)
+                && resolve_exp_impl(env, scope, exp->op_exp->exp_right);
+        }
+        case IF_EXP: {
+            if (exp->if_exp == NULL) {
+                return false;
+            }
+
+            return resolve_exp_impl(env, scope, exp->if_exp->exp_cond)
+                && resolve_exp_impl(env, scope, exp->if_exp->exp_true)
+                && resolve_exp_impl(env, scope, exp->if_exp->exp_false);
+        }
+        case LET_EXP: {
+            if (exp->let_exp == NULL) {
+                return false;
+            }
+
+            Scope scope_new = { .var = exp->let_exp->var, .next = scope };
+            return resolve_exp_impl(env, scope, exp->let_exp->exp_1)
+                && resolve_exp_impl(env, &scope_new, exp->let_exp->exp_2);
+        }
+        case FUN_EXP: {
+            if (exp->fun_exp == NULL) {
+                return false;
+            }
+
+            Scope scope_bound = { .var = exp->fun_exp->var, .next = NULL };
+            if (!resolve_captured_var_exps(
+                    env,
+                    scope,
+                    exp->arena,
+                    &scope_bound,
+                    exp->fun_exp->exp,
+                    &exp->fun_exp->captured_var_exps,
+                    &exp->fun_exp->captured_var_count
+                )) {
+                Scope scope_new = { .var = exp->fun_exp->var, .next = scope };
+                return resolve_exp_impl(env, &scope_new, exp->fun_exp->exp);
+            }
+
+            Scope *scopes_captured = create_captured_scopes(
+                exp->fun_exp->captured_var_exps,
+                exp->fun_exp->captured_var_count
+            );
+            Scope scope_new = {
+                .var = exp->fun_exp->var,
+                .next = scopes_captured == NULL
+                    ? NULL
+                    : &scopes_captured[exp->fun_exp->captured_var_count - 1]
+            };
+            Env env_empty = { .var_binding = NULL };
+            bool is_resolved = resolve_exp_impl(&env_empty, &scope_new, exp->fun_exp->exp);
+            free(scopes_captured);
+            return is_resolved;
+        }
+        case APP_EXP: {
+            if (exp->app_exp == NULL) {
+                return false;
+            }
+
+            return resolve_exp_impl(env, scope, exp->app_exp->exp_1)
+                && resolve_exp_impl(env, scope, exp->app_exp->exp_2);
+        }
+        case LET_REC_EXP: {
+            if (exp->let_rec_exp == NULL) {
+                return false;
+            }
+
+            Scope scope_rec = { .var = exp->let_rec_exp->var_rec, .next = scope };
+            Scope scope_new = { .var = exp->let_rec_exp->var, .next = &scope_rec };
+
+            Scope scope_bound_rec = { .var = exp->let_rec_exp->var_rec, .next = NULL };
+            Scope scope_bound = { .var = exp->let_rec_exp->var, .next = &scope_bound_rec };
+            if (!resolve_captured_var_exps(
+                    env,
+                    scope,
+                    exp->arena,
+                    &scope_bound,
+                    exp->let_rec_exp->exp_1,
+                    &exp->let_rec_exp->captured_var_exps,
+                    &exp->let_rec_exp->captured_var_count
+                )) {
+                return resolve_exp_impl(env, &scope_new, exp->let_rec_exp->exp_1)
+                    && resolve_exp_impl(env, &scope_rec, exp->let_rec_exp->exp_2);
+            }
+
+            Scope *scopes_captured = create_captured_scopes(
+                exp->let_rec_exp->captured_var_exps,
+                exp->let_rec_exp->captured_var_count
+            );
+            Scope scope_captured_rec = {
+                .var = exp->let_rec_exp->var_rec,
+                .next = scopes_captured == NULL
+                    ? NULL
+                    : &scopes_captured[exp->let_rec_exp->captured_var_count - 1]
+            };
+            Scope scope_captured_new = { .var = exp->let_rec_exp->var, .next = &scope_captured_rec };
+            Env env_empty = { .var_binding = NULL };
+            bool is_resolved = resolve_exp_impl(&env_empty, &scope_captured_new, exp->let_rec_exp->exp_1);
+            free(scopes_captured);
+            return is_resolved && resolve_exp_impl(env, &scope_rec, exp->let_rec_exp->exp_2);
+        }
+        case NIL_EXP: {
+            return true;
+        }
+        case CONS_EXP: {
+            if (exp->cons_exp == NULL) {
+                return false;
+            }
+
+            return resolve_exp_impl(env, scope, exp->cons_exp->exp_elem)
+                && resolve_exp_impl(env, scope, exp->cons_exp->exp_list);
+        }
+        case MATCH_EXP: {
+            if (exp->match_exp == NULL) {
+                return false;
+            }
+
+            Scope scope_elem = { .var = exp->match_exp->var_elem, .next = scope };
+            Scope scope_list = { .var = exp->match_exp->var_list, .next = &scope_elem };
+            return resolve_exp_impl(env, scope, exp->match_exp->exp_list)
+                && resolve_exp_impl(env, scope, exp->match_exp->exp_match_nil)
+                && resolve_exp_impl(env, &scope_list, exp->match_exp->exp_match_cons);
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+bool resolve_exp(const Env *env, Exp *exp) {
+    if (env == NULL || exp == NULL) {
+        return false;
+    }
+
+    return resolve_exp_impl(env, NULL, exp);
+}
+
+static Exp *fold_exp_impl(Exp *exp);
+
+static bool is_literal_exp(const Exp *exp) {
+    return exp->type == INT_EXP || exp->type == BOOL_EXP || exp->type == NIL_EXP;
+}
+
+static bool is_literal_list_exp(const Exp *exp) {
+    while (exp->type == CONS_EXP) {
+        const Exp *exp_elem = exp->cons_exp->exp_elem;
+        if (!is_literal_exp(exp_elem) && !is_literal_list_exp(exp_elem)) {
+            return false;
+        }
+
+        exp = exp->cons_exp->exp_list;
+    }
+
+    return exp->type == NIL_EXP;
+}
+
+static Exp *create_literal_exp(const Exp *exp_literal) {
+    switch (exp_literal->type) {
+        case INT_EXP: {
+            return create_int_exp(exp_literal->int_exp->int_value);
+        }
+        case BOOL_EXP: {
+            return create_bool_exp(exp_literal->bool_exp->bool_value);
+        }
+        case NIL_EXP: {
+            return create_nil_exp();
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
+
+static void free_folded_exp(Exp *exp) {
+    if (exp != NULL && exp->arena == NULL) {
+        free_exp(exp);
+    }
+}
+
+static bool is_var_free_in_function(const Exp *exp, const Var *var, const bool is_in_function) {
+    if (exp == NULL) {
+        return false;
+    }
+
+    switch (exp->type) {
+        case VAR_EXP: {
+            return is_in_function && is_same_var(exp->var_exp->var, var);
+        }
+        case OP_EXP: {
+            return is_var_free_in_function(exp->op_exp->exp_left, var, is_in_function)
+                || is_var_free_in_function(exp->op_exp->exp_right, var, is_in_function);
+        }
+        case IF_EXP: {
+            return is_var_free_in_function(exp->if_exp->exp_cond, var, is_in_function)
+                || is_var_free_in_function(exp->if_exp->exp_true, var, is_in_function)
+                || is_var_free_in_function(exp->if_exp->exp_false, var, is_in_function);
+        }
+        case LET_EXP: {
+            return is_var_free_in_function(exp->let_exp->exp_1, var, is_in_function)
+                || (!is_same_var(exp->let_exp->var, var)
+                    && is_var_free_in_function(exp->let_exp->exp_2, var, is_in_function));
+        }
+        case FUN_EXP: {
+            return !is_same_var(exp->fun_exp->var, var)
+                && is_var_free_in_function(exp->fun_exp->exp, var, true);
+        }
+        case APP_EXP: {
+            return is_var_free_in_function(exp->app_exp->exp_1, var, is_in_function)
+                || is_var_free_in_function(exp->app_exp->exp_2, var, is_in_function);
+        }
+        case LET_REC_EXP: {
+            if (is_same_var(exp->let_rec_exp->var_rec, var)) {
+                return false;
+            }
+
+            return (!is_same_var(exp->let_rec_exp->var, var)
+                    && is_var_free_in_function(exp->let_rec_exp->exp_1, var, true))
+                || is_var_free_in_function(exp->let_rec_exp->exp_2, var, is_in_function);
+        }
+        case CONS_EXP: {
+            return is_var_free_in_function(exp->cons_exp->exp_elem, var, is_in_function)
+                || is_var_free_in_function(exp->cons_exp->exp_list, var, is_in_function);
+        }
+        case MATCH_EXP: {
+            return is_var_free_in_function(exp->match_exp->exp_list, var, is_in_function)
+                || is_var_free_in_function(exp->match_exp->exp_match_nil, var, is_in_function)
+                || (!is_same_var(exp->match_exp->var_elem, var)
+                    && !is_same_var(exp->match_exp->var_list, var)
+                    && is_var_free_in_function(exp->match_exp->exp_match_cons, var, is_in_function));
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+static Exp *substitute_exp(Exp *exp, const Var *var, const Exp *exp_literal) {
+    if (exp == NULL) {
+        return NULL;
+    }
+
+    switch (exp->type) {
+        case VAR_EXP: {
+            if (!is_same_var(exp->var_exp->var, var)) {
+                return exp;
+            }
+
+            free_folded_exp(exp);
+            return create_literal_exp(exp_literal);
+        }
+        case OP_EXP: {
+            exp->op_exp->exp_left = substitute_exp(exp->op_exp->exp_left, var, exp_literal);
+            exp->op_exp->exp_right = substitute_exp(exp->op_exp->exp_right, var, exp_literal);
+            return exp;
+        }
+        case IF_EXP: {
+            exp->if_exp->exp_cond = substitute_exp(exp->if_exp->exp_cond, var, exp_literal);
+            exp->if_exp->exp_true = substitute_exp(exp->if_exp->exp_true, var, exp_literal);
+            exp->if_exp->exp_false = substitute_exp(exp->if_exp->exp_false, var, exp_literal);
+            return exp;
+        }
+        case LET_EXP: {
+            exp->let_exp->exp_1 = substitute_exp(exp->let_exp->exp_1, var, exp_literal);
+            if (!is_same_var(exp->let_exp->var, var)) {
+                exp->let_exp->exp_2 = substitute_exp(exp->let_exp->exp_2, var, exp_literal);
+            }
+            return exp;
+        }
+        case APP_EXP: {
+            exp->app_exp->exp_1 = substitute_exp(exp->app_exp->exp_1, var, exp_literal);
+            exp->app_exp->exp_2 = substitute_exp(exp->app_exp->exp_2, var, exp_literal);
+            return exp;
+        }
+        case LET_REC_EXP: {
+            if (!is_same_var(exp->let_rec_exp->var_rec, var)) {
+                exp->let_rec_exp->exp_2 = substitute_exp(exp->let_rec_exp->exp_2, var, exp_literal);
+            }
+            return exp;
+        }
+        case CONS_EXP: {
+            exp->cons_exp->exp_elem = substitute_exp(exp->cons_exp->exp_elem, var, exp_literal);
+            exp->cons_exp->exp_list = substitute_exp(exp->cons_exp->exp_list, var, exp_literal);
+            return exp;
+        }
+        case MATCH_EXP: {
+            MatchExp *match_exp = exp->match_exp;
+            match_exp->exp_list = substitute_exp(match_exp->exp_list, var, exp_literal);
+            match_exp->exp_match_nil = substitute_exp(match_exp->exp_match_nil, var, exp_literal);
+            if (!is_same_var(match_exp->var_elem, var) && !is_same_var(match_exp->var_list, var)) {
+                match_exp->exp_match_cons = substitute_exp(match_exp->exp_match_cons, var, exp_literal);
+            }
+            return exp;
+        }
+        default: {
+            return exp;
+        }
+    }
+}
+
+static Exp *fold_op_exp(Exp *exp) {
+    OpExp *op_exp = exp->op_exp;
+    op_exp->exp_left = fold_exp_impl(op_exp->exp_left);
+    op_exp->exp_right = fold_exp_impl(op_exp->exp_right);
+    if (op_exp->exp_left == NULL
+        || op_exp->exp_right == NULL
+        || op_exp->exp_left->type != INT_EXP
+        || op_exp->exp_right->type != INT_EXP) {
+        return exp;
+    }
 
-            free_env(env_new);
-            free_value(rec_closure_value);
+    int int_value_left = op_exp->exp_left->int_exp->int_value;
+    int int_value_right = op_exp->exp_right->int_exp->int_value;
 
-            return value;
+    Exp *exp_folded;
+    switch (op_exp->type) {
+        case PLUS_OP_EXP: {
+            exp_folded = create_int_exp(int_value_left + int_value_right);
+            break;
         }
-        case NIL_EXP: {
-            Value *value = malloc(sizeof(Value));
-            value->type = NIL_VALUE;
-            return value;
+        case MINUS_OP_EXP: {
+            exp_folded = create_int_exp(int_value_left - int_value_right);
+            break;
         }
-        case CONS_EXP: {
-            if (exp->cons_exp == NULL) {
-                return NULL;
-            }
+        case TIMES_OP_EXP: {
+            exp_folded = create_int_exp(int_value_left * int_value_right);
+            break;
+        }
+        case LT_OP_EXP: {
+            exp_folded = create_bool_exp(int_value_left < int_value_right);
+            break;
+        }
+        default: {
+            return exp;
+        }
+    }
 
-            const Exp *exp_elem = exp->cons_exp->exp_elem;
-            if (exp_elem == NULL) {
-                return NULL;
-            }
+    free_folded_exp(exp);
+    return exp_folded;
+}
 
-            const Exp *exp_list = exp->cons_exp->exp_list;
-            if (exp_list == NULL) {
-                return NULL;
-            }
+static Exp *fold_exp_impl(Exp *exp) {
+    if (exp == NULL) {
+        return NULL;
+    }
 
-            Value *value_elem = evaluate_impl(env, exp_elem);
-            if (value_elem == NULL) {
-                return NULL;
+    switch (exp->type) {
+        case OP_EXP: {
+            return fold_op_exp(exp);
+        }
+        case IF_EXP: {
+            IfExp *if_exp = exp->if_exp;
+            if_exp->exp_cond = fold_exp_impl(if_exp->exp_cond);
+            if (if_exp->exp_cond == NULL || if_exp->exp_cond->type != BOOL_EXP) {
+                if_exp->exp_true = fold_exp_impl(if_exp->exp_true);
+                if_exp->exp_false = fold_exp_impl(if_exp->exp_false);
+                return exp;
+            }
+
+            Exp *exp_branch;
+            if (if_exp->exp_cond->bool_exp->bool_value) {
+                exp_branch = if_exp->exp_true;
+                if_exp->exp_true = NULL;
+            } else {
+                exp_branch = if_exp->exp_false;
+                if_exp->exp_false = NULL;
             }
 
-            Value *value_list = evaluate_impl(env, exp_list);
-            if (value_list == NULL) {
-                free_value(value_elem);
-                return NULL;
+            free_folded_exp(exp);
+            return fold_exp_impl(exp_branch);
+        }
+        case LET_EXP: {
+            LetExp *let_exp = exp->let_exp;
+            let_exp->exp_1 = fold_exp_impl(let_exp->exp_1);
+            if (let_exp->exp_1 == NULL
+                || !is_literal_exp(let_exp->exp_1)
+                || is_var_free_in_function(let_exp->exp_2, let_exp->var, false)) {
+                let_exp->exp_2 = fold_exp_impl(let_exp->exp_2);
+                return exp;
             }
 
-            Value *value = malloc(sizeof(Value));
-            value->type = CONS_VALUE;
-            value->cons_value = create_cons(value_elem, value_list);
-            free_value(value_elem);
-            free_value(value_list);
-            return value;
+            Exp *exp_body = substitute_exp(let_exp->exp_2, let_exp->var, let_exp->exp_1);
+            let_exp->exp_2 = NULL;
+
+            free_folded_exp(exp);
+            return fold_exp_impl(exp_body);
+        }
+        case FUN_EXP: {
+            exp->fun_exp->exp = fold_exp_impl(exp->fun_exp->exp);
+            return exp;
+        }
+        case APP_EXP: {
+            exp->app_exp->exp_1 = fold_exp_impl(exp->app_exp->exp_1);
+            exp->app_exp->exp_2 = fold_exp_impl(exp->app_exp->exp_2);
+            return exp;
+        }
+        case LET_REC_EXP: {
+            exp->let_rec_exp->exp_1 = fold_exp_impl(exp->let_rec_exp->exp_1);
+            exp->let_rec_exp->exp_2 = fold_exp_impl(exp->let_rec_exp->exp_2);
+            return exp;
+        }
+        case CONS_EXP: {
+            exp->cons_exp->exp_elem = fold_exp_impl(exp->cons_exp->exp_elem);
+            exp->cons_exp->exp_list = fold_exp_impl(exp->cons_exp->exp_list);
+            return exp;
         }
         case MATCH_EXP: {
-            if (exp->match_exp == NULL) {
-                return NULL;
+            MatchExp *match_exp = exp->match_exp;
+            match_exp->exp_list = fold_exp_impl(match_exp->exp_list);
+            if (match_exp->exp_list == NULL) {
+                return exp;
             }
 
-            const Exp *exp_list = exp->match_exp->exp_list;
-            if (exp_list == NULL) {
-                return NULL;
-            }
+            if (match_exp->exp_list->type == NIL_EXP) {
+                Exp *exp_match_nil = match_exp->exp_match_nil;
+                match_exp->exp_match_nil = NULL;
 
-            Value *value_list = evaluate_impl(env, exp_list);
-            if (value_list == NULL) {
-                return NULL;
+                free_folded_exp(exp);
+                return fold_exp_impl(exp_match_nil);
             }
 
-            switch (value_list->type) {
-                case NIL_VALUE: {
-                    const Exp *exp_match_nil = exp->match_exp->exp_match_nil;
-                    if (exp_match_nil == NULL) {
-                        free_value(value_list);
-                        return NULL;
-                    }
-
-                    Value *value_nil = evaluate_impl(env, exp_match_nil);
-                    if (value_nil == NULL) {
-                        free_value(value_list);
-                        return NULL;
-                    }
-
-                    free_value(value_list);
-                    return value_nil;
-                }
-                case CONS_VALUE: {
-                    Cons *cons_value = value_list->cons_value;
-                    if (cons_value == NULL) {
-                        free_value(value_list);
-                        return NULL;
-                    }
-
-                    Value *value_elem = create_copied_value(cons_value->value_elem);
-                    if (value_elem == NULL) {
-                        free_value(value_list);
-                        return NULL;
-                    }
-
-                    Value *value_subsequent_list = create_copied_value(cons_value->value_list);
-                    if (value_list == NULL) {
-                        free_value(value_elem);
-                        free_value(value_list);
-                        return NULL;
-                    }
-
-                    const Exp *exp_match_cons = exp->match_exp->exp_match_cons;
-                    if (exp_match_cons == NULL) {
-                        free_value(value_subsequent_list);
-                        free_value(value_elem);
-                        free_value(value_list);
-                        return NULL;
-                    }
-
-                    Env *env_temp = create_appended_env(
-                        env,
-                        exp->match_exp->var_elem,
-                        value_elem
-                    );
-                    if (env_temp == NULL) {
-                        free_value(value_subsequent_list);
-                        free_value(value_elem);
-                        free_value(value_list);
-                    }
-
-                    Env *env_new = create_appended_env(
-                        env_temp,
-                        exp->match_exp->var_list,
-                        value_subsequent_list
-                    );
-                    free_env(env_temp);
-                    if (env_new == NULL) {
-                        free_value(value_subsequent_list);
-                        free_value(value_elem);
-                        free_value(value_list);
-                    }
+            if (!is_literal_list_exp(match_exp->exp_list)) {
+                match_exp->exp_match_nil = fold_exp_impl(match_exp->exp_match_nil);
+                match_exp->exp_match_cons = fold_exp_impl(match_exp->exp_match_cons);
+                return exp;
+            }
 
-                    Value *value_cons = evaluate_impl(env_new, exp_match_cons);
-                    if (value_cons == NULL) {
-                        free_value(value_subsequent_list);
-                        free_value(value_elem);
-                        free_value(value_list);
-                        return NULL;
-                    }
+            Exp *exp_let = create_let_exp(
+                create_copied_var(match_exp->var_elem),
+                match_exp->exp_list->cons_exp->exp_elem,
+                create_let_exp(
+                    create_copied_var(match_exp->var_list),
+                    match_exp->exp_list->cons_exp->exp_list,
+                    match_exp->exp_match_cons
+                )
+            );
+            match_exp->exp_list->cons_exp->exp_elem = NULL;
+            match_exp->exp_list->cons_exp->exp_list = NULL;
+            match_exp->exp_match_cons = NULL;
 
-                    free_env(env_new);
-                    free_value(value_subsequent_list);
-                    free_value(value_elem);
-                    free_value(value_list);
-                    return value_cons;
-                }
-                default: {
-                    free_value(value_list);
-                    return NULL;
-                }
-            }
+            free_folded_exp(exp);
+            return fold_exp_impl(exp_let);
         }
         default: {
-            return NULL;
+            return exp;
         }
     }
 }
 
+Exp *fold_exp(Exp *exp) {
+    if (exp == NULL) {
+        return NULL;
+    }
+
+    Arena *arena_saved = current_arena;
+    current_arena = exp->arena;
+    Exp *exp_folded = fold_exp_impl(exp);
+    current_arena = arena_saved;
+    return exp_folded;
+}
+
 Def *create_let_def(Var *var, Exp *exp_1) {
     if (var == NULL || exp_1 == NULL) {
         return NULL;
@@ -1617,6 +3709,8 @@ Def *create_let_rec_def(Var *var_rec, Var *var, Exp *exp_1) {
     let_rec_def->var_rec = var_rec;
     let_rec_def->var = var;
     let_rec_def->exp_1 = exp_1;
+    let_rec_def->captured_var_exps = NULL;
+    let_rec_def->captured_var_count = -1;
 
     Def *def = malloc(sizeof(Def));
     def->type = LET_REC_DEF;
@@ -1650,6 +3744,12 @@ void free_def(Def *def) {
 
             free_var(def->let_rec_def->var_rec);
             free_var(def->let_rec_def->var);
+            if (def->let_rec_def->exp_1->arena == NULL) {
+                free_captured_var_exps(
+                    def->let_rec_def->captured_var_exps,
+                    def->let_rec_def->captured_var_count
+                );
+            }
             free_exp(def->let_rec_def->exp_1);
             free(def->let_rec_def);
             free(def);
@@ -1662,6 +3762,108 @@ void free_def(Def *def) {
     }
 }
 
+bool resolve_def(const Env *env, Def *def) {
+    if (env == NULL || def == NULL) {
+        return false;
+    }
+
+    switch (def->type) {
+        case LET_DEF: {
+            if (def->let_def == NULL) {
+                return false;
+            }
+
+            return resolve_exp_impl(env, NULL, def->let_def->exp_1);
+        }
+        case LET_REC_DEF: {
+            if (def->let_rec_def == NULL) {
+                return false;
+            }
+
+            Scope scope_rec = { .var = def->let_rec_def->var_rec, .next = NULL };
+            Scope scope_new = { .var = def->let_rec_def->var, .next = &scope_rec };
+            if (!resolve_captured_var_exps(
+                    env,
+                    NULL,
+                    def->let_rec_def->exp_1->arena,
+                    &scope_new,
+                    def->let_rec_def->exp_1,
+                    &def->let_rec_def->captured_var_exps,
+                    &def->let_rec_def->captured_var_count
+                )) {
+                return resolve_exp_impl(env, &scope_new, def->let_rec_def->exp_1);
+            }
+
+            Scope *scopes_captured = create_captured_scopes(
+                def->let_rec_def->captured_var_exps,
+                def->let_rec_def->captured_var_count
+            );
+            Scope scope_captured_rec = {
+                .var = def->let_rec_def->var_rec,
+                .next = scopes_captured == NULL
+                    ? NULL
+                    : &scopes_captured[def->let_rec_def->captured_var_count - 1]
+            };
+            Scope scope_captured_new = { .var = def->let_rec_def->var, .next = &scope_captured_rec };
+            Env env_empty = { .var_binding = NULL };
+            bool is_resolved = resolve_exp_impl(&env_empty, &scope_captured_new, def->let_rec_def->exp_1);
+            free(scopes_captured);
+            return is_resolved;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+void fold_def(Def *def) {
+    if (def == NULL) {
+        return;
+    }
+
+    switch (def->type) {
+        case LET_DEF: {
+            if (def->let_def != NULL) {
+                def->let_def->exp_1 = fold_exp(def->let_def->exp_1);
+            }
+            return;
+        }
+        case LET_REC_DEF: {
+            if (def->let_rec_def != NULL) {
+                def->let_rec_def->exp_1 = fold_exp(def->let_rec_def->exp_1);
+            }
+            return;
+        }
+        default: {
+            return;
+        }
+    }
+}
+
+RecClosure *create_def_rec_closure(const Env *env, const LetRecDef *let_rec_def) {
+    if (let_rec_def->captured_var_count < 0) {
+        return create_rec_closure(env, let_rec_def->var_rec, let_rec_def->var, let_rec_def->exp_1);
+    }
+
+    Env *env_captured = create_captured_env(
+        env,
+        let_rec_def->captured_var_exps,
+        let_rec_def->captured_var_count
+    );
+    if (env_captured == NULL) {
+        return NULL;
+    }
+
+    RecClosure *rec_closure = create_rec_closure(
+        env_captured,
+        let_rec_def->var_rec,
+        let_rec_def->var,
+        let_rec_def->exp_1
+    );
+    free_env(env_captured);
+    return rec_closure;
+}
+
 bool add_def_to_env(Env *env, const Def *def) {
     if (env == NULL || def == NULL) {
         return false;
@@ -1682,6 +3884,7 @@ bool add_def_to_env(Env *env, const Def *def) {
             var_binding->var = create_copied_var(def->let_def->var);
             var_binding->value = value_1;
             var_binding->next = env->var_binding;
+            var_binding->ref_count = 1;
             env->var_binding = var_binding;
             return true;
         }
@@ -1690,14 +3893,7 @@ bool add_def_to_env(Env *env, const Def *def) {
                 return false;
             }
 
-            Value *rec_closure_value = create_rec_closure_value(
-                create_rec_closure(
-                    env,
-                    def->let_rec_def->var_rec,
-                    def->let_rec_def->var,
-                    def->let_rec_def->exp_1
-                )
-            );
+            Value *rec_closure_value = create_rec_closure_value(create_def_rec_closure(env, def->let_rec_def));
             if (rec_closure_value == NULL) {
                 return false;
             }
@@ -1706,6 +3902,7 @@ bool add_def_to_env(Env *env, const Def *def) {
             var_binding->var = create_copied_var(def->let_rec_def->var_rec);
             var_binding->value = rec_closure_value;
             var_binding->next = env->var_binding;
+            var_binding->ref_count = 1;
             env->var_binding = var_binding;
             return true;
         }
@@ -1715,6 +3912,33 @@ bool add_def_to_env(Env *env, const Def *def) {
     }
 }
 
+bool add_def_to_env_cek(Env *env, const Def *def) {
+    if (env == NULL || def == NULL) {
+        return false;
+    }
+
+    if (def->type != LET_DEF) {
+        return add_def_to_env(env, def);
+    }
+
+    if (def->let_def == NULL) {
+        return false;
+    }
+
+    Value *value_1 = evaluate_cek(env, def->let_def->exp_1, NULL);
+    if (value_1 == NULL) {
+        return false;
+    }
+
+    VarBinding *var_binding = malloc(sizeof(VarBinding));
+    var_binding->var = create_copied_var(def->let_def->var);
+    var_binding->value = value_1;
+    var_binding->next = env->var_binding;
+    var_binding->ref_count = 1;
+    env->var_binding = var_binding;
+    return true;
+}
+
 bool fprint_var(FILE *fp, const Var *var) {
     if (fp == NULL || var == NULL) {
         return false;
@@ -1774,23 +3998,38 @@ bool fprint_rec_closure(FILE *fp, const RecClosure *rec_closure) {
     return true;
 }
 
-bool fprint_cons(FILE *fp, const Cons *cons) {
-    if (cons == NULL) {
-        return false;
-    }
+static bool fprint_list(FILE *fp, ListCursor *list_cursor) {
+    size_t cons_count = 0;
+    while (is_list_cursor_at_cons(list_cursor)) {
+        fprintf(fp, "(");
+        if (!fprint_value(fp, get_list_cursor_elem(list_cursor))) {
+            return false;
+        }
+        fprintf(fp, " :: ");
+        cons_count++;
 
-    fprintf(fp, "(");
-    if (!fprint_value(fp, cons->value_elem)) {
-        return false;
+        advance_list_cursor(list_cursor);
     }
-    fprintf(fp, " :: ");
-    if (!fprint_value(fp, cons->value_list)) {
+    if (!fprint_value(fp, list_cursor->value)) {
         return false;
     }
-    fprintf(fp, ")");
+    for (size_t i = 0; i < cons_count; i++) {
+        fprintf(fp, ")");
+    }
     return true;
 }
 
+bool fprint_cons(FILE *fp, const Cons *cons) {
+    if (cons == NULL) {
+        return false;
+    }
+
+    Value value = { .type = CONS_VALUE, .cons_value = (Cons *) cons, .ref_count = 0 };
+    ListCursor list_cursor;
+    set_list_cursor(&list_cursor, &value);
+    return fprint_list(fp, &list_cursor);
+}
+
 bool fprint_value(FILE *fp, const Value *value) {
     if (fp == NULL || value == NULL) {
         return false;
@@ -1830,6 +4069,11 @@ bool fprint_value(FILE *fp, const Value *value) {
 
             return fprint_cons(fp, value->cons_value);
         }
+        case PACKED_CONS_VALUE: {
+            ListCursor list_cursor;
+            set_list_cursor(&list_cursor, value);
+            return fprint_list(fp, &list_cursor);
+        }
         default: {
             return false;
         }
@@ -1841,42 +4085,48 @@ bool fprint_env(FILE *fp, const Env *env) {
         return false;
     }
 
-    Env *env_reverse = create_copied_env(env);
-    VarBinding *var_binding_prev = NULL;
-    VarBinding *var_binding_current = env_reverse->var_binding;
-    while (var_binding_current != NULL) {
-        VarBinding *var_binding_next = var_binding_current->next;
+    size_t var_binding_count = 0;
+    for (VarBinding *var_binding = env->var_binding;
+         var_binding != NULL;
+         var_binding = var_binding->next) {
+        var_binding_count++;
+    }
 
-        var_binding_current->next = var_binding_prev;
+    if (var_binding_count == 0) {
+        return true;
+    }
 
-        var_binding_prev = var_binding_current;
-        var_binding_current = var_binding_next;
+    VarBinding **var_bindings = malloc(sizeof(VarBinding *) * var_binding_count);
+    size_t i = var_binding_count;
+    for (VarBinding *var_binding = env->var_binding;
+         var_binding != NULL;
+         var_binding = var_binding->next) {
+        i--;
+        var_bindings[i] = var_binding;
     }
-    env_reverse->var_binding = var_binding_prev;
 
-    VarBinding *var_binding = env_reverse->var_binding;
-    while (var_binding != NULL) {
+    for (i = 0; i < var_binding_count; i++) {
+        VarBinding *var_binding = var_bindings[i];
         if (var_binding->var == NULL || var_binding->value == NULL) {
-            free_env(env_reverse);
+            free(var_bindings);
             return false;
         }
 
         if (!fprint_var(fp, var_binding->var)) {
-            free_env(env_reverse);
+            free(var_bindings);
             return false;
         }
         fprintf(fp, " = ");
         if (!fprint_value(fp, var_binding->value)) {
-            free_env(env_reverse);
+            free(var_bindings);
             return false;
         }
-        if (var_binding->next != NULL) {
+        if (i + 1 < var_binding_count) {
             fprintf(fp, ", ");
         }
-        var_binding = var_binding->next;
     }
 
-    free_env(env_reverse);
+    free(var_bindings);
 
     return true;
 }
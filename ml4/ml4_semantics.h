@@ -6,6 +6,32 @@
 
 #define VAR_NAME_LEN_MAX (32)
 
+#define SMALL_INT_VALUE_MIN (-128)
+
+#define SMALL_INT_VALUE_MAX (1023)
+
+#define ARENA_BLOCK_SIZE_MIN (1024)
+
+#define ARENA_BLOCK_SIZE_MAX (64 * 1024)
+
+#define MEMO_SIZE_MAX (16 * 1024 * 1024)
+
+#define MEMO_BUCKET_COUNT_MIN (1024)
+
+#define MEMO_HASH_VAR_BINDING_COUNT_MAX (4)
+
+#define MEMO_HASH_CELL_COUNT_MAX (64)
+
+#define MEMO_VALUE_CELL_COUNT_MAX (64)
+
+#define VALUE_TABLE_CAPACITY_MIN (1024)
+
+#define PACKED_CHUNK_CAPACITY_MIN (8)
+
+#define PACKED_CHUNK_CAPACITY_MAX (256)
+
+#define UNCURRIED_ARG_COUNT_MAX (8)
+
 typedef struct {
     char *name;
     size_t name_len;
@@ -17,7 +43,8 @@ typedef enum {
     CLOSURE_VALUE,
     REC_CLOSURE_VALUE,
     NIL_VALUE,
-    CONS_VALUE
+    CONS_VALUE,
+    PACKED_CONS_VALUE
 } ValueType;
 
 typedef struct ClosureTag Closure;
@@ -26,6 +53,12 @@ typedef struct RecClosureTag RecClosure;
 
 typedef struct ConsTag Cons;
 
+typedef struct PackedConsTag PackedCons;
+
+typedef struct NodeFunctionTag NodeFunction;
+
+typedef struct JitFunctionTag JitFunction;
+
 typedef struct {
     ValueType type;
     union {
@@ -34,19 +67,66 @@ typedef struct {
         Closure *closure_value;
         RecClosure *rec_closure_value;
         Cons *cons_value;
+        PackedCons *packed_cons_value;
     };
+    size_t ref_count;
 } Value;
 
 typedef struct VarBindingTag {
     Var *var;
     Value *value;
     struct VarBindingTag *next;
+    size_t ref_count;
 } VarBinding;
 
 typedef struct {
     VarBinding *var_binding;
 } Env;
 
+typedef struct ArenaBlockTag {
+    struct ArenaBlockTag *next;
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+typedef struct ArenaVarBindingTag {
+    VarBinding *var_binding;
+    struct ArenaVarBindingTag *next;
+} ArenaVarBinding;
+
+typedef struct {
+    ArenaBlock *block;
+    ArenaVarBinding *arena_var_binding;
+    size_t ref_count;
+} Arena;
+
+typedef struct MemoEntryTag {
+    Value *value_function;
+    Value *value_argument;
+    Value *value;
+    size_t hash;
+    size_t size;
+    struct MemoEntryTag *next;
+    struct MemoEntryTag *lru_prev;
+    struct MemoEntryTag *lru_next;
+} MemoEntry;
+
+typedef struct {
+    MemoEntry **buckets;
+    size_t bucket_count;
+    size_t entry_count;
+    MemoEntry *lru_head;
+    MemoEntry *lru_tail;
+    size_t size;
+    size_t size_max;
+} Memo;
+
+typedef struct {
+    Value **values;
+    size_t capacity;
+    size_t count;
+} ValueTable;
+
 typedef struct {
     int int_value;
 } IntExp;
@@ -57,6 +137,8 @@ typedef struct {
 
 typedef struct {
     Var *var;
+    int index;
+    VarBinding *var_binding;
 } VarExp;
 
 typedef struct OpExpTag OpExp;
@@ -105,12 +187,15 @@ typedef struct {
         ConsExp *cons_exp;
         MatchExp *match_exp;
     };
+    size_t ref_count;
+    Arena *arena;
 } Exp;
 
 struct ClosureTag {
     Env *env;
     Var *var;
     Exp *exp;
+    NodeFunction *node_function;
 };
 
 struct RecClosureTag {
@@ -118,6 +203,9 @@ struct RecClosureTag {
     Var *var_rec;
     Var *var;
     Exp *exp;
+    NodeFunction *node_function;
+    JitFunction *jit_function;
+    size_t apply_count;
 };
 
 struct ConsTag {
@@ -125,6 +213,19 @@ struct ConsTag {
     Value *value_list;
 };
 
+typedef struct {
+    size_t count;
+    size_t capacity;
+    Value *value_list;
+    size_t ref_count;
+    int int_values[];
+} PackedChunk;
+
+struct PackedConsTag {
+    PackedChunk *chunk;
+    size_t length;
+};
+
 typedef enum {
     PLUS_OP_EXP,
     MINUS_OP_EXP,
@@ -153,6 +254,8 @@ struct LetExpTag {
 struct FunExpTag {
     Var *var;
     Exp *exp;
+    VarExp *captured_var_exps;
+    int captured_var_count;
 };
 
 struct AppExpTag {
@@ -165,6 +268,8 @@ struct LetRecExpTag {
     Var *var;
     Exp *exp_1;
     Exp *exp_2;
+    VarExp *captured_var_exps;
+    int captured_var_count;
 };
 
 struct ConsExpTag {
@@ -194,6 +299,8 @@ typedef struct {
     Var *var_rec;
     Var *var;
     Exp *exp_1;
+    VarExp *captured_var_exps;
+    int captured_var_count;
 } LetRecDef;
 
 typedef struct {
@@ -251,6 +358,16 @@ void free_cons(Cons *cons);
 
 Value *create_cons_value(Cons *cons);
 
+Value *create_packed_cons_value(PackedChunk *chunk, const size_t length);
+
+void free_packed_chunk(PackedChunk *chunk);
+
+Value *create_list_value(const Value *value_elem, const Value *value_list);
+
+bool try_get_elem_and_list(const Value *value, Value **value_elem, Value **value_list);
+
+bool try_take_elem_and_list(Value *value, Value **value_elem, Value **value_list);
+
 Value *create_copied_value(const Value *value);
 
 void free_value(Value *value);
@@ -263,6 +380,42 @@ Env *create_appended_env(const Env *env, const Var *var, const Value *value);
 
 void free_env(Env *env);
 
+VarBinding *create_copied_var_binding(const VarBinding *var_binding);
+
+void free_var_binding(VarBinding *var_binding);
+
+Arena *create_arena();
+
+Arena *create_copied_arena(const Arena *arena);
+
+void free_arena(Arena *arena);
+
+void *allocate_from_arena(Arena *arena, size_t size);
+
+bool add_var_binding_to_arena(Arena *arena, VarBinding *var_binding);
+
+void set_current_arena(Arena *arena);
+
+Memo *create_memo(const size_t size_max);
+
+void free_memo(Memo *memo);
+
+void set_current_memo(Memo *memo);
+
+size_t hash_value(const Value *value);
+
+bool is_same_value(const Value *value_1, const Value *value_2);
+
+size_t hash_env(const Env *env);
+
+bool is_same_env(const Env *env_1, const Env *env_2);
+
+ValueTable *create_value_table(void);
+
+void free_value_table(ValueTable *value_table);
+
+void set_current_value_table(ValueTable *value_table);
+
 Exp *create_int_exp(const int int_value);
 
 Exp *create_bool_exp(const bool bool_value);
@@ -303,16 +456,32 @@ Exp *create_copied_exp(const Exp *exp);
 
 Value *evaluate(const Exp *exp);
 
+bool resolve_exp(const Env *env, Exp *exp);
+
+Exp *fold_exp(Exp *exp);
+
 Value *evaluate_impl(const Env *env, const Exp *exp);
 
+Value *apply_closure_value(const Value *value_1, const Value *value_2);
+
+Value *evaluate_cek(const Env *env, const Exp *exp, size_t *depth);
+
 Def *create_let_def(Var *var, Exp *exp_1);
 
 Def *create_let_rec_def(Var *var_rec, Var *var, Exp *exp_1);
 
 void free_def(Def *def);
 
+bool resolve_def(const Env *env, Def *def);
+
+void fold_def(Def *def);
+
+RecClosure *create_def_rec_closure(const Env *env, const LetRecDef *let_rec_def);
+
 bool add_def_to_env(Env *env, const Def *def);
 
+bool add_def_to_env_cek(Env *env, const Def *def);
+
 bool fprint_var(FILE *fp, const Var *var);
 
 bool fprint_closure(FILE *fp, const Closure *closure);
@@ -0,0 +1,1165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ml4_semantics.h"
+#include "ml4_vm.h"
+
+typedef struct CompileScopeTag {
+    const Var *var;
+    int slot;
+    const struct CompileScopeTag *next;
+} CompileScope;
+
+typedef struct {
+    const Env *env;
+    Code *code;
+    int depth;
+    int depth_max;
+} Compiler;
+
+static Code *create_code() {
+    Code *code = malloc(sizeof(Code));
+    code->instructions = NULL;
+    code->instruction_count = 0;
+    code->instruction_capacity = 0;
+    code->slot_count = 0;
+    code->stack_size = 0;
+    code->is_rec = false;
+    code->var_rec = NULL;
+    code->var = NULL;
+    code->exp = NULL;
+    code->captured_vars = NULL;
+    code->captured_sources = NULL;
+    code->captured_count = 0;
+    code->codes = NULL;
+    code->code_count = 0;
+    code->var_bindings = NULL;
+    code->var_binding_count = 0;
+    code->ref_count = 1;
+    return code;
+}
+
+Code *create_copied_code(const Code *code) {
+    if (code == NULL) {
+        return NULL;
+    }
+
+    Code *code_new = (Code *) code;
+    code_new->ref_count++;
+    return code_new;
+}
+
+void free_code(Code *code) {
+    if (code == NULL) {
+        return;
+    }
+
+    code->ref_count--;
+    if (0 < code->ref_count) {
+        return;
+    }
+
+    for (int i = 0; i < code->code_count; i++) {
+        free_code(code->codes[i]);
+    }
+    free(code->codes);
+
+    for (int i = 0; i < code->var_binding_count; i++) {
+        free_var_binding(code->var_bindings[i]);
+    }
+    free(code->var_bindings);
+
+    free(code->captured_vars);
+    free(code->captured_sources);
+    free_exp(code->exp);
+    free(code->instructions);
+    free(code);
+}
+
+static CodeTable *current_code_table = NULL;
+
+CodeTable *create_code_table(void) {
+    CodeTable *code_table = malloc(sizeof(CodeTable));
+    code_table->entries = calloc(CODE_TABLE_CAPACITY_MIN, sizeof(CodeTableEntry));
+    code_table->capacity = CODE_TABLE_CAPACITY_MIN;
+    code_table->count = 0;
+    return code_table;
+}
+
+void free_code_table(CodeTable *code_table) {
+    if (code_table == NULL) {
+        return;
+    }
+
+    if (current_code_table == code_table) {
+        current_code_table = NULL;
+    }
+    for (size_t i = 0; i < code_table->capacity; i++) {
+        free_code(code_table->entries[i].code);
+    }
+    free(code_table->entries);
+    free(code_table);
+}
+
+void set_current_code_table(CodeTable *code_table) {
+    current_code_table = code_table;
+}
+
+static size_t hash_code_table_key(const Exp *exp) {
+    size_t hash = (size_t) exp;
+    hash = (hash ^ (hash >> 16)) * 16777619u;
+    return hash ^ (hash >> 16);
+}
+
+static CodeTableEntry *find_code_table_entry(const CodeTable *code_table, const Exp *exp) {
+    size_t mask = code_table->capacity - 1;
+    size_t i = hash_code_table_key(exp) & mask;
+    while (code_table->entries[i].exp != NULL && code_table->entries[i].exp != exp) {
+        i = (i + 1) & mask;
+    }
+    return &code_table->entries[i];
+}
+
+static const Code *find_code_in_table(const CodeTable *code_table, const Exp *exp) {
+    if (code_table == NULL) {
+        return NULL;
+    }
+
+    return find_code_table_entry(code_table, exp)->code;
+}
+
+static void add_code_to_table(CodeTable *code_table, Code *code) {
+    if (code_table->capacity < (code_table->count + 1) * 2) {
+        CodeTableEntry *entries = code_table->entries;
+        size_t capacity = code_table->capacity;
+
+        code_table->entries = calloc(capacity * 2, sizeof(CodeTableEntry));
+        code_table->capacity = capacity * 2;
+        for (size_t i = 0; i < capacity; i++) {
+            if (entries[i].exp != NULL) {
+                *find_code_table_entry(code_table, entries[i].exp) = entries[i];
+            }
+        }
+        free(entries);
+    }
+
+    CodeTableEntry *code_table_entry = find_code_table_entry(code_table, code->exp);
+    if (code_table_entry->exp == NULL) {
+        code_table->count++;
+    }
+    free_code(code_table_entry->code);
+    code_table_entry->exp = code->exp;
+    code_table_entry->code = create_copied_code(code);
+}
+
+static int emit(Compiler *compiler,
+                const InstructionType type,
+                const int operand_1,
+                const int operand_2,
+                const int operand_3,
+                const int stack_effect) {
+    Code *code = compiler->code;
+    if (code->instruction_count == code->instruction_capacity) {
+        code->instruction_capacity = code->instruction_capacity == 0 ? 16 : code->instruction_capacity * 2;
+        code->instructions = realloc(code->instructions, sizeof(Instruction) * code->instruction_capacity);
+    }
+
+    Instruction *instruction = &code->instructions[code->instruction_count];
+    instruction->type = type;
+    instruction->operand_1 = operand_1;
+    instruction->operand_2 = operand_2;
+    instruction->operand_3 = operand_3;
+
+    compiler->depth += stack_effect;
+    if (compiler->depth_max < compiler->depth) {
+        compiler->depth_max = compiler->depth;
+    }
+
+    return code->instruction_count++;
+}
+
+static int add_slot(Compiler *compiler) {
+    return compiler->code->slot_count++;
+}
+
+static int add_code(Code *code, Code *code_child) {
+    code->codes = realloc(code->codes, sizeof(Code *) * (code->code_count + 1));
+    code->codes[code->code_count] = code_child;
+    return code->code_count++;
+}
+
+static int add_global(Compiler *compiler, const Var *var, const VarBinding *var_binding) {
+    if (var_binding == NULL && compiler->env != NULL) {
+        VarBinding *var_binding_env = compiler->env->var_binding;
+        while (var_binding_env != NULL) {
+            if (is_same_var(var_binding_env->var, var)) {
+                var_binding = var_binding_env;
+                break;
+            }
+
+            var_binding_env = var_binding_env->next;
+        }
+    }
+
+    if (var_binding == NULL) {
+        return -1;
+    }
+
+    Code *code = compiler->code;
+    for (int i = 0; i < code->var_binding_count; i++) {
+        if (code->var_bindings[i] == var_binding) {
+            return i;
+        }
+    }
+
+    code->var_bindings = realloc(code->var_bindings, sizeof(VarBinding *) * (code->var_binding_count + 1));
+    code->var_bindings[code->var_binding_count] = create_copied_var_binding(var_binding);
+    return code->var_binding_count++;
+}
+
+static const CompileScope *find_compile_scope(const CompileScope *scope, const Var *var) {
+    while (scope != NULL) {
+        if (is_same_var(scope->var, var)) {
+            return scope;
+        }
+
+        scope = scope->next;
+    }
+
+    return NULL;
+}
+
+static bool compile_exp_impl(Compiler *compiler, const CompileScope *scope, const Exp *exp, const bool is_tail);
+
+static Code *compile_function(Compiler *compiler,
+                              const CompileScope *scope,
+                              const Env *env_body,
+                              const bool is_rec,
+                              const Var *var_rec,
+                              const Var *var,
+                              const Exp *exp_body,
+                              const VarExp *captured_var_exps,
+                              const int captured_var_count) {
+    if (var == NULL || exp_body == NULL || captured_var_count < 0) {
+        return NULL;
+    }
+
+    Code *code = create_code();
+    code->is_rec = is_rec;
+    code->var_rec = create_copied_var(var_rec);
+    code->var = create_copied_var(var);
+    code->exp = create_copied_exp(exp_body);
+
+    if (0 < captured_var_count) {
+        code->captured_vars = malloc(sizeof(Var *) * captured_var_count);
+        code->captured_sources = malloc(sizeof(int) * captured_var_count);
+    }
+    code->captured_count = captured_var_count;
+
+    for (int i = 0; i < captured_var_count; i++) {
+        const VarExp *var_exp = &captured_var_exps[i];
+        code->captured_vars[i] = var_exp->var;
+
+        const CompileScope *scope_found = find_compile_scope(scope, var_exp->var);
+        if (scope_found != NULL) {
+            code->captured_sources[i] = scope_found->slot;
+            continue;
+        }
+
+        int global = compiler == NULL ? -1 : add_global(compiler, var_exp->var, var_exp->var_binding);
+        if (global < 0) {
+            free_code(code);
+            return NULL;
+        }
+
+        code->captured_sources[i] = -(global + 1);
+    }
+
+    Compiler compiler_body = { .env = env_body, .code = code, .depth = 0, .depth_max = 0 };
+
+    CompileScope *scopes_captured = NULL;
+    if (0 < captured_var_count) {
+        scopes_captured = malloc(sizeof(CompileScope) * captured_var_count);
+        for (int i = 0; i < captured_var_count; i++) {
+            scopes_captured[i].var = code->captured_vars[i];
+            scopes_captured[i].slot = add_slot(&compiler_body);
+            scopes_captured[i].next = i == 0 ? NULL : &scopes_captured[i - 1];
+        }
+    }
+    const CompileScope *scope_captured = scopes_captured == NULL ? NULL : &scopes_captured[captured_var_count - 1];
+
+    CompileScope scope_rec = { .var = var_rec, .slot = 0, .next = scope_captured };
+    if (is_rec) {
+        scope_rec.slot = add_slot(&compiler_body);
+    }
+    CompileScope scope_new = {
+        .var = var,
+        .slot = add_slot(&compiler_body),
+        .next = is_rec ? &scope_rec : scope_captured
+    };
+
+    bool is_compiled = compile_exp_impl(&compiler_body, &scope_new, exp_body, true);
+    free(scopes_captured);
+    if (!is_compiled) {
+        free_code(code);
+        return NULL;
+    }
+
+    emit(&compiler_body, RETURN_INSTRUCTION, 0, 0, 0, -1);
+    code->stack_size = code->slot_count + compiler_body.depth_max;
+    if (current_code_table != NULL) {
+        add_code_to_table(current_code_table, code);
+    }
+    return code;
+}
+
+static bool compile_exp_impl(Compiler *compiler, const CompileScope *scope, const Exp *exp, const bool is_tail) {
+    if (exp == NULL) {
+        return false;
+    }
+
+    switch (exp->type) {
+        case INT_EXP: {
+            if (exp->int_exp == NULL) {
+                return false;
+            }
+
+            emit(compiler, PUSH_INT_INSTRUCTION, exp->int_exp->int_value, 0, 0, 1);
+            return true;
+        }
+        case BOOL_EXP: {
+            if (exp->bool_exp == NULL) {
+                return false;
+            }
+
+            emit(compiler, PUSH_BOOL_INSTRUCTION, exp->bool_exp->bool_value, 0, 0, 1);
+            return true;
+        }
+        case VAR_EXP: {
+            if (exp->var_exp == NULL) {
+                return false;
+            }
+
+            const CompileScope *scope_found = find_compile_scope(scope, exp->var_exp->var);
+            if (scope_found != NULL) {
+                emit(compiler, LOAD_INSTRUCTION, scope_found->slot, 0, 0, 1);
+                return true;
+            }
+
+            int global = add_global(compiler, exp->var_exp->var, exp->var_exp->var_binding);
+            if (global < 0) {
+                return false;
+            }
+
+            emit(compiler, LOAD_GLOBAL_INSTRUCTION, global, 0, 0, 1);
+            return true;
+        }
+        case OP_EXP: {
+            if (exp->op_exp == NULL) {
+                return false;
+            }
+
+            if (!compile_exp_impl(compiler, scope, exp->op_exp->exp_left, false)) {
+                return false;
+            }
+
+            if (!compile_exp_impl(compiler, scope, exp->op_exp->exp_right, false)) {
+                return false;
+            }
+
+            switch (exp->op_exp->type) {
+                case PLUS_OP_EXP: {
+                    emit(compiler, PLUS_INSTRUCTION, 0, 0, 0, -1);
+                    return true;
+                }
+                case MINUS_OP_EXP: {
+                    emit(compiler, MINUS_INSTRUCTION, 0, 0, 0, -1);
+                    return true;
+                }
+                case TIMES_OP_EXP: {
+                    emit(compiler, TIMES_INSTRUCTION, 0, 0, 0, -1);
+                    return true;
+                }
+                case LT_OP_EXP: {
+                    emit(compiler, LT_INSTRUCTION, 0, 0, 0, -1);
+                    return true;
+                }
+                default: {
+                    return false;
+                }
+            }
+        }
+        case IF_EXP: {
+            if (exp->if_exp == NULL) {
+                return false;
+            }
+
+            if (!compile_exp_impl(compiler, scope, exp->if_exp->exp_cond, false)) {
+                return false;
+            }
+
+            int jump_if_false = emit(compiler, JUMP_IF_FALSE_INSTRUCTION, 0, 0, 0, -1);
+            int depth = compiler->depth;
+
+            if (!compile_exp_impl(compiler, scope, exp->if_exp->exp_true, is_tail)) {
+                return false;
+            }
+
+            int jump = emit(compiler, JUMP_INSTRUCTION, 0, 0, 0, 0);
+            compiler->code->instructions[jump_if_false].operand_1 = compiler->code->instruction_count;
+            compiler->depth = depth;
+
+            if (!compile_exp_impl(compiler, scope, exp->if_exp->exp_false, is_tail)) {
+                return false;
+            }
+
+            compiler->code->instructions[jump].operand_1 = compiler->code->instruction_count;
+            return true;
+        }
+        case LET_EXP: {
+            if (exp->let_exp == NULL) {
+                return false;
+            }
+
+            if (!compile_exp_impl(compiler, scope, exp->let_exp->exp_1, false)) {
+                return false;
+            }
+
+            CompileScope scope_new = { .var = exp->let_exp->var, .slot = add_slot(compiler), .next = scope };
+            emit(compiler, STORE_INSTRUCTION, scope_new.slot, 0, 0, -1);
+            return compile_exp_impl(compiler, &scope_new, exp->let_exp->exp_2, is_tail);
+        }
+        case FUN_EXP: {
+            if (exp->fun_exp == NULL) {
+                return false;
+            }
+
+            Code *code_child = compile_function(
+                compiler,
+                scope,
+                NULL,
+                false,
+                NULL,
+                exp->fun_exp->var,
+                exp->fun_exp->exp,
+                exp->fun_exp->captured_var_exps,
+                exp->fun_exp->captured_var_count
+            );
+            if (code_child == NULL) {
+                return false;
+            }
+
+            emit(compiler, MAKE_CLOSURE_INSTRUCTION, add_code(compiler->code, code_child), 0, 0, 1);
+            return true;
+        }
+        case APP_EXP: {
+            if (exp->app_exp == NULL) {
+                return false;
+            }
+
+            if (!compile_exp_impl(compiler, scope, exp->app_exp->exp_1, false)) {
+                return false;
+            }
+
+            if (!compile_exp_impl(compiler, scope, exp->app_exp->exp_2, false)) {
+                return false;
+            }
+
+            emit(compiler, is_tail ? TAIL_CALL_INSTRUCTION : CALL_INSTRUCTION, 0, 0, 0, -1);
+            return true;
+        }
+        case LET_REC_EXP: {
+            if (exp->let_rec_exp == NULL) {
+                return false;
+            }
+
+            Code *code_child = compile_function(
+                compiler,
+                scope,
+                NULL,
+                true,
+                exp->let_rec_exp->var_rec,
+                exp->let_rec_exp->var,
+                exp->let_rec_exp->exp_1,
+                exp->let_rec_exp->captured_var_exps,
+                exp->let_rec_exp->captured_var_count
+            );
+            if (code_child == NULL) {
+                return false;
+            }
+
+            emit(compiler, MAKE_REC_CLOSURE_INSTRUCTION, add_code(compiler->code, code_child), 0, 0, 1);
+
+            CompileScope scope_rec = { .var = exp->let_rec_exp->var_rec, .slot = add_slot(compiler), .next = scope };
+            emit(compiler, STORE_INSTRUCTION, scope_rec.slot, 0, 0, -1);
+            return compile_exp_impl(compiler, &scope_rec, exp->let_rec_exp->exp_2, is_tail);
+        }
+        case NIL_EXP: {
+            emit(compiler, PUSH_NIL_INSTRUCTION, 0, 0, 0, 1);
+            return true;
+        }
+        case CONS_EXP: {
+            if (exp->cons_exp == NULL) {
+                return false;
+            }
+
+            if (!compile_exp_impl(compiler, scope, exp->cons_exp->exp_elem, false)) {
+                return false;
+            }
+
+            if (!compile_exp_impl(compiler, scope, exp->cons_exp->exp_list, false)) {
+                return false;
+            }
+
+            emit(compiler, CONS_INSTRUCTION, 0, 0, 0, -1);
+            return true;
+        }
+        case MATCH_EXP: {
+            if (exp->match_exp == NULL) {
+                return false;
+            }
+
+            if (!compile_exp_impl(compiler, scope, exp->match_exp->exp_list, false)) {
+                return false;
+            }
+
+            CompileScope scope_elem = { .var = exp->match_exp->var_elem, .slot = add_slot(compiler), .next = scope };
+            CompileScope scope_list = { .var = exp->match_exp->var_list, .slot = add_slot(compiler), .next = &scope_elem };
+            int match = emit(compiler, MATCH_INSTRUCTION, scope_elem.slot, scope_list.slot, 0, -1);
+            int depth = compiler->depth;
+
+            if (!compile_exp_impl(compiler, &scope_list, exp->match_exp->exp_match_cons, is_tail)) {
+                return false;
+            }
+
+            int jump = emit(compiler, JUMP_INSTRUCTION, 0, 0, 0, 0);
+            compiler->code->instructions[match].operand_3 = compiler->code->instruction_count;
+            compiler->depth = depth;
+
+            if (!compile_exp_impl(compiler, scope, exp->match_exp->exp_match_nil, is_tail)) {
+                return false;
+            }
+
+            compiler->code->instructions[jump].operand_1 = compiler->code->instruction_count;
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+Code *compile_exp(const Env *env, const Exp *exp) {
+    if (env == NULL || exp == NULL) {
+        return NULL;
+    }
+
+    Code *code = create_code();
+    Compiler compiler = { .env = env, .code = code, .depth = 0, .depth_max = 0 };
+    if (!compile_exp_impl(&compiler, NULL, exp, false)) {
+        free_code(code);
+        return NULL;
+    }
+
+    emit(&compiler, RETURN_INSTRUCTION, 0, 0, 0, -1);
+    code->stack_size = code->slot_count + compiler.depth_max;
+    return code;
+}
+
+typedef enum {
+    EMPTY_SLOT,
+    INT_SLOT,
+    BOOL_SLOT,
+    PACKED_SLOT,
+    VALUE_SLOT
+} SlotType;
+
+typedef struct {
+    SlotType type;
+    union {
+        int int_value;
+        bool bool_value;
+        PackedCons packed_cons;
+        Value *value;
+    };
+} Slot;
+
+typedef struct {
+    const Code *code;
+    int pc;
+    int base;
+    Value *value_function;
+} Frame;
+
+static void set_slot(Slot *slot, Value *value) {
+    switch (value->type) {
+        case INT_VALUE: {
+            slot->type = INT_SLOT;
+            slot->int_value = value->int_value;
+            free_value(value);
+            return;
+        }
+        case BOOL_VALUE: {
+            slot->type = BOOL_SLOT;
+            slot->bool_value = value->bool_value;
+            free_value(value);
+            return;
+        }
+        default: {
+            slot->type = VALUE_SLOT;
+            slot->value = value;
+            return;
+        }
+    }
+}
+
+static Value *create_value_from_slot(const Slot *slot) {
+    switch (slot->type) {
+        case INT_SLOT: {
+            return create_int_value(slot->int_value);
+        }
+        case BOOL_SLOT: {
+            return create_bool_value(slot->bool_value);
+        }
+        case PACKED_SLOT: {
+            slot->packed_cons.chunk->ref_count++;
+            return create_packed_cons_value(slot->packed_cons.chunk, slot->packed_cons.length);
+        }
+        case VALUE_SLOT: {
+            return create_copied_value(slot->value);
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
+
+static void free_slot(Slot *slot) {
+    if (slot->type == PACKED_SLOT) {
+        free_packed_chunk(slot->packed_cons.chunk);
+    } else if (slot->type == VALUE_SLOT) {
+        free_value(slot->value);
+    }
+    slot->type = EMPTY_SLOT;
+}
+
+static Env *create_captured_env(const Code *code, const Slot *slots, const Code *code_child) {
+    Env *env_captured = malloc(sizeof(Env));
+    env_captured->var_binding = NULL;
+
+    for (int i = 0; i < code_child->captured_count; i++) {
+        int source = code_child->captured_sources[i];
+
+        VarBinding *var_binding = malloc(sizeof(VarBinding));
+        var_binding->var = create_copied_var(code_child->captured_vars[i]);
+        var_binding->value = 0 <= source
+            ? create_value_from_slot(&slots[source])
+            : create_copied_value(code->var_bindings[-source - 1]->value);
+        var_binding->next = env_captured->var_binding;
+        var_binding->ref_count = 1;
+        env_captured->var_binding = var_binding;
+    }
+
+    return env_captured;
+}
+
+Value *execute_code(const Code *code) {
+    if (code == NULL) {
+        return NULL;
+    }
+
+    int stack_capacity = code->stack_size < 64 ? 64 : code->stack_size;
+    Slot *stack = malloc(sizeof(Slot) * stack_capacity);
+    int sp = 0;
+
+    const Exp *exp_cached = NULL;
+    const Code *code_cached = NULL;
+
+    int frame_capacity = 16;
+    Frame *frames = malloc(sizeof(Frame) * frame_capacity);
+    int frame_count = 1;
+
+    Frame *frame = &frames[0];
+    frame->code = code;
+    frame->pc = 0;
+    frame->base = 0;
+    frame->value_function = NULL;
+    for (int i = 0; i < code->slot_count; i++) {
+        stack[sp++].type = EMPTY_SLOT;
+    }
+
+    while (true) {
+        const Instruction *instruction = &frame->code->instructions[frame->pc++];
+        Slot *slots = &stack[frame->base];
+        switch (instruction->type) {
+            case PUSH_INT_INSTRUCTION: {
+                stack[sp].type = INT_SLOT;
+                stack[sp++].int_value = instruction->operand_1;
+                break;
+            }
+            case PUSH_BOOL_INSTRUCTION: {
+                stack[sp].type = BOOL_SLOT;
+                stack[sp++].bool_value = instruction->operand_1;
+                break;
+            }
+            case PUSH_NIL_INSTRUCTION: {
+                stack[sp].type = VALUE_SLOT;
+                stack[sp++].value = create_nil_value();
+                break;
+            }
+            case LOAD_INSTRUCTION: {
+                const Slot *slot = &slots[instruction->operand_1];
+                if (slot->type == EMPTY_SLOT) {
+                    goto error;
+                }
+
+                stack[sp] = *slot;
+                if (slot->type == PACKED_SLOT) {
+                    slot->packed_cons.chunk->ref_count++;
+                } else if (slot->type == VALUE_SLOT) {
+                    stack[sp].value = create_copied_value(slot->value);
+                }
+                sp++;
+                break;
+            }
+            case LOAD_GLOBAL_INSTRUCTION: {
+                set_slot(&stack[sp++], create_copied_value(frame->code->var_bindings[instruction->operand_1]->value));
+                break;
+            }
+            case STORE_INSTRUCTION: {
+                free_slot(&slots[instruction->operand_1]);
+                slots[instruction->operand_1] = stack[--sp];
+                break;
+            }
+            case PLUS_INSTRUCTION:
+            case MINUS_INSTRUCTION:
+            case TIMES_INSTRUCTION:
+            case LT_INSTRUCTION: {
+                Slot *slot_left = &stack[sp - 2];
+                const Slot *slot_right = &stack[sp - 1];
+                if (slot_left->type != INT_SLOT || slot_right->type != INT_SLOT) {
+                    goto error;
+                }
+
+                switch (instruction->type) {
+                    case PLUS_INSTRUCTION: {
+                        slot_left->int_value += slot_right->int_value;
+                        break;
+                    }
+                    case MINUS_INSTRUCTION: {
+                        slot_left->int_value -= slot_right->int_value;
+                        break;
+                    }
+                    case TIMES_INSTRUCTION: {
+                        slot_left->int_value *= slot_right->int_value;
+                        break;
+                    }
+                    default: {
+                        slot_left->type = BOOL_SLOT;
+                        slot_left->bool_value = slot_left->int_value < slot_right->int_value;
+                        break;
+                    }
+                }
+                sp--;
+                break;
+            }
+            case JUMP_INSTRUCTION: {
+                frame->pc = instruction->operand_1;
+                break;
+            }
+            case JUMP_IF_FALSE_INSTRUCTION: {
+                const Slot *slot_cond = &stack[sp - 1];
+                if (slot_cond->type != BOOL_SLOT) {
+                    goto error;
+                }
+
+                sp--;
+                if (!slot_cond->bool_value) {
+                    frame->pc = instruction->operand_1;
+                }
+                break;
+            }
+            case MAKE_CLOSURE_INSTRUCTION:
+            case MAKE_REC_CLOSURE_INSTRUCTION: {
+                const Code *code_child = frame->code->codes[instruction->operand_1];
+                Env *env_captured = create_captured_env(frame->code, slots, code_child);
+
+                Value *value;
+                if (instruction->type == MAKE_CLOSURE_INSTRUCTION) {
+                    value = create_closure_value(create_closure(env_captured, code_child->var, code_child->exp));
+                } else {
+                    value = create_rec_closure_value(
+                        create_rec_closure(
+                            env_captured,
+                            code_child->var_rec,
+                            code_child->var,
+                            code_child->exp
+                        )
+                    );
+                }
+                free_env(env_captured);
+                if (value == NULL) {
+                    goto error;
+                }
+
+                stack[sp].type = VALUE_SLOT;
+                stack[sp++].value = value;
+                break;
+            }
+            case CALL_INSTRUCTION:
+            case TAIL_CALL_INSTRUCTION: {
+                if (stack[sp - 2].type != VALUE_SLOT) {
+                    goto error;
+                }
+
+                Value *value_1 = stack[sp - 2].value;
+                Slot slot_2 = stack[sp - 1];
+
+                const Exp *exp_callee;
+                const Env *env_callee;
+                switch (value_1->type) {
+                    case CLOSURE_VALUE: {
+                        exp_callee = value_1->closure_value->exp;
+                        env_callee = value_1->closure_value->env;
+                        break;
+                    }
+                    case REC_CLOSURE_VALUE: {
+                        exp_callee = value_1->rec_closure_value->exp;
+                        env_callee = value_1->rec_closure_value->env;
+                        break;
+                    }
+                    default: {
+                        goto error;
+                    }
+                }
+                sp -= 2;
+
+                if (exp_callee != exp_cached) {
+                    exp_cached = exp_callee;
+                    code_cached = find_code_in_table(current_code_table, exp_callee);
+                }
+                const Code *code_callee = code_cached;
+                if (code_callee == NULL) {
+                    Value *value_2 = create_value_from_slot(&slot_2);
+                    free_slot(&slot_2);
+                    Value *value = apply_closure_value(value_1, value_2);
+                    free_value(value_2);
+                    free_value(value_1);
+                    if (value == NULL) {
+                        goto error;
+                    }
+
+                    set_slot(&stack[sp++], value);
+                    break;
+                }
+
+                if (instruction->type == TAIL_CALL_INSTRUCTION && 1 < frame_count) {
+                    while (frame->base < sp) {
+                        free_slot(&stack[--sp]);
+                    }
+                    free_value(frame->value_function);
+                } else {
+                    if (frame_count == frame_capacity) {
+                        frame_capacity *= 2;
+                        frames = realloc(frames, sizeof(Frame) * frame_capacity);
+                    }
+                    frame = &frames[frame_count++];
+                    frame->base = sp;
+                }
+                frame->code = code_callee;
+                frame->pc = 0;
+                frame->value_function = value_1;
+
+                if (stack_capacity < frame->base + code_callee->stack_size) {
+                    while (stack_capacity < frame->base + code_callee->stack_size) {
+                        stack_capacity *= 2;
+                    }
+                    stack = realloc(stack, sizeof(Slot) * stack_capacity);
+                }
+                slots = &stack[frame->base];
+                for (int i = 0; i < code_callee->slot_count; i++) {
+                    slots[i].type = EMPTY_SLOT;
+                }
+
+                VarBinding *var_binding = env_callee->var_binding;
+                for (int i = code_callee->captured_count - 1; 0 <= i; i--) {
+                    set_slot(&slots[i], create_copied_value(var_binding->value));
+                    var_binding = var_binding->next;
+                }
+
+                int slot = code_callee->captured_count;
+                if (code_callee->is_rec) {
+                    slots[slot].type = VALUE_SLOT;
+                    slots[slot++].value = create_copied_value(value_1);
+                }
+                slots[slot] = slot_2;
+                sp = frame->base + code_callee->slot_count;
+                break;
+            }
+            case RETURN_INSTRUCTION: {
+                Slot slot = stack[--sp];
+                while (frame->base < sp) {
+                    free_slot(&stack[--sp]);
+                }
+                free_value(frame->value_function);
+
+                frame_count--;
+                if (frame_count == 0) {
+                    Value *value = create_value_from_slot(&slot);
+                    free_slot(&slot);
+                    free(frames);
+                    free(stack);
+                    return value;
+                }
+
+                frame = &frames[frame_count - 1];
+                stack[sp++] = slot;
+                break;
+            }
+            case CONS_INSTRUCTION: {
+                Value *value_elem = create_value_from_slot(&stack[sp - 2]);
+                Value *value_list = create_value_from_slot(&stack[sp - 1]);
+                Value *value = create_list_value(value_elem, value_list);
+                free_value(value_list);
+                free_value(value_elem);
+                free_slot(&stack[--sp]);
+                free_slot(&stack[--sp]);
+                if (value == NULL) {
+                    goto error;
+                }
+
+                set_slot(&stack[sp++], value);
+                break;
+            }
+            case MATCH_INSTRUCTION: {
+                Slot *slot_list = &stack[sp - 1];
+                if (slot_list->type == VALUE_SLOT && slot_list->value->type == PACKED_CONS_VALUE) {
+                    Value *value_list = slot_list->value;
+                    slot_list->type = PACKED_SLOT;
+                    slot_list->packed_cons = *value_list->packed_cons_value;
+                    slot_list->packed_cons.chunk->ref_count++;
+                    free_value(value_list);
+                }
+
+                if (slot_list->type == PACKED_SLOT) {
+                    PackedCons packed_cons = slot_list->packed_cons;
+                    sp--;
+
+                    free_slot(&slots[instruction->operand_1]);
+                    slots[instruction->operand_1].type = INT_SLOT;
+                    slots[instruction->operand_1].int_value = packed_cons.chunk->int_values[packed_cons.length - 1];
+                    free_slot(&slots[instruction->operand_2]);
+                    if (1 < packed_cons.length) {
+                        slots[instruction->operand_2].type = PACKED_SLOT;
+                        slots[instruction->operand_2].packed_cons.chunk = packed_cons.chunk;
+                        slots[instruction->operand_2].packed_cons.length = packed_cons.length - 1;
+                    } else {
+                        set_slot(&slots[instruction->operand_2], create_copied_value(packed_cons.chunk->value_list));
+                        free_packed_chunk(packed_cons.chunk);
+                    }
+                    break;
+                }
+
+                if (slot_list->type != VALUE_SLOT) {
+                    goto error;
+                }
+
+                switch (slot_list->value->type) {
+                    case NIL_VALUE: {
+                        frame->pc = instruction->operand_3;
+                        break;
+                    }
+                    case CONS_VALUE: {
+                        Value *value_elem = NULL;
+                        Value *value_list = NULL;
+                        if (!try_get_elem_and_list(slot_list->value, &value_elem, &value_list)) {
+                            free_value(value_elem);
+                            free_value(value_list);
+                            goto error;
+                        }
+
+                        free_slot(&slots[instruction->operand_1]);
+                        set_slot(&slots[instruction->operand_1], value_elem);
+                        free_slot(&slots[instruction->operand_2]);
+                        set_slot(&slots[instruction->operand_2], value_list);
+                        break;
+                    }
+                    default: {
+                        goto error;
+                    }
+                }
+                free_slot(&stack[--sp]);
+                break;
+            }
+            default: {
+                goto error;
+            }
+        }
+    }
+
+error:
+    while (0 < sp) {
+        free_slot(&stack[--sp]);
+    }
+    for (int i = 0; i < frame_count; i++) {
+        free_value(frames[i].value_function);
+    }
+    free(frames);
+    free(stack);
+    return NULL;
+}
+
+Value *evaluate_vm(const Env *env, const Exp *exp) {
+    if (env == NULL || exp == NULL) {
+        return NULL;
+    }
+
+    CodeTable *code_table = NULL;
+    if (current_code_table == NULL) {
+        code_table = create_code_table();
+        set_current_code_table(code_table);
+    }
+
+    Value *value;
+    Code *code = compile_exp(env, exp);
+    if (code == NULL) {
+        value = evaluate_impl(env, exp);
+    } else {
+        value = execute_code(code);
+        free_code(code);
+    }
+
+    free_code_table(code_table);
+    return value;
+}
+
+bool add_def_to_env_vm(Env *env, const Def *def) {
+    if (env == NULL || def == NULL) {
+        return false;
+    }
+
+    switch (def->type) {
+        case LET_DEF: {
+            if (def->let_def == NULL) {
+                return false;
+            }
+
+            Value *value_1 = evaluate_vm(env, def->let_def->exp_1);
+            if (value_1 == NULL) {
+                return false;
+            }
+
+            VarBinding *var_binding = malloc(sizeof(VarBinding));
+            var_binding->var = create_copied_var(def->let_def->var);
+            var_binding->value = value_1;
+            var_binding->next = env->var_binding;
+            var_binding->ref_count = 1;
+            env->var_binding = var_binding;
+            return true;
+        }
+        case LET_REC_DEF: {
+            if (def->let_rec_def == NULL) {
+                return false;
+            }
+
+            RecClosure *rec_closure = create_def_rec_closure(env, def->let_rec_def);
+            if (rec_closure == NULL) {
+                return false;
+            }
+
+            free_code(compile_function(
+                NULL,
+                NULL,
+                env,
+                true,
+                def->let_rec_def->var_rec,
+                def->let_rec_def->var,
+                def->let_rec_def->exp_1,
+                NULL,
+                0
+            ));
+
+            Value *rec_closure_value = create_rec_closure_value(rec_closure);
+            if (rec_closure_value == NULL) {
+                return false;
+            }
+
+            VarBinding *var_binding = malloc(sizeof(VarBinding));
+            var_binding->var = create_copied_var(def->let_rec_def->var_rec);
+            var_binding->value = rec_closure_value;
+            var_binding->next = env->var_binding;
+            var_binding->ref_count = 1;
+            env->var_binding = var_binding;
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+static const char *instruction_names[] = {
+    "PUSH_INT",
+    "PUSH_BOOL",
+    "PUSH_NIL",
+    "LOAD",
+    "LOAD_GLOBAL",
+    "STORE",
+    "PLUS",
+    "MINUS",
+    "TIMES",
+    "LT",
+    "JUMP",
+    "JUMP_IF_FALSE",
+    "MAKE_CLOSURE",
+    "MAKE_REC_CLOSURE",
+    "CALL",
+    "TAIL_CALL",
+    "RETURN",
+    "CONS",
+    "MATCH"
+};
+
+bool fprint_code(FILE *fp, const Code *code) {
+    if (fp == NULL || code == NULL) {
+        return false;
+    }
+
+    for (int i = 0; i < code->instruction_count; i++) {
+        const Instruction *instruction = &code->instructions[i];
+        fprintf(fp, "%d: %s", i, instruction_names[instruction->type]);
+        switch (instruction->type) {
+            case PUSH_INT_INSTRUCTION:
+            case LOAD_INSTRUCTION:
+            case LOAD_GLOBAL_INSTRUCTION:
+            case STORE_INSTRUCTION:
+            case JUMP_INSTRUCTION:
+            case JUMP_IF_FALSE_INSTRUCTION:
+            case MAKE_CLOSURE_INSTRUCTION:
+            case MAKE_REC_CLOSURE_INSTRUCTION: {
+                fprintf(fp, " %d", instruction->operand_1);
+                break;
+            }
+            case PUSH_BOOL_INSTRUCTION: {
+                fprintf(fp, " %s", instruction->operand_1 ? "true" : "false");
+                break;
+            }
+            case MATCH_INSTRUCTION: {
+                fprintf(fp, " %d %d %d", instruction->operand_1, instruction->operand_2, instruction->operand_3);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+        fprintf(fp, "\n");
+    }
+
+    for (int i = 0; i < code->code_count; i++) {
+        fprintf(fp, "code %d:\n", i);
+        fprint_code(fp, code->codes[i]);
+    }
+
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef ML4_VM_H
+#define ML4_VM_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define CODE_TABLE_CAPACITY_MIN (256)
+
+typedef struct CodeTag Code;
+
+typedef enum {
+    PUSH_INT_INSTRUCTION,
+    PUSH_BOOL_INSTRUCTION,
+    PUSH_NIL_INSTRUCTION,
+    LOAD_INSTRUCTION,
+    LOAD_GLOBAL_INSTRUCTION,
+    STORE_INSTRUCTION,
+    PLUS_INSTRUCTION,
+    MINUS_INSTRUCTION,
+    TIMES_INSTRUCTION,
+    LT_INSTRUCTION,
+    JUMP_INSTRUCTION,
+    JUMP_IF_FALSE_INSTRUCTION,
+    MAKE_CLOSURE_INSTRUCTION,
+    MAKE_REC_CLOSURE_INSTRUCTION,
+    CALL_INSTRUCTION,
+    TAIL_CALL_INSTRUCTION,
+    RETURN_INSTRUCTION,
+    CONS_INSTRUCTION,
+    MATCH_INSTRUCTION
+} InstructionType;
+
+typedef struct {
+    InstructionType type;
+    int operand_1;
+    int operand_2;
+    int operand_3;
+} Instruction;
+
+struct CodeTag {
+    Instruction *instructions;
+    int instruction_count;
+    int instruction_capacity;
+    int slot_count;
+    int stack_size;
+    bool is_rec;
+    Var *var_rec;
+    Var *var;
+    Exp *exp;
+    Var **captured_vars;
+    int *captured_sources;
+    int captured_count;
+    struct CodeTag **codes;
+    int code_count;
+    VarBinding **var_bindings;
+    int var_binding_count;
+    size_t ref_count;
+};
+
+typedef struct {
+    const Exp *exp;
+    Code *code;
+} CodeTableEntry;
+
+typedef struct {
+    CodeTableEntry *entries;
+    size_t capacity;
+    size_t count;
+} CodeTable;
+
+CodeTable *create_code_table(void);
+
+void free_code_table(CodeTable *code_table);
+
+void set_current_code_table(CodeTable *code_table);
+
+Code *compile_exp(const Env *env, const Exp *exp);
+
+Code *create_copied_code(const Code *code);
+
+void free_code(Code *code);
+
+Value *execute_code(const Code *code);
+
+Value *evaluate_vm(const Env *env, const Exp *exp);
+
+bool add_def_to_env_vm(Env *env, const Def *def);
+
+bool fprint_code(FILE *fp, const Code *code);
+
+#endif // ML4_VM_H
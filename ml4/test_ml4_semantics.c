@@ -1,8 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "ml4_semantics.h"
 #include "ml4_derivation.h"
+#include "ml4_vm.h"
+#include "ml4_node.h"
+#include "ml4_jit.h"
+#include "ml4_emit.h"
 
 void test1(void) {
     Exp *exp1 = create_lt_op_exp(
@@ -19,18 +24,19 @@ void test1(void) {
         )
     );
 
-    VarBinding *var_binding_1 = malloc(sizeof(VarBinding));
-    var_binding_1->var = create_var("x");
-    var_binding_1->value = create_int_value(2);
-    var_binding_1->next = NULL;
+    Var *var_1 = create_var("x");
+    Value *value_1 = create_int_value(2);
+    Var *var_2 = create_var("hoge");
+    Value *value_2 = create_bool_value(true);
 
-    VarBinding *var_binding_2 = malloc(sizeof(VarBinding));
-    var_binding_2->var = create_var("hoge");
-    var_binding_2->value = create_bool_value(true);
-    var_binding_2->next = var_binding_1;
-
-    Env *env = malloc(sizeof(Env));
-    env->var_binding = var_binding_2;
+    Env env_empty = { .var_binding = NULL };
+    Env *env_1 = create_appended_env(&env_empty, var_1, value_1);
+    Env *env = create_appended_env(env_1, var_2, value_2);
+    free_env(env_1);
+    free_value(value_2);
+    free_var(var_2);
+    free_value(value_1);
+    free_var(var_1);
 
     Value *value1 = evaluate_impl(env, exp1);
     printf("%s\n", value1->bool_value ? "true" : "false");
@@ -49,12 +55,14 @@ void test2(void) {
     Value *value1 = create_int_value(3);
     Var *var2 = create_var("y");
     Value *value2 = create_int_value(2);
-    VarBinding var_binding1 = { .var = var1, .value = value1, .next = NULL };
-    VarBinding var_binding2 = { .var = var2, .value = value2, .next = &var_binding1 };
-    Env env = { .var_binding = &var_binding2 };
-    Value *value3 = evaluate_impl(&env, exp1);
+    Env env_empty = { .var_binding = NULL };
+    Env *env_1 = create_appended_env(&env_empty, var1, value1);
+    Env *env_2 = create_appended_env(env_1, var2, value2);
+    Value *value3 = evaluate_impl(env_2, exp1);
     printf("%d\n", value3->int_value);
     free_value(value3);
+    free_env(env_2);
+    free_env(env_1);
     free_var(var2);
     free_value(value2);
     free_var(var1);
@@ -353,9 +361,653 @@ void test12(void) {
     free_exp(exp1);
 }
 
+void test13(void) {
+    Exp *exp1 = create_let_exp(
+        create_var("y"),
+        create_int_exp(2),
+        create_app_exp(
+            create_fun_exp(
+                create_var("z"),
+                create_plus_op_exp(
+                    create_var_exp(create_var("x")),
+                    create_times_op_exp(
+                        create_var_exp(create_var("y")),
+                        create_var_exp(create_var("z"))
+                    )
+                )
+            ),
+            create_int_exp(3)
+        )
+    );
+    Var *var1 = create_var("x");
+    Value *value1 = create_int_value(1);
+    Env env_empty = { .var_binding = NULL };
+    Env *env = create_appended_env(&env_empty, var1, value1);
+    free_value(value1);
+    free_var(var1);
+
+    resolve_exp(env, exp1);
+
+    Value *value2 = evaluate_impl(env, exp1);
+    printf("%d\n", value2->int_value);
+    free_value(value2);
+    free_env(env);
+    free_exp(exp1);
+}
+
+void test14(void) {
+    Exp *exp1 = create_let_exp(
+        create_var("y"),
+        create_int_exp(2),
+        create_let_exp(
+            create_var("z"),
+            create_int_exp(3),
+            create_fun_exp(
+                create_var("x"),
+                create_plus_op_exp(
+                    create_var_exp(create_var("x")),
+                    create_var_exp(create_var("y"))
+                )
+            )
+        )
+    );
+    Env env = { .var_binding = NULL };
+
+    resolve_exp(&env, exp1);
+
+    Value *value1 = evaluate_impl(&env, exp1);
+    fprint_value(stdout, value1);
+    printf("\n");
+    free_value(value1);
+
+    free_exp(exp1);
+}
+
+void test15(void) {
+    Exp *exp1 = create_let_rec_exp(
+        create_var("sum"),
+        create_var("n"),
+        create_fun_exp(
+            create_var("acc"),
+            create_if_exp(
+                create_lt_op_exp(
+                    create_var_exp(create_var("n")),
+                    create_int_exp(1)
+                ),
+                create_var_exp(create_var("acc")),
+                create_app_exp(
+                    create_app_exp(
+                        create_var_exp(create_var("sum")),
+                        create_minus_op_exp(
+                            create_var_exp(create_var("n")),
+                            create_int_exp(1)
+                        )
+                    ),
+                    create_plus_op_exp(
+                        create_var_exp(create_var("acc")),
+                        create_var_exp(create_var("n"))
+                    )
+                )
+            )
+        ),
+        create_app_exp(
+            create_app_exp(
+                create_var_exp(create_var("sum")),
+                create_int_exp(10000)
+            ),
+            create_int_exp(0)
+        )
+    );
+    Env env = { .var_binding = NULL };
+
+    resolve_exp(&env, exp1);
+
+    Value *value1 = evaluate_vm(&env, exp1);
+    fprint_value(stdout, value1);
+    printf("\n");
+    free_value(value1);
+
+    free_exp(exp1);
+}
+
+void test16(void) {
+    Exp *exp1 = create_let_rec_exp(
+        create_var("loop"),
+        create_var("n"),
+        create_if_exp(
+            create_lt_op_exp(
+                create_var_exp(create_var("n")),
+                create_int_exp(1)
+            ),
+            create_int_exp(0),
+            create_app_exp(
+                create_var_exp(create_var("loop")),
+                create_minus_op_exp(
+                    create_var_exp(create_var("n")),
+                    create_int_exp(1)
+                )
+            )
+        ),
+        create_app_exp(
+            create_var_exp(create_var("loop")),
+            create_int_exp(1000000)
+        )
+    );
+    Env env = { .var_binding = NULL };
+
+    Value *value1 = evaluate_impl(&env, exp1);
+    fprint_value(stdout, value1);
+    printf("\n");
+    free_value(value1);
+
+    free_exp(exp1);
+}
+
+void test17(void) {
+    Exp *exp1 = create_let_rec_exp(
+        create_var("sum"),
+        create_var("n"),
+        create_if_exp(
+            create_lt_op_exp(
+                create_var_exp(create_var("n")),
+                create_int_exp(1)
+            ),
+            create_int_exp(0),
+            create_plus_op_exp(
+                create_var_exp(create_var("n")),
+                create_app_exp(
+                    create_var_exp(create_var("sum")),
+                    create_minus_op_exp(
+                        create_var_exp(create_var("n")),
+                        create_int_exp(1)
+                    )
+                )
+            )
+        ),
+        create_app_exp(
+            create_var_exp(create_var("sum")),
+            create_int_exp(10000)
+        )
+    );
+    Env env = { .var_binding = NULL };
+
+    resolve_exp(&env, exp1);
+
+    size_t depth;
+    Value *value1 = evaluate_cek(&env, exp1, &depth);
+    fprint_value(stdout, value1);
+    printf("\n");
+    printf("%zu\n", depth);
+    free_value(value1);
+
+    free_exp(exp1);
+}
+
+void test18(void) {
+    Exp *exp1 = create_let_exp(
+        create_var("k"),
+        create_int_exp(5),
+        create_let_rec_exp(
+            create_var("loop"),
+            create_var("n"),
+            create_if_exp(
+                create_lt_op_exp(
+                    create_var_exp(create_var("n")),
+                    create_int_exp(1)
+                ),
+                create_var_exp(create_var("k")),
+                create_app_exp(
+                    create_var_exp(create_var("loop")),
+                    create_minus_op_exp(
+                        create_var_exp(create_var("n")),
+                        create_int_exp(1)
+                    )
+                )
+            ),
+            create_app_exp(
+                create_var_exp(create_var("loop")),
+                create_int_exp(1000000)
+            )
+        )
+    );
+    Env env = { .var_binding = NULL };
+
+    resolve_exp(&env, exp1);
+
+    Value *value1 = evaluate_compiled(&env, exp1);
+    fprint_value(stdout, value1);
+    printf("\n");
+    free_value(value1);
+
+    free_exp(exp1);
+}
+
+void test19(void) {
+    Exp *exp1 = create_match_exp(
+        create_cons_exp(
+            create_int_exp(1),
+            create_cons_exp(
+                create_int_exp(2),
+                create_nil_exp()
+            )
+        ),
+        create_int_exp(0),
+        create_var("a"),
+        create_var("b"),
+        create_plus_op_exp(
+            create_var_exp(create_var("a")),
+            create_int_exp(10)
+        )
+    );
+    Env env = { .var_binding = NULL };
+
+    exp1 = fold_exp(exp1);
+    fprint_exp(stdout, exp1);
+    printf("\n");
+
+    resolve_exp(&env, exp1);
+
+    Value *value1 = evaluate_impl(&env, exp1);
+    fprint_value(stdout, value1);
+    printf("\n");
+    free_value(value1);
+
+    free_exp(exp1);
+}
+
+void test20(void) {
+    Exp *exp1 = create_let_rec_exp(
+        create_var("fib"),
+        create_var("n"),
+        create_if_exp(
+            create_lt_op_exp(
+                create_var_exp(create_var("n")),
+                create_int_exp(2)
+            ),
+            create_var_exp(create_var("n")),
+            create_plus_op_exp(
+                create_app_exp(
+                    create_var_exp(create_var("fib")),
+                    create_minus_op_exp(
+                        create_var_exp(create_var("n")),
+                        create_int_exp(1)
+                    )
+                ),
+                create_app_exp(
+                    create_var_exp(create_var("fib")),
+                    create_minus_op_exp(
+                        create_var_exp(create_var("n")),
+                        create_int_exp(2)
+                    )
+                )
+            )
+        ),
+        create_app_exp(
+            create_var_exp(create_var("fib")),
+            create_int_exp(45)
+        )
+    );
+    Env env = { .var_binding = NULL };
+    Memo *memo = create_memo(MEMO_SIZE_MAX);
+
+    resolve_exp(&env, exp1);
+
+    set_current_memo(memo);
+    Value *value1 = evaluate_impl(&env, exp1);
+    set_current_memo(NULL);
+    fprint_value(stdout, value1);
+    printf("\n");
+    free_value(value1);
+
+    free_memo(memo);
+    free_exp(exp1);
+}
+
+void test21(void) {
+    Exp *exp1 = create_cons_exp(
+        create_int_exp(5000),
+        create_cons_exp(
+            create_int_exp(6000),
+            create_nil_exp()
+        )
+    );
+    Env env = { .var_binding = NULL };
+    ValueTable *value_table = create_value_table();
+
+    resolve_exp(&env, exp1);
+
+    set_current_value_table(value_table);
+    Value *value1 = evaluate_impl(&env, exp1);
+    Value *value2 = evaluate_impl(&env, exp1);
+    fprint_value(stdout, value1);
+    printf(" %s\n", value1 == value2 ? "shared" : "not shared");
+    free_value(value1);
+    free_value(value2);
+    set_current_value_table(NULL);
+
+    free_value_table(value_table);
+    free_exp(exp1);
+}
+
+void test22(void) {
+    Value *value1 = create_nil_value();
+    for (int i = 3; 0 < i; i--) {
+        Value *value_elem = create_int_value(i * 1000);
+        Value *value_list = create_list_value(value_elem, value1);
+        free_value(value_elem);
+        free_value(value1);
+        value1 = value_list;
+    }
+
+    Value *value_elem;
+    Value *value_list;
+    try_get_elem_and_list(value1, &value_elem, &value_list);
+
+    Value *value_cons = create_cons_value(create_cons(value_elem, value_list));
+    fprint_value(stdout, value1);
+    printf(" %s\n", is_same_value(value1, value_cons) ? "same" : "not same");
+    free_value(value_cons);
+    free_value(value_list);
+    free_value(value_elem);
+    free_value(value1);
+}
+
+void test23(void) {
+    Exp *exp1 = create_let_rec_exp(
+        create_var("f"),
+        create_var("n"),
+        create_if_exp(
+            create_lt_op_exp(
+                create_var_exp(create_var("n")),
+                create_int_exp(2)
+            ),
+            create_times_op_exp(
+                create_var_exp(create_var("n")),
+                create_int_exp(7)
+            ),
+            create_minus_op_exp(
+                create_app_exp(
+                    create_var_exp(create_var("f")),
+                    create_minus_op_exp(
+                        create_var_exp(create_var("n")),
+                        create_int_exp(1)
+                    )
+                ),
+                create_app_exp(
+                    create_var_exp(create_var("f")),
+                    create_minus_op_exp(
+                        create_var_exp(create_var("n")),
+                        create_int_exp(2)
+                    )
+                )
+            )
+        ),
+        create_app_exp(
+            create_var_exp(create_var("f")),
+            create_int_exp(25)
+        )
+    );
+    Env env = { .var_binding = NULL };
+
+    resolve_exp(&env, exp1);
+
+    Value *value1 = evaluate_impl(&env, exp1);
+    set_jit_enabled(true);
+    Value *value2 = evaluate_impl(&env, exp1);
+    set_jit_enabled(false);
+    fprint_value(stdout, value2);
+    printf(" %s\n", is_same_value(value1, value2) ? "same" : "not same");
+    free_value(value1);
+    free_value(value2);
+
+    free_exp(exp1);
+}
+
+void test24(void) {
+    Def *def1 = create_let_rec_def(
+        create_var("f"),
+        create_var("n"),
+        create_if_exp(
+            create_lt_op_exp(
+                create_var_exp(create_var("n")),
+                create_int_exp(1)
+            ),
+            create_nil_exp(),
+            create_cons_exp(
+                create_var_exp(create_var("n")),
+                create_app_exp(
+                    create_var_exp(create_var("f")),
+                    create_minus_op_exp(
+                        create_var_exp(create_var("n")),
+                        create_int_exp(1)
+                    )
+                )
+            )
+        )
+    );
+    Exp *exp1 = create_app_exp(
+        create_var_exp(create_var("f")),
+        create_int_exp(3)
+    );
+
+    Emitter *emitter = create_emitter();
+    add_def_to_emitter(emitter, def1);
+    add_exp_to_emitter(emitter, exp1);
+
+    FILE *fp = tmpfile();
+    fprint_emitter(fp, emitter);
+    long size = ftell(fp);
+    fclose(fp);
+    printf("%d items, %d functions, %s\n",
+           emitter->item_count,
+           emitter->function_count,
+           0 < size ? "emitted" : "not emitted");
+
+    free_emitter(emitter);
+    free_exp(exp1);
+    free_def(def1);
+}
+
+void test25(void) {
+    Exp *exp1 = create_let_exp(
+        create_var("add"),
+        create_fun_exp(
+            create_var("x"),
+            create_fun_exp(
+                create_var("y"),
+                create_plus_op_exp(
+                    create_var_exp(create_var("x")),
+                    create_var_exp(create_var("y"))
+                )
+            )
+        ),
+        create_cons_exp(
+            create_app_exp(
+                create_app_exp(
+                    create_var_exp(create_var("add")),
+                    create_int_exp(3)
+                ),
+                create_int_exp(4)
+            ),
+            create_cons_exp(
+                create_app_exp(
+                    create_var_exp(create_var("add")),
+                    create_int_exp(3)
+                ),
+                create_nil_exp()
+            )
+        )
+    );
+    Env env = { .var_binding = NULL };
+
+    resolve_exp(&env, exp1);
+
+    Value *value1 = evaluate_impl(&env, exp1);
+    fprint_value(stdout, value1);
+    printf("\n");
+    free_value(value1);
+
+    free_exp(exp1);
+}
+
+void test26(void) {
+    Exp *exp1 = create_let_exp(
+        create_var("x"),
+        create_int_exp(3),
+        create_if_exp(
+            create_lt_op_exp(
+                create_var_exp(create_var("x")),
+                create_int_exp(5)
+            ),
+            create_times_op_exp(
+                create_var_exp(create_var("x")),
+                create_int_exp(2)
+            ),
+            create_int_exp(0)
+        )
+    );
+    Env env = { .var_binding = NULL };
+
+    fprint_streamed_derivation(stdout, &env, exp1);
+
+    free_exp(exp1);
+}
+
+void test27(void) {
+    Exp *exp1 = create_app_exp(
+        create_fun_exp(
+            create_var("x"),
+            create_times_op_exp(
+                create_var_exp(create_var("x")),
+                create_var_exp(create_var("x"))
+            )
+        ),
+        create_int_exp(7)
+    );
+    Env env = { .var_binding = NULL };
+    DerivationMemo *derivation_memo = create_derivation_memo();
+
+    set_current_derivation_memo(derivation_memo);
+    Derivation *derivation1 = derive_impl(&env, exp1);
+    Derivation *derivation2 = derive_impl(&env, exp1);
+    fprint_value(stdout, derivation1->value);
+    printf(" %s\n", derivation1 == derivation2 ? "shared" : "not shared");
+    free_derivation(derivation1);
+    free_derivation(derivation2);
+    set_current_derivation_memo(NULL);
+
+    free_derivation_memo(derivation_memo);
+    free_exp(exp1);
+}
+
+void test28(void) {
+    Exp *exp1 = create_plus_op_exp(
+        create_int_exp(1),
+        create_times_op_exp(
+            create_int_exp(2),
+            create_int_exp(3)
+        )
+    );
+    Env env = { .var_binding = NULL };
+    DerivationBudget *derivation_budget = create_derivation_budget(7, SIZE_MAX);
+
+    set_current_derivation_budget(derivation_budget);
+    Derivation *derivation1 = derive_impl(&env, exp1);
+    printf("%zu nodes, %zu bytes\n", derivation1->sizes[0].node_count, get_derivation_output_size(derivation1));
+    fprint_derivation(stdout, derivation1);
+    printf("\n");
+    free_derivation(derivation1);
+
+    derivation_budget->node_count_max = 6;
+    Derivation *derivation2 = derive_impl(&env, exp1);
+    printf("%s\n", derivation2 == NULL && derivation_budget->is_node_count_exceeded ? "exceeded" : "not exceeded");
+    set_current_derivation_budget(NULL);
+
+    free_derivation_budget(derivation_budget);
+    free_exp(exp1);
+}
+
+void test29(void) {
+    Def *def1 = create_let_def(create_var("a"), create_int_exp(1));
+    Def *def2 = create_let_def(create_var("b"), create_int_exp(2));
+    Def *def3 = create_let_rec_def(
+        create_var("f"),
+        create_var("n"),
+        create_if_exp(
+            create_lt_op_exp(
+                create_var_exp(create_var("n")),
+                create_int_exp(1)
+            ),
+            create_var_exp(create_var("a")),
+            create_app_exp(
+                create_var_exp(create_var("f")),
+                create_minus_op_exp(
+                    create_var_exp(create_var("n")),
+                    create_int_exp(1)
+                )
+            )
+        )
+    );
+    Env env = { .var_binding = NULL };
+
+    resolve_def(&env, def1);
+    add_def_to_env(&env, def1);
+    resolve_def(&env, def2);
+    add_def_to_env(&env, def2);
+    resolve_def(&env, def3);
+    add_def_to_env(&env, def3);
+
+    fprint_value(stdout, env.var_binding->value);
+    printf("\n");
+
+    free_var_binding(env.var_binding);
+    free_def(def1);
+    free_def(def2);
+    free_def(def3);
+}
+
+void test30(void) {
+    Exp *exp1 = create_let_rec_exp(
+        create_var("loop"),
+        create_var("n"),
+        create_if_exp(
+            create_lt_op_exp(
+                create_var_exp(create_var("n")),
+                create_int_exp(1)
+            ),
+            create_int_exp(0),
+            create_app_exp(
+                create_var_exp(create_var("loop")),
+                create_minus_op_exp(
+                    create_var_exp(create_var("n")),
+                    create_int_exp(1)
+                )
+            )
+        ),
+        create_app_exp(
+            create_var_exp(create_var("loop")),
+            create_int_exp(1000000)
+        )
+    );
+    Env env = { .var_binding = NULL };
+    Memo *memo = create_memo(MEMO_SIZE_MAX);
+
+    resolve_exp(&env, exp1);
+
+    set_current_memo(memo);
+    Value *value1 = evaluate_impl(&env, exp1);
+    set_current_memo(NULL);
+    fprint_value(stdout, value1);
+    printf(" (%zu memo entries)\n", memo->entry_count);
+    free_value(value1);
+
+    free_memo(memo);
+    free_exp(exp1);
+}
+
 int main(void) {
-//    test1();
-//    test2();
+    test1();
+    test2();
 //    test3();
 //    test4();
 //    test5();
@@ -366,6 +1018,24 @@ int main(void) {
     test10();
     test11();
     test12();
+    test13();
+    test14();
+    test15();
+    test16();
+    test17();
+    test18();
+    test19();
+    test20();
+    test21();
+    test22();
+    test23();
+    test24();
+    test25();
+    test26();
+    test27();
+    test28();
+    test29();
+    test30();
 
     return 0;
 }